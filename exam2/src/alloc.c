@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "stats.h"
+
+char *allocKindNames[ALLOC_KIND_COUNT] = {
+  "token", "type", "constant", "object", "attributes",
+  "scope", "objectNode", "symtab", "code", "parser",
+  "editBuffer", "lines", "document", "unit"
+};
+
+/******************* plain malloc ******************************/
+
+void *mallocAllocate(size_t size, AllocKind kind, char *file, int line)
+{
+  STATS_ALLOCATION(size);
+  return malloc(size);
+}
+
+void *mallocReallocate(void *block, size_t size, AllocKind kind, char *file, int line)
+{
+  STATS_ALLOCATION(size);
+  return realloc(block, size);
+}
+
+void mallocRelease(void *block)
+{
+  free(block);
+}
+
+Allocator mallocAllocator = { mallocAllocate, mallocReallocate, mallocRelease };
+Allocator *allocator = &mallocAllocator;
+
+void setAllocator(Allocator *newAllocator)
+{
+  allocator = newAllocator;
+}
+
+/******************* profiling ******************************/
+
+// Call sites are few and fixed, so they live in a small open addressed
+// table keyed by the __FILE__ literal and line of the macro that made them
+#define SITE_TABLE_SIZE 1024
+
+typedef struct {
+  long long count;
+  long long bytes;
+  long long liveBytes;
+  long long peakLiveBytes;
+} AllocCounts;
+
+typedef struct {
+  char *file;
+  int line;
+  AllocKind kind;
+  AllocCounts counts;
+} AllocSite;
+
+// Each block carries its size and site in front of it, kept aligned
+typedef union {
+  struct {
+    size_t size;
+    int site;
+  } info;
+  max_align_t align;
+} BlockHeader;
+
+AllocSite sites[SITE_TABLE_SIZE];
+AllocCounts kindCounts[ALLOC_KIND_COUNT];
+AllocCounts totalCounts;
+
+int findSite(AllocKind kind, char *file, int line)
+{
+  unsigned int slot = ((unsigned int)((size_t)file >> 3) * 31u + (unsigned int)line) % SITE_TABLE_SIZE;
+  int probes;
+
+  for (probes = 0; probes < SITE_TABLE_SIZE; probes++)
+  {
+    if (sites[slot].file == NULL)
+    {
+      sites[slot].file = file;
+      sites[slot].line = line;
+      sites[slot].kind = kind;
+      return slot;
+    }
+    if (sites[slot].file == file && sites[slot].line == line)
+      return slot;
+    slot = (slot + 1) % SITE_TABLE_SIZE;
+  }
+  return 0;
+}
+
+void countAllocation(AllocCounts *counts, long long size)
+{
+  counts->count++;
+  counts->bytes += size;
+  counts->liveBytes += size;
+  if (counts->liveBytes > counts->peakLiveBytes)
+    counts->peakLiveBytes = counts->liveBytes;
+}
+
+void countRelease(AllocCounts *counts, long long size)
+{
+  counts->liveBytes -= size;
+}
+
+void recordAllocation(BlockHeader *header, size_t size, AllocKind kind, char *file, int line)
+{
+  header->info.size = size;
+  header->info.site = findSite(kind, file, line);
+  countAllocation(&sites[header->info.site].counts, size);
+  countAllocation(&kindCounts[sites[header->info.site].kind], size);
+  countAllocation(&totalCounts, size);
+}
+
+void recordRelease(BlockHeader *header)
+{
+  AllocSite *site = &sites[header->info.site];
+
+  countRelease(&site->counts, header->info.size);
+  countRelease(&kindCounts[site->kind], header->info.size);
+  countRelease(&totalCounts, header->info.size);
+}
+
+void *profilingAllocate(size_t size, AllocKind kind, char *file, int line)
+{
+  BlockHeader *header = (BlockHeader *)malloc(sizeof(BlockHeader) + size);
+
+  STATS_ALLOCATION(size);
+  if (header == NULL)
+    return NULL;
+  recordAllocation(header, size, kind, file, line);
+  return header + 1;
+}
+
+// A grown block is released at its old site and allocated again at this one
+void *profilingReallocate(void *block, size_t size, AllocKind kind, char *file, int line)
+{
+  BlockHeader *header = NULL;
+
+  STATS_ALLOCATION(size);
+  if (block != NULL)
+  {
+    header = (BlockHeader *)block - 1;
+    recordRelease(header);
+  }
+  header = (BlockHeader *)realloc(header, sizeof(BlockHeader) + size);
+  if (header == NULL)
+    return NULL;
+  recordAllocation(header, size, kind, file, line);
+  return header + 1;
+}
+
+void profilingRelease(void *block)
+{
+  BlockHeader *header;
+
+  if (block == NULL)
+    return;
+  header = (BlockHeader *)block - 1;
+  recordRelease(header);
+  free(header);
+}
+
+Allocator profilingAllocator = { profilingAllocate, profilingReallocate, profilingRelease };
+
+int compareSitePeaks(const void *a, const void *b)
+{
+  long long x = (*(AllocSite * const *)a)->counts.peakLiveBytes;
+  long long y = (*(AllocSite * const *)b)->counts.peakLiveBytes;
+  return (x < y) - (x > y);
+}
+
+void printCounts(FILE *out, char *name, char *kind, AllocCounts *counts)
+{
+  fprintf(out, "%-24s %-11s %12lld %14lld %14lld %14lld\n", name, kind,
+          counts->count, counts->bytes, counts->peakLiveBytes, counts->liveBytes);
+}
+
+// Kinds in declaration order, then call sites by peak live bytes
+void printAllocationProfile(FILE *out)
+{
+  AllocSite *used[SITE_TABLE_SIZE];
+  char name[64];
+  int usedCount = 0;
+  int i;
+
+  fprintf(out, "%-24s %-11s %12s %14s %14s %14s\n", "allocation", "kind",
+          "count", "bytes", "peak live", "live at exit");
+  printCounts(out, "total", "", &totalCounts);
+  for (i = 0; i < ALLOC_KIND_COUNT; i++)
+    if (kindCounts[i].count > 0)
+      printCounts(out, "", allocKindNames[i], &kindCounts[i]);
+
+  for (i = 0; i < SITE_TABLE_SIZE; i++)
+    if (sites[i].file != NULL)
+      used[usedCount++] = &sites[i];
+  qsort(used, usedCount, sizeof(AllocSite *), compareSitePeaks);
+  for (i = 0; i < usedCount; i++)
+  {
+    snprintf(name, sizeof(name), "%s:%d", used[i]->file, used[i]->line);
+    printCounts(out, name, allocKindNames[used[i]->kind], &used[i]->counts);
+  }
+}
+
+/******************* arena ******************************/
+
+// Blocks of one compilation are cut from large chunks and given back all
+// at once by resetArena. The compile server uses it, so a compilation
+// stopped half way by error() leaks nothing.
+#define ARENA_CHUNK_SIZE (1 << 20)
+
+typedef union ArenaChunk_ {
+  struct {
+    union ArenaChunk_ *next;
+    size_t size;  // bytes after the chunk header
+    size_t used;
+  } info;
+  max_align_t align;
+} ArenaChunk;
+
+ArenaChunk *arenaChunks = NULL;  // the chunk being cut first
+ArenaChunk *spareChunks = NULL;  // empty ones, of the standard size
+
+size_t roundToHeader(size_t size)
+{
+  return (size + sizeof(BlockHeader) - 1) / sizeof(BlockHeader) * sizeof(BlockHeader);
+}
+
+char *chunkData(ArenaChunk *chunk)
+{
+  return (char *)(chunk + 1);
+}
+
+void *arenaAllocate(size_t size, AllocKind kind, char *file, int line)
+{
+  size_t needed = sizeof(BlockHeader) + roundToHeader(size);
+  size_t chunkSize;
+  ArenaChunk *chunk = arenaChunks;
+  BlockHeader *header;
+
+  STATS_ALLOCATION(size);
+  if (chunk == NULL || chunk->info.used + needed > chunk->info.size)
+  {
+    if (spareChunks != NULL && needed <= ARENA_CHUNK_SIZE)
+    {
+      chunk = spareChunks;
+      spareChunks = chunk->info.next;
+    }
+    else
+    {
+      chunkSize = (needed > ARENA_CHUNK_SIZE) ? needed : ARENA_CHUNK_SIZE;
+      chunk = (ArenaChunk *)malloc(sizeof(ArenaChunk) + chunkSize);
+      if (chunk == NULL)
+        return NULL;
+      chunk->info.size = chunkSize;
+    }
+    chunk->info.next = arenaChunks;
+    chunk->info.used = 0;
+    arenaChunks = chunk;
+  }
+  header = (BlockHeader *)(chunkData(chunk) + chunk->info.used);
+  header->info.size = size;
+  chunk->info.used += needed;
+  return header + 1;
+}
+
+// The last block of the current chunk grows in place, as the code buffer
+// usually is; any other block is copied
+void *arenaReallocate(void *block, size_t size, AllocKind kind, char *file, int line)
+{
+  BlockHeader *header;
+  ArenaChunk *chunk = arenaChunks;
+  size_t oldSize;
+  void *copy;
+
+  if (block == NULL)
+    return arenaAllocate(size, kind, file, line);
+  header = (BlockHeader *)block - 1;
+  oldSize = header->info.size;
+  if (size <= oldSize)
+    return block;
+
+  if (chunk != NULL &&
+      (char *)block + roundToHeader(oldSize) == chunkData(chunk) + chunk->info.used &&
+      chunk->info.used + roundToHeader(size) - roundToHeader(oldSize) <= chunk->info.size)
+  {
+    STATS_ALLOCATION(size);
+    chunk->info.used += roundToHeader(size) - roundToHeader(oldSize);
+    header->info.size = size;
+    return block;
+  }
+
+  copy = arenaAllocate(size, kind, file, line);
+  if (copy != NULL)
+    memcpy(copy, block, oldSize);
+  return copy;
+}
+
+void arenaRelease(void *block)
+{
+}
+
+Allocator arenaAllocator = { arenaAllocate, arenaReallocate, arenaRelease };
+
+// Chunks of the standard size are kept for the next compilation, so a
+// server settles at the memory of its largest request; larger ones are freed
+void resetArena(void)
+{
+  ArenaChunk *chunk = arenaChunks;
+  ArenaChunk *next;
+
+  while (chunk != NULL)
+  {
+    next = chunk->info.next;
+    if (chunk->info.size == ARENA_CHUNK_SIZE)
+    {
+      chunk->info.next = spareChunks;
+      spareChunks = chunk;
+    }
+    else
+      free(chunk);
+    chunk = next;
+  }
+  arenaChunks = NULL;
+}
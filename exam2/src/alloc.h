@@ -0,0 +1,55 @@
+#ifndef __ALLOC_H__
+#define __ALLOC_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Memory of the compiler's own structures. Every allocation names its
+// kind and, through the macros below, its call site, so an allocator can
+// account for them. The allocator is chosen once, before the first
+// allocation: a block must go back to the allocator that gave it. The
+// arena allocator is the exception: it ignores release, so blocks made
+// before switching to it may still be handed to it.
+
+typedef enum {
+  ALLOC_TOKEN,
+  ALLOC_TYPE,
+  ALLOC_CONSTANT,
+  ALLOC_OBJECT,
+  ALLOC_ATTRIBUTES,  // the xxxAttrs of an object
+  ALLOC_SCOPE,
+  ALLOC_OBJECT_NODE,
+  ALLOC_SYMTAB,
+  ALLOC_CODE,        // code blocks and their instructions
+  ALLOC_PARSER,      // the parser's operator and type stacks
+  ALLOC_EDIT_BUFFER, // the text and tokens of a TokenBuffer
+  ALLOC_LINES,       // where the lines of a source start
+  ALLOC_DOCUMENT,    // the routines and dependencies a document keeps
+  ALLOC_UNIT,        // the units a program uses
+  ALLOC_KIND_COUNT
+} AllocKind;
+
+typedef struct {
+  void *(*allocate)(size_t size, AllocKind kind, char *file, int line);
+  void *(*reallocate)(void *block, size_t size, AllocKind kind, char *file, int line);
+  void (*release)(void *block);
+} Allocator;
+
+extern Allocator *allocator;
+extern Allocator mallocAllocator;
+extern Allocator profilingAllocator;
+extern Allocator arenaAllocator;
+
+void setAllocator(Allocator *newAllocator);
+void printAllocationProfile(FILE *out);
+void resetArena(void);
+
+#define ALLOCATE(type, kind) \
+  ((type *)allocator->allocate(sizeof(type), kind, __FILE__, __LINE__))
+#define ALLOCATE_ARRAY(type, count, kind) \
+  ((type *)allocator->allocate((count) * sizeof(type), kind, __FILE__, __LINE__))
+#define REALLOCATE_ARRAY(block, type, count, kind) \
+  ((type *)allocator->reallocate(block, (count) * sizeof(type), kind, __FILE__, __LINE__))
+#define RELEASE(block) (allocator->release(block))
+
+#endif
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "asmgen.h"
+#include "vm.h"
+
+// x86-64 System V translation of the stack machine code.
+//
+// The machine stack is the KPL stack: a push increases t and decreases %rsp,
+// so %rsp always points at s[t]. %rbp holds the frame base b, and the word
+// at frame offset k lives at -8k(%rbp):
+//   0: return value   1: dynamic link   2: return address   3: static link
+//   4..: parameters (VAR parameters hold addresses), then local variables
+
+#define SLOT(k) (-8 * (WORD)(k))
+
+#define STATIC_LINK SLOT(3)
+
+#define CC_COMMAND "cc"
+
+// Room below the stack limit for the C library called by the runtime
+#define RUNTIME_STACK_SLACK 65536
+
+char *runtimeAssembly =
+  "\t.section .rodata\n"
+  ".Lkpl_fmt_int:\n"
+  "\t.string \"%lld\"\n"
+  "\t.text\n"
+  "kpl_writei:\n"
+  "\tsub $8, %rsp\n"
+  "\tmov %rdi, %rsi\n"
+  "\tlea .Lkpl_fmt_int(%rip), %rdi\n"
+  "\txor %eax, %eax\n"
+  "\tcall printf@PLT\n"
+  "\tadd $8, %rsp\n"
+  "\tret\n"
+  "kpl_writec:\n"
+  "\tsub $8, %rsp\n"
+  "\tmovzbl %dil, %edi\n"
+  "\tcall putchar@PLT\n"
+  "\tadd $8, %rsp\n"
+  "\tret\n"
+  "kpl_writeln:\n"
+  "\tsub $8, %rsp\n"
+  "\tmov $10, %edi\n"
+  "\tcall putchar@PLT\n"
+  "\tadd $8, %rsp\n"
+  "\tret\n"
+  "kpl_readi:\n"
+  "\tsub $24, %rsp\n"
+  "\tmovq $0, (%rsp)\n"
+  "\tmov %rsp, %rsi\n"
+  "\tlea .Lkpl_fmt_int(%rip), %rdi\n"
+  "\txor %eax, %eax\n"
+  "\tcall scanf@PLT\n"
+  "\tcmp $-1, %eax\n"
+  "\tje kpl_end_of_input\n"
+  "\tmov (%rsp), %rax\n"
+  "\tadd $24, %rsp\n"
+  "\tret\n"
+  "kpl_readc:\n"
+  "\tsub $8, %rsp\n"
+  "\tcall getchar@PLT\n"
+  "\tcltq\n"
+  "\tadd $8, %rsp\n"
+  "\tret\n"
+  // %rdi ** %rsi by repeated squaring; negative exponents truncate to 0
+  // except for the bases 1 and -1
+  "kpl_power:\n"
+  "\tmov $1, %eax\n"
+  "\ttest %rsi, %rsi\n"
+  "\tjs .Lkpl_power_negative\n"
+  ".Lkpl_power_loop:\n"
+  "\ttest %rsi, %rsi\n"
+  "\tjz .Lkpl_power_done\n"
+  "\ttest $1, %sil\n"
+  "\tjz .Lkpl_power_square\n"
+  "\timul %rdi, %rax\n"
+  ".Lkpl_power_square:\n"
+  "\timul %rdi, %rdi\n"
+  "\tshr $1, %rsi\n"
+  "\tjmp .Lkpl_power_loop\n"
+  ".Lkpl_power_negative:\n"
+  "\tcmp $1, %rdi\n"
+  "\tje .Lkpl_power_done\n"
+  "\txor %eax, %eax\n"
+  "\tcmp $-1, %rdi\n"
+  "\tjne .Lkpl_power_done\n"
+  "\tmov $1, %eax\n"
+  "\ttest $1, %sil\n"
+  "\tjz .Lkpl_power_done\n"
+  "\tneg %rax\n"
+  ".Lkpl_power_done:\n"
+  "\tret\n"
+  // runtime errors end the program as the interpreter reports them
+  "kpl_divide_by_zero:\n"
+  "\tlea .Lkpl_msg_divide(%rip), %rdi\n"
+  "\tjmp kpl_runtime_error\n"
+  "kpl_stack_overflow:\n"
+  "\tlea .Lkpl_msg_stack(%rip), %rdi\n"
+  "\tjmp kpl_runtime_error\n"
+  "kpl_end_of_input:\n"
+  "\tlea .Lkpl_msg_input(%rip), %rdi\n"
+  "kpl_runtime_error:\n"
+  "\tand $-16, %rsp\n"
+  "\tmov %rdi, %rbx\n"
+  "\txor %edi, %edi\n"
+  "\tcall fflush@PLT\n"
+  "\tmov stderr@GOTPCREL(%rip), %rax\n"
+  "\tmov (%rax), %rsi\n"
+  "\tmov %rbx, %rdi\n"
+  "\tcall fputs@PLT\n"
+  "\tmov $1, %edi\n"
+  "\tcall exit@PLT\n"
+  "\t.section .rodata\n"
+  ".Lkpl_msg_divide:\n"
+  "\t.string \"\\nRuntime error: divide by zero.\\n\"\n"
+  ".Lkpl_msg_stack:\n"
+  "\t.string \"\\nRuntime error: stack overflow.\\n\"\n"
+  ".Lkpl_msg_input:\n"
+  "\t.string \"\\nRuntime error: unexpected end of input.\\n\"\n"
+  "\t.local kpl_saved_rsp\n"
+  "\t.comm kpl_saved_rsp, 8, 8\n"
+  "\t.local kpl_stack_limit\n"
+  "\t.comm kpl_stack_limit, 8, 8\n"
+  "\t.section .note.GNU-stack,\"\",@progbits\n";
+
+// Load the frame base `level` static links away into %rax
+void genBase(FILE *out, WORD level)
+{
+  WORD i;
+
+  if (level == 0)
+  {
+    fprintf(out, "\tmov %%rbp, %%rax\n");
+    return;
+  }
+  fprintf(out, "\tmov %lld(%%rbp), %%rax\n", STATIC_LINK);
+  for (i = 1; i < level; i++)
+    fprintf(out, "\tmov %lld(%%rax), %%rax\n", STATIC_LINK);
+}
+
+// Runtime routines are ordinary C-ABI functions: align %rsp around the call
+void genRuntimeCall(FILE *out, char *routine)
+{
+  fprintf(out, "\tmov %%rsp, %%rbx\n");
+  fprintf(out, "\tand $-16, %%rsp\n");
+  fprintf(out, "\tcall %s\n", routine);
+  fprintf(out, "\tmov %%rbx, %%rsp\n");
+}
+
+void genCompare(FILE *out, char *setcc)
+{
+  fprintf(out, "\tpop %%rax\n");
+  fprintf(out, "\tcmp %%rax, (%%rsp)\n");
+  fprintf(out, "\t%s %%al\n", setcc);
+  fprintf(out, "\tmovzbq %%al, %%rax\n");
+  fprintf(out, "\tmov %%rax, (%%rsp)\n");
+}
+
+// Add the top n words two at a time with SSE2, leaving the total on top
+void genSum(FILE *out, WORD n)
+{
+  fprintf(out, "\tmov %%rsp, %%rdx\n");
+  fprintf(out, "\tmov $%lld, %%ecx\n", n / 2);
+  fprintf(out, "\tpxor %%xmm0, %%xmm0\n");
+  fprintf(out, "1:\n");
+  fprintf(out, "\tmovdqu (%%rdx), %%xmm1\n");
+  fprintf(out, "\tpaddq %%xmm1, %%xmm0\n");
+  fprintf(out, "\tadd $16, %%rdx\n");
+  fprintf(out, "\tdec %%ecx\n");
+  fprintf(out, "\tjnz 1b\n");
+  if (n % 2 != 0)
+  {
+    fprintf(out, "\tmovq (%%rdx), %%xmm1\n");
+    fprintf(out, "\tpaddq %%xmm1, %%xmm0\n");
+  }
+  fprintf(out, "\tpshufd $0x4e, %%xmm0, %%xmm1\n");
+  fprintf(out, "\tpaddq %%xmm1, %%xmm0\n");
+  fprintf(out, "\tmovq %%xmm0, %%rax\n");
+  fprintf(out, "\tadd $%lld, %%rsp\n", 8 * (n - 1));
+  fprintf(out, "\tmov %%rax, (%%rsp)\n");
+}
+
+// A CALL finds s[t] at `depth` bytes above %rsp (the DCT before it is folded in)
+void genCallSequence(FILE *out, Instruction *inst, WORD depth)
+{
+  genBase(out, inst->p);
+  fprintf(out, "\tmov %%rax, %lld(%%rsp)\n", depth + SLOT(4));
+  fprintf(out, "\tmov %%rbp, %lld(%%rsp)\n", depth + SLOT(2));
+  fprintf(out, "\tlea %lld(%%rsp), %%rbp\n", depth + SLOT(1));
+  if (depth + SLOT(2) > 0)
+    fprintf(out, "\tadd $%lld, %%rsp\n", depth + SLOT(2));
+  else if (depth + SLOT(2) < 0)
+    fprintf(out, "\tsub $%lld, %%rsp\n", -(depth + SLOT(2)));
+  fprintf(out, "\tcall .L%lld\n", inst->q);
+}
+
+// Mark jump targets and the INT that opens each subroutine body.
+// At a subroutine entry %rsp points at the return address instead of s[b-1],
+// so that INT is translated relative to %rbp.
+void analyzeCode(CodeBlock *codeBlock, char *isLabel, char *isEntry)
+{
+  int i;
+  WORD target;
+  Instruction *code = codeBlock->code;
+
+  memset(isLabel, 0, codeBlock->codeSize + 1);
+  memset(isEntry, 0, codeBlock->codeSize + 1);
+
+  for (i = 0; i < codeBlock->codeSize; i++)
+  {
+    switch (code[i].op)
+    {
+    case OP_J:
+    case OP_FJ:
+      isLabel[code[i].q] = 1;
+      break;
+    case OP_CALL:
+      isLabel[code[i].q] = 1;
+      target = code[i].q;
+      if (code[target].op == OP_J)
+        target = code[target].q;
+      if (code[target].op == OP_INT)
+        isEntry[target] = 1;
+      break;
+    default:
+      break;
+    }
+  }
+
+  // The main program
+  target = 0;
+  if (codeBlock->codeSize > 0 && code[0].op == OP_J)
+    target = code[0].q;
+  if (target < codeBlock->codeSize && code[target].op == OP_INT)
+    isEntry[target] = 1;
+}
+
+void genInstruction(FILE *out, Instruction *inst, int isEntry)
+{
+  switch (inst->op)
+  {
+  case OP_LA:
+    if (inst->p == 0)
+      fprintf(out, "\tlea %lld(%%rbp), %%rax\n", SLOT(inst->q));
+    else
+    {
+      genBase(out, inst->p);
+      fprintf(out, "\tlea %lld(%%rax), %%rax\n", SLOT(inst->q));
+    }
+    fprintf(out, "\tpush %%rax\n");
+    break;
+  case OP_LV:
+    if (inst->p == 0)
+      fprintf(out, "\tpushq %lld(%%rbp)\n", SLOT(inst->q));
+    else
+    {
+      genBase(out, inst->p);
+      fprintf(out, "\tpushq %lld(%%rax)\n", SLOT(inst->q));
+    }
+    break;
+  case OP_LC:
+    if (inst->q >= -2147483648LL && inst->q <= 2147483647LL)
+      fprintf(out, "\tpushq $%lld\n", inst->q);
+    else
+    {
+      fprintf(out, "\tmovabs $%lld, %%rax\n", inst->q);
+      fprintf(out, "\tpush %%rax\n");
+    }
+    break;
+  case OP_LI:
+    fprintf(out, "\tmov (%%rsp), %%rax\n");
+    fprintf(out, "\tmov (%%rax), %%rax\n");
+    fprintf(out, "\tmov %%rax, (%%rsp)\n");
+    break;
+  case OP_INT:
+    if (isEntry)
+      fprintf(out, "\tlea %lld(%%rbp), %%rsp\n", SLOT(inst->q - 1));
+    else
+      fprintf(out, "\tsub $%lld, %%rsp\n", 8 * inst->q);
+    fprintf(out, "\tcmp kpl_stack_limit(%%rip), %%rsp\n");
+    fprintf(out, "\tjb kpl_stack_overflow\n");
+    break;
+  case OP_DCT:
+    fprintf(out, "\tadd $%lld, %%rsp\n", 8 * inst->q);
+    break;
+  case OP_J:
+    fprintf(out, "\tjmp .L%lld\n", inst->q);
+    break;
+  case OP_FJ:
+    fprintf(out, "\tpop %%rax\n");
+    fprintf(out, "\ttest %%rax, %%rax\n");
+    fprintf(out, "\tjz .L%lld\n", inst->q);
+    break;
+  case OP_HL:
+    fprintf(out, "\tmov kpl_saved_rsp(%%rip), %%rsp\n");
+    fprintf(out, "\tpop %%rbx\n");
+    fprintf(out, "\tpop %%rbp\n");
+    fprintf(out, "\txor %%eax, %%eax\n");
+    fprintf(out, "\tret\n");
+    break;
+  case OP_ST:
+    fprintf(out, "\tpop %%rax\n");
+    fprintf(out, "\tpop %%rcx\n");
+    fprintf(out, "\tmov %%rax, (%%rcx)\n");
+    break;
+  case OP_STN:
+    fprintf(out, "\tpop %%rax\n");
+    fprintf(out, "\tmov %lld(%%rsp), %%rcx\n", 8 * (inst->q - 1));
+    fprintf(out, "\tmov %%rax, (%%rcx)\n");
+    break;
+  case OP_CALL:
+    genCallSequence(out, inst, 0);
+    break;
+  case OP_EP:
+    // ret pops the return address, then drops the RV and DL slots
+    fprintf(out, "\tlea %lld(%%rbp), %%rsp\n", SLOT(2));
+    fprintf(out, "\tmov %lld(%%rbp), %%rbp\n", SLOT(1));
+    fprintf(out, "\tret $16\n");
+    break;
+  case OP_EF:
+    // same as EP but the return value is left on top
+    fprintf(out, "\tlea %lld(%%rbp), %%rsp\n", SLOT(2));
+    fprintf(out, "\tmov %lld(%%rbp), %%rbp\n", SLOT(1));
+    fprintf(out, "\tret $8\n");
+    break;
+  case OP_RC:
+    genRuntimeCall(out, "kpl_readc");
+    fprintf(out, "\tpush %%rax\n");
+    break;
+  case OP_RI:
+    genRuntimeCall(out, "kpl_readi");
+    fprintf(out, "\tpush %%rax\n");
+    break;
+  case OP_WRC:
+    fprintf(out, "\tpop %%rdi\n");
+    genRuntimeCall(out, "kpl_writec");
+    break;
+  case OP_WRI:
+    fprintf(out, "\tpop %%rdi\n");
+    genRuntimeCall(out, "kpl_writei");
+    break;
+  case OP_WLN:
+    genRuntimeCall(out, "kpl_writeln");
+    break;
+  case OP_AD:
+    fprintf(out, "\tpop %%rax\n");
+    fprintf(out, "\tadd %%rax, (%%rsp)\n");
+    break;
+  case OP_SB:
+    fprintf(out, "\tpop %%rax\n");
+    fprintf(out, "\tsub %%rax, (%%rsp)\n");
+    break;
+  case OP_ML:
+    fprintf(out, "\tpop %%rax\n");
+    fprintf(out, "\timul (%%rsp), %%rax\n");
+    fprintf(out, "\tmov %%rax, (%%rsp)\n");
+    break;
+  case OP_DV:
+    fprintf(out, "\tpop %%rcx\n");
+    fprintf(out, "\ttest %%rcx, %%rcx\n");
+    fprintf(out, "\tjz kpl_divide_by_zero\n");
+    fprintf(out, "\tpop %%rax\n");
+    // idiv traps on the one quotient that overflows; it wraps as in the
+    // constant folder
+    fprintf(out, "\tcmp $-1, %%rcx\n");
+    fprintf(out, "\tjne 1f\n");
+    fprintf(out, "\tneg %%rax\n");
+    fprintf(out, "\tjmp 2f\n");
+    fprintf(out, "1:\tcqo\n");
+    fprintf(out, "\tidiv %%rcx\n");
+    fprintf(out, "2:\tpush %%rax\n");
+    break;
+  case OP_PW:
+    // kpl_power does not touch the C library, so no alignment is needed
+    fprintf(out, "\tpop %%rsi\n");
+    fprintf(out, "\tpop %%rdi\n");
+    fprintf(out, "\tcall kpl_power\n");
+    fprintf(out, "\tpush %%rax\n");
+    break;
+  case OP_SUM:
+    genSum(out, inst->q);
+    break;
+  case OP_NEG:
+    fprintf(out, "\tnegq (%%rsp)\n");
+    break;
+  case OP_CV:
+    fprintf(out, "\tpushq (%%rsp)\n");
+    break;
+  case OP_AX:
+    // frames grow downwards, so a word offset moves to lower addresses
+    fprintf(out, "\tpop %%rax\n");
+    fprintf(out, "\tshl $3, %%rax\n");
+    fprintf(out, "\tsub %%rax, (%%rsp)\n");
+    break;
+  case OP_EQ:
+    genCompare(out, "sete");
+    break;
+  case OP_NE:
+    genCompare(out, "setne");
+    break;
+  case OP_GT:
+    genCompare(out, "setg");
+    break;
+  case OP_LT:
+    genCompare(out, "setl");
+    break;
+  case OP_GE:
+    genCompare(out, "setge");
+    break;
+  case OP_LE:
+    genCompare(out, "setle");
+    break;
+  case OP_BP:
+  default:
+    break;
+  }
+}
+
+void genAssembly(CodeBlock *codeBlock, FILE *out)
+{
+  int i;
+  char *isLabel = (char *)malloc(codeBlock->codeSize + 1);
+  char *isEntry = (char *)malloc(codeBlock->codeSize + 1);
+  Instruction *code = codeBlock->code;
+
+  analyzeCode(codeBlock, isLabel, isEntry);
+
+  fprintf(out, "\t.text\n");
+  fprintf(out, "\t.globl main\n");
+  fprintf(out, "main:\n");
+  fprintf(out, "\tpush %%rbp\n");
+  fprintf(out, "\tpush %%rbx\n");
+  // the program runs on a stack as large as the interpreter's, and
+  // overflows it at the same depth
+  fprintf(out, "\tmov %%rsp, kpl_saved_rsp(%%rip)\n");
+  fprintf(out, "\tsub $8, %%rsp\n");
+  fprintf(out, "\tmov $%d, %%edi\n", RUNTIME_STACK_SLACK + STACK_SIZE * 8);
+  fprintf(out, "\tcall malloc@PLT\n");
+  fprintf(out, "\ttest %%rax, %%rax\n");
+  fprintf(out, "\tjz kpl_stack_overflow\n");
+  fprintf(out, "\tlea %d(%%rax), %%rcx\n", RUNTIME_STACK_SLACK + STACK_MARGIN * 8);
+  fprintf(out, "\tmov %%rcx, kpl_stack_limit(%%rip)\n");
+  fprintf(out, "\tlea %d(%%rax), %%rsp\n", RUNTIME_STACK_SLACK + STACK_SIZE * 8);
+  fprintf(out, "\tlea -8(%%rsp), %%rbp\n");
+
+  for (i = 0; i < codeBlock->codeSize; i++)
+  {
+    if (isLabel[i])
+      fprintf(out, ".L%d:\n", i);
+
+    // fold "DCT n; CALL" so that no live word is left below %rsp
+    if (code[i].op == OP_DCT && i + 1 < codeBlock->codeSize &&
+        code[i + 1].op == OP_CALL && !isLabel[i + 1])
+    {
+      genCallSequence(out, code + i + 1, 8 * code[i].q);
+      i++;
+      continue;
+    }
+
+    genInstruction(out, code + i, isEntry[i]);
+  }
+  if (isLabel[codeBlock->codeSize])
+    fprintf(out, ".L%d:\n", codeBlock->codeSize);
+
+  fputs(runtimeAssembly, out);
+
+  free(isLabel);
+  free(isEntry);
+}
+
+int saveAssembly(CodeBlock *codeBlock, char *fileName)
+{
+  FILE *out = fopen(fileName, "w");
+
+  if (out == NULL)
+    return ASM_ERROR;
+  genAssembly(codeBlock, out);
+  fclose(out);
+  return ASM_SUCCESS;
+}
+
+// File names go to the compiler as they are: no shell sees them
+int runCommand(char *argv[])
+{
+  pid_t child;
+  int status;
+
+  fflush(stdout);
+  fflush(stderr);
+  child = fork();
+  if (child < 0)
+    return ASM_ERROR;
+  if (child == 0)
+  {
+    execvp(argv[0], argv);
+    fprintf(stderr, "kplc: can't run %s\n", argv[0]);
+    _exit(127);
+  }
+  while (waitpid(child, &status, 0) < 0)
+    if (errno != EINTR)
+    {
+      fprintf(stderr, "kplc: can't wait for %s\n", argv[0]);
+      return ASM_ERROR;
+    }
+  return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? ASM_SUCCESS : ASM_ERROR;
+}
+
+// Assemble and link with the local C toolchain
+int buildExecutable(char *asmFileName, char *exeFileName)
+{
+  char *argv[] = { CC_COMMAND, "-o", exeFileName, asmFileName, NULL };
+
+  return runCommand(argv);
+}
@@ -0,0 +1,16 @@
+#ifndef __ASMGEN_H__
+#define __ASMGEN_H__
+
+#include <stdio.h>
+#include "instructions.h"
+
+#define ASM_SUCCESS 1
+#define ASM_ERROR 0
+
+void genAssembly(CodeBlock* codeBlock, FILE* out);
+int saveAssembly(CodeBlock* codeBlock, char* fileName);
+int buildExecutable(char* asmFileName, char* exeFileName);
+// Runs argv[0] with argv, without a shell: ASM_SUCCESS when it exits 0
+int runCommand(char* argv[]);
+
+#endif
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Compare the interpreter and tiered JIT against the native assembly and
+# emitted C backends.
+# Usage: bench/backends.sh [program.kpl]   (run from exam2/src after make)
+
+KPLC=./kplc
+PROGRAM=${1:-bench/backends.kpl}
+WORK=${TMPDIR:-/tmp}/kplc-bench.$$
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+# seconds spent by a command, output discarded
+elapsed() {
+  start=$(date +%s.%N)
+  "$@" > /dev/null
+  end=$(date +%s.%N)
+  awk "BEGIN { printf \"%.3f\", $end - $start }"
+}
+
+$KPLC "$PROGRAM" -o "$WORK/native" > /dev/null || exit 1
+$KPLC "$PROGRAM" --emit-c -o "$WORK/emitted-c" > /dev/null || exit 1
+
+printf "%-12s %s\n" "backend" "seconds"
+printf "%-12s %s\n" "interpreter" "$(elapsed $KPLC "$PROGRAM" -run)"
+printf "%-12s %s\n" "jit" "$(elapsed $KPLC "$PROGRAM" -jit)"
+printf "%-12s %s\n" "native" "$(elapsed "$WORK/native")"
+printf "%-12s %s\n" "emitted-c" "$(elapsed "$WORK/emitted-c")"
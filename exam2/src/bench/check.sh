@@ -0,0 +1,29 @@
+#!/bin/sh
+# kplc --check with 1, 2, 4... threads, up to the processors here, on
+# generated programs of as many lines as given.
+# Usage: bench/check.sh [lines...]   (run from exam2/src after make bench/kplgen)
+
+KPLC=${KPLC:-./kplc}
+WORK=${TMPDIR:-/tmp}/kplc-bench-check.$$
+CPUS=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+# seconds spent by a command, output discarded
+elapsed() {
+  start=$(date +%s.%N)
+  "$@" > /dev/null
+  end=$(date +%s.%N)
+  awk "BEGIN { printf \"%.3f\", $end - $start }"
+}
+
+printf "%-8s %-10s %s\n" "lines" "threads" "seconds"
+for lines in ${@:-20000 100000}; do
+  bench/kplgen -lines "$lines" -depth 1 > "$WORK/gen.kpl"
+  threads=1
+  while [ "$threads" -le "$CPUS" ]; do
+    printf "%-8s %-10s %s\n" "$lines" "$threads" "$(elapsed $KPLC "$WORK/gen.kpl" --check -j "$threads")"
+    threads=$((threads * 2))
+  done
+done
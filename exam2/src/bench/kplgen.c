@@ -0,0 +1,336 @@
+// Synthetic KPL program generator for the scaling benchmarks.
+//
+//   kplgen [-seed N] [-lines N] [-globals N] [-depth N] [-width N] [-dims N] [-sum N]
+//
+// writes a valid exam2 program of about the given number of lines to
+// stdout. The same options always give the same program. The program
+// stops when run: subroutines never recurse, every one is called once
+// by its parent and loops have constant bounds.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHILDREN 2           // nested subroutines of each subroutine
+#define STATEMENTS 20        // statements in each subroutine body
+#define LOCALS 4             // L0.. in each subroutine
+#define ARRAY_SIZE 8         // elements in each array dimension
+#define MAIN_STATEMENTS 10
+
+int seed = 1;
+long long lineTarget = 1000;
+int globals = 50;
+int maxDepth = 3;
+int width = 4;
+int dims = 2;
+int sumTerms = 8;
+
+unsigned long long randomState;
+long long linesWritten = 0;
+int subroutineCount = 0;
+
+// xorshift64*: small, fast and the same on every platform
+unsigned long long nextRandom(void)
+{
+  randomState ^= randomState >> 12;
+  randomState ^= randomState << 25;
+  randomState ^= randomState >> 27;
+  return randomState * 2685821657736338717ULL;
+}
+
+int randomBelow(int n)
+{
+  return (int)(nextRandom() % (unsigned long long)n);
+}
+
+void endLine(void)
+{
+  putchar('\n');
+  linesWritten++;
+}
+
+/******************************************************************/
+
+// An integer operand visible at the given depth (0 is the main program)
+void genOperand(int depth)
+{
+  int i;
+
+  switch (randomBelow(depth > 0 ? 5 : 3))
+  {
+  case 0:
+    printf("%d", randomBelow(100));
+    break;
+  case 1:
+    printf("G%d", randomBelow(globals));
+    break;
+  case 2:
+    printf("A");
+    for (i = 0; i < dims; i++)
+      printf("(.%d.)", 1 + randomBelow(ARRAY_SIZE));
+    break;
+  case 3:
+    printf("L%d", randomBelow(LOCALS));
+    break;
+  default:
+    printf("X");
+    break;
+  }
+}
+
+// width operands joined by + - * and division by non-zero constants
+void genExpression(int depth, int operands)
+{
+  int i;
+
+  genOperand(depth);
+  for (i = 1; i < operands; i++)
+  {
+    switch (randomBelow(4))
+    {
+    case 0: printf(" + "); genOperand(depth); break;
+    case 1: printf(" - "); genOperand(depth); break;
+    case 2: printf(" * "); genOperand(depth); break;
+    default: printf(" / %d", 1 + randomBelow(9)); break;
+    }
+  }
+}
+
+void genTarget(int depth)
+{
+  if (depth > 0 && randomBelow(2) == 0)
+    printf("L%d", randomBelow(LOCALS));
+  else
+    printf("G%d", randomBelow(globals));
+}
+
+void genStatement(int depth, char *indent)
+{
+  int i;
+
+  printf("%s", indent);
+  switch (randomBelow(sumTerms > 0 ? 10 : 9))
+  {
+  case 0:
+  case 1:
+    printf("IF ");
+    genExpression(depth, 1 + width / 2);
+    printf(" < ");
+    genExpression(depth, 1 + width / 2);
+    printf(" THEN ");
+    genTarget(depth);
+    printf(" := ");
+    genExpression(depth, width);
+    printf(" ELSE ");
+    genTarget(depth);
+    printf(" := ");
+    genExpression(depth, width);
+    break;
+  case 2:
+    if (depth > 0)
+    {
+      printf("FOR I := 1 TO %d DO ", 1 + randomBelow(3));
+      genTarget(depth);
+      printf(" := ");
+      genExpression(depth, width);
+      printf(" + I");
+      break;
+    }
+    // fall through: the main program has no loop variable
+  case 3:
+    printf("A");
+    for (i = 0; i < dims; i++)
+      printf("(.%d.)", 1 + randomBelow(ARRAY_SIZE));
+    printf(" := ");
+    genExpression(depth, width);
+    break;
+  case 9:
+    genTarget(depth);
+    printf(" := SUM ");
+    for (i = 0; i < sumTerms; i++)
+    {
+      if (i > 0)
+        printf(", ");
+      genExpression(depth, 1 + randomBelow(3));
+    }
+    break;
+  default:
+    genTarget(depth);
+    printf(" := ");
+    genExpression(depth, width);
+    break;
+  }
+  printf(";");
+  endLine();
+}
+
+/******************************************************************/
+
+void genSubroutine(int depth)
+{
+  char indent[64];
+  int children[CHILDREN];
+  int id = subroutineCount++;
+  int isFunction = (id % 3 == 2);
+  int childCount = 0;
+  int i;
+
+  memset(indent, ' ', 2 * depth);
+  indent[2 * depth] = '\0';
+
+  if (isFunction)
+    printf("%sFUNCTION F%d(X : INTEGER) : INTEGER;", indent, id);
+  else
+    printf("%sPROCEDURE P%d(X : INTEGER; VAR R : INTEGER);", indent, id);
+  endLine();
+  printf("%sVAR I : INTEGER;", indent);
+  for (i = 0; i < LOCALS; i++)
+    printf(" L%d : INTEGER;", i);
+  endLine();
+
+  if (depth < maxDepth)
+    for (i = 0; i < CHILDREN; i++)
+    {
+      children[childCount++] = subroutineCount;
+      genSubroutine(depth + 1);
+    }
+
+  printf("%sBEGIN", indent);
+  endLine();
+  for (i = 0; i < LOCALS; i++)
+  {
+    printf("%s  L%d := X + %d;", indent, i, i);
+    endLine();
+  }
+  for (i = 0; i < STATEMENTS; i++)
+    genStatement(depth, "  ");
+
+  // every subroutine runs its children once, so a run stays linear
+  for (i = 0; i < childCount; i++)
+  {
+    if (children[i] % 3 == 2)
+      printf("%s  L0 := F%d(L1);", indent, children[i]);
+    else
+      printf("%s  CALL P%d(L1, L2);", indent, children[i]);
+    endLine();
+  }
+
+  if (isFunction)
+    printf("%s  F%d := L0 + L1", indent, id);
+  else
+    printf("%s  R := L0 + L1", indent);
+  endLine();
+  printf("%sEND;", indent);
+  endLine();
+}
+
+// Lines written by genSubroutine at the given depth
+long long subroutineLines(int depth)
+{
+  long long children = 0;
+
+  if (depth < maxDepth)
+    children = CHILDREN * (subroutineLines(depth + 1) + 1);
+  return 6 + LOCALS + STATEMENTS + children;
+}
+
+void genProgram(void)
+{
+  long long treeLines = subroutineLines(0);
+  int *topLevel;
+  int topLevelCount = 0, topLevelCapacity = 64;
+  int i;
+
+  topLevel = (int *)malloc(topLevelCapacity * sizeof(int));
+
+  printf("PROGRAM Bench;");
+  endLine();
+  printf("(* kplgen -seed %d -lines %lld -globals %d -depth %d -width %d -dims %d -sum %d *)",
+         seed, lineTarget, globals, maxDepth, width, dims, sumTerms);
+  endLine();
+  printf("VAR A : ");
+  for (i = 0; i < dims; i++)
+    printf("ARRAY(. %d .) OF ", ARRAY_SIZE);
+  printf("INTEGER;");
+  endLine();
+  for (i = 0; i < globals; i++)
+  {
+    printf("    G%d : INTEGER;", i);
+    endLine();
+  }
+
+  // the main program and its calls take the last lines of the budget
+  while (linesWritten + treeLines + globals + MAIN_STATEMENTS + topLevelCount + 4 <= lineTarget)
+  {
+    if (topLevelCount == topLevelCapacity)
+    {
+      topLevelCapacity *= 2;
+      topLevel = (int *)realloc(topLevel, topLevelCapacity * sizeof(int));
+    }
+    topLevel[topLevelCount++] = subroutineCount;
+    genSubroutine(0);
+  }
+
+  printf("BEGIN");
+  endLine();
+  for (i = 0; i < globals; i++)
+  {
+    printf("  G%d := %d;", i, i);
+    endLine();
+  }
+  // statements fill what the subroutine trees left of the budget
+  for (i = 0; i < MAIN_STATEMENTS || linesWritten + topLevelCount + 2 < lineTarget; i++)
+    genStatement(0, "  ");
+  for (i = 0; i < topLevelCount; i++)
+  {
+    if (topLevel[i] % 3 == 2)
+      printf("  G0 := F%d(G1);", topLevel[i]);
+    else
+      printf("  CALL P%d(G1, G2);", topLevel[i]);
+    endLine();
+  }
+  printf("  CALL WRITEI(G0); CALL WRITELN");
+  endLine();
+  printf("END.");
+  endLine();
+
+  free(topLevel);
+}
+
+int main(int argc, char *argv[])
+{
+  int i;
+
+  for (i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "-seed") == 0)
+      seed = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-lines") == 0)
+      lineTarget = atoll(argv[i + 1]);
+    else if (strcmp(argv[i], "-globals") == 0)
+      globals = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-depth") == 0)
+      maxDepth = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-width") == 0)
+      width = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-dims") == 0)
+      dims = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-sum") == 0)
+      sumTerms = atoi(argv[i + 1]);
+    else
+      break;
+  }
+  if (i < argc || globals < 3 || width < 1 || dims < 1 || maxDepth < 0 || maxDepth > 20)
+  {
+    fprintf(stderr, "Usage: kplgen [-seed N] [-lines N] [-globals N>=3] [-depth N<=20] "
+            "[-width N] [-dims N] [-sum N]\n");
+    return 1;
+  }
+
+  randomState = 0x9E3779B97F4A7C15ULL ^ (unsigned long long)seed;
+  if (randomState == 0)
+    randomState = 1;
+
+  genProgram();
+  return 0;
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Latency of an edit in kplc --lsp, on generated programs: a didChange, the
+# diagnostics it brings and a hover after it, which waits for them, in a
+# statement of a nested subroutine, in the main program and in the
+# declaration of a global variable.
+# Usage: bench/lsp.sh [edits]   (run from exam2/src after make kplc bench/kplgen)
+
+KPLC=${KPLC:-./kplc}
+EDITS=${1:-200}
+WORK=${TMPDIR:-/tmp}/kplc-lsp.$$
+URI=file:///bench.kpl
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+send() {
+  printf 'Content-Length: %d\r\n\r\n%s' "$(printf '%s' "$1" | wc -c)" "$1"
+}
+
+# A space typed at the start of line and taken away again, edits times,
+# each asked about: the edits would otherwise be checked together
+session() {
+  send '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{}}'
+  printf '{"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"%s","version":1,"text":"' "$URI" > "$WORK/open"
+  awk 'BEGIN { ORS = "" } { gsub(/\\/, "\\\\"); gsub(/"/, "\\\""); print $0 "\\n" }' "$PROGRAM" >> "$WORK/open"
+  printf '"}}}' >> "$WORK/open"
+  printf 'Content-Length: %d\r\n\r\n' "$(wc -c < "$WORK/open")"
+  cat "$WORK/open"
+  i=0
+  while [ $i -lt "$2" ]; do
+    if [ $((i % 2)) -eq 0 ]; then end=0; text=" "; else end=1; text=""; fi
+    send "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"$URI\"},\"contentChanges\":[{\"range\":{\"start\":{\"line\":$1,\"character\":0},\"end\":{\"line\":$1,\"character\":$end}},\"text\":\"$text\"}]}}"
+    send "{\"jsonrpc\":\"2.0\",\"id\":$((i + 3)),\"method\":\"textDocument/hover\",\"params\":{\"textDocument\":{\"uri\":\"$URI\"},\"position\":{\"line\":$1,\"character\":0}}}"
+    i=$((i + 1))
+  done
+  send '{"jsonrpc":"2.0","id":2,"method":"shutdown"}'
+  send '{"jsonrpc":"2.0","method":"exit"}'
+}
+
+elapsed() {
+  start=$(date +%s%N)
+  $KPLC --lsp < "$1" > /dev/null
+  end=$(date +%s%N)
+  echo $((end - start))
+}
+
+for LINES in 1000 10000 100000; do
+  PROGRAM=$WORK/$LINES.kpl
+  bench/kplgen -lines $LINES > "$PROGRAM"
+  nested=$(grep -n ' L0 := X + 0;' "$PROGRAM" | head -n 1 | cut -d: -f1)
+  main=$(($(wc -l < "$PROGRAM") - 2))
+  global=$(grep -n '^    G1 : INTEGER;' "$PROGRAM" | cut -d: -f1)
+
+  session 0 0 > "$WORK/opened"
+  opened=$(elapsed "$WORK/opened")
+  echo "$LINES lines"
+  echo "  open     $((opened / 1000)) us"
+  for place in nested main global; do
+    eval line=\$$place
+    session $((line - 1)) "$EDITS" > "$WORK/edited"
+    edited=$(elapsed "$WORK/edited")
+    printf "  %-8s mean %d us over %d edits\n" $place $(((edited - opened) / EDITS / 1000)) "$EDITS"
+  done
+done
@@ -0,0 +1,662 @@
+// Microbenchmarks of the scanner, token buffer, document and symbol table
+// hot paths.
+//
+//   micro [-w warmup] [-r repetitions] [-baseline file] [-record file] [filter]
+//
+// Every benchmark is calibrated during warmup so that one repetition takes
+// about a millisecond, then timed over the repetitions. The median and the
+// 99th percentile of the time per operation are reported, with the change
+// of the median against a baseline written earlier by -record. With
+// -counters the hardware counters of all repetitions are reported per
+// operation as well.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "alloc.h"
+#include "perfcount.h"
+#include "reader.h"
+#include "scanner.h"
+#include "symtab.h"
+#include "token.h"
+#include "tokenbuf.h"
+#include "lines.h"
+#include "document.h"
+
+#define MIN_REPETITION_NS 1000000LL
+#define MAX_BENCHMARKS 32
+#define EDITED_LINES 1000000
+#define CHECKED_PROCEDURES 1000
+
+extern __thread SymTab *symtab;
+
+Object *lookupObject(char *name);
+
+struct Benchmark_;
+
+typedef long long (*BenchFunction)(struct Benchmark_ *benchmark, long long iterations);
+
+typedef struct Benchmark_ {
+  char name[48];
+  BenchFunction run;   // returns the number of operations done
+  int size;
+  void *data;          // what the benchmark works on, built beforehand
+  void (*prepare)(struct Benchmark_ *benchmark);  // builds costly data, if run
+  double median;       // nanoseconds per operation
+  double p99;
+  CounterSample counters;  // over all repetitions
+  long long operations;
+} Benchmark;
+
+Benchmark benchmarks[MAX_BENCHMARKS];
+int benchmarkCount = 0;
+int countersEnabled = 0;
+
+volatile long long sink;
+
+long long nanoClock(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/******************************************************************/
+
+// A mix of everything the scanner reads, repeated to fill the buffer
+char *sampleLines =
+  "PROCEDURE Update(VAR Total : INTEGER; Step : INTEGER);\n"
+  "VAR Index : INTEGER; Table : ARRAY(. 16 .) OF CHAR;\n"
+  "BEGIN (* keep the running total *)\n"
+  "  FOR Index := 1 TO 16 DO Table(.Index.) := 'A';\n"
+  "  IF Total <= 1000 THEN Total := Total * Step + 17 - Index / 3\n"
+  "  ELSE WHILE Total != 0 DO Total := Total - 1;\n"
+  "  Total := SUM 1, Step, Total; CALL WRITEI(Total)\n"
+  "END;\n";
+
+char *sourceBuffer;
+size_t sourceSize;
+
+void makeSource(size_t size)
+{
+  size_t lineSize = strlen(sampleLines);
+
+  sourceBuffer = (char *)malloc(size + lineSize + 1);
+  sourceSize = 0;
+  while (sourceSize < size)
+  {
+    memcpy(sourceBuffer + sourceSize, sampleLines, lineSize);
+    sourceSize += lineSize;
+  }
+  sourceBuffer[sourceSize] = '\0';
+}
+
+// Tokens per pass over an in-memory buffer of size bytes
+long long benchGetToken(Benchmark *benchmark, long long iterations)
+{
+  long long tokens = 0;
+  long long i;
+  Token *token;
+  TokenType tokenType;
+
+  for (i = 0; i < iterations; i++)
+  {
+    openInput(fmemopen(sourceBuffer, benchmark->size, "r"));
+    do
+    {
+      token = getToken();
+      tokenType = token->tokenType;
+      RELEASE(token);
+      tokens++;
+      sink += tokenType;
+    } while (tokenType != TK_EOF);
+    closeInputStream();
+  }
+  return tokens;
+}
+
+// A whole buffer of size bytes lexed into a token buffer, per token
+long long benchTokenBuffer(Benchmark *benchmark, long long iterations)
+{
+  TokenBuffer *buffer;
+  long long tokens = 0;
+  long long i;
+
+  for (i = 0; i < iterations; i++)
+  {
+    buffer = createTokenBuffer(sourceBuffer, benchmark->size);
+    tokens += getTokenCount(buffer);
+    freeTokenBuffer(buffer);
+  }
+  return tokens;
+}
+
+// The newlines of a buffer of size bytes, per line
+long long benchIndexLines(Benchmark *benchmark, long long iterations)
+{
+  LineIndex *index;
+  long long lines = 0;
+  long long i;
+
+  for (i = 0; i < iterations; i++)
+  {
+    index = indexLines(sourceBuffer, benchmark->size);
+    lines += index->count;
+    freeLineIndex(index);
+  }
+  return lines;
+}
+
+// Edits of a buffer of EDITED_LINES lines, each put in and taken out again
+// at a cursor moved by stride bytes in between
+typedef struct {
+  TokenBuffer *buffer;
+  char *inserted;
+  int stride;
+  int cursor;
+} EditSession;
+
+TokenBuffer *editedBuffer;
+
+EditSession *makeEditSession(char *inserted, int stride)
+{
+  EditSession *session = (EditSession *)malloc(sizeof(EditSession));
+
+  session->buffer = NULL;
+  session->inserted = inserted;
+  session->stride = stride;
+  session->cursor = 0;
+  return session;
+}
+
+// The edited buffer takes seconds to lex, so only benchmarks run make it
+void prepareEditedBuffer(Benchmark *benchmark)
+{
+  EditSession *session = (EditSession *)benchmark->data;
+  int lineSize = strlen(sampleLines);
+  char *source;
+  int i;
+
+  if (editedBuffer == NULL)
+  {
+    source = (char *)malloc((size_t)lineSize * (EDITED_LINES / 8));
+    for (i = 0; i < EDITED_LINES / 8; i++)
+      memcpy(source + (size_t)i * lineSize, sampleLines, lineSize);
+    editedBuffer = createTokenBuffer(source, lineSize * (EDITED_LINES / 8));
+    free(source);
+  }
+  session->buffer = editedBuffer;
+}
+
+long long benchEdit(Benchmark *benchmark, long long iterations)
+{
+  EditSession *session = (EditSession *)benchmark->data;
+  int length = strlen(session->inserted);
+  TokenChange change;
+  long long i;
+
+  for (i = 0; i < iterations; i += 2)
+  {
+    session->cursor = (int)(((long long)session->cursor + session->stride) %
+                            getTextSize(session->buffer));
+    editTokenBuffer(session->buffer, session->cursor, 0, session->inserted, length, &change);
+    sink += change.inserted;
+    editTokenBuffer(session->buffer, session->cursor, length, "", 0, &change);
+    sink += change.inserted;
+  }
+  return i;
+}
+
+// A program of CHECKED_PROCEDURES procedures, edited at one byte that is
+// changed and changed back: in the body of a procedure, in the program's
+// body, or in a constant all of the procedures use
+typedef struct {
+  char *marker;   // the byte is the last of the marker's first occurrence
+  char spellings[2];
+  int offset;
+  Document *document;
+} CheckSession;
+
+char *checkedProcedure =
+  "PROCEDURE P%d(N : INTEGER);\n"
+  "VAR I : INTEGER;\n"
+  "BEGIN\n"
+  "  I := N + K;\n"
+  "  IF I > %d THEN G := G + I ELSE G := G - I\n"
+  "END;\n";
+
+Document *checkedDocument;
+
+CheckSession *makeCheckSession(char *marker, char first, char second)
+{
+  CheckSession *session = (CheckSession *)malloc(sizeof(CheckSession));
+
+  session->marker = marker;
+  session->spellings[0] = first;
+  session->spellings[1] = second;
+  session->document = NULL;
+  return session;
+}
+
+char *makeCheckedProgram(int *size)
+{
+  char *source = (char *)malloc(CHECKED_PROCEDURES * 128 + 256);
+  int i;
+
+  *size = sprintf(source, "PROGRAM CHECKED;\nCONST K = 3;\nVAR G : INTEGER;\n");
+  for (i = 0; i < CHECKED_PROCEDURES; i++)
+    *size += sprintf(source + *size, checkedProcedure, i, i);
+  *size += sprintf(source + *size, "BEGIN\n  G := 0;\n  CALL P1(1)\nEND.\n");
+  return source;
+}
+
+void prepareCheckedDocument(Benchmark *benchmark)
+{
+  CheckSession *session = (CheckSession *)benchmark->data;
+  char *source;
+  int size;
+
+  source = makeCheckedProgram(&size);
+  if (checkedDocument == NULL)
+  {
+    checkedDocument = openDocument(source, size);
+    checkDocument(checkedDocument);
+  }
+  session->document = checkedDocument;
+  session->offset = strstr(source, session->marker) - source + strlen(session->marker) - 1;
+  free(source);
+}
+
+long long benchCheckEdit(Benchmark *benchmark, long long iterations)
+{
+  CheckSession *session = (CheckSession *)benchmark->data;
+  char current;
+  long long i;
+
+  for (i = 0; i < iterations; i++)
+  {
+    copyText(session->document->tokens, session->offset, 1, &current);
+    editDocument(session->document, session->offset, 1,
+                 &session->spellings[current == session->spellings[0]], 1);
+    checkDocument(session->document);
+    sink += session->document->tokensChecked;
+  }
+  return i;
+}
+
+// The whole program checked when opened, per token
+long long benchCheckProgram(Benchmark *benchmark, long long iterations)
+{
+  Document *document;
+  char *source;
+  long long tokens = 0;
+  long long i;
+  int size;
+
+  source = makeCheckedProgram(&size);
+  for (i = 0; i < iterations; i++)
+  {
+    document = openDocument(source, size);
+    checkDocument(document);
+    tokens += document->tokensChecked;
+    closeDocument(document);
+  }
+  free(source);
+  return tokens;
+}
+
+char *keywordProbes[] = {
+  "BEGIN", "Total", "END", "INTEGER", "Index", "IF", "WHILE", "Step",
+  "UNTIL", "VAR", "PROCEDURE", "Table", "SUM", "X", "FUNCTION", "TO"
+};
+
+long long benchCheckKeyword(Benchmark *benchmark, long long iterations)
+{
+  int probes = sizeof(keywordProbes) / sizeof(keywordProbes[0]);
+  long long i;
+
+  for (i = 0; i < iterations; i++)
+    sink += checkKeyword(keywordProbes[i % probes]);
+  return iterations;
+}
+
+long long benchMakeToken(Benchmark *benchmark, long long iterations)
+{
+  Token *tokens[64];
+  long long i;
+  int j;
+
+  for (i = 0; i < iterations; i += 64)
+  {
+    for (j = 0; j < 64; j++)
+      tokens[j] = makeToken(TK_IDENT, j);
+    for (j = 0; j < 64; j++)
+      RELEASE(tokens[j]);
+  }
+  return i;
+}
+
+/******************************************************************/
+
+void declareVariables(char *prefix, int count)
+{
+  char name[32];
+  Object *obj;
+  int i;
+
+  for (i = 0; i < count; i++)
+  {
+    snprintf(name, sizeof(name), "%.8s%d", prefix, i);
+    obj = createVariableObject(name);
+    obj->varAttrs->type = makeIntType();
+    declareObject(obj);
+  }
+}
+
+Scope *enterProcedure(char *name)
+{
+  Object *proc = createProcedureObject(name);
+
+  declareObject(proc);
+  enterBlock(proc->procAttrs->scope);
+  return proc->procAttrs->scope;
+}
+
+// One scope of size variables, searched for each of them in turn
+long long benchFindObject(Benchmark *benchmark, long long iterations)
+{
+  char name[32];
+  Scope *scope = (Scope *)benchmark->data;
+  long long i;
+
+  for (i = 0; i < iterations; i++)
+  {
+    snprintf(name, sizeof(name), "V%lld", i % benchmark->size);
+    sink += (long long)(size_t)findObject(scope->objList, name);
+  }
+  return iterations;
+}
+
+// size nested scopes of 8 variables, looking up one of the outermost
+long long benchLookupObject(Benchmark *benchmark, long long iterations)
+{
+  long long i;
+
+  symtab->currentScope = (Scope *)benchmark->data;
+  for (i = 0; i < iterations; i++)
+    sink += (long long)(size_t)lookupObject((i & 1) ? "N0_3" : "WRITEI");
+  return iterations;
+}
+
+Scope *makeFlatScope(int size)
+{
+  char name[32];
+  Scope *programScope = symtab->currentScope;
+  Scope *scope;
+
+  snprintf(name, sizeof(name), "FLAT%d", size);
+  scope = enterProcedure(name);
+  declareVariables("V", size);
+  symtab->currentScope = programScope;
+  return scope;
+}
+
+Scope *makeNestedScopes(int size)
+{
+  char name[32];
+  Scope *programScope = symtab->currentScope;
+  Scope *scope;
+  int depth;
+
+  declareVariables("N0_", 8);
+  for (depth = 1; depth < size; depth++)
+  {
+    snprintf(name, sizeof(name), "NEST%d_%d", size, depth);
+    enterProcedure(name);
+    snprintf(name, sizeof(name), "N%d_", depth);
+    declareVariables(name, 8);
+  }
+  scope = symtab->currentScope;
+  symtab->currentScope = programScope;
+  return scope;
+}
+
+/******************************************************************/
+
+// Two equal types of size nested arrays, compared down to the element
+long long benchCompareType(Benchmark *benchmark, long long iterations)
+{
+  Type **types = (Type **)benchmark->data;
+  long long i;
+
+  for (i = 0; i < iterations; i++)
+    sink += compareType(types[0], types[1]);
+  return iterations;
+}
+
+Type **makeArrayTypes(int size)
+{
+  Type **types = (Type **)malloc(2 * sizeof(Type *));
+  int copy, depth;
+
+  for (copy = 0; copy < 2; copy++)
+  {
+    types[copy] = makeIntType();
+    for (depth = 0; depth < size; depth++)
+      types[copy] = makeArrayType(depth + 2, types[copy]);
+  }
+  return types;
+}
+
+/******************************************************************/
+
+Benchmark *addBenchmark(char *name, BenchFunction run, int size, void *data)
+{
+  Benchmark *benchmark = &benchmarks[benchmarkCount++];
+
+  if (size > 0)
+    snprintf(benchmark->name, sizeof(benchmark->name), "%s/%d", name, size);
+  else
+    snprintf(benchmark->name, sizeof(benchmark->name), "%s", name);
+  benchmark->run = run;
+  benchmark->size = size;
+  benchmark->data = data;
+  benchmark->prepare = NULL;
+  return benchmark;
+}
+
+int compareDouble(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+void measure(Benchmark *benchmark, int warmup, int repetitions)
+{
+  double *samples = (double *)malloc(repetitions * sizeof(double));
+  long long iterations = 1;
+  long long start, elapsed, operations;
+  CounterSample countersStart;
+  int i;
+
+  // double the iterations until a repetition is long enough to time
+  for (;;)
+  {
+    start = nanoClock();
+    benchmark->run(benchmark, iterations);
+    if (nanoClock() - start >= MIN_REPETITION_NS)
+      break;
+    iterations *= 2;
+  }
+  for (i = 0; i < warmup; i++)
+    benchmark->run(benchmark, iterations);
+
+  memset(&benchmark->counters, 0, sizeof(benchmark->counters));
+  benchmark->operations = 0;
+  if (countersEnabled)
+    readCounters(&countersStart);
+  for (i = 0; i < repetitions; i++)
+  {
+    start = nanoClock();
+    operations = benchmark->run(benchmark, iterations);
+    elapsed = nanoClock() - start;
+    samples[i] = (double)elapsed / operations;
+    benchmark->operations += operations;
+  }
+  if (countersEnabled)
+    addCounterDelta(&benchmark->counters, &countersStart);
+  qsort(samples, repetitions, sizeof(double), compareDouble);
+  benchmark->median = samples[repetitions / 2];
+  benchmark->p99 = samples[(repetitions * 99 + 99) / 100 - 1];
+  free(samples);
+}
+
+// Counts per operation; n/a where the processor lacks the counter
+void printCounters(FILE *report, Benchmark *benchmark)
+{
+  int counter;
+
+  for (counter = 0; counter < COUNTER_COUNT; counter++)
+  {
+    if (!counterSupported(counter))
+      fprintf(report, " %10s", "n/a");
+    else
+      fprintf(report, " %10.3f",
+              (double)benchmark->counters.values[counter] / benchmark->operations);
+    if (counter == COUNTER_CYCLES)
+      fprintf(report, " %6.2f", instructionsPerCycle(&benchmark->counters));
+  }
+}
+
+// The median of name in a file written by -record, or 0
+double baselineMedian(char *fileName, char *name)
+{
+  char line[256], recorded[64];
+  double median, found = 0;
+  FILE *f = (fileName != NULL) ? fopen(fileName, "r") : NULL;
+
+  if (f == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), f) != NULL)
+    if (sscanf(line, "%63s %lf", recorded, &median) == 2 && strcmp(recorded, name) == 0)
+      found = median;
+  fclose(f);
+  return found;
+}
+
+int main(int argc, char *argv[])
+{
+  char *baselineFile = NULL, *recordFile = NULL, *filter = NULL;
+  int warmup = 10, repetitions = 100;
+  FILE *report, *record = NULL;
+  double baseline;
+  int i;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+      warmup = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      repetitions = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc)
+      baselineFile = argv[++i];
+    else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+      recordFile = argv[++i];
+    else if (strcmp(argv[i], "-counters") == 0)
+      countersEnabled = 1;
+    else if (argv[i][0] != '-')
+      filter = argv[i];
+    else
+      break;
+  }
+  if (i < argc || repetitions < 1 || warmup < 0)
+  {
+    fprintf(stderr, "Usage: micro [-w warmup] [-r repetitions] [-baseline file] "
+            "[-record file] [-counters] [filter]\n");
+    return 1;
+  }
+
+  // the reader echoes what it reads; keep that off the report
+  fflush(stdout);
+  report = fdopen(dup(fileno(stdout)), "w");
+  if (freopen("/dev/null", "w", stdout) == NULL)
+    return 1;
+
+  if (countersEnabled && !(countersEnabled = openCounters()))
+    fprintf(stderr, "micro: hardware performance counters are unavailable\n");
+
+  makeSource(64 * 1024);
+  initSymTab();
+  enterBlock(createProgramObject("MICRO")->progAttrs->scope);
+  addBenchmark("getToken", benchGetToken, 1024, NULL);
+  addBenchmark("getToken", benchGetToken, 64 * 1024, NULL);
+  addBenchmark("tokenBuffer", benchTokenBuffer, 64 * 1024, NULL);
+  addBenchmark("indexLines", benchIndexLines, 64 * 1024, NULL);
+  // typing moves along a line or two; jumps go anywhere in the buffer
+  addBenchmark("editTyping", benchEdit, EDITED_LINES,
+               makeEditSession("X", 37))->prepare = prepareEditedBuffer;
+  addBenchmark("editJump", benchEdit, EDITED_LINES,
+               makeEditSession("X", 15485863))->prepare = prepareEditedBuffer;
+  addBenchmark("editComment", benchEdit, EDITED_LINES,
+               makeEditSession("(*", 37))->prepare = prepareEditedBuffer;
+  addBenchmark("checkProgram", benchCheckProgram, CHECKED_PROCEDURES, NULL);
+  addBenchmark("checkBody", benchCheckEdit, CHECKED_PROCEDURES,
+               makeCheckSession("P500(N : INTEGER);\nVAR I : INTEGER;\nBEGIN\n  I := N +", '+', '-'))
+    ->prepare = prepareCheckedDocument;
+  addBenchmark("checkMain", benchCheckEdit, CHECKED_PROCEDURES,
+               makeCheckSession("G := 0", '0', '1'))->prepare = prepareCheckedDocument;
+  addBenchmark("checkConstant", benchCheckEdit, CHECKED_PROCEDURES,
+               makeCheckSession("K = 3", '3', '4'))->prepare = prepareCheckedDocument;
+  addBenchmark("checkKeyword", benchCheckKeyword, 0, NULL);
+  addBenchmark("makeToken", benchMakeToken, 0, NULL);
+  addBenchmark("findObject", benchFindObject, 10, makeFlatScope(10));
+  addBenchmark("findObject", benchFindObject, 100, makeFlatScope(100));
+  addBenchmark("findObject", benchFindObject, 1000, makeFlatScope(1000));
+  addBenchmark("lookupObject", benchLookupObject, 1, makeNestedScopes(1));
+  addBenchmark("lookupObject", benchLookupObject, 4, makeNestedScopes(4));
+  addBenchmark("lookupObject", benchLookupObject, 16, makeNestedScopes(16));
+  addBenchmark("compareType", benchCompareType, 1, makeArrayTypes(1));
+  addBenchmark("compareType", benchCompareType, 4, makeArrayTypes(4));
+  addBenchmark("compareType", benchCompareType, 16, makeArrayTypes(16));
+
+  if (recordFile != NULL && (record = fopen(recordFile, "w")) == NULL)
+  {
+    fprintf(stderr, "Can\'t write %s\n", recordFile);
+    return 1;
+  }
+
+  fprintf(report, "%-24s %12s %12s", "benchmark", "median ns", "p99 ns");
+  if (countersEnabled)
+    fprintf(report, " %10s %6s %10s %10s", "cycles", "IPC", "br-misses", "c-misses");
+  fprintf(report, " %10s\n", "baseline");
+  for (i = 0; i < benchmarkCount; i++)
+  {
+    if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL)
+      continue;
+    if (benchmarks[i].prepare != NULL)
+      benchmarks[i].prepare(&benchmarks[i]);
+    measure(&benchmarks[i], warmup, repetitions);
+    fprintf(report, "%-24s %12.2f %12.2f", benchmarks[i].name,
+            benchmarks[i].median, benchmarks[i].p99);
+    if (countersEnabled)
+      printCounters(report, &benchmarks[i]);
+    baseline = baselineMedian(baselineFile, benchmarks[i].name);
+    if (baseline > 0)
+      fprintf(report, " %+9.1f%%", 100.0 * (benchmarks[i].median - baseline) / baseline);
+    fprintf(report, "\n");
+    fflush(report);
+    if (record != NULL)
+      fprintf(record, "%s %.3f %.3f\n", benchmarks[i].name,
+              benchmarks[i].median, benchmarks[i].p99);
+  }
+
+  if (record != NULL)
+    fclose(record);
+  closeCounters();
+  fclose(report);
+  return 0;
+}
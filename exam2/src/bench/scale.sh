@@ -0,0 +1,81 @@
+#!/bin/sh
+# Scaling benchmark: compile generated programs of growing size and record
+# scanner, front end and full compile throughput with the peak RSS.
+# Usage: bench/scale.sh [lines ...]   (run from exam2/src after make kplc bench/kplgen)
+#
+# Each run is appended to $HISTORY. A scale whose full compile throughput
+# drops, or whose peak RSS grows, by more than $TOLERANCE percent against
+# its previous entry is reported and makes the script fail.
+#
+# With COUNTERS=1 the compiler also reads the hardware counters, and their
+# IPC and misses per source line are shown for each phase.
+
+KPLC=./kplc
+KPLGEN=bench/kplgen
+SCALES=${*:-1000 100000 10000000}
+HISTORY=${HISTORY:-bench/history.tsv}
+TOLERANCE=${TOLERANCE:-20}
+WORK=${TMPDIR:-/tmp}/kplc-scale.$$
+FLAGS=--stats
+[ -n "$COUNTERS" ] && FLAGS=--counters
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+REVISION=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+DATE=$(date +%Y-%m-%dT%H:%M:%S)
+STATUS=0
+
+# a field of the --stats JSON
+stat() {
+  sed -n "s/.*\"$1\": { \"ns\": \([0-9]*\).*/\1/p; s/.*\"$1\": \([0-9]*\).*/\1/p" "$WORK/stats.json" | head -1
+}
+
+# IPC and misses per line of each phase that has counters
+counters() {
+  grep '"cycles"' "$WORK/stats.json" | awk -v lines="$1" '{
+    gsub(/[",:{}]/, " ")
+    for (i = 2; i < NF; i += 2) value[$i] = $(i + 1)
+    printf "  %-8s IPC %5.2f", $1, value["ipc"]
+    if ("branchMisses" in value) printf "  branch misses/line %8.2f", value["branchMisses"] / lines
+    if ("cacheMisses" in value) printf "  cache misses/line %8.2f", value["cacheMisses"] / lines
+    printf "\n"
+    delete value
+  }'
+}
+
+# lines per second over nanoseconds
+rate() {
+  awk "BEGIN { printf \"%.0f\", $1 / ($2 / 1e9) }"
+}
+
+printf "%-10s %14s %14s %14s %12s\n" "lines" "scan lines/s" "front lines/s" "full lines/s" "peak RSS KB"
+for LINES in $SCALES; do
+  $KPLGEN -seed 1 -lines "$LINES" > "$WORK/scale.kpl" || exit 1
+
+  # the compiler echoes its source, which is part of what it costs
+  start=$(date +%s%N)
+  $KPLC "$WORK/scale.kpl" $FLAGS -S -o "$WORK/scale.s" > /dev/null 2> "$WORK/stats.json" || exit 1
+  end=$(date +%s%N)
+
+  scan=$(rate "$LINES" "$(stat scan)")
+  front=$(rate "$LINES" "$(stat compile)")
+  full=$(rate "$LINES" $((end - start)))
+  rss=$(stat maxRssKb)
+  printf "%-10s %14s %14s %14s %12s\n" "$LINES" "$scan" "$front" "$full" "$rss"
+  [ -n "$COUNTERS" ] && counters "$LINES"
+
+  previous=$(awk -F'\t' -v lines="$LINES" '$3 == lines { row = $0 } END { print row }' "$HISTORY" 2>/dev/null)
+  if [ -n "$previous" ]; then
+    echo "$previous" | awk -F'\t' -v full="$full" -v rss="$rss" -v tolerance="$TOLERANCE" '{
+      if (full < $6 * (100 - tolerance) / 100)
+        { printf "  REGRESSION: full compile %d lines/s, was %d at %s\n", full, $6, $2; failed = 1 }
+      if (rss > $7 * (100 + tolerance) / 100)
+        { printf "  REGRESSION: peak RSS %d KB, was %d at %s\n", rss, $7, $2; failed = 1 }
+    } END { exit failed }' || STATUS=1
+  fi
+
+  printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\n" "$DATE" "$REVISION" "$LINES" "$scan" "$front" "$full" "$rss" >> "$HISTORY"
+done
+
+exit $STATUS
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Latency of the compile server against starting kplc for every compile.
+# Usage: bench/server.sh [requests]   (run from exam2/src after make kplc kplclient bench/kplgen)
+
+KPLC=${KPLC:-./kplc}
+REQUESTS=${1:-500}
+WORK=${TMPDIR:-/tmp}/kplc-server.$$
+SOCKET=$WORK/kplc.sock
+
+mkdir -p "$WORK"
+trap './kplclient -shutdown "$SOCKET" 2> /dev/null; rm -rf "$WORK"' EXIT
+
+bench/kplgen -lines 1000 > "$WORK/1000.kpl"
+bench/kplgen -lines 10000 > "$WORK/10000.kpl"
+
+$KPLC --server "$SOCKET" &
+tries=0
+until [ -S "$SOCKET" ] || [ $tries -ge 50 ]; do
+  sleep 0.1
+  tries=$((tries + 1))
+done
+
+for PROGRAM in tests/swap.kpl "$WORK/1000.kpl" "$WORK/10000.kpl"; do
+  echo "$(basename "$PROGRAM")"
+  printf "  server   "
+  ./kplclient -n "$REQUESTS" "$SOCKET" "$PROGRAM" || exit 1
+
+  # a new process for each compile, as an editor without the server does
+  start=$(date +%s%N)
+  i=0
+  while [ $i -lt 50 ]; do
+    $KPLC "$PROGRAM" > /dev/null
+    i=$((i + 1))
+  done
+  end=$(date +%s%N)
+  echo "  process  mean $(( (end - start) / 50000 )) us over 50 runs"
+done
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "dialect.h"
+#include "reader.h"
+#include "parser.h"
+#include "codegen.h"
+#include "error.h"
+#include "alloc.h"
+#include "stats.h"
+#include "cache.h"
+#include "unit.h"
+
+#define CACHE_MAGIC "KPLCACHE"
+#define CACHE_FORMAT 2
+#define CACHE_MAX_PATH 4096
+
+// Eviction lists the whole directory, so only about one write in
+// CACHE_EVICT_INTERVAL does it; the cache may outgrow its limit by as many
+// records in between. It trims to 90% of the limit, so the next few
+// scans find nothing to do.
+#define CACHE_EVICT_INTERVAL 32
+#define CACHE_EVICT_TARGET(limit) ((limit) / 10 * 9)
+// Temporary files this old were left by a kplc that died while writing
+#define CACHE_STALE_SECONDS 3600
+
+// Followed by reportSize bytes of errorReport, codeSize instructions, then
+// importCount CacheImport
+typedef struct {
+  char magic[8];
+  int format;
+  int instructionSize;  // sizeof(Instruction) of the kplc that wrote it
+  CacheKey key;
+  long long sourceSize;
+  long long echoed;     // bytes of source echoed before the result
+  int failed;           // the report holds the error printed, there is no code
+  int reportSize;
+  int codeSize;
+  int importCount;      // the interfaces of units the program read
+} CacheRecord;
+
+typedef struct {
+  char name[MAX_IDENT_LEN + 1];
+  CacheKey key;
+} CacheImport;
+
+typedef struct {
+  char name[40];
+  struct timespec used;
+  long long size;
+} CacheEntry;
+
+/******************* key ******************************/
+
+uint64_t mixWord(uint64_t hash, uint64_t word, uint64_t multiplier)
+{
+  hash ^= word * multiplier;
+  hash = (hash << 29) | (hash >> 35);
+  return hash * 0x9E3779B97F4A7C15ULL;
+}
+
+uint64_t finishHash(uint64_t hash)
+{
+  hash ^= hash >> 30;
+  hash *= 0xBF58476D1CE4E5B9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94D049BB133111EBULL;
+  return hash ^ (hash >> 31);
+}
+
+// Two lanes of a word at a time hash, 128 bits between them
+void mixBytes(CacheKey *key, char *bytes, long long size)
+{
+  uint64_t word;
+  long long i;
+
+  for (i = 0; i + 8 <= size; i += 8)
+  {
+    memcpy(&word, bytes + i, 8);
+    key->high = mixWord(key->high, word, 0xD6E8FEB86659FD93ULL);
+    key->low = mixWord(key->low, word, 0xA0761D6478BD642FULL);
+  }
+  word = 0;
+  memcpy(&word, bytes + i, size - i);
+  key->high = mixWord(key->high, word ^ (uint64_t)size, 0xD6E8FEB86659FD93ULL);
+  key->low = mixWord(key->low, word ^ (uint64_t)size, 0xA0761D6478BD642FULL);
+}
+
+// Anything that changes what kplc makes of a source belongs in its key
+void hashSource(char *source, long long size, CacheKey *key)
+{
+  char compiler[64];
+
+  snprintf(compiler, sizeof(compiler), "kplc %s format %d dialect %d instruction %d",
+           KPLC_VERSION, CACHE_FORMAT, DIALECT, (int)sizeof(Instruction));
+  key->high = 0x243F6A8885A308D3ULL;
+  key->low = 0x13198A2E03707344ULL;
+  mixBytes(key, compiler, strlen(compiler));
+  mixBytes(key, source, size);
+  key->high = finishHash(key->high);
+  key->low = finishHash(key->low);
+}
+
+void hashBytes(char *bytes, long long size, CacheKey *key)
+{
+  key->high = 0x243F6A8885A308D3ULL;
+  key->low = 0x13198A2E03707344ULL;
+  mixBytes(key, bytes, size);
+  key->high = finishHash(key->high);
+  key->low = finishHash(key->low);
+}
+
+/******************* records ******************************/
+
+char *readSource(char *fileName, long long *size)
+{
+  FILE *f = fopen(fileName, "rb");
+  char *source;
+  long length;
+
+  if (f == NULL)
+    return NULL;
+  if (fseek(f, 0, SEEK_END) != 0 || (length = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0)
+  {
+    fclose(f);
+    return NULL;
+  }
+  source = (char *)malloc(length + 1);
+  if (source != NULL && fread(source, 1, length, f) != (size_t)length)
+  {
+    free(source);
+    source = NULL;
+  }
+  fclose(f);
+  *size = length;
+  return source;
+}
+
+void recordPath(char *path, char *directory, CacheKey *key)
+{
+  snprintf(path, CACHE_MAX_PATH, "%s/%016llx%016llx", directory,
+           (unsigned long long)key->high, (unsigned long long)key->low);
+}
+
+int validRecord(CacheRecord *record, CacheKey *key, long long sourceSize)
+{
+  return memcmp(record->magic, CACHE_MAGIC, 8) == 0 &&
+         record->format == CACHE_FORMAT &&
+         record->instructionSize == (int)sizeof(Instruction) &&
+         record->key.high == key->high && record->key.low == key->low &&
+         record->sourceSize == sourceSize &&
+         record->echoed >= 0 && record->echoed <= sourceSize &&
+         record->reportSize >= 0 && record->reportSize < (int)sizeof(errorReport) &&
+         record->codeSize >= 0 && (!record->failed || record->codeSize == 0) &&
+         record->importCount >= 0;
+}
+
+// Whether the interfaces the record was compiled with are those there now
+int sameImports(FILE *f, int importCount)
+{
+  CacheImport import;
+  CacheKey key;
+  int i;
+
+  for (i = 0; i < importCount; i++)
+    if (fread(&import, sizeof(CacheImport), 1, f) != 1 ||
+        memchr(import.name, '\0', MAX_IDENT_LEN + 1) == NULL ||
+        !readInterfaceKey(import.name, &key) ||
+        key.high != import.key.high || key.low != import.key.low)
+      return 0;
+  return 1;
+}
+
+// Reads a record into errorReport and the code buffer; 0 when there is
+// none or it is damaged, leaving the code buffer empty
+int loadRecord(char *path, CacheKey *key, long long sourceSize, CacheRecord *record)
+{
+  CodeBlock *codeBlock = getCodeBuffer();
+  Instruction *code;
+  FILE *f = fopen(path, "rb");
+  int loaded = 0;
+
+  if (f == NULL)
+    return 0;
+  if (fread(record, sizeof(CacheRecord), 1, f) == 1 && validRecord(record, key, sourceSize) &&
+      fread(errorReport, 1, record->reportSize, f) == (size_t)record->reportSize)
+  {
+    errorReport[record->reportSize] = '\0';
+    if (record->codeSize > codeBlock->maxSize)
+    {
+      code = REALLOCATE_ARRAY(codeBlock->code, Instruction, record->codeSize, ALLOC_CODE);
+      if (code != NULL)
+      {
+        codeBlock->code = code;
+        codeBlock->maxSize = record->codeSize;
+      }
+    }
+    if (record->codeSize <= codeBlock->maxSize &&
+        fread(codeBlock->code, sizeof(Instruction), record->codeSize, f) == (size_t)record->codeSize &&
+        sameImports(f, record->importCount))
+    {
+      codeBlock->codeSize = record->codeSize;
+      loaded = 1;
+      // its modification time is when it was last used
+      futimens(fileno(f), NULL);
+    }
+  }
+  fclose(f);
+  return loaded;
+}
+
+int lookupRecord(char *directory, CacheKey *key, char *source, long long size,
+                 CacheRecord *record)
+{
+  char path[CACHE_MAX_PATH];
+  int found;
+
+  STATS_START(CACHE);
+  hashSource(source, size, key);
+  recordPath(path, directory, key);
+  found = loadRecord(path, key, size, record);
+  STATS_STOP(CACHE);
+  return found;
+}
+
+int compareEntryUse(const void *a, const void *b)
+{
+  const struct timespec *x = &((const CacheEntry *)a)->used;
+  const struct timespec *y = &((const CacheEntry *)b)->used;
+
+  if (x->tv_sec != y->tv_sec)
+    return (x->tv_sec > y->tv_sec) - (x->tv_sec < y->tv_sec);
+  return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// Removes the least recently used records until the rest fit the target
+void evictRecords(char *directory, long long limit)
+{
+  char path[CACHE_MAX_PATH];
+  CacheEntry *entries = NULL;
+  int count = 0, capacity = 0;
+  long long total = 0;
+  struct dirent *file;
+  struct stat status;
+  DIR *dir = opendir(directory);
+  int i;
+
+  if (dir == NULL)
+    return;
+  while ((file = readdir(dir)) != NULL)
+  {
+    snprintf(path, CACHE_MAX_PATH, "%s/%s", directory, file->d_name);
+    if (strncmp(file->d_name, ".tmp-", 5) == 0)
+    {
+      if (stat(path, &status) == 0 && time(NULL) - status.st_mtime > CACHE_STALE_SECONDS)
+        unlink(path);
+      continue;
+    }
+    if (strlen(file->d_name) != 32 || stat(path, &status) != 0 || !S_ISREG(status.st_mode))
+      continue;
+    if (count == capacity)
+    {
+      capacity = capacity ? 2 * capacity : 1024;
+      entries = (CacheEntry *)realloc(entries, capacity * sizeof(CacheEntry));
+    }
+    strcpy(entries[count].name, file->d_name);
+    entries[count].used = status.st_mtim;
+    entries[count].size = status.st_size;
+    total += status.st_size;
+    count++;
+  }
+  closedir(dir);
+
+  if (total > limit)
+  {
+    qsort(entries, count, sizeof(CacheEntry), compareEntryUse);
+    for (i = 0; i < count && total > CACHE_EVICT_TARGET(limit); i++)
+    {
+      snprintf(path, CACHE_MAX_PATH, "%s/%s", directory, entries[i].name);
+      if (unlink(path) == 0)
+        STATS_COUNT(cacheEvictions);
+      total -= entries[i].size;
+    }
+  }
+  free(entries);
+}
+
+int writeRecord(FILE *f, CacheRecord *record)
+{
+  CodeBlock *codeBlock = getCodeBuffer();
+  CacheImport import;
+  int i;
+
+  if (fwrite(record, sizeof(CacheRecord), 1, f) != 1 ||
+      fwrite(errorReport, 1, record->reportSize, f) != (size_t)record->reportSize ||
+      fwrite(codeBlock->code, sizeof(Instruction), record->codeSize, f) != (size_t)record->codeSize)
+    return 0;
+  for (i = 0; i < record->importCount; i++)
+  {
+    memset(&import, 0, sizeof(CacheImport));
+    getImport(i, import.name, &import.key);
+    if (fwrite(&import, sizeof(CacheImport), 1, f) != 1)
+      return 0;
+  }
+  return 1;
+}
+
+// Best effort: a cache that can't be written only costs the next compile
+void storeRecord(char *directory, CacheKey *key, long long size, long long echoed,
+                 int failed, long long limit)
+{
+  char path[CACHE_MAX_PATH], temporary[CACHE_MAX_PATH];
+  CacheRecord record;
+  FILE *f;
+  int fd, written;
+
+  STATS_START(CACHE);
+  memset(&record, 0, sizeof(record));
+  memcpy(record.magic, CACHE_MAGIC, 8);
+  record.format = CACHE_FORMAT;
+  record.instructionSize = sizeof(Instruction);
+  record.key = *key;
+  record.sourceSize = size;
+  record.echoed = echoed;
+  record.failed = failed;
+  record.reportSize = failed ? strlen(errorReport) : 0;
+  record.codeSize = failed ? 0 : getCodeBuffer()->codeSize;
+  record.importCount = getImportCount();
+
+  recordPath(path, directory, key);
+  snprintf(temporary, CACHE_MAX_PATH, "%s/.tmp-%ld-%016llx", directory, (long)getpid(),
+           (unsigned long long)key->low);
+  fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd >= 0 && (f = fdopen(fd, "wb")) != NULL)
+  {
+    written = writeRecord(f, &record);
+    if (fclose(f) == 0 && written && rename(temporary, path) == 0)
+    {
+      if (key->low % CACHE_EVICT_INTERVAL == 0)
+        evictRecords(directory, limit);
+    }
+    else
+      unlink(temporary);
+  }
+  else if (fd >= 0)
+  {
+    close(fd);
+    unlink(temporary);
+  }
+  STATS_STOP(CACHE);
+}
+
+/******************* compiling ******************************/
+
+int compileCached(char *fileName, char *directory, long long limit)
+{
+  CacheRecord record;
+  CacheKey key;
+  jmp_buf handler;
+  long long size, echoed;
+  int failed = 0;
+  char *source = readSource(fileName, &size);
+
+  if (source == NULL)
+    return IO_ERROR;
+  // fmemopen takes an int size; such a source is left to the plain compiler
+  if (size > INT_MAX)
+  {
+    free(source);
+    return compile(fileName);
+  }
+  mkdir(directory, 0777);
+
+  if (lookupRecord(directory, &key, source, size, &record))
+  {
+    STATS_COUNT(cacheHits);
+    if (echoInput)
+      fwrite(source, 1, record.echoed, stdout);
+    free(source);
+    if (record.failed)
+    {
+      printf("%s", errorReport);
+      exit(0);
+    }
+    return IO_SUCCESS;
+  }
+
+  STATS_COUNT(cacheMisses);
+  openInputBuffer(source, size);
+  errorHandler = &handler;
+  if (setjmp(handler) == 0)
+    compileInput();
+  else
+    failed = 1;
+  errorHandler = NULL;
+  echoed = inputPosition();
+  closeInputStream();
+
+  // a unit is compiled again each time for its interface
+  if (!compiledUnit())
+    storeRecord(directory, &key, size, echoed, failed, limit);
+  free(source);
+  if (failed)
+  {
+    printf("%s", errorReport);
+    exit(0);
+  }
+  cleanBuiltins();
+  return IO_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+// On-disk cache of compilations for --cache, a directory of records. A
+// record is named by a hash of the source bytes, the compiler version and
+// the dialect, and holds either the generated stack machine code or the
+// error kplc printed, with how much of the source it echoed first. A hit
+// replays them without scanning or parsing.
+//
+// Records are written to a temporary file and renamed into place, so
+// readers see a whole record or none and several kplc may share one
+// directory; a damaged record is a miss. A hit touches the record, and
+// when the records outgrow the limit the least recently used go first.
+//
+// A program using units (see unit.h) keeps in its record the hash of each
+// interface it read: when one of them has changed, the record is a miss.
+// Units themselves are compiled every time, for their interfaces.
+
+#include <stdint.h>
+
+#define KPLC_VERSION "1.0"
+#define CACHE_DEFAULT_LIMIT_MB 512
+
+typedef struct {
+  uint64_t high;
+  uint64_t low;
+} CacheKey;
+
+// The 128-bit hash of size bytes
+void hashBytes(char *bytes, long long size, CacheKey *key);
+
+// Compiles fileName into the code buffer through the cache in directory,
+// holding it to about limit bytes; IO_ERROR when the source can't be read.
+// A program with an error ends kplc, as compile() does.
+int compileCached(char *fileName, char *directory, long long limit);
+
+#endif
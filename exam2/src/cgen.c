@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "asmgen.h"
+#include "vm.h"
+#include "cgen.h"
+
+// C99 translation of the stack machine code.
+//
+// Every subroutine becomes a C function whose frame is a local array laid
+// out like a stack machine frame (fr[3] is the static link, parameters
+// from fr[4], then the local variables and arrays), so an inner subroutine
+// reaches the environment of an outer one through the chain of fr[3] links.
+// The operand stack has a fixed depth at every instruction, so each operand
+// slot becomes a C local s1, s2, ... that the C compiler keeps in registers.
+
+#define MAX_BASE_LEN 64
+
+#define NOT_VISITED -1
+
+// C frames take more room than the words the interpreter counts: the
+// program thread gets this many bytes of stack per counted word
+#define C_STACK_BYTES_PER_WORD 64
+
+struct Subroutine_ {
+  int frameSize;
+  int paramCount;
+  int isFunction;
+  int maxDepth;
+};
+
+typedef struct Subroutine_ Subroutine;
+
+char *runtimeSource =
+  "#define _POSIX_C_SOURCE 200809L\n"
+  "#include <pthread.h>\n"
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "\n"
+  "typedef long long WORD;\n"
+  "// arithmetic wraps around, as the constant folder does it\n"
+  "typedef unsigned long long UWORD;\n"
+  "\n"
+  "static WORD kpl_words;\n"
+  "\n"
+  "static void kpl_runtime_error(const char *message)\n"
+  "{\n"
+  "  fflush(stdout);\n"
+  "  fprintf(stderr, \"\\nRuntime error: %s.\\n\", message);\n"
+  "  exit(1);\n"
+  "}\n"
+  "\n"
+  "static WORD *kpl_base(WORD *fr, int level) { while (level-- > 0) fr = (WORD *)fr[3]; return fr; }\n"
+  "static void kpl_writei(WORD i) { printf(\"%lld\", i); }\n"
+  "static void kpl_writec(WORD ch) { putchar((unsigned char)ch); }\n"
+  "static void kpl_writeln(void) { putchar('\\n'); }\n"
+  "static WORD kpl_readi(void) { WORD i = 0; if (scanf(\"%lld\", &i) == EOF) kpl_runtime_error(\"unexpected end of input\"); return i; }\n"
+  "static WORD kpl_readc(void) { return getchar(); }\n"
+  "static WORD kpl_power(WORD b, WORD e)\n"
+  "{\n"
+  "  unsigned long long r = 1, f = (unsigned long long)b;\n"
+  "  if (e < 0) return b == 1 ? 1 : b == -1 ? ((e & 1) ? -1 : 1) : 0;\n"
+  "  for (; e > 0; e >>= 1) { if (e & 1) r *= f; f *= f; }\n"
+  "  return (WORD)r;\n"
+  "}\n"
+  "\n";
+
+// Operand stack effect of an instruction
+int stackEffect(Instruction *inst, Subroutine *subroutines)
+{
+  switch (inst->op)
+  {
+  case OP_LA:
+  case OP_LV:
+  case OP_LC:
+  case OP_CV:
+  case OP_RC:
+  case OP_RI:
+    return 1;
+  case OP_INT:
+    return inst->q;
+  case OP_DCT:
+    return -inst->q;
+  case OP_CALL:
+    return subroutines[inst->q].isFunction;
+  case OP_FJ:
+  case OP_STN:
+  case OP_WRC:
+  case OP_WRI:
+  case OP_AD:
+  case OP_SB:
+  case OP_ML:
+  case OP_DV:
+  case OP_PW:
+  case OP_AX:
+  case OP_EQ:
+  case OP_NE:
+  case OP_GT:
+  case OP_LT:
+  case OP_GE:
+  case OP_LE:
+    return -1;
+  case OP_ST:
+    return -2;
+  case OP_SUM:
+    return 1 - inst->q;
+  default:
+    return 0;
+  }
+}
+
+// First instruction of the body, after the jump over nested subroutines
+// and the INT that allocates the frame
+int bodyAddress(CodeBlock *codeBlock, int entry, Subroutine *subroutine)
+{
+  Instruction *code = codeBlock->code;
+  int start = entry;
+
+  if (code[start].op == OP_J)
+    start = code[start].q;
+  subroutine->frameSize = RESERVED_WORDS;
+  if (code[start].op == OP_INT)
+  {
+    subroutine->frameSize = code[start].q;
+    start++;
+  }
+  return start;
+}
+
+// Follow the control flow of one subroutine, recording which instructions
+// it owns and the operand depth before each of them
+void walkSubroutine(CodeBlock *codeBlock, int entry, Subroutine *subroutines,
+                    int *owner, int *depth, char *isLabel)
+{
+  Instruction *code = codeBlock->code;
+  Subroutine *subroutine = subroutines + entry;
+  int *workList = (int *)malloc(2 * (codeBlock->codeSize + 1) * sizeof(int));
+  int workSize = 0;
+  int i, d;
+
+  workList[workSize++] = bodyAddress(codeBlock, entry, subroutine);
+  workList[workSize++] = 0;
+
+  while (workSize > 0)
+  {
+    d = workList[--workSize];
+    i = workList[--workSize];
+
+    while (i < codeBlock->codeSize && owner[i] != entry)
+    {
+      owner[i] = entry;
+      depth[i] = d;
+
+      if (code[i].op == OP_EF)
+        subroutine->isFunction = 1;
+      if (code[i].op == OP_HL || code[i].op == OP_EP || code[i].op == OP_EF)
+        break;
+
+      d += stackEffect(code + i, subroutines);
+      if (d > subroutine->maxDepth)
+        subroutine->maxDepth = d;
+
+      if (code[i].op == OP_J)
+      {
+        isLabel[code[i].q] = 1;
+        i = code[i].q;
+        continue;
+      }
+      if (code[i].op == OP_FJ)
+      {
+        isLabel[code[i].q] = 1;
+        workList[workSize++] = code[i].q;
+        workList[workSize++] = d;
+      }
+      i++;
+    }
+  }
+  free(workList);
+}
+
+// Expression for the frame `level` static links away
+void formatBase(char *buffer, WORD level)
+{
+  if (level == 0)
+    strcpy(buffer, "fr");
+  else
+    snprintf(buffer, MAX_BASE_LEN, "kpl_base(fr, %lld)", level);
+}
+
+void genCompareC(FILE *out, int d, char *op)
+{
+  fprintf(out, "  s%d = (s%d %s s%d);\n", d - 1, d - 1, op, d);
+}
+
+void genCInstruction(FILE *out, CodeBlock *codeBlock, int i, int d, Subroutine *subroutines)
+{
+  Instruction *inst = codeBlock->code + i;
+  char base[MAX_BASE_LEN];
+  int callee, k;
+
+  switch (inst->op)
+  {
+  case OP_LA:
+    formatBase(base, inst->p);
+    fprintf(out, "  s%d = (WORD)(%s + %lld);\n", d + 1, base, inst->q);
+    break;
+  case OP_LV:
+    formatBase(base, inst->p);
+    fprintf(out, "  s%d = %s[%lld];\n", d + 1, base, inst->q);
+    break;
+  case OP_LC:
+    fprintf(out, "  s%d = %lldLL;\n", d + 1, inst->q);
+    break;
+  case OP_LI:
+    fprintf(out, "  s%d = *(WORD *)s%d;\n", d, d);
+    break;
+  case OP_J:
+    fprintf(out, "  goto L%lld;\n", inst->q);
+    break;
+  case OP_FJ:
+    fprintf(out, "  if (s%d == 0) goto L%lld;\n", d, inst->q);
+    break;
+  case OP_HL:
+  case OP_EP:
+    fprintf(out, "  kpl_words -= sizeof fr / sizeof fr[0];\n");
+    fprintf(out, "  return 0;\n");
+    break;
+  case OP_EF:
+    fprintf(out, "  kpl_words -= sizeof fr / sizeof fr[0];\n");
+    fprintf(out, "  return fr[0];\n");
+    break;
+  case OP_ST:
+    fprintf(out, "  *(WORD *)s%d = s%d;\n", d - 1, d);
+    break;
+  case OP_STN:
+    fprintf(out, "  *(WORD *)s%d = s%d;\n", d - (int)inst->q, d);
+    break;
+  case OP_CALL:
+    // the arguments are still in the slots above the reserved words
+    callee = inst->q;
+    formatBase(base, inst->p);
+    if (subroutines[callee].isFunction)
+      fprintf(out, "  s%d = kpl_%d(%s, ", d + 1, callee, base);
+    else
+      fprintf(out, "  kpl_%d(%s, ", callee, base);
+    if (subroutines[callee].paramCount == 0)
+      fprintf(out, "NULL");
+    else
+    {
+      fprintf(out, "(WORD[]){");
+      for (k = 0; k < subroutines[callee].paramCount; k++)
+        fprintf(out, "%ss%d", k > 0 ? ", " : "", d + RESERVED_WORDS + 1 + k);
+      fprintf(out, "}");
+    }
+    fprintf(out, ");\n");
+    break;
+  case OP_RC:
+    fprintf(out, "  s%d = kpl_readc();\n", d + 1);
+    break;
+  case OP_RI:
+    fprintf(out, "  s%d = kpl_readi();\n", d + 1);
+    break;
+  case OP_WRC:
+    fprintf(out, "  kpl_writec(s%d);\n", d);
+    break;
+  case OP_WRI:
+    fprintf(out, "  kpl_writei(s%d);\n", d);
+    break;
+  case OP_WLN:
+    fprintf(out, "  kpl_writeln();\n");
+    break;
+  case OP_AD:
+    fprintf(out, "  s%d = (WORD)((UWORD)s%d + (UWORD)s%d);\n", d - 1, d - 1, d);
+    break;
+  case OP_SB:
+    fprintf(out, "  s%d = (WORD)((UWORD)s%d - (UWORD)s%d);\n", d - 1, d - 1, d);
+    break;
+  case OP_ML:
+    fprintf(out, "  s%d = (WORD)((UWORD)s%d * (UWORD)s%d);\n", d - 1, d - 1, d);
+    break;
+  case OP_DV:
+    fprintf(out, "  if (s%d == 0) kpl_runtime_error(\"divide by zero\");\n", d);
+    fprintf(out, "  s%d = (s%d == -1) ? (WORD)(0 - (UWORD)s%d) : s%d / s%d;\n", d - 1, d, d - 1, d - 1, d);
+    break;
+  case OP_PW:
+    fprintf(out, "  s%d = kpl_power(s%d, s%d);\n", d - 1, d - 1, d);
+    break;
+  case OP_SUM:
+    fprintf(out, "  s%d = (WORD)((UWORD)s%d", d - (int)inst->q + 1, d - (int)inst->q + 1);
+    for (k = d - (int)inst->q + 2; k <= d; k++)
+      fprintf(out, " + (UWORD)s%d", k);
+    fprintf(out, ");\n");
+    break;
+  case OP_NEG:
+    fprintf(out, "  s%d = (WORD)(0 - (UWORD)s%d);\n", d, d);
+    break;
+  case OP_CV:
+    fprintf(out, "  s%d = s%d;\n", d + 1, d);
+    break;
+  case OP_AX:
+    fprintf(out, "  s%d = (WORD)((WORD *)s%d + s%d);\n", d - 1, d - 1, d);
+    break;
+  case OP_EQ:
+    genCompareC(out, d, "==");
+    break;
+  case OP_NE:
+    genCompareC(out, d, "!=");
+    break;
+  case OP_GT:
+    genCompareC(out, d, ">");
+    break;
+  case OP_LT:
+    genCompareC(out, d, "<");
+    break;
+  case OP_GE:
+    genCompareC(out, d, ">=");
+    break;
+  case OP_LE:
+    genCompareC(out, d, "<=");
+    break;
+  case OP_INT:
+  case OP_DCT:
+  case OP_BP:
+  default:
+    break;
+  }
+}
+
+void genCFunction(FILE *out, CodeBlock *codeBlock, int entry, Subroutine *subroutines,
+                  int *owner, int *depth, char *isLabel)
+{
+  Subroutine *subroutine = subroutines + entry;
+  int body = bodyAddress(codeBlock, entry, subroutine);
+  int i;
+
+  fprintf(out, "static WORD kpl_%d(WORD *sl, WORD *args)\n{\n", entry);
+  fprintf(out, "  WORD fr[%d];\n", subroutine->frameSize);
+  for (i = 1; i <= subroutine->maxDepth; i++)
+    fprintf(out, "  WORD s%d;\n", i);
+  // frames overflow where the interpreter's stack would
+  fprintf(out, "  if ((kpl_words += %d) > %d) kpl_runtime_error(\"stack overflow\");\n",
+          subroutine->frameSize, STACK_SIZE - STACK_MARGIN);
+  fprintf(out, "  fr[3] = (WORD)sl;\n");
+  for (i = 0; i < subroutine->paramCount; i++)
+    fprintf(out, "  fr[%d] = args[%d];\n", RESERVED_WORDS + i, i);
+
+  for (i = body; i < codeBlock->codeSize; i++)
+  {
+    if (owner[i] != entry)
+      continue;
+    if (isLabel[i])
+      fprintf(out, "L%d:;\n", i);
+    genCInstruction(out, codeBlock, i, depth[i], subroutines);
+  }
+  fprintf(out, "}\n\n");
+}
+
+void genCSource(CodeBlock *codeBlock, FILE *out)
+{
+  Instruction *code = codeBlock->code;
+  int size = codeBlock->codeSize;
+  Subroutine *subroutines = (Subroutine *)calloc(size + 1, sizeof(Subroutine));
+  char *isEntry = (char *)calloc(size + 1, sizeof(char));
+  char *isLabel = (char *)calloc(size + 1, sizeof(char));
+  int *owner = (int *)malloc((size + 1) * sizeof(int));
+  int *depth = (int *)malloc((size + 1) * sizeof(int));
+  int i;
+
+  // Subroutine entries and their parameter counts, from the DCT before each CALL
+  isEntry[0] = 1;
+  for (i = 0; i < size; i++)
+    if (code[i].op == OP_CALL)
+    {
+      isEntry[code[i].q] = 1;
+      if (i > 0 && code[i - 1].op == OP_DCT)
+        subroutines[code[i].q].paramCount = code[i - 1].q - RESERVED_WORDS;
+    }
+
+  // A first walk finds functions, the second one computes operand depths
+  for (i = 0; i <= size; i++)
+    owner[i] = NOT_VISITED;
+  for (i = 0; i < size; i++)
+    if (isEntry[i])
+      walkSubroutine(codeBlock, i, subroutines, owner, depth, isLabel);
+  for (i = 0; i <= size; i++)
+    owner[i] = NOT_VISITED;
+  for (i = 0; i < size; i++)
+    if (isEntry[i])
+    {
+      subroutines[i].maxDepth = 0;
+      walkSubroutine(codeBlock, i, subroutines, owner, depth, isLabel);
+    }
+
+  fputs(runtimeSource, out);
+  for (i = 0; i < size; i++)
+    if (isEntry[i])
+      fprintf(out, "static WORD kpl_%d(WORD *sl, WORD *args);\n", i);
+  fprintf(out, "\n");
+
+  for (i = 0; i < size; i++)
+    if (isEntry[i])
+      genCFunction(out, codeBlock, i, subroutines, owner, depth, isLabel);
+
+  fprintf(out, "static void *kpl_main(void *unused)\n{\n  kpl_0(NULL, NULL);\n  return unused;\n}\n\n");
+  fprintf(out, "int main(void)\n{\n");
+  fprintf(out, "  pthread_t thread;\n");
+  fprintf(out, "  pthread_attr_t attributes;\n\n");
+  fprintf(out, "  pthread_attr_init(&attributes);\n");
+  fprintf(out, "  pthread_attr_setstacksize(&attributes, %dUL);\n", STACK_SIZE * C_STACK_BYTES_PER_WORD);
+  fprintf(out, "  if (pthread_create(&thread, &attributes, kpl_main, NULL) != 0)\n");
+  fprintf(out, "    kpl_runtime_error(\"stack overflow\");\n");
+  fprintf(out, "  pthread_join(thread, NULL);\n");
+  fprintf(out, "  return 0;\n}\n");
+
+  free(subroutines);
+  free(isEntry);
+  free(isLabel);
+  free(owner);
+  free(depth);
+}
+
+int saveCSource(CodeBlock *codeBlock, char *fileName)
+{
+  FILE *out = fopen(fileName, "w");
+
+  if (out == NULL)
+    return CGEN_ERROR;
+  genCSource(codeBlock, out);
+  fclose(out);
+  return CGEN_SUCCESS;
+}
+
+// Compile the emitted C with the system C compiler
+int buildCExecutable(char *cFileName, char *exeFileName)
+{
+  char *argv[] = { "cc", "-O2", "-std=c99", "-pthread", "-o", exeFileName, cFileName, NULL };
+
+  return (runCommand(argv) == ASM_SUCCESS) ? CGEN_SUCCESS : CGEN_ERROR;
+}
@@ -0,0 +1,14 @@
+#ifndef __CGEN_H__
+#define __CGEN_H__
+
+#include <stdio.h>
+#include "instructions.h"
+
+#define CGEN_SUCCESS 1
+#define CGEN_ERROR 0
+
+void genCSource(CodeBlock* codeBlock, FILE* out);
+int saveCSource(CodeBlock* codeBlock, char* fileName);
+int buildCExecutable(char* cFileName, char* exeFileName);
+
+#endif
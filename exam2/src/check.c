@@ -0,0 +1,403 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include "reader.h"
+#include "scanner.h"
+#include "parser.h"
+#include "codegen.h"
+#include "tokenbuf.h"
+#include "alloc.h"
+#include "error.h"
+#include "stats.h"
+#include "trace.h"
+#include "unit.h"
+#include "check.h"
+
+extern __thread SymTab *symtab;
+extern __thread CodeBlock *codeBlock;
+extern __thread Token *currentToken;
+extern __thread Token *lookAhead;
+
+char *readSource(char *fileName, long long *size);
+void raiseError(void) __attribute__((noreturn));
+
+enum {
+  BLOCK_UNCHECKED,
+  BLOCK_ENDED,     // at the END skipping found
+  BLOCK_FAILED,
+  BLOCK_MOVED      // somewhere else
+};
+
+// A block the first pass skipped, and what its check found
+typedef struct {
+  Object *owner;       // the subroutine
+  ObjectNode *node;    // its node in the program's scope
+  int first;           // the first token of the block
+  int end;             // the END closing it
+  int outcome;
+  ErrorCode lastError;
+  char errorMessage[MAX_ERROR_MESSAGE];
+  char errorReport[MAX_ERROR_MESSAGE + 2];
+} Block;
+
+typedef struct {
+  int index;           // 0 for the calling thread
+  pthread_t thread;
+#ifdef KPL_STATS
+  Statistics statistics;
+#endif
+} Worker;
+
+TokenBuffer *tokens;
+int tokenCount;
+LineIndex *tokenLines;     // made before the threads start, as they share it
+SymTab *programSymTab;     // of the first pass, which the threads copy
+
+Block *blocks = NULL;
+int blockCount = 0;
+int blockCapacity = 0;
+int nextBlock;             // the next one for a thread to take
+volatile int firstStopped; // the first one that failed or moved so far:
+                           // those after it can't be the one reported
+
+int routineDepth;          // of the first pass: 1 in the program's header
+__thread int checkCursor;  // the next token of the thread's parse
+
+/******************* tokens ******************************/
+
+Token *copyToken(int index)
+{
+  LexedToken lexed;
+  Token *token = ALLOCATE(Token, ALLOC_TOKEN);
+
+  getLexedToken(tokens, (index < tokenCount) ? index : tokenCount - 1, &lexed);
+  *token = lexed.token;
+  return token;
+}
+
+// The tokenSource of the checks: the errors of the scanner come up as the
+// parser reaches them, as they would from getValidToken
+Token *nextCheckedToken(void)
+{
+  Token *token = copyToken(checkCursor++);
+
+  if (token->tokenType == TK_NONE)
+    error(token->value, token->offset);
+  return token;
+}
+
+TokenType tokenTypeAt(int index)
+{
+  LexedToken lexed;
+
+  getLexedToken(tokens, (index < tokenCount) ? index : tokenCount - 1, &lexed);
+  return lexed.token.tokenType;
+}
+
+// The END closing the block from token first, passing over the blocks of
+// the subroutines declared in it; -1 when the tokens end before
+int findBlockEnd(int token)
+{
+  TokenType type;
+  int parentheses, depth;
+
+  for (;;)
+  {
+    type = tokenTypeAt(token);
+    if (type == TK_EOF)
+      return -1;
+    if (type == KW_FUNCTION || type == KW_PROCEDURE)
+    {
+      // the header ends at the first semicolon outside of its parameters
+      parentheses = 0;
+      while ((type = tokenTypeAt(++token)) != SB_SEMICOLON || parentheses > 0)
+        if (type == TK_EOF)
+          return -1;
+        else if (type == SB_LPAR)
+          parentheses++;
+        else if (type == SB_RPAR)
+          parentheses--;
+      if ((token = findBlockEnd(token + 1)) < 0)
+        return -1;
+    }
+    else if (type == KW_BEGIN)
+    {
+      for (depth = 0;; token++)
+        if ((type = tokenTypeAt(token)) == TK_EOF)
+          return -1;
+        else if (type == KW_BEGIN)
+          depth++;
+        else if (type == KW_END && --depth == 0)
+          return token;
+    }
+    token++;
+  }
+}
+
+/******************* the first pass ******************************/
+
+int parseRoutine(void)
+{
+  return 0;
+}
+
+void countRoutine(Object *obj)
+{
+  routineDepth++;
+}
+
+void passBlock(void)
+{
+}
+
+// Leaves the block of a subroutine at the top of the program to the
+// threads, the parser then as if it had read up to its END
+int skipTopBlock(void)
+{
+  ObjectNode *node;
+  Block *block;
+  int end;
+
+  if (routineDepth != 2 || (end = findBlockEnd(checkCursor - 1)) < 0)
+    return 0;
+  if (blockCount == blockCapacity)
+  {
+    blockCapacity = (blockCapacity == 0) ? 256 : 2 * blockCapacity;
+    blocks = (Block *)realloc(blocks, blockCapacity * sizeof(Block));
+  }
+  block = &blocks[blockCount++];
+  block->owner = symtab->currentScope->owner;
+  for (node = symtab->program->progAttrs->scope->objList; node->next != NULL; node = node->next)
+    ;
+  block->node = node;
+  block->first = checkCursor - 1;
+  block->end = end;
+  block->outcome = BLOCK_UNCHECKED;
+
+  RELEASE(currentToken);
+  RELEASE(lookAhead);
+  currentToken = lookAhead = copyToken(end);
+  checkCursor = end + 1;
+  lookAhead = nextCheckedToken();
+  return 1;
+}
+
+void uncountRoutine(void)
+{
+  routineDepth--;
+}
+
+void ignoreResolved(char *name, Object *obj, int levels)
+{
+}
+
+void ignoreDeclared(void)
+{
+}
+
+ParserHooks firstPassHooks = { parseRoutine, countRoutine, passBlock, skipTopBlock,
+                               uncountRoutine, ignoreResolved, ignoreDeclared };
+
+// Runs parse from token first with the parser of the calling thread; 0
+// when error() stopped it
+int parseFrom(int first, void (*parse)(void), ParserHooks *hooks)
+{
+  jmp_buf handler;
+  jmp_buf *outerHandler = errorHandler;
+  LineIndex *outerLines = sourceLines;
+  volatile int parsed = 0;
+
+  tokenSource = nextCheckedToken;
+  sourceLines = tokenLines;
+  parserHooks = hooks;
+  resetParser();
+  checkCursor = first;
+
+  errorHandler = &handler;
+  if (setjmp(handler) == 0)
+  {
+    lookAhead = nextCheckedToken();
+    parse();
+    parsed = 1;
+  }
+  errorHandler = outerHandler;
+  sourceLines = outerLines;
+
+  resetParser();
+  parserHooks = NULL;
+  tokenSource = getValidToken;
+  return parsed;
+}
+
+/******************* the threads ******************************/
+
+void checkSkipped(Block *block)
+{
+  Object *owner = block->owner;
+
+  symtab->currentScope = (owner->kind == OBJ_FUNCTION) ? owner->funcAttrs->scope
+                                                        : owner->procAttrs->scope;
+  symtab->partialScope = symtab->program->progAttrs->scope;
+  symtab->partialEnd = block->node->next;
+  if (!parseFrom(block->first, compileBlock, NULL))
+  {
+    block->outcome = BLOCK_FAILED;
+    block->lastError = lastError;
+    strcpy(block->errorMessage, errorMessage);
+    strcpy(block->errorReport, errorReport);
+  }
+  else
+    block->outcome = (checkCursor - 2 == block->end) ? BLOCK_ENDED : BLOCK_MOVED;
+}
+
+void *checkBlocks(void *argument)
+{
+#ifdef KPL_STATS
+  Worker *worker = (Worker *)argument;
+#endif
+  SymTab *outerSymTab = symtab;
+  CodeBlock *outerCode = codeBlock;
+  SymTab own = *programSymTab;
+  int i, stopped;
+
+#ifdef KPL_STATS
+  if (worker->index > 0)
+    setTraceThread(worker->index);
+#endif
+  symtab = &own;
+  initCodeBuffer();
+  while ((i = __sync_fetch_and_add(&nextBlock, 1)) < firstStopped)
+  {
+    checkSkipped(&blocks[i]);
+    if (blocks[i].outcome != BLOCK_ENDED)
+      while ((stopped = firstStopped) > i && !__sync_bool_compare_and_swap(&firstStopped, stopped, i))
+        ;
+  }
+  cleanCodeBuffer();
+  codeBlock = outerCode;
+  symtab = outerSymTab;
+#ifdef KPL_STATS
+  if (worker->index > 0)
+    worker->statistics = statistics;
+#endif
+  return NULL;
+}
+
+void runThreads(int threadCount)
+{
+  Worker workers[CHECK_MAX_THREADS];
+  int i;
+
+  nextBlock = 0;
+  firstStopped = blockCount;
+  // the profiling and arena allocators are for one thread
+  if (allocator != &mallocAllocator || threadCount > blockCount)
+    threadCount = (allocator == &mallocAllocator) ? blockCount : 1;
+  if (threadCount > CHECK_MAX_THREADS)
+    threadCount = CHECK_MAX_THREADS;
+  if (threadCount < 1)
+    threadCount = 1;
+
+  for (i = 0; i < threadCount; i++)
+    workers[i].index = i;
+  for (i = 1; i < threadCount; i++)
+    if (pthread_create(&workers[i].thread, NULL, checkBlocks, &workers[i]) != 0)
+    {
+      threadCount = i;
+      break;
+    }
+  STATS_ADD(checkThreads, threadCount);
+  checkBlocks(&workers[0]);
+  for (i = 1; i < threadCount; i++)
+  {
+    pthread_join(workers[i].thread, NULL);
+#ifdef KPL_STATS
+    addStatistics(&workers[i].statistics);
+#endif
+  }
+}
+
+/******************* checks ******************************/
+
+void beginCheck(void)
+{
+  initSymTab();
+  resetUnits();
+  initCodeBuffer();
+}
+
+void endCheck(void)
+{
+  cleanSymTab();
+  cleanCodeBuffer();
+}
+
+int checkFile(char *fileName, int threadCount)
+{
+  char message[MAX_ERROR_MESSAGE], report[MAX_ERROR_MESSAGE + 2];
+  ErrorCode code = lastError;
+  CodeBlock *outerCode = codeBlock;
+  long long size;
+  char *source = readSource(fileName, &size);
+  Block *stopped = NULL;
+  int passed, i;
+
+  if (source == NULL)
+    return IO_ERROR;
+  STATS_START(COMPILE);
+  tokens = createChunkedTokenBuffer(source, (int)size, threadCount, LEX_CHUNK_SIZE);
+  tokenCount = getTokenCount(tokens);
+  tokenLines = getLineIndex(tokens);
+  free(source);
+
+  beginCheck();
+  programSymTab = symtab;
+  blockCount = 0;
+  routineDepth = 0;
+  passed = parseFrom(0, compileProgram, &firstPassHooks);
+  // the calling thread's checks overwrite it
+  code = lastError;
+  strcpy(message, errorMessage);
+  strcpy(report, errorReport);
+
+  runThreads(threadCount);
+  for (i = 0; i < blockCount && stopped == NULL; i++)
+    if (blocks[i].outcome != BLOCK_ENDED)
+      stopped = &blocks[i];
+  STATS_ADD(checkBlocks, blockCount);
+
+  if (stopped != NULL && stopped->outcome == BLOCK_MOVED)
+  {
+    STATS_COUNT(checkOnePass);
+    endCheck();
+    beginCheck();
+    passed = parseFrom(0, compileProgram, NULL);
+    code = lastError;
+    strcpy(message, errorMessage);
+    strcpy(report, errorReport);
+  }
+  else if (stopped != NULL)
+  {
+    passed = 0;
+    code = stopped->lastError;
+    strcpy(message, stopped->errorMessage);
+    strcpy(report, stopped->errorReport);
+  }
+
+  endCheck();
+  codeBlock = outerCode;
+  freeTokenBuffer(tokens);
+  cleanBuiltins();
+  STATS_STOP(COMPILE);
+
+  if (!passed)
+  {
+    lastError = code;
+    strcpy(errorMessage, message);
+    strcpy(errorReport, report);
+    raiseError();
+  }
+  return IO_SUCCESS;
+}
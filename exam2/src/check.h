@@ -0,0 +1,35 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+// kplc --check: the error of a program, without its code, with the blocks
+// of its subroutines checked on several threads.
+//
+// A first pass parses the program from a TokenBuffer as kplc would, but
+// for the block of each subroutine declared at the top of the program:
+// from its first token it skips to the END closing it, passing over the
+// blocks of the subroutines nested in it, and goes on after the header of
+// the next one. The threads then take the blocks skipped in turn, each
+// parsed in the scope its header made, seeing of the program's objects
+// only those declared before it. Every thread has its own parser, symbol
+// table and code buffer (their globals are per thread); the objects of
+// the first pass are shared and only read, but for the locals the
+// threads declare in the scope of their own subroutine.
+//
+// The error is the one kplc would stop at: that of the first block, in
+// the text, to fail, else that of the first pass. A block whose parse
+// ends before or after the END found by skipping, which only a malformed
+// program brings, makes the whole program be checked again in one pass.
+//
+// Only programs are checked: a unit would have its interface written.
+
+#define CHECK_MAX_THREADS 64
+
+// A source of several LEX_CHUNK_SIZE bytes is lexed in chunks on as many
+// threads first (see createChunkedTokenBuffer).
+
+// Checks fileName with threadCount threads, 1 for none besides the one
+// calling: IO_ERROR when it can't be read. An error is raised with
+// error(), on the calling thread.
+int checkFile(char *fileName, int threadCount);
+
+#endif
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "codegen.h"
+#include "unit.h"
+
+extern __thread SymTab *symtab;
+
+extern Object *readiFunction;
+extern Object *readcFunction;
+extern Object *writeiProcedure;
+extern Object *writecProcedure;
+extern Object *writelnProcedure;
+
+__thread CodeBlock *codeBlock;
+
+// Code before this address may be a jump target and is never folded away
+__thread CodeAddress foldBarrier = 0;
+
+// Number of static links to follow from the current scope to reach scope
+int computeNestedLevel(Scope *scope)
+{
+  int level = 0;
+  Scope *tmp = symtab->currentScope;
+
+  while (tmp != scope)
+  {
+    tmp = tmp->outer;
+    level++;
+  }
+  return level;
+}
+
+/******************* Object access ******************************/
+
+void genVariableAddress(Object *var)
+{
+  int level = computeNestedLevel(var->varAttrs->scope);
+  noteUnitVariable(var);
+  genLA(level, var->varAttrs->localOffset);
+}
+
+void genVariableValue(Object *var)
+{
+  int level = computeNestedLevel(var->varAttrs->scope);
+  noteUnitVariable(var);
+  genLV(level, var->varAttrs->localOffset);
+}
+
+// Scope that holds a parameter is the scope of its function/procedure
+Scope *parameterScope(Object *param)
+{
+  Object *owner = param->paramAttrs->function;
+  if (owner->kind == OBJ_FUNCTION)
+    return owner->funcAttrs->scope;
+  return owner->procAttrs->scope;
+}
+
+// A VAR parameter slot already holds the address of the argument
+void genParameterAddress(Object *param)
+{
+  int level = computeNestedLevel(parameterScope(param));
+  if (param->paramAttrs->kind == PARAM_VALUE)
+    genLA(level, param->paramAttrs->localOffset);
+  else
+    genLV(level, param->paramAttrs->localOffset);
+}
+
+void genParameterValue(Object *param)
+{
+  int level = computeNestedLevel(parameterScope(param));
+  genLV(level, param->paramAttrs->localOffset);
+  if (param->paramAttrs->kind == PARAM_REFERENCE)
+    genLI();
+}
+
+// The return value lives in the first slot of the function's frame
+void genReturnValueAddress(Object *func)
+{
+  int level = computeNestedLevel(func->funcAttrs->scope);
+  genLA(level, 0);
+}
+
+void genReturnValueValue(Object *func)
+{
+  int level = computeNestedLevel(func->funcAttrs->scope);
+  genLV(level, 0);
+}
+
+/******************* Calls ******************************/
+
+int isPredefinedFunction(Object *func)
+{
+  return ((func == readiFunction) || (func == readcFunction));
+}
+
+int isPredefinedProcedure(Object *proc)
+{
+  return ((proc == writeiProcedure) || (proc == writecProcedure) || (proc == writelnProcedure));
+}
+
+void genPredefinedFunctionCall(Object *func)
+{
+  if (func == readiFunction)
+    genRI();
+  else if (func == readcFunction)
+    genRC();
+}
+
+// Arguments of the predefined procedures are already on the stack
+void genPredefinedProcedureCall(Object *proc)
+{
+  if (proc == writeiProcedure)
+    genWRI();
+  else if (proc == writecProcedure)
+    genWRC();
+  else if (proc == writelnProcedure)
+    genWLN();
+}
+
+// The static link of a callee is the frame of the scope it was declared in
+void genFunctionCall(Object *func)
+{
+  int level = computeNestedLevel(func->funcAttrs->scope->outer);
+  genCALL(level, func->funcAttrs->codeAddress);
+}
+
+void genProcedureCall(Object *proc)
+{
+  int level = computeNestedLevel(proc->procAttrs->scope->outer);
+  genCALL(level, proc->procAttrs->codeAddress);
+}
+
+/******************* Constant folding ******************************/
+
+int isFoldableConstant(CodeAddress address)
+{
+  return address >= foldBarrier && codeBlock->code[address].op == OP_LC;
+}
+
+// Replace "LC a; LC b; op" by "LC (a op b)" before op is emitted.
+// Additive constants also merge across a non-constant operand:
+// "LC a; AD; LC b; SB" becomes "LC (a - b); AD".
+int foldBinary(enum OpCode op)
+{
+  Instruction *code = codeBlock->code;
+  CodeAddress top = codeBlock->codeSize - 1;
+  WORD value;
+
+  if (top < 1 || !isFoldableConstant(top))
+    return 0;
+
+  if (isFoldableConstant(top - 1))
+  {
+    if (!evaluateOperation(op, code[top - 1].q, code[top].q, &value))
+      return 0;
+    code[top - 1].q = value;
+    codeBlock->codeSize--;
+    return 1;
+  }
+
+  if ((op == OP_AD || op == OP_SB) && top >= 2 && isFoldableConstant(top - 2) &&
+      (code[top - 1].op == OP_AD || code[top - 1].op == OP_SB))
+  {
+    value = code[top - 2].q;
+    if (code[top - 1].op == OP_SB)
+      evaluateOperation(OP_SB, 0, value, &value);
+    evaluateOperation(op, value, code[top].q, &value);
+    code[top - 2].q = value;
+    code[top - 1].op = OP_AD;
+    codeBlock->codeSize--;
+    return 1;
+  }
+  return 0;
+}
+
+int foldNegation(void)
+{
+  CodeAddress top = codeBlock->codeSize - 1;
+
+  if (top < 0 || !isFoldableConstant(top))
+    return 0;
+  evaluateOperation(OP_SB, 0, codeBlock->code[top].q, &codeBlock->code[top].q);
+  return 1;
+}
+
+// Take back an expression that was folded into a single LC
+int takeFoldedConstant(CodeAddress start, WORD *value)
+{
+  if (codeBlock->codeSize != start + 1 || !isFoldableConstant(start))
+    return 0;
+  *value = codeBlock->code[start].q;
+  codeBlock->codeSize--;
+  return 1;
+}
+
+/******************* Instructions ******************************/
+
+void genLA(int level, int offset) { emitLA(codeBlock, level, offset); }
+void genLV(int level, int offset) { emitLV(codeBlock, level, offset); }
+void genLC(WORD constant) { emitLC(codeBlock, constant); }
+void genLI(void) { emitLI(codeBlock); }
+void genINT(int delta) { emitINT(codeBlock, delta); }
+void genDCT(int delta) { emitDCT(codeBlock, delta); }
+void genJ(CodeAddress label) { emitJ(codeBlock, label); }
+void genFJ(CodeAddress label) { emitFJ(codeBlock, label); }
+void genHL(void) { emitHL(codeBlock); }
+void genST(void) { emitST(codeBlock); }
+void genSTN(int distance) { emitSTN(codeBlock, distance); }
+void genCALL(int level, CodeAddress label) { emitCALL(codeBlock, level, label); }
+void genEP(void) { emitEP(codeBlock); }
+void genEF(void) { emitEF(codeBlock); }
+void genRC(void) { emitRC(codeBlock); }
+void genRI(void) { emitRI(codeBlock); }
+void genWRC(void) { emitWRC(codeBlock); }
+void genWRI(void) { emitWRI(codeBlock); }
+void genWLN(void) { emitWLN(codeBlock); }
+void genAD(void) { if (!foldBinary(OP_AD)) emitAD(codeBlock); }
+void genSB(void) { if (!foldBinary(OP_SB)) emitSB(codeBlock); }
+void genML(void) { if (!foldBinary(OP_ML)) emitML(codeBlock); }
+void genDV(void) { if (!foldBinary(OP_DV)) emitDV(codeBlock); }
+void genPW(void) { if (!foldBinary(OP_PW)) emitPW(codeBlock); }
+void genNEG(void) { if (!foldNegation()) emitNEG(codeBlock); }
+void genCV(void) { emitCV(codeBlock); }
+void genAX(void) { emitAX(codeBlock); }
+void genEQ(void) { if (!foldBinary(OP_EQ)) emitEQ(codeBlock); }
+void genNE(void) { if (!foldBinary(OP_NE)) emitNE(codeBlock); }
+void genGT(void) { if (!foldBinary(OP_GT)) emitGT(codeBlock); }
+void genLT(void) { if (!foldBinary(OP_LT)) emitLT(codeBlock); }
+void genGE(void) { if (!foldBinary(OP_GE)) emitGE(codeBlock); }
+void genLE(void) { if (!foldBinary(OP_LE)) emitLE(codeBlock); }
+
+// The top `count` words are added up by one instruction
+void genSUM(int count)
+{
+  if (count == 2)
+    genAD();
+  else if (count > 2)
+    emitSUM(codeBlock, count);
+}
+
+// Jumps are emitted before their target is known and patched later
+void updateJ(CodeAddress jmp, CodeAddress label)
+{
+  codeBlock->code[jmp].q = label;
+}
+
+void updateFJ(CodeAddress jmp, CodeAddress label)
+{
+  codeBlock->code[jmp].q = label;
+}
+
+// The address may become a jump target, so stop folding across it
+CodeAddress getCurrentCodeAddress(void)
+{
+  foldBarrier = codeBlock->codeSize;
+  return codeBlock->codeSize;
+}
+
+// Where the code of the next expression will start; folding goes on
+CodeAddress getExpressionStart(void)
+{
+  return codeBlock->codeSize;
+}
+
+/******************* Code buffer ******************************/
+
+void initCodeBuffer(void)
+{
+  codeBlock = createCodeBlock(CODE_SIZE);
+  foldBarrier = 0;
+}
+
+void printCodeBuffer(void)
+{
+  printCodeBlock(codeBlock);
+}
+
+void cleanCodeBuffer(void)
+{
+  freeCodeBlock(codeBlock);
+}
+
+CodeBlock *getCodeBuffer(void)
+{
+  return codeBlock;
+}
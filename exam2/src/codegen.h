@@ -0,0 +1,74 @@
+#ifndef __CODEGEN_H__
+#define __CODEGEN_H__
+
+#include "symtab.h"
+#include "instructions.h"
+
+#define CODE_SIZE 10000
+// Widest SUM instruction, bounding the operand stack of a SUM expression
+#define MAX_SUM_WIDTH 256
+
+int computeNestedLevel(Scope* scope);
+
+void genVariableAddress(Object* var);
+void genVariableValue(Object* var);
+void genParameterAddress(Object* param);
+void genParameterValue(Object* param);
+void genReturnValueAddress(Object* func);
+void genReturnValueValue(Object* func);
+
+int isPredefinedFunction(Object* func);
+int isPredefinedProcedure(Object* proc);
+void genPredefinedFunctionCall(Object* func);
+void genPredefinedProcedureCall(Object* proc);
+void genFunctionCall(Object* func);
+void genProcedureCall(Object* proc);
+
+void genLA(int level, int offset);
+void genLV(int level, int offset);
+void genLC(WORD constant);
+void genLI(void);
+void genINT(int delta);
+void genDCT(int delta);
+void genJ(CodeAddress label);
+void genFJ(CodeAddress label);
+void genHL(void);
+void genST(void);
+void genSTN(int distance);
+void genCALL(int level, CodeAddress label);
+void genEP(void);
+void genEF(void);
+void genRC(void);
+void genRI(void);
+void genWRC(void);
+void genWRI(void);
+void genWLN(void);
+void genAD(void);
+void genSB(void);
+void genML(void);
+void genDV(void);
+void genSUM(int count);
+void genPW(void);
+void genNEG(void);
+void genCV(void);
+void genAX(void);
+void genEQ(void);
+void genNE(void);
+void genGT(void);
+void genLT(void);
+void genGE(void);
+void genLE(void);
+
+void updateJ(CodeAddress jmp, CodeAddress label);
+void updateFJ(CodeAddress jmp, CodeAddress label);
+
+CodeAddress getCurrentCodeAddress(void);
+CodeAddress getExpressionStart(void);
+int takeFoldedConstant(CodeAddress start, WORD* value);
+
+void initCodeBuffer(void);
+void printCodeBuffer(void);
+void cleanCodeBuffer(void);
+CodeBlock* getCodeBuffer(void);
+
+#endif
@@ -5,6 +5,7 @@
  */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include "debug.h"
 
 void pad(int n) {
@@ -12,77 +13,131 @@ void pad(int n) {
   for (i = 0; i < n ; i++) printf(" ");
 }
 
-void printType(Type* type) {
+// Adds to the length characters in buffer as snprintf would, cutting
+// what doesn't fit
+int writeText(char *buffer, int size, int length, char *format, ...) {
+  va_list arguments;
+  int n;
+
+  if (length >= size - 1)
+    return length;
+  va_start(arguments, format);
+  n = vsnprintf(buffer + length, size - length, format, arguments);
+  va_end(arguments);
+  if (n < 0)
+    return length;
+  return (length + n < size - 1) ? length + n : size - 1;
+}
+
+int writeType(char *buffer, int size, int length, Type* type) {
+  if (type == NULL)
+    return writeText(buffer, size, length, "?");
   switch (type->typeClass) {
   case TP_INT:
-    printf("Int");
-    break;
+    return writeText(buffer, size, length, "Int");
   case TP_CHAR:
-    printf("Char");
-    break;
+    return writeText(buffer, size, length, "Char");
   case TP_ARRAY:
-    printf("Arr(%d,",type->arraySize);
-    printType(type->elementType);
-    printf(")");
-    break;
+    length = writeText(buffer, size, length, "Arr(%d,",type->arraySize);
+    length = writeType(buffer, size, length, type->elementType);
+    return writeText(buffer, size, length, ")");
   }
+  return length;
 }
 
-void printConstantValue(ConstantValue* value) {
+int writeConstantValue(char *buffer, int size, int length, ConstantValue* value) {
   switch (value->type) {
   case TP_INT:
-    printf("%d",value->intValue);
-    break;
+    return writeText(buffer, size, length, "%lld",value->intValue);
   case TP_CHAR:
-    printf("\'%c\'",value->charValue);
-    break;
+    return writeText(buffer, size, length, "\'%c\'",value->charValue);
   default:
-    break;
+    return length;
   }
 }
 
-void printObject(Object* obj, int indent) {
+void formatType(char *buffer, int size, Type* type) {
+  buffer[0] = '\0';
+  writeType(buffer, size, 0, type);
+}
+
+void formatConstantValue(char *buffer, int size, ConstantValue* value) {
+  buffer[0] = '\0';
+  writeConstantValue(buffer, size, 0, value);
+}
+
+void formatObject(char *buffer, int size, Object* obj) {
+  int length;
+
+  buffer[0] = '\0';
   switch (obj->kind) {
   case OBJ_CONSTANT:
-    pad(indent);
-    printf("Const %s = ", obj->name);
-    printConstantValue(obj->constAttrs->value);
+    length = writeText(buffer, size, 0, "Const %s = ", obj->name);
+    writeConstantValue(buffer, size, length, obj->constAttrs->value);
     break;
   case OBJ_TYPE:
-    pad(indent);
-    printf("Type %s = ", obj->name);
-    printType(obj->typeAttrs->actualType);
+    length = writeText(buffer, size, 0, "Type %s = ", obj->name);
+    writeType(buffer, size, length, obj->typeAttrs->actualType);
     break;
   case OBJ_VARIABLE:
-    pad(indent);
-    printf("Var %s : ", obj->name);
-    printType(obj->varAttrs->type);
+    length = writeText(buffer, size, 0, "Var %s : ", obj->name);
+    writeType(buffer, size, length, obj->varAttrs->type);
     break;
   case OBJ_PARAMETER:
-    pad(indent);
     if (obj->paramAttrs->kind == PARAM_VALUE) 
-      printf("Param %s : ", obj->name);
+      length = writeText(buffer, size, 0, "Param %s : ", obj->name);
     else
-      printf("Param VAR %s : ", obj->name);
-    printType(obj->paramAttrs->type);
+      length = writeText(buffer, size, 0, "Param VAR %s : ", obj->name);
+    writeType(buffer, size, length, obj->paramAttrs->type);
+    break;
+  case OBJ_FUNCTION:
+    length = writeText(buffer, size, 0, "Function %s : ",obj->name);
+    writeType(buffer, size, length, obj->funcAttrs->returnType);
+    break;
+  case OBJ_PROCEDURE:
+    writeText(buffer, size, 0, "Procedure %s",obj->name);
     break;
+  case OBJ_PROGRAM:
+    writeText(buffer, size, 0, "Program %s",obj->name);
+    break;
+  }
+}
+
+void printType(Type* type) {
+  char text[MAX_DEBUG_TEXT];
+
+  formatType(text, MAX_DEBUG_TEXT, type);
+  printf("%s", text);
+}
+
+void printConstantValue(ConstantValue* value) {
+  char text[MAX_DEBUG_TEXT];
+
+  formatConstantValue(text, MAX_DEBUG_TEXT, value);
+  printf("%s", text);
+}
+
+void printObject(Object* obj, int indent) {
+  char text[MAX_DEBUG_TEXT];
+
+  formatObject(text, MAX_DEBUG_TEXT, obj);
+  pad(indent);
+  printf("%s", text);
+  switch (obj->kind) {
   case OBJ_FUNCTION:
-    pad(indent);
-    printf("Function %s : ",obj->name);
-    printType(obj->funcAttrs->returnType);
     printf("\n");
     printScope(obj->funcAttrs->scope, indent + 4);
     break;
   case OBJ_PROCEDURE:
-    pad(indent);
-    printf("Procedure %s\n",obj->name);
+    printf("\n");
     printScope(obj->procAttrs->scope, indent + 4);
     break;
   case OBJ_PROGRAM:
-    pad(indent);
-    printf("Program %s\n",obj->name);
+    printf("\n");
     printScope(obj->progAttrs->scope, indent + 4);
     break;
+  default:
+    break;
   }
 }
 
@@ -98,4 +153,3 @@ void printObjectList(ObjectNode* objList, int indent) {
 void printScope(Scope* scope, int indent) {
   printObjectList(scope->objList, indent);
 }
-
@@ -9,6 +9,15 @@
 
 #include "symtab.h"
 
+// Enough for the one line printObject gives but for very deep arrays,
+// which are cut
+#define MAX_DEBUG_TEXT 256
+
+// What the print functions below print, without an object's scope
+void formatType(char *buffer, int size, Type* type);
+void formatConstantValue(char *buffer, int size, ConstantValue* value);
+void formatObject(char *buffer, int size, Object* obj);
+
 void printType(Type* type);
 void printConstantValue(ConstantValue* value);
 void printObject(Object* obj, int indent);
@@ -0,0 +1,20 @@
+#ifndef __DIALECT_H__
+#define __DIALECT_H__
+
+// KPL dialects, chosen when the compiler is built (make DIALECT=...)
+#define DIALECT_WEEK2 1 // the base language
+#define DIALECT_EXAM1 2 // + BYTES, REPEAT ... UNTIL and **
+#define DIALECT_EXAM2 3 // + SUM and **
+#define DIALECT_UNITS 4 // exam2 + UNIT and USES, the dialect of kplc
+
+#ifndef DIALECT
+#define DIALECT DIALECT_UNITS
+#endif
+
+#define HAS_POWER (DIALECT == DIALECT_EXAM1 || DIALECT == DIALECT_EXAM2 || DIALECT == DIALECT_UNITS)
+#define HAS_BYTES (DIALECT == DIALECT_EXAM1)
+#define HAS_REPEAT (DIALECT == DIALECT_EXAM1)
+#define HAS_SUM (DIALECT == DIALECT_EXAM2 || DIALECT == DIALECT_UNITS)
+#define HAS_UNITS (DIALECT == DIALECT_UNITS)
+
+#endif
@@ -0,0 +1,893 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "document.h"
+#include "parser.h"
+#include "scanner.h"
+#include "semantics.h"
+#include "codegen.h"
+#include "alloc.h"
+#include "unit.h"
+
+extern __thread SymTab *symtab;
+extern __thread CodeBlock *codeBlock;
+extern __thread Token *currentToken;
+extern __thread Token *lookAhead;
+
+Object *lookupObject(char *name);
+void freeObject(Object *obj);
+void freeObjectList(ObjectNode *objList);
+
+// A name of a routine that resolved outside of it, levels scopes out
+// from the routine's own, to an object with that fingerprint
+typedef struct {
+  char name[MAX_IDENT_LEN];
+  int levels;
+  unsigned long long fingerprint;
+} Dependency;
+
+// The program or a subroutine, by the indices of its tokens
+struct Routine_ {
+  Object *object;
+  int start;          // its FUNCTION or PROCEDURE, 0 for the program
+  int block;          // the first token of its block
+  int end;            // the ; or . closing it, -1 until the parser got there
+  int headerObjects;  // parameters, which come first in its scope
+  int frameSize;      // of its scope after the parameters
+  int *declarations;  // the names declared in its scope, in their order
+  int declarationCount;
+  int declarationCapacity;
+  Dependency *dependencies;
+  int dependencyCount;
+  int dependencyCapacity;
+  int changed;        // the last edit changed some of its tokens
+  char *error;        // the message of the check of its block that failed
+  int errorToken;     // the lookahead then; the error's place is kept from it
+  int errorDistance;  // from the token's offset
+  struct Routine_ *parent;
+  struct Routine_ *children;
+  struct Routine_ *lastChild;
+  struct Routine_ *next;
+};
+
+// Fingerprints taken during a check, by object: the objects of a
+// document neither change nor go away while it is checked
+#define SIGNATURES 1024
+
+typedef struct {
+  Object *object;
+  unsigned long long fingerprint;
+} Signature;
+
+Signature signatures[SIGNATURES];
+
+Document *checked;         // the document being checked
+int cursor;                // its next token for the parser
+Routine *rechecked;        // the routine whose block is checked
+Routine *active;           // the innermost routine being parsed
+Routine *oldChildren;      // those declared in that block before, not met yet
+ObjectNode *oldLocals;     // and the objects the block had
+int firstChanged;          // the first token the edits changed
+int endMoved;
+
+/******************* routines ******************************/
+
+Routine *newRoutine(void)
+{
+  Routine *routine = ALLOCATE(Routine, ALLOC_DOCUMENT);
+
+  memset(routine, 0, sizeof(Routine));
+  routine->end = -1;
+  return routine;
+}
+
+void freeRoutine(Routine *routine)
+{
+  Routine *child, *next;
+
+  if (routine == NULL)
+    return;
+  for (child = routine->children; child != NULL; child = next)
+  {
+    next = child->next;
+    freeRoutine(child);
+  }
+  RELEASE(routine->dependencies);
+  RELEASE(routine->declarations);
+  RELEASE(routine->error);
+  RELEASE(routine);
+}
+
+void freeRoutineList(Routine *routine)
+{
+  Routine *next;
+
+  for (; routine != NULL; routine = next)
+  {
+    next = routine->next;
+    freeRoutine(routine);
+  }
+}
+
+void addChild(Routine *parent, Routine *child)
+{
+  child->parent = parent;
+  child->next = NULL;
+  if (parent->lastChild == NULL)
+    parent->children = child;
+  else
+    parent->lastChild->next = child;
+  parent->lastChild = child;
+}
+
+void removeLastChild(Routine *parent)
+{
+  Routine *child = parent->children;
+
+  if (child == parent->lastChild)
+    parent->children = parent->lastChild = NULL;
+  else
+  {
+    while (child->next != parent->lastChild)
+      child = child->next;
+    child->next = NULL;
+    parent->lastChild = child;
+  }
+}
+
+void addDeclaration(Routine *routine, int token)
+{
+  if (routine->declarationCount == routine->declarationCapacity)
+  {
+    routine->declarationCapacity = (routine->declarationCapacity == 0) ? 8 : 2 * routine->declarationCapacity;
+    routine->declarations = REALLOCATE_ARRAY(routine->declarations, int,
+                                             routine->declarationCapacity, ALLOC_DOCUMENT);
+  }
+  routine->declarations[routine->declarationCount++] = token;
+}
+
+Scope *routineScope(Object *obj)
+{
+  switch (obj->kind)
+  {
+  case OBJ_FUNCTION:
+    return obj->funcAttrs->scope;
+  case OBJ_PROCEDURE:
+    return obj->procAttrs->scope;
+  default:
+    return obj->progAttrs->scope;
+  }
+}
+
+void removeObject(ObjectNode **objList, Object *obj)
+{
+  ObjectNode *node;
+
+  while (*objList != NULL && (*objList)->object != obj)
+    objList = &(*objList)->next;
+  if (*objList != NULL)
+  {
+    node = *objList;
+    *objList = node->next;
+    RELEASE(node);
+  }
+}
+
+int countObjects(ObjectNode *objList)
+{
+  int count = 0;
+
+  for (; objList != NULL; objList = objList->next)
+    count++;
+  return count;
+}
+
+/******************* fingerprints ******************************/
+
+// FNV-1a over what checking a use of the object looks at
+unsigned long long mixFingerprint(unsigned long long hash, WORD value)
+{
+  int i;
+
+  for (i = 0; i < 8; i++)
+  {
+    hash ^= (value >> (8 * i)) & 0xff;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+unsigned long long fingerprintType(unsigned long long hash, Type *type)
+{
+  if (type == NULL)
+    return mixFingerprint(hash, -1);
+  hash = mixFingerprint(hash, type->typeClass);
+  if (type->typeClass == TP_ARRAY)
+  {
+    hash = mixFingerprint(hash, type->arraySize);
+    hash = fingerprintType(hash, type->elementType);
+  }
+  return hash;
+}
+
+unsigned long long fingerprintParams(unsigned long long hash, ObjectNode *paramList)
+{
+  for (; paramList != NULL; paramList = paramList->next)
+  {
+    hash = mixFingerprint(hash, paramList->object->paramAttrs->kind);
+    hash = fingerprintType(hash, paramList->object->paramAttrs->type);
+  }
+  return mixFingerprint(hash, -1);
+}
+
+unsigned long long fingerprintObject(Object *obj)
+{
+  unsigned long long hash = mixFingerprint(14695981039346656037ULL, obj->kind);
+  ConstantValue *value;
+
+  switch (obj->kind)
+  {
+  case OBJ_CONSTANT:
+    value = obj->constAttrs->value;
+    hash = mixFingerprint(hash, value->type);
+    return mixFingerprint(hash, (value->type == TP_INT) ? value->intValue : value->charValue);
+  case OBJ_VARIABLE:
+    return fingerprintType(hash, obj->varAttrs->type);
+  case OBJ_TYPE:
+    return fingerprintType(hash, obj->typeAttrs->actualType);
+  case OBJ_PARAMETER:
+    hash = mixFingerprint(hash, obj->paramAttrs->kind);
+    return fingerprintType(hash, obj->paramAttrs->type);
+  case OBJ_FUNCTION:
+    hash = fingerprintParams(hash, obj->funcAttrs->paramList);
+    return fingerprintType(hash, obj->funcAttrs->returnType);
+  case OBJ_PROCEDURE:
+    return fingerprintParams(hash, obj->procAttrs->paramList);
+  default:
+    return hash;
+  }
+}
+
+unsigned long long signatureOf(Object *obj)
+{
+  Signature *signature = &signatures[((unsigned long)obj >> 4) % SIGNATURES];
+
+  if (signature->object != obj)
+  {
+    signature->object = obj;
+    signature->fingerprint = fingerprintObject(obj);
+  }
+  return signature->fingerprint;
+}
+
+// Whether routine or one of its subroutines failed
+int failedWithin(Routine *routine)
+{
+  Routine *child;
+
+  if (routine->error != NULL)
+    return 1;
+  for (child = routine->children; child != NULL; child = child->next)
+    if (failedWithin(child))
+      return 1;
+  return 0;
+}
+
+// Whether the names of routine, depth levels below the block being
+// checked, that resolve outside of the routine still resolve to the same
+// objects, and none of its blocks failed
+int stillResolves(Routine *routine, int depth)
+{
+  Dependency *dependency;
+  Routine *child;
+  Object *obj;
+  int i;
+
+  if (routine->error != NULL)
+    return 0;
+  for (i = 0; i < routine->dependencyCount; i++)
+  {
+    dependency = &routine->dependencies[i];
+    if (dependency->levels <= depth)
+      continue;
+    obj = lookupObject(dependency->name);
+    if (obj == NULL || signatureOf(obj) != dependency->fingerprint)
+      return 0;
+  }
+  for (child = routine->children; child != NULL; child = child->next)
+    if (!stillResolves(child, depth + 1))
+      return 0;
+  return 1;
+}
+
+/******************* parser hooks ******************************/
+
+Token *copyDocumentToken(int index)
+{
+  LexedToken lexed;
+  Token *token = ALLOCATE(Token, ALLOC_TOKEN);
+  int count = getTokenCount(checked->tokens);
+
+  getLexedToken(checked->tokens, (index < count) ? index : count - 1, &lexed);
+  *token = lexed.token;
+  return token;
+}
+
+// The tokenSource of a check: the errors of the scanner come up as the
+// parser reaches them, as they would from getValidToken
+Token *nextDocumentToken(void)
+{
+  Token *token = copyDocumentToken(cursor++);
+
+  checked->tokensChecked++;
+  if (token->tokenType == TK_NONE)
+    error(token->value, token->offset);
+  return token;
+}
+
+// A subroutine of the block checked again comes back as it was, declared
+// first so that its own name resolves to it from inside. One before the
+// edit needs no lookups: all it sees was declared again from the same
+// tokens, in the same scopes.
+int reuseRoutine(void)
+{
+  ParserHooks *hooks = parserHooks;
+  Routine *routine;
+  int index = cursor - 1;
+  int same;
+
+  if (active != rechecked)
+    return 0;
+  // the edit took away those the parser went past
+  while (oldChildren != NULL && oldChildren->start < index)
+  {
+    routine = oldChildren;
+    oldChildren = routine->next;
+    freeRoutine(routine);
+  }
+  routine = oldChildren;
+  if (routine == NULL || routine->start != index || routine->changed ||
+      findObject(symtab->currentScope->objList, routine->object->name) != NULL)
+    return 0;
+
+  // it stays with the old objects, freed with them, unless it comes back
+  declareObject(routine->object);
+  parserHooks = NULL;
+  same = (routine->end < firstChanged) ? !failedWithin(routine) : stillResolves(routine, 0);
+  parserHooks = hooks;
+  if (!same)
+  {
+    removeObject(&(symtab->currentScope->objList), routine->object);
+    return 0;
+  }
+
+  removeObject(&oldLocals, routine->object);
+  addDeclaration(active, routine->start + 1);
+  oldChildren = routine->next;
+  addChild(active, routine);
+  cursor = routine->end + 1;
+  RELEASE(currentToken);
+  currentToken = copyDocumentToken(routine->end);
+  RELEASE(lookAhead);
+  lookAhead = nextDocumentToken();
+  return 1;
+}
+
+// Its name and the next token have been read: FUNCTION is 3 tokens back
+void beginRoutine(Object *obj)
+{
+  Routine *routine;
+
+  if (active == NULL)
+    routine = checked->program;
+  else
+  {
+    routine = newRoutine();
+    routine->start = cursor - 3;
+    addChild(active, routine);
+  }
+  routine->object = obj;
+  active = routine;
+}
+
+void beginBlock(void)
+{
+  active->block = cursor - 1;
+  active->frameSize = symtab->currentScope->frameSize;
+  active->headerObjects = countObjects(symtab->currentScope->objList);
+}
+
+void endRoutine(void)
+{
+  active->end = cursor - 2;
+  active = active->parent;
+}
+
+void resolved(char *name, Object *obj, int levels)
+{
+  Dependency *dependency;
+  int i;
+
+  if (levels == 0 || (levels == 1 && obj == active->object))
+    return;
+  for (i = 0; i < active->dependencyCount; i++)
+    if (strcmp(active->dependencies[i].name, name) == 0)
+      return;
+  if (active->dependencyCount == active->dependencyCapacity)
+  {
+    active->dependencyCapacity = (active->dependencyCapacity == 0) ? 8 : 2 * active->dependencyCapacity;
+    active->dependencies = REALLOCATE_ARRAY(active->dependencies, Dependency,
+                                            active->dependencyCapacity, ALLOC_DOCUMENT);
+  }
+  dependency = &active->dependencies[active->dependencyCount++];
+  strcpy(dependency->name, name);
+  dependency->levels = levels;
+  dependency->fingerprint = fingerprintObject(obj);
+}
+
+// Its name is the current token
+void declared(void)
+{
+  addDeclaration(active, cursor - 2);
+}
+
+// A check parses every block it reaches
+int keepBlock(void)
+{
+  return 0;
+}
+
+ParserHooks documentHooks = { reuseRoutine, beginRoutine, beginBlock, keepBlock, endRoutine, resolved, declared };
+
+/******************* checks ******************************/
+
+// Runs parse on the document's tokens; 0 when error() stopped it
+int parseDocument(Document *document, void (*parse)(void))
+{
+  jmp_buf handler;
+  jmp_buf *outerHandler = errorHandler;
+  CodeBlock *outerCode = codeBlock;
+  LineIndex *outerLines = sourceLines;
+  volatile int parsed = 0;
+
+  checked = document;
+  sourceLines = getLineIndex(document->tokens);
+  document->tokensChecked = 0;
+  memset(signatures, 0, sizeof(signatures));
+  tokenSource = nextDocumentToken;
+  parserHooks = &documentHooks;
+  initCodeBuffer();
+  resetParser();
+
+  errorHandler = &handler;
+  if (setjmp(handler) == 0)
+  {
+    lookAhead = nextDocumentToken();
+    parse();
+    parsed = 1;
+  }
+  errorHandler = outerHandler;
+  sourceLines = outerLines;
+
+  resetParser();
+  cleanCodeBuffer();
+  codeBlock = outerCode;
+  parserHooks = NULL;
+  tokenSource = getValidToken;
+  return parsed;
+}
+
+// The block of a subroutine checked again must end where it did; the
+// program's may end anywhere, as nothing follows it
+void parseBlock(void)
+{
+  compileBlock();
+  if (rechecked->parent == NULL)
+  {
+    eat(SB_PERIOD);
+    rechecked->end = cursor - 2;
+  }
+  else if (cursor - 1 != rechecked->end)
+    endMoved = 1;
+  else
+    eat(SB_SEMICOLON);
+}
+
+void recordFailure(Routine *routine, int token)
+{
+  LexedToken lexed;
+  int count = getTokenCount(checked->tokens);
+  int length = 0;
+
+  if (token >= count)
+    token = count - 1;
+  getLexedToken(checked->tokens, token, &lexed);
+  sscanf(errorMessage, "%*d-%*d:%n", &length);
+  routine->error = ALLOCATE_ARRAY(char, strlen(errorMessage + length) + 1, ALLOC_DOCUMENT);
+  strcpy(routine->error, errorMessage + length);
+  routine->errorToken = token;
+  routine->errorDistance = errorOffset - lexed.token.offset;
+}
+
+// The routines the failed parse was still in have no end
+void dropUnfinished(void)
+{
+  Routine *routine = active;
+  Routine *parent;
+
+  while (routine != NULL && routine != rechecked)
+  {
+    parent = routine->parent;
+    removeLastChild(parent);
+    freeRoutine(routine);
+    routine = parent;
+  }
+}
+
+void releaseSymTab(void)
+{
+  freeUnits(symtab->units);
+  if (symtab->program != NULL)
+    freeObject(symtab->program);
+  RELEASE(symtab);
+}
+
+void checkProgram(Document *document)
+{
+  document->fullChecks++;
+  freeRoutine(document->program);
+  if (document->symtab != NULL)
+  {
+    symtab = document->symtab;
+    releaseSymTab();
+  }
+  initSymTab();
+  document->symtab = symtab;
+
+  document->program = newRoutine();
+  rechecked = document->program;
+  active = NULL;
+  cursor = 0;
+  oldChildren = NULL;
+  oldLocals = NULL;
+  if (!parseDocument(document, compileProgram))
+  {
+    recordFailure(document->program, cursor - 1);
+    dropUnfinished();
+  }
+}
+
+// Checks the block of routine again in the scope of its header; 0 when
+// the edit moved the end of the block, for the caller to check everything
+int checkBlock(Document *document, Routine *routine)
+{
+  Scope *scope = routineScope(routine->object);
+  ObjectNode **locals = &scope->objList;
+  int ended = 1;
+  int i;
+
+  for (i = 0; i < routine->headerObjects; i++)
+    locals = &(*locals)->next;
+  oldLocals = *locals;
+  *locals = NULL;
+  scope->frameSize = routine->frameSize;
+  oldChildren = routine->children;
+  routine->children = routine->lastChild = NULL;
+  routine->dependencyCount = 0;
+  routine->declarationCount = routine->headerObjects;
+  RELEASE(routine->error);
+  routine->error = NULL;
+
+  symtab = document->symtab;
+  symtab->currentScope = scope;
+  rechecked = active = routine;
+  cursor = routine->block;
+  endMoved = 0;
+  if (parseDocument(document, parseBlock))
+    ended = !endMoved;
+  else if (routine->parent != NULL && cursor - 1 > routine->end)
+    ended = 0;
+  else
+  {
+    recordFailure(routine, cursor - 1);
+    dropUnfinished();
+  }
+
+  freeRoutineList(oldChildren);
+  freeObjectList(oldLocals);
+  oldChildren = NULL;
+  oldLocals = NULL;
+  return ended;
+}
+
+/******************* edits ******************************/
+
+// All the tokens the edit changed are in the block, before its end
+int holdsChange(Routine *routine, TokenChange *change)
+{
+  return routine->block <= change->first &&
+         (routine->parent == NULL || change->first + change->removed <= routine->end);
+}
+
+int touchesChange(Routine *routine, TokenChange *change)
+{
+  if (change->removed == 0)
+    return routine->start < change->first && change->first <= routine->end;
+  return change->first <= routine->end && change->first + change->removed > routine->start;
+}
+
+int shiftIndex(int index, TokenChange *change)
+{
+  return (index >= change->first + change->removed) ? index + change->inserted - change->removed : index;
+}
+
+void shiftRoutine(Routine *routine, TokenChange *change)
+{
+  Routine *child;
+  int i;
+
+  routine->changed |= touchesChange(routine, change);
+  routine->start = shiftIndex(routine->start, change);
+  routine->block = shiftIndex(routine->block, change);
+  routine->end = shiftIndex(routine->end, change);
+  routine->errorToken = shiftIndex(routine->errorToken, change);
+  for (i = 0; i < routine->declarationCount; i++)
+    routine->declarations[i] = shiftIndex(routine->declarations[i], change);
+  for (child = routine->children; child != NULL; child = child->next)
+    shiftRoutine(child, change);
+}
+
+void locateError(Document *document, Routine *routine, int *line, int *column)
+{
+  LexedToken lexed;
+
+  getLexedToken(document->tokens, routine->errorToken, &lexed);
+  findPosition(getLineIndex(document->tokens), lexed.token.offset + routine->errorDistance, line, column);
+}
+
+void collectFailures(Document *document, Routine *routine)
+{
+  Routine *child;
+
+  if (routine->error != NULL)
+  {
+    if (document->failedCount == document->failedCapacity)
+    {
+      document->failedCapacity = (document->failedCapacity == 0) ? 4 : 2 * document->failedCapacity;
+      document->failed = REALLOCATE_ARRAY(document->failed, Routine *,
+                                          document->failedCapacity, ALLOC_DOCUMENT);
+    }
+    document->failed[document->failedCount++] = routine;
+  }
+  for (child = routine->children; child != NULL; child = child->next)
+    collectFailures(document, child);
+}
+
+int compareFailures(const void *a, const void *b)
+{
+  int lineA, columnA, lineB, columnB;
+
+  locateError(checked, *(Routine * const *)a, &lineA, &columnA);
+  locateError(checked, *(Routine * const *)b, &lineB, &columnB);
+  if (lineA != lineB)
+    return (lineA > lineB) - (lineA < lineB);
+  return (columnA > columnB) - (columnA < columnB);
+}
+
+void sortFailures(Document *document)
+{
+  document->failedCount = 0;
+  collectFailures(document, document->program);
+  checked = document;
+  qsort(document->failed, document->failedCount, sizeof(Routine *), compareFailures);
+}
+
+Document *openDocument(char *source, int size)
+{
+  Document *document = ALLOCATE(Document, ALLOC_DOCUMENT);
+
+  memset(document, 0, sizeof(Document));
+  document->tokens = createTokenBuffer(source, size);
+  // checked all when first asked for
+  document->revision = 1;
+  return document;
+}
+
+void closeDocument(Document *document)
+{
+  SymTab *outerSymtab = symtab;
+
+  freeRoutine(document->program);
+  if (document->symtab != NULL)
+  {
+    symtab = document->symtab;
+    releaseSymTab();
+    symtab = outerSymtab;
+  }
+  freeTokenBuffer(document->tokens);
+  RELEASE(document->failed);
+  RELEASE(document);
+}
+
+// The innermost block holding both, NULL when one is the whole program
+Routine *commonBlock(Routine *a, Routine *b)
+{
+  Routine *routine;
+
+  for (; a != NULL; a = a->parent)
+    for (routine = b; routine != NULL; routine = routine->parent)
+      if (routine == a)
+        return a;
+  return NULL;
+}
+
+int editDocument(Document *document, int offset, int deleted, char *inserted, int insertedSize)
+{
+  TokenChange change;
+  Routine *routine = document->program;
+  Routine *child;
+
+  if (!editTokenBuffer(document->tokens, offset, deleted, inserted, insertedSize, &change))
+    return 0;
+
+  // the innermost block holding the edit, found by the indices before it
+  if (routine == NULL || routine->end < 0 || !holdsChange(routine, &change))
+    routine = NULL;
+  else
+  {
+    child = routine->children;
+    while (child != NULL)
+    {
+      if (holdsChange(child, &change))
+      {
+        routine = child;
+        child = child->children;
+      }
+      else
+        child = child->next;
+    }
+  }
+  if (document->program != NULL)
+    shiftRoutine(document->program, &change);
+
+  if (document->revision == document->checkedRevision)
+  {
+    document->pending = routine;
+    document->firstChanged = change.first;
+  }
+  else
+  {
+    document->pending = commonBlock(document->pending, routine);
+    document->firstChanged = shiftIndex(document->firstChanged, &change);
+    if (change.first < document->firstChanged)
+      document->firstChanged = change.first;
+  }
+  document->revision++;
+  return 1;
+}
+
+void checkDocument(Document *document)
+{
+  SymTab *outerSymtab = symtab;
+  Routine *routine;
+
+  if (document->checkedRevision == document->revision)
+    return;
+  firstChanged = document->firstChanged;
+  if (document->pending == NULL || !checkBlock(document, document->pending))
+    checkProgram(document);
+  else
+    // the others the edits touched are gone
+    for (routine = document->pending; routine != NULL; routine = routine->parent)
+      routine->changed = 0;
+  sortFailures(document);
+  document->checkedRevision = document->revision;
+  symtab = outerSymtab;
+}
+
+int getDiagnosticCount(Document *document)
+{
+  checkDocument(document);
+  return document->failedCount;
+}
+
+void getDiagnostic(Document *document, int index, char message[MAX_ERROR_MESSAGE])
+{
+  Routine *routine;
+  int line, column;
+
+  checkDocument(document);
+  routine = document->failed[index];
+  locateError(document, routine, &line, &column);
+  snprintf(message, MAX_ERROR_MESSAGE, "%d-%d:%s", line, column, routine->error);
+}
+
+/******************* names ******************************/
+
+// The innermost routine whose tokens hold token; the program holds all
+Routine *routineHolding(Routine *routine, int token)
+{
+  Routine *child = routine->children;
+
+  while (child != NULL)
+  {
+    if (child->start <= token && token <= child->end)
+    {
+      routine = child;
+      child = child->children;
+    }
+    else
+      child = child->next;
+  }
+  return routine;
+}
+
+int findDeclaration(Document *document, int token, Object **obj)
+{
+  SymTab *outerSymtab = symtab;
+  LexedToken name, declaration;
+  Routine *routine;
+  int i;
+
+  *obj = NULL;
+  checkDocument(document);
+  getLexedToken(document->tokens, token, &name);
+  if (name.token.tokenType != TK_IDENT)
+    return -1;
+  // as the parser got there: in the scopes around it, declared before it
+  for (routine = routineHolding(document->program, token); routine != NULL; routine = routine->parent)
+    for (i = 0; i < routine->declarationCount && routine->declarations[i] <= token; i++)
+    {
+      getLexedToken(document->tokens, routine->declarations[i], &declaration);
+      if (strcmp(declaration.token.string, name.token.string) == 0)
+      {
+        if (routine->object != NULL)
+          *obj = findObject(routineScope(routine->object)->objList, name.token.string);
+        return routine->declarations[i];
+      }
+    }
+  // those of the units are built in the document's symbol table
+  symtab = document->symtab;
+  *obj = findUnitObject(symtab->units, name.token.string);
+  symtab = outerSymtab;
+  if (*obj == NULL)
+    *obj = findObject(document->symtab->globalObjectList, name.token.string);
+  return -1;
+}
+
+void visitRoutine(Routine *routine, int depth,
+                  void (*visit)(Object *obj, int name, int first, int last, int depth))
+{
+  Scope *scope = routineScope(routine->object);
+  Routine *child = routine->children;
+  LexedToken name;
+  Object *obj;
+  int i;
+
+  for (i = 0; i < routine->declarationCount; i++)
+  {
+    getLexedToken(checked->tokens, routine->declarations[i], &name);
+    if ((obj = findObject(scope->objList, name.token.string)) == NULL)
+      continue;
+    while (child != NULL && child->start + 1 < routine->declarations[i])
+      child = child->next;
+    if (child != NULL && child->start + 1 == routine->declarations[i])
+    {
+      visit(obj, routine->declarations[i], child->start, child->end, depth);
+      visitRoutine(child, depth + 1, visit);
+    }
+    else
+      visit(obj, routine->declarations[i], routine->declarations[i], routine->declarations[i], depth);
+  }
+}
+
+void visitDeclarations(Document *document,
+                       void (*visit)(Object *obj, int name, int first, int last, int depth))
+{
+  checkDocument(document);
+  if (document->program->object == NULL)
+    return;
+  checked = document;
+  visitRoutine(document->program, 0, visit);
+}
@@ -0,0 +1,76 @@
+#ifndef __DOCUMENT_H__
+#define __DOCUMENT_H__
+
+#include "tokenbuf.h"
+#include "symtab.h"
+#include "error.h"
+
+// A program open in an editor, checked again after every edit. The parser
+// reads the tokens of the document's TokenBuffer, and tells it where each
+// subroutine and its block begin and end, and which names of a subroutine
+// resolve outside of it, to what: the kind, type, value or signature of
+// the object, kept as a fingerprint.
+//
+// An edit only lexes: the blocks are checked when something is asked of
+// the document, so that edits in a row are checked together. A check
+// takes the innermost block holding all the tokens the edits changed,
+// again in the scope its header made; the symbols of every other block
+// stay. A block checked again skips each subroutine declared in it whose
+// tokens did not change and whose outside names still resolve to objects
+// with the same fingerprint: editing a statement doesn't check the
+// subroutines around it, and editing a declaration checks only those
+// using the name. An edit in the program's header, or one that moves
+// where the block of a subroutine ends, checks the whole program.
+//
+// A check stops at its first error, as kplc does. The error stays with
+// the block that was checked until that block is checked again, and other
+// blocks are still checked on their own, so there may be several.
+//
+// A check also keeps where every name it declared is, so that an editor
+// can go from a name to its declaration, which the symbol table holds.
+//
+// Checking emits code into the code buffer, thrown away afterwards.
+
+typedef struct Routine_ Routine;
+
+typedef struct {
+  TokenBuffer *tokens;
+  SymTab *symtab;
+  Routine *program;     // the blocks known from the last checks
+  Routine **failed;     // those with an error, in source order
+  int failedCount;
+  int failedCapacity;
+  int tokensChecked;    // tokens the last check read
+  int fullChecks;       // checks of the whole program, the first one too
+  int revision;         // of the text, one more at each edit
+  int checkedRevision;  // the revision the blocks were checked at
+  Routine *pending;     // the block holding the edits since, NULL for all
+  int firstChanged;     // the first token they changed
+} Document;
+
+Document *openDocument(char *source, int size);
+void closeDocument(Document *document);
+
+// Edits the text as editTokenBuffer does; 0 when the bytes to delete are
+// not all in the source
+int editDocument(Document *document, int offset, int deleted, char *inserted, int insertedSize);
+// Checks what the edits since the last check touched, if any: the
+// functions below do it first
+void checkDocument(Document *document);
+
+// The errors as lineNo-colNo:message, at their places in the text now
+int getDiagnosticCount(Document *document);
+void getDiagnostic(Document *document, int index, char message[MAX_ERROR_MESSAGE]);
+
+// The token of the name declaring what the identifier at token names, as
+// the parser resolved it there, and the object in obj; -1 for a
+// predefined object, one of a unit, or none, obj then NULL when none
+int findDeclaration(Document *document, int token, Object **obj);
+
+// Calls visit for the declarations of the program in source order, each
+// subroutine followed by its own at depth + 1: the token of the name, and
+// the first and last of a subroutine, its name for the others
+void visitDeclarations(Document *document,
+                       void (*visit)(Object *obj, int name, int first, int last, int depth));
+
+#endif
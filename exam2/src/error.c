@@ -6,16 +6,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include "lines.h"
 #include "error.h"
 
-#define NUM_OF_ERRORS 32
+#define NUM_OF_ERRORS 35
 
 struct ErrorMessage {
   ErrorCode errorCode;
   char *message;
 };
 
-struct ErrorMessage errors[32] = {
+struct ErrorMessage errors[NUM_OF_ERRORS] = {
   {ERR_END_OF_COMMENT, "End of comment expected."},
   {ERR_IDENT_TOO_LONG, "Identifier too long."},
   {ERR_INVALID_CONSTANT_CHAR, "Invalid char constant."},
@@ -48,20 +49,57 @@ struct ErrorMessage errors[32] = {
   {ERR_TOO_MANY_EXPRESSIONS, "Too many expressions on the right side."},
   {ERR_TOO_FEW_EXPRESSIONS, "Too few expressions on the right side."},
   {ERR_CONSTANT_ASSIGN, "Cannot assign to a constant."},
+  {ERR_CONSTANT_DIVISION_BY_ZERO, "Division by zero in a constant expression."},
+  {ERR_UNIT_NOT_FOUND, "No interface of the unit, or a damaged one."},
+  {ERR_UNIT_NOT_WRITTEN, "Can't write the interface of the unit."},
 };
 
-void error(ErrorCode err, int lineNo, int colNo) {
+__thread char errorMessage[MAX_ERROR_MESSAGE];
+__thread char errorReport[MAX_ERROR_MESSAGE + 2];
+__thread ErrorCode lastError;
+__thread int errorOffset;
+__thread jmp_buf *errorHandler = NULL;
+
+void raiseError(void) __attribute__((noreturn));
+
+// Hands the error to errorHandler, or prints the report and ends kplc
+void raiseError(void) {
+  if (errorHandler != NULL)
+    longjmp(*errorHandler, 1);
+  printf("%s", errorReport);
+  exit(0);
+}
+
+// The line and column are found only now, for the message
+void describeError(int offset, char *text, char *report) {
+  int lineNo = 0, colNo = 0;
+
+  errorOffset = offset;
+  if (sourceLines != NULL)
+    findPosition(sourceLines, offset, &lineNo, &colNo);
+  snprintf(errorMessage, MAX_ERROR_MESSAGE, "%d-%d:%s", lineNo, colNo, text);
+  snprintf(errorReport, sizeof(errorReport), report, errorMessage);
+}
+
+void error(ErrorCode err, int offset) {
   int i;
+  lastError = err;
+  errorMessage[0] = '\0';
+  errorReport[0] = '\0';
   for (i = 0 ; i < NUM_OF_ERRORS; i ++)
     if (errors[i].errorCode == err) {
-      printf("\n%d-%d:%s\n", lineNo, colNo, errors[i].message);
-      exit(0);
+      describeError(offset, errors[i].message, "\n%s\n");
+      break;
     }
+  raiseError();
 }
 
-void missingToken(TokenType tokenType, int lineNo, int colNo) {
-  printf("%d-%d:Missing %s\n", lineNo, colNo, tokenToString(tokenType));
-  exit(0);
+void missingToken(TokenType tokenType, int offset) {
+  char text[MAX_ERROR_MESSAGE];
+
+  snprintf(text, sizeof(text), "Missing %s", tokenToString(tokenType));
+  describeError(offset, text, "%s\n");
+  raiseError();
 }
 
 void assert(char *msg) {
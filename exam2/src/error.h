@@ -6,8 +6,11 @@
 
 #ifndef __ERROR_H__
 #define __ERROR_H__
+#include <setjmp.h>
 #include "token.h"
 
+#define MAX_ERROR_MESSAGE 256
+
 typedef enum {
   ERR_END_OF_COMMENT,
   ERR_IDENT_TOO_LONG,
@@ -40,11 +43,29 @@ typedef enum {
   ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY,
   ERR_TOO_MANY_EXPRESSIONS,
   ERR_TOO_FEW_EXPRESSIONS,
-  ERR_CONSTANT_ASSIGN
+  ERR_CONSTANT_ASSIGN,
+  ERR_CONSTANT_DIVISION_BY_ZERO,
+  ERR_UNIT_NOT_FOUND,
+  ERR_UNIT_NOT_WRITTEN
 } ErrorCode;
 
-void error(ErrorCode err, int lineNo, int colNo);
-void missingToken(TokenType tokenType, int lineNo, int colNo);
+// All five are per thread.
+// The last diagnostic, as lineNo-colNo:message
+extern __thread char errorMessage[MAX_ERROR_MESSAGE];
+// The same as kplc prints it on stdout after the echoed source
+extern __thread char errorReport[MAX_ERROR_MESSAGE + 2];
+// The code of the last error(), which a TokenBuffer keeps for a document
+extern __thread ErrorCode lastError;
+// And the offset in the source it was raised at
+extern __thread int errorOffset;
+// When set, a compilation stopped by an error jumps here instead of
+// ending the process: the compile server goes on to its next request
+extern __thread jmp_buf *errorHandler;
+
+// Both report at the lineNo-colNo of offset in sourceLines, or at 0-0
+// without them, and end the compilation
+void error(ErrorCode err, int offset) __attribute__((noreturn));
+void missingToken(TokenType tokenType, int offset) __attribute__((noreturn));
 void assert(char *msg);
 
 #endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "instructions.h"
+#include "alloc.h"
+
+CodeBlock *createCodeBlock(int maxSize)
+{
+  CodeBlock *codeBlock = ALLOCATE(CodeBlock, ALLOC_CODE);
+
+  codeBlock->code = ALLOCATE_ARRAY(Instruction, maxSize, ALLOC_CODE);
+  codeBlock->codeSize = 0;
+  codeBlock->maxSize = maxSize;
+  return codeBlock;
+}
+
+void freeCodeBlock(CodeBlock *codeBlock)
+{
+  RELEASE(codeBlock->code);
+  RELEASE(codeBlock);
+}
+
+// Append one instruction, growing the block when it is full
+int emitCode(CodeBlock *codeBlock, enum OpCode op, WORD p, WORD q)
+{
+  Instruction *bottom;
+
+  if (codeBlock->codeSize >= codeBlock->maxSize)
+  {
+    bottom = REALLOCATE_ARRAY(codeBlock->code, Instruction, 2 * codeBlock->maxSize, ALLOC_CODE);
+    if (bottom == NULL)
+      return 0;
+    codeBlock->code = bottom;
+    codeBlock->maxSize *= 2;
+  }
+
+  bottom = codeBlock->code + codeBlock->codeSize;
+  bottom->op = op;
+  bottom->p = p;
+  bottom->q = q;
+  codeBlock->codeSize++;
+  return 1;
+}
+
+int emitLA(CodeBlock *codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_LA, p, q); }
+int emitLV(CodeBlock *codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_LV, p, q); }
+int emitLC(CodeBlock *codeBlock, WORD q) { return emitCode(codeBlock, OP_LC, DC_VALUE, q); }
+int emitLI(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_LI, DC_VALUE, DC_VALUE); }
+int emitINT(CodeBlock *codeBlock, WORD q) { return emitCode(codeBlock, OP_INT, DC_VALUE, q); }
+int emitDCT(CodeBlock *codeBlock, WORD q) { return emitCode(codeBlock, OP_DCT, DC_VALUE, q); }
+int emitJ(CodeBlock *codeBlock, WORD q) { return emitCode(codeBlock, OP_J, DC_VALUE, q); }
+int emitFJ(CodeBlock *codeBlock, WORD q) { return emitCode(codeBlock, OP_FJ, DC_VALUE, q); }
+int emitHL(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_HL, DC_VALUE, DC_VALUE); }
+int emitST(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_ST, DC_VALUE, DC_VALUE); }
+int emitSTN(CodeBlock *codeBlock, WORD q) { return emitCode(codeBlock, OP_STN, DC_VALUE, q); }
+int emitCALL(CodeBlock *codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_CALL, p, q); }
+int emitEP(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_EP, DC_VALUE, DC_VALUE); }
+int emitEF(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_EF, DC_VALUE, DC_VALUE); }
+int emitRC(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_RC, DC_VALUE, DC_VALUE); }
+int emitRI(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_RI, DC_VALUE, DC_VALUE); }
+int emitWRC(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_WRC, DC_VALUE, DC_VALUE); }
+int emitWRI(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_WRI, DC_VALUE, DC_VALUE); }
+int emitWLN(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_WLN, DC_VALUE, DC_VALUE); }
+int emitAD(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_AD, DC_VALUE, DC_VALUE); }
+int emitSB(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_SB, DC_VALUE, DC_VALUE); }
+int emitML(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_ML, DC_VALUE, DC_VALUE); }
+int emitDV(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_DV, DC_VALUE, DC_VALUE); }
+int emitPW(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_PW, DC_VALUE, DC_VALUE); }
+int emitSUM(CodeBlock *codeBlock, WORD q) { return emitCode(codeBlock, OP_SUM, DC_VALUE, q); }
+int emitNEG(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_NEG, DC_VALUE, DC_VALUE); }
+int emitCV(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_CV, DC_VALUE, DC_VALUE); }
+int emitAX(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_AX, DC_VALUE, DC_VALUE); }
+int emitEQ(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_EQ, DC_VALUE, DC_VALUE); }
+int emitNE(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_NE, DC_VALUE, DC_VALUE); }
+int emitGT(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_GT, DC_VALUE, DC_VALUE); }
+int emitLT(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_LT, DC_VALUE, DC_VALUE); }
+int emitGE(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_GE, DC_VALUE, DC_VALUE); }
+int emitLE(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_LE, DC_VALUE, DC_VALUE); }
+int emitBP(CodeBlock *codeBlock) { return emitCode(codeBlock, OP_BP, DC_VALUE, DC_VALUE); }
+
+// Integer power by repeated squaring. A negative exponent gives the
+// truncated reciprocal, so only 1 and -1 stay non-zero.
+WORD powerOf(WORD base, WORD exponent)
+{
+  unsigned long long result = 1;
+  unsigned long long factor = (unsigned long long)base;
+
+  if (exponent < 0)
+  {
+    if (base == 1)
+      return 1;
+    if (base == -1)
+      return (exponent & 1) ? -1 : 1;
+    return 0;
+  }
+  while (exponent > 0)
+  {
+    if (exponent & 1)
+      result *= factor;
+    factor *= factor;
+    exponent >>= 1;
+  }
+  return (WORD)result;
+}
+
+// Compile-time value of a binary operation, with the same wrap-around as
+// the generated code. Returns 0 when the operation must be left to run time.
+int evaluateOperation(enum OpCode op, WORD a, WORD b, WORD *result)
+{
+  unsigned long long x = (unsigned long long)a;
+  unsigned long long y = (unsigned long long)b;
+
+  switch (op)
+  {
+  case OP_AD: *result = (WORD)(x + y); break;
+  case OP_SB: *result = (WORD)(x - y); break;
+  case OP_ML: *result = (WORD)(x * y); break;
+  case OP_DV:
+    if (b == 0)
+      return 0;
+    // LLONG_MIN / -1 wraps to itself, as the negation it is
+    *result = (b == -1) ? (WORD)(0 - x) : a / b;
+    break;
+  case OP_PW: *result = powerOf(a, b); break;
+  case OP_EQ: *result = (a == b); break;
+  case OP_NE: *result = (a != b); break;
+  case OP_GT: *result = (a > b); break;
+  case OP_LT: *result = (a < b); break;
+  case OP_GE: *result = (a >= b); break;
+  case OP_LE: *result = (a <= b); break;
+  default:
+    return 0;
+  }
+  return 1;
+}
+
+void printInstruction(Instruction *inst)
+{
+  switch (inst->op)
+  {
+  case OP_LA: printf("LA %lld,%lld", inst->p, inst->q); break;
+  case OP_LV: printf("LV %lld,%lld", inst->p, inst->q); break;
+  case OP_LC: printf("LC %lld", inst->q); break;
+  case OP_LI: printf("LI"); break;
+  case OP_INT: printf("INT %lld", inst->q); break;
+  case OP_DCT: printf("DCT %lld", inst->q); break;
+  case OP_J: printf("J %lld", inst->q); break;
+  case OP_FJ: printf("FJ %lld", inst->q); break;
+  case OP_HL: printf("HL"); break;
+  case OP_ST: printf("ST"); break;
+  case OP_STN: printf("STN %lld", inst->q); break;
+  case OP_CALL: printf("CALL %lld,%lld", inst->p, inst->q); break;
+  case OP_EP: printf("EP"); break;
+  case OP_EF: printf("EF"); break;
+  case OP_RC: printf("RC"); break;
+  case OP_RI: printf("RI"); break;
+  case OP_WRC: printf("WRC"); break;
+  case OP_WRI: printf("WRI"); break;
+  case OP_WLN: printf("WLN"); break;
+  case OP_AD: printf("AD"); break;
+  case OP_SB: printf("SB"); break;
+  case OP_ML: printf("ML"); break;
+  case OP_DV: printf("DV"); break;
+  case OP_PW: printf("PW"); break;
+  case OP_SUM: printf("SUM %lld", inst->q); break;
+  case OP_NEG: printf("NEG"); break;
+  case OP_CV: printf("CV"); break;
+  case OP_AX: printf("AX"); break;
+  case OP_EQ: printf("EQ"); break;
+  case OP_NE: printf("NE"); break;
+  case OP_GT: printf("GT"); break;
+  case OP_LT: printf("LT"); break;
+  case OP_GE: printf("GE"); break;
+  case OP_LE: printf("LE"); break;
+  case OP_BP: printf("BP"); break;
+  default: break;
+  }
+}
+
+void printCodeBlock(CodeBlock *codeBlock)
+{
+  int i;
+
+  for (i = 0; i < codeBlock->codeSize; i++)
+  {
+    printf("%d:  ", i);
+    printInstruction(codeBlock->code + i);
+    printf("\n");
+  }
+}
@@ -0,0 +1,860 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "vm.h"
+#include "jit.h"
+
+// Native code works directly on the interpreter's stack and frame layout,
+// so interpreted and compiled frames can call each other freely.
+//   r12 = &stack[0]   r13 = &stack[t]   r14 = b   r15 = &stack[b]
+//   rbx = stack limit
+
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+#define NO_INDEX -1
+
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_AE 0x3
+#define CC_L 0xC
+#define CC_GE 0xD
+#define CC_LE 0xE
+#define CC_G 0xF
+
+// Room reserved per stack machine instruction
+#define MAX_NATIVE_SIZE 96
+
+#define NOT_COMPILED 0
+#define COMPILED 1
+#define UNCOMPILABLE 2
+
+extern WORD *stack;
+extern int t;
+extern int b;
+extern int pc;
+extern int ps;
+
+typedef void (*JitEntry)(void *nativeCode);
+
+CodeBlock *jitCodeBlock;
+
+unsigned char *nativeBuffer;
+int nativeSize;
+
+int *owner;
+int *hotness;
+int *state;
+unsigned char **nativeAddress;
+int compiledCount;
+int nesting;
+
+// Shared entry and exit code
+JitEntry trampoline;
+int exitStub;
+int syncExitStub;
+int divideByZeroStub;
+int stackOverflowStub;
+
+// Jumps waiting for the address of their target instruction
+int *fixupPosition;
+int *fixupTarget;
+int fixupCount;
+
+/******************************************************************/
+
+void emitByte(int value)
+{
+  nativeBuffer[nativeSize++] = (unsigned char)value;
+}
+
+void emitInt32(int value)
+{
+  int i;
+  for (i = 0; i < 4; i++)
+    emitByte((value >> (8 * i)) & 0xFF);
+}
+
+void emitInt64(WORD value)
+{
+  int i;
+  for (i = 0; i < 8; i++)
+    emitByte((int)((value >> (8 * i)) & 0xFF));
+}
+
+void patchInt32(int position, int value)
+{
+  int i;
+  for (i = 0; i < 4; i++)
+    nativeBuffer[position + i] = (unsigned char)((value >> (8 * i)) & 0xFF);
+}
+
+void emitRex(int wide, int reg, int index, int base)
+{
+  int rex = 0x40;
+  if (wide)
+    rex |= 0x08;
+  if (reg >= 8)
+    rex |= 0x04;
+  if (index >= 8)
+    rex |= 0x02;
+  if (base >= 8)
+    rex |= 0x01;
+  if (rex != 0x40)
+    emitByte(rex);
+}
+
+// ModRM (and SIB) for [base + index*8 + disp]
+void emitMemory(int reg, int base, int index, int disp)
+{
+  int mod;
+
+  if (disp == 0 && (base & 7) != 5)
+    mod = 0;
+  else if (disp >= -128 && disp <= 127)
+    mod = 1;
+  else
+    mod = 2;
+
+  if (index == NO_INDEX && (base & 7) != 4)
+    emitByte((mod << 6) | ((reg & 7) << 3) | (base & 7));
+  else
+  {
+    emitByte((mod << 6) | ((reg & 7) << 3) | 4);
+    if (index == NO_INDEX)
+      emitByte((4 << 3) | (base & 7));
+    else
+      emitByte((3 << 6) | ((index & 7) << 3) | (base & 7));
+  }
+
+  if (mod == 1)
+    emitByte(disp & 0xFF);
+  else if (mod == 2)
+    emitInt32(disp);
+}
+
+// opcode with a register and a memory operand, 64 bit
+void emitMemoryOp(int opcode, int reg, int base, int index, int disp)
+{
+  emitRex(1, reg, index, base);
+  emitByte(opcode);
+  emitMemory(reg, base, index, disp);
+}
+
+// opcode with two register operands, 64 bit
+void emitRegisterOp(int opcode, int reg, int rm)
+{
+  emitRex(1, reg, NO_INDEX, rm);
+  emitByte(opcode);
+  emitByte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void emitLoad(int dst, int base, int index, int disp)
+{
+  emitMemoryOp(0x8B, dst, base, index, disp);
+}
+
+void emitStore(int src, int base, int index, int disp)
+{
+  emitMemoryOp(0x89, src, base, index, disp);
+}
+
+void emitLea(int dst, int base, int index, int disp)
+{
+  emitMemoryOp(0x8D, dst, base, index, disp);
+}
+
+void emitMove(int dst, int src)
+{
+  emitRegisterOp(0x89, src, dst);
+}
+
+// add/sub/cmp reg, imm32 (extension 0, 5, 7)
+void emitImmediateOp(int extension, int reg, int value)
+{
+  emitRex(1, 0, NO_INDEX, reg);
+  emitByte(0x81);
+  emitByte(0xC0 | (extension << 3) | (reg & 7));
+  emitInt32(value);
+}
+
+void emitAddImmediate(int reg, int value)
+{
+  if (value != 0)
+    emitImmediateOp(0, reg, value);
+}
+
+void emitSubImmediate(int reg, int value)
+{
+  if (value != 0)
+    emitImmediateOp(5, reg, value);
+}
+
+void emitMoveImmediate(int reg, WORD value)
+{
+  emitRex(1, 0, NO_INDEX, reg);
+  emitByte(0xB8 | (reg & 7));
+  emitInt64(value);
+}
+
+void emitAddress(int reg, void *address)
+{
+  emitMoveImmediate(reg, (WORD)(intptr_t)address);
+}
+
+// 32 bit stores and loads for the interpreter's int registers
+void emitStore32(int src, int base)
+{
+  emitRex(0, src, NO_INDEX, base);
+  emitByte(0x89);
+  emitMemory(src, base, NO_INDEX, 0);
+}
+
+void emitLoad32(int dst, int base)
+{
+  emitMemoryOp(0x63, dst, base, NO_INDEX, 0);
+}
+
+void emitSetStatus(int status)
+{
+  emitAddress(RAX, &ps);
+  emitByte(0xC7);
+  emitMemory(0, RAX, NO_INDEX, 0);
+  emitInt32(status);
+}
+
+void emitCall(void *function)
+{
+  emitAddress(RAX, function);
+  emitByte(0xFF);
+  emitByte(0xD0);
+}
+
+void emitJumpTo(int position)
+{
+  emitByte(0xE9);
+  emitInt32(position - (nativeSize + 4));
+}
+
+void emitJumpIfTo(int condition, int position)
+{
+  emitByte(0x0F);
+  emitByte(0x80 | condition);
+  emitInt32(position - (nativeSize + 4));
+}
+
+void emitJumpToCode(int condition, int target)
+{
+  if (condition < 0)
+    emitByte(0xE9);
+  else
+  {
+    emitByte(0x0F);
+    emitByte(0x80 | condition);
+  }
+  fixupPosition[fixupCount] = nativeSize;
+  fixupTarget[fixupCount] = target;
+  fixupCount++;
+  emitInt32(0);
+}
+
+// Leave native code when the program status is no longer active
+void emitCheckStatus(int stub)
+{
+  emitAddress(RAX, &ps);
+  emitByte(0x83);
+  emitMemory(7, RAX, NO_INDEX, 0);
+  emitByte(0);
+  emitJumpIfTo(CC_NE, stub);
+}
+
+void emitDrop(void)
+{
+  emitSubImmediate(R13, 8);
+}
+
+void emitPush(int reg)
+{
+  emitAddImmediate(R13, 8);
+  emitStore(reg, R13, NO_INDEX, 0);
+}
+
+// rax := base(p)
+void emitBase(int level)
+{
+  emitMove(RAX, R14);
+  while (level > 0)
+  {
+    emitLoad(RAX, R12, RAX, 24);
+    level--;
+  }
+}
+
+/******************************************************************/
+
+void jitWriteChar(WORD value)
+{
+  putchar((unsigned char)value);
+}
+
+void jitWriteInt(WORD value)
+{
+  printf("%lld", value);
+}
+
+void jitWriteLn(void)
+{
+  putchar('\n');
+}
+
+WORD jitReadChar(void)
+{
+  return getchar();
+}
+
+WORD jitReadInt(void)
+{
+  WORD number = 0;
+  if (scanf("%lld", &number) == EOF)
+    ps = PS_IO_ERROR;
+  return number;
+}
+
+// Called from native code with a fresh frame already in place
+void jitEnter(int entry)
+{
+  void *native = jitHotCall(entry);
+
+  if (native != NULL)
+    jitRun(native);
+  else
+  {
+    pc = entry;
+    run(jitCodeBlock);
+  }
+}
+
+/******************************************************************/
+
+void genTrampoline(void)
+{
+  trampoline = (JitEntry)(nativeBuffer + nativeSize);
+
+  emitByte(0x53);                 // push rbx
+  emitByte(0x41); emitByte(0x54); // push r12
+  emitByte(0x41); emitByte(0x55); // push r13
+  emitByte(0x41); emitByte(0x56); // push r14
+  emitByte(0x41); emitByte(0x57); // push r15
+
+  emitAddress(RAX, &stack);
+  emitLoad(R12, RAX, NO_INDEX, 0);
+  emitAddress(RAX, &t);
+  emitLoad32(RCX, RAX);
+  emitLea(R13, R12, RCX, 0);
+  emitAddress(RAX, &b);
+  emitLoad32(R14, RAX);
+  emitLea(R15, R12, R14, 0);
+  emitMoveImmediate(RBX, (WORD)(STACK_SIZE - STACK_MARGIN) * 8);
+  emitRegisterOp(0x01, R12, RBX);  // add rbx, r12
+
+  emitByte(0xFF);                 // jmp rdi
+  emitByte(0xE7);
+
+  exitStub = nativeSize;
+  emitByte(0x41); emitByte(0x5F); // pop r15
+  emitByte(0x41); emitByte(0x5E); // pop r14
+  emitByte(0x41); emitByte(0x5D); // pop r13
+  emitByte(0x41); emitByte(0x5C); // pop r12
+  emitByte(0x5B);                 // pop rbx
+  emitByte(0xC3);                 // ret
+
+  // Store t and b back for the interpreter
+  syncExitStub = nativeSize;
+  emitMove(RAX, R13);
+  emitRegisterOp(0x29, R12, RAX); // sub rax, r12
+  emitRex(1, 0, NO_INDEX, RAX);   // sar rax, 3
+  emitByte(0xC1);
+  emitByte(0xF8);
+  emitByte(3);
+  emitAddress(RCX, &t);
+  emitStore32(RAX, RCX);
+  emitAddress(RCX, &b);
+  emitStore32(R14, RCX);
+  emitJumpTo(exitStub);
+
+  divideByZeroStub = nativeSize;
+  emitSetStatus(PS_DIVIDE_BY_ZERO);
+  emitJumpTo(syncExitStub);
+
+  stackOverflowStub = nativeSize;
+  emitSetStatus(PS_STACK_OVERFLOW);
+  emitJumpTo(syncExitStub);
+}
+
+void genNativeCompare(int condition)
+{
+  emitLoad(RAX, R13, NO_INDEX, 0);
+  emitDrop();
+  emitMemoryOp(0x39, RAX, R13, NO_INDEX, 0); // cmp [r13], rax
+  emitByte(0x0F);                            // setcc al
+  emitByte(0x90 | condition);
+  emitByte(0xC0);
+  emitByte(0x0F);                            // movzx eax, al
+  emitByte(0xB6);
+  emitByte(0xC0);
+  emitStore(RAX, R13, NO_INDEX, 0);
+}
+
+void genNativeReturn(int isFunction)
+{
+  emitAddress(RCX, &t);
+  if (isFunction)
+    emitStore32(R14, RCX);
+  else
+  {
+    emitLea(RAX, R14, NO_INDEX, -1);
+    emitStore32(RAX, RCX);
+  }
+  emitAddress(RCX, &pc);
+  emitLoad(RAX, R15, NO_INDEX, 16);
+  emitStore32(RAX, RCX);
+  emitAddress(RCX, &b);
+  emitLoad(RAX, R15, NO_INDEX, 8);
+  emitStore32(RAX, RCX);
+  emitJumpTo(exitStub);
+}
+
+void genNativeCall(Instruction *inst)
+{
+  emitBase((int)inst->p);
+  emitStore(R14, R13, NO_INDEX, 16);
+  emitStore(RAX, R13, NO_INDEX, 32);
+  emitByte(0x49);                           // movq [r13+24], JIT_RETURN
+  emitByte(0xC7);
+  emitMemory(0, R13, NO_INDEX, 24);
+  emitInt32(JIT_RETURN);
+
+  emitMove(RCX, R13);
+  emitRegisterOp(0x29, R12, RCX);          // sub rcx, r12
+  emitRex(1, 0, NO_INDEX, RCX);            // sar rcx, 3
+  emitByte(0xC1);
+  emitByte(0xF9);
+  emitByte(3);
+  emitAddress(RDX, &t);
+  emitStore32(RCX, RDX);
+  emitLea(RCX, RCX, NO_INDEX, 1);
+  emitAddress(RDX, &b);
+  emitStore32(RCX, RDX);
+
+  emitByte(0xBF);                           // mov edi, entry
+  emitInt32((int)inst->q);
+  emitCall((void *)jitEnter);
+
+  // The callee has restored b; only the top of stack moved
+  emitAddress(RAX, &t);
+  emitLoad32(RAX, RAX);
+  emitLea(R13, R12, RAX, 0);
+  emitCheckStatus(exitStub);
+}
+
+// Add the top n words two at a time with SSE2, leaving the total on top
+void genNativeSum(int n)
+{
+  int loop;
+
+  emitLea(RDX, R13, NO_INDEX, -8 * (n - 1));
+  emitByte(0xB9);                           // mov ecx, n / 2
+  emitInt32(n / 2);
+  emitByte(0x66); emitByte(0x0F);           // pxor xmm0, xmm0
+  emitByte(0xEF); emitByte(0xC0);
+  loop = nativeSize;
+  emitByte(0xF3); emitByte(0x0F);           // movdqu xmm1, [rdx]
+  emitByte(0x6F); emitByte(0x0A);
+  emitByte(0x66); emitByte(0x0F);           // paddq xmm0, xmm1
+  emitByte(0xD4); emitByte(0xC1);
+  emitAddImmediate(RDX, 16);
+  emitByte(0xFF); emitByte(0xC9);           // dec ecx
+  emitJumpIfTo(CC_NE, loop);
+  if (n % 2 != 0)
+  {
+    emitByte(0xF3); emitByte(0x0F);         // movq xmm1, [rdx]
+    emitByte(0x7E); emitByte(0x0A);
+    emitByte(0x66); emitByte(0x0F);         // paddq xmm0, xmm1
+    emitByte(0xD4); emitByte(0xC1);
+  }
+  emitByte(0x66); emitByte(0x0F);           // pshufd xmm1, xmm0, 0x4e
+  emitByte(0x70); emitByte(0xC8); emitByte(0x4E);
+  emitByte(0x66); emitByte(0x0F);           // paddq xmm0, xmm1
+  emitByte(0xD4); emitByte(0xC1);
+  emitByte(0x66); emitByte(0x48);           // movq rax, xmm0
+  emitByte(0x0F); emitByte(0x7E); emitByte(0xC0);
+  emitSubImmediate(R13, 8 * (n - 1));
+  emitStore(RAX, R13, NO_INDEX, 0);
+}
+
+void genNativeInstruction(Instruction *inst)
+{
+  switch (inst->op)
+  {
+  case OP_LA:
+    if (inst->p == 0)
+      emitLea(RAX, R14, NO_INDEX, (int)inst->q);
+    else
+    {
+      emitBase((int)inst->p);
+      emitLea(RAX, RAX, NO_INDEX, (int)inst->q);
+    }
+    emitPush(RAX);
+    break;
+  case OP_LV:
+    if (inst->p == 0)
+      emitLoad(RAX, R15, NO_INDEX, (int)inst->q * 8);
+    else
+    {
+      emitBase((int)inst->p);
+      emitLoad(RAX, R12, RAX, (int)inst->q * 8);
+    }
+    emitPush(RAX);
+    break;
+  case OP_LC:
+    emitAddImmediate(R13, 8);
+    if (inst->q >= INT32_MIN && inst->q <= INT32_MAX)
+    {
+      emitRex(1, 0, NO_INDEX, R13);
+      emitByte(0xC7);
+      emitMemory(0, R13, NO_INDEX, 0);
+      emitInt32((int)inst->q);
+    }
+    else
+    {
+      emitMoveImmediate(RAX, inst->q);
+      emitStore(RAX, R13, NO_INDEX, 0);
+    }
+    break;
+  case OP_LI:
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    emitLoad(RAX, R12, RAX, 0);
+    emitStore(RAX, R13, NO_INDEX, 0);
+    break;
+  case OP_INT:
+    emitAddImmediate(R13, (int)inst->q * 8);
+    emitRegisterOp(0x39, RBX, R13);        // cmp r13, rbx
+    emitJumpIfTo(CC_AE, stackOverflowStub);
+    break;
+  case OP_DCT:
+    emitSubImmediate(R13, (int)inst->q * 8);
+    break;
+  case OP_J:
+    emitJumpToCode(-1, (int)inst->q);
+    break;
+  case OP_FJ:
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    emitDrop();
+    emitRegisterOp(0x85, RAX, RAX);        // test rax, rax
+    emitJumpToCode(CC_E, (int)inst->q);
+    break;
+  case OP_HL:
+    emitSetStatus(PS_NORMAL_EXIT);
+    emitJumpTo(syncExitStub);
+    break;
+  case OP_ST:
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    emitLoad(RCX, R13, NO_INDEX, -8);
+    emitStore(RAX, R12, RCX, 0);
+    emitSubImmediate(R13, 16);
+    break;
+  case OP_STN:
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    emitLoad(RCX, R13, NO_INDEX, -8 * (int)inst->q);
+    emitStore(RAX, R12, RCX, 0);
+    emitDrop();
+    break;
+  case OP_CALL:
+    genNativeCall(inst);
+    break;
+  case OP_EP:
+    genNativeReturn(0);
+    break;
+  case OP_EF:
+    genNativeReturn(1);
+    break;
+  case OP_RC:
+    emitCall((void *)jitReadChar);
+    emitPush(RAX);
+    break;
+  case OP_RI:
+    emitCall((void *)jitReadInt);
+    emitPush(RAX);
+    emitCheckStatus(syncExitStub);
+    break;
+  case OP_WRC:
+  case OP_WRI:
+    emitLoad(RDI, R13, NO_INDEX, 0);
+    emitDrop();
+    emitCall(inst->op == OP_WRC ? (void *)jitWriteChar : (void *)jitWriteInt);
+    break;
+  case OP_WLN:
+    emitCall((void *)jitWriteLn);
+    break;
+  case OP_AD:
+  case OP_AX:
+  case OP_SB:
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    emitDrop();
+    emitMemoryOp(inst->op == OP_SB ? 0x29 : 0x01, RAX, R13, NO_INDEX, 0);
+    break;
+  case OP_ML:
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    emitDrop();
+    emitRex(1, RAX, NO_INDEX, R13);        // imul rax, [r13]
+    emitByte(0x0F);
+    emitByte(0xAF);
+    emitMemory(RAX, R13, NO_INDEX, 0);
+    emitStore(RAX, R13, NO_INDEX, 0);
+    break;
+  case OP_DV:
+    emitLoad(RCX, R13, NO_INDEX, 0);
+    emitDrop();
+    emitRegisterOp(0x85, RCX, RCX);
+    emitJumpIfTo(CC_E, divideByZeroStub);
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    // idiv traps on LLONG_MIN / -1, which wraps as in the constant folder
+    emitImmediateOp(7, RCX, -1);
+    emitByte(0x75);                        // jne +5, to cqo
+    emitByte(0x05);
+    emitByte(0x48);                        // neg rax
+    emitByte(0xF7);
+    emitByte(0xD8);
+    emitByte(0xEB);                        // jmp +5, past idiv
+    emitByte(0x05);
+    emitByte(0x48);                        // cqo
+    emitByte(0x99);
+    emitByte(0x48);                        // idiv rcx
+    emitByte(0xF7);
+    emitByte(0xF9);
+    emitStore(RAX, R13, NO_INDEX, 0);
+    break;
+  case OP_PW:
+    emitLoad(RSI, R13, NO_INDEX, 0);
+    emitDrop();
+    emitLoad(RDI, R13, NO_INDEX, 0);
+    emitCall((void *)powerOf);
+    emitStore(RAX, R13, NO_INDEX, 0);
+    break;
+  case OP_SUM:
+    genNativeSum((int)inst->q);
+    break;
+  case OP_NEG:
+    emitRex(1, 0, NO_INDEX, R13);
+    emitByte(0xF7);
+    emitMemory(3, R13, NO_INDEX, 0);
+    break;
+  case OP_CV:
+    emitLoad(RAX, R13, NO_INDEX, 0);
+    emitPush(RAX);
+    break;
+  case OP_EQ:
+    genNativeCompare(CC_E);
+    break;
+  case OP_NE:
+    genNativeCompare(CC_NE);
+    break;
+  case OP_GT:
+    genNativeCompare(CC_G);
+    break;
+  case OP_LT:
+    genNativeCompare(CC_L);
+    break;
+  case OP_GE:
+    genNativeCompare(CC_GE);
+    break;
+  case OP_LE:
+    genNativeCompare(CC_LE);
+    break;
+  case OP_BP:
+  default:
+    break;
+  }
+}
+
+/******************************************************************/
+
+// Mark every instruction reachable from entry without crossing a call
+void markOwner(int entry)
+{
+  Instruction *code = jitCodeBlock->code;
+  int *work = (int *)malloc(jitCodeBlock->codeSize * sizeof(int));
+  int top = 0;
+  int address;
+
+  work[top++] = entry;
+  while (top > 0)
+  {
+    address = work[--top];
+    while (address >= 0 && address < jitCodeBlock->codeSize && owner[address] < 0)
+    {
+      owner[address] = entry;
+      if (code[address].op == OP_J)
+        address = (int)code[address].q;
+      else if (code[address].op == OP_EP || code[address].op == OP_EF || code[address].op == OP_HL)
+        break;
+      else
+      {
+        if (code[address].op == OP_FJ)
+          work[top++] = (int)code[address].q;
+        address++;
+      }
+    }
+  }
+  free(work);
+}
+
+int compileSubroutine(int entry)
+{
+  Instruction *code = jitCodeBlock->code;
+  int codeSize = jitCodeBlock->codeSize;
+  int *offset;
+  int count = 0;
+  int start = nativeSize;
+  int i;
+
+  for (i = 0; i < codeSize; i++)
+    if (owner[i] == entry)
+      count++;
+  if ((long)nativeSize + (long)count * MAX_NATIVE_SIZE > JIT_CODE_SIZE)
+    return 0;
+
+  if (mprotect(nativeBuffer, JIT_CODE_SIZE, PROT_READ | PROT_WRITE) != 0)
+    return 0;
+
+  offset = (int *)malloc(codeSize * sizeof(int));
+  fixupPosition = (int *)malloc((count + 1) * sizeof(int));
+  fixupTarget = (int *)malloc((count + 1) * sizeof(int));
+  fixupCount = 0;
+
+  for (i = 0; i < codeSize; i++)
+    if (owner[i] == entry)
+    {
+      offset[i] = nativeSize;
+      genNativeInstruction(code + i);
+    }
+
+  for (i = 0; i < fixupCount; i++)
+    patchInt32(fixupPosition[i], offset[fixupTarget[i]] - (fixupPosition[i] + 4));
+
+  for (i = 0; i < codeSize; i++)
+    if (owner[i] == entry)
+      nativeAddress[i] = nativeBuffer + offset[i];
+
+  free(offset);
+  free(fixupPosition);
+  free(fixupTarget);
+
+  if (mprotect(nativeBuffer, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0)
+  {
+    nativeSize = start;
+    return 0;
+  }
+
+  compiledCount++;
+  return 1;
+}
+
+void *compileIfHot(int entry, int threshold)
+{
+  if (nesting >= JIT_MAX_NESTING)
+    return NULL;
+  if (state[entry] == NOT_COMPILED && ++hotness[entry] >= threshold)
+    state[entry] = compileSubroutine(entry) ? COMPILED : UNCOMPILABLE;
+  return state[entry] == COMPILED ? nativeAddress[entry] : NULL;
+}
+
+/******************************************************************/
+
+// Count a call; native code for the entry once it has become hot
+void *jitHotCall(int entry)
+{
+  return compileIfHot(entry, JIT_CALL_THRESHOLD);
+}
+
+// Count a loop back-edge; native code for the loop head once hot
+void *jitHotLoop(int target)
+{
+  int entry = owner[target];
+
+  if (entry < 0 || compileIfHot(entry, JIT_LOOP_THRESHOLD) == NULL)
+    return NULL;
+  return nativeAddress[target];
+}
+
+// Continue the current frame in native code until it returns or halts
+void jitRun(void *nativeCode)
+{
+  nesting++;
+  trampoline(nativeCode);
+  nesting--;
+}
+
+int jitCompiledCount(void)
+{
+  return compiledCount;
+}
+
+int initJit(CodeBlock *codeBlock)
+{
+  int codeSize = codeBlock->codeSize;
+  int i;
+
+  nativeBuffer = (unsigned char *)mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (nativeBuffer == MAP_FAILED)
+    return 0;
+
+  jitCodeBlock = codeBlock;
+  nativeSize = 0;
+  compiledCount = 0;
+  nesting = 0;
+  owner = (int *)malloc(codeSize * sizeof(int));
+  hotness = (int *)calloc(codeSize, sizeof(int));
+  state = (int *)calloc(codeSize, sizeof(int));
+  nativeAddress = (unsigned char **)calloc(codeSize, sizeof(unsigned char *));
+
+  for (i = 0; i < codeSize; i++)
+    owner[i] = -1;
+  if (codeSize > 0)
+    markOwner(0);
+  for (i = 0; i < codeSize; i++)
+    if (codeBlock->code[i].op == OP_CALL)
+      markOwner((int)codeBlock->code[i].q);
+
+  genTrampoline();
+  if (mprotect(nativeBuffer, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0)
+  {
+    cleanJit();
+    return 0;
+  }
+  return 1;
+}
+
+void cleanJit(void)
+{
+  if (nativeBuffer != NULL && nativeBuffer != MAP_FAILED)
+    munmap(nativeBuffer, JIT_CODE_SIZE);
+  nativeBuffer = NULL;
+  free(owner);
+  free(hotness);
+  free(state);
+  free(nativeAddress);
+  owner = NULL;
+  hotness = NULL;
+  state = NULL;
+  nativeAddress = NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "instructions.h"
+
+// Calls or loop back-edges before a subroutine is compiled
+#define JIT_CALL_THRESHOLD 100
+#define JIT_LOOP_THRESHOLD 1000
+
+// Native frames nest on the C stack; deeper calls stay interpreted
+#define JIT_MAX_NESTING 10000
+
+#define JIT_CODE_SIZE (16 * 1024 * 1024)
+
+int initJit(CodeBlock* codeBlock);
+void cleanJit(void);
+
+void* jitHotCall(int entry);
+void* jitHotLoop(int target);
+void jitRun(void* nativeCode);
+
+int jitCompiledCount(void);
+
+#endif
@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "json.h"
+
+// The text being read; a malformed value jumps to jsonError
+char *jsonText;
+int jsonSize;
+int jsonPosition;
+jmp_buf jsonError;
+char *jsonPending;  // a string being read, not in the tree yet
+
+void badJson(void) __attribute__((noreturn));
+
+void badJson(void)
+{
+  longjmp(jsonError, 1);
+}
+
+JsonValue *newJsonValue(JsonType type)
+{
+  JsonValue *value = (JsonValue *)calloc(1, sizeof(JsonValue));
+
+  value->type = type;
+  return value;
+}
+
+void freeJson(JsonValue *value)
+{
+  JsonValue *next;
+
+  for (; value != NULL; value = next)
+  {
+    next = value->next;
+    freeJson(value->children);
+    free(value->text);
+    free(value->key);
+    free(value);
+  }
+}
+
+void skipBlanks(void)
+{
+  while (jsonPosition < jsonSize &&
+         (jsonText[jsonPosition] == ' ' || jsonText[jsonPosition] == '\t' ||
+          jsonText[jsonPosition] == '\n' || jsonText[jsonPosition] == '\r'))
+    jsonPosition++;
+}
+
+// The next character after blanks, taken when it is c
+int takeJson(char c)
+{
+  skipBlanks();
+  if (jsonPosition < jsonSize && jsonText[jsonPosition] == c)
+  {
+    jsonPosition++;
+    return 1;
+  }
+  return 0;
+}
+
+void expectJson(char c)
+{
+  if (!takeJson(c))
+    badJson();
+}
+
+void expectWord(char *word)
+{
+  int length = strlen(word);
+
+  if (jsonSize - jsonPosition < length || strncmp(jsonText + jsonPosition, word, length) != 0)
+    badJson();
+  jsonPosition += length;
+}
+
+int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  badJson();
+}
+
+int readHex4(void)
+{
+  int code = 0;
+  int i;
+
+  if (jsonSize - jsonPosition < 4)
+    badJson();
+  for (i = 0; i < 4; i++)
+    code = code * 16 + hexDigit(jsonText[jsonPosition++]);
+  return code;
+}
+
+// code as UTF-8 at out; the number of bytes
+int encodeUtf8(int code, char *out)
+{
+  if (code < 0x80)
+  {
+    out[0] = code;
+    return 1;
+  }
+  if (code < 0x800)
+  {
+    out[0] = 0xc0 | (code >> 6);
+    out[1] = 0x80 | (code & 0x3f);
+    return 2;
+  }
+  if (code < 0x10000)
+  {
+    out[0] = 0xe0 | (code >> 12);
+    out[1] = 0x80 | ((code >> 6) & 0x3f);
+    out[2] = 0x80 | (code & 0x3f);
+    return 3;
+  }
+  out[0] = 0xf0 | (code >> 18);
+  out[1] = 0x80 | ((code >> 12) & 0x3f);
+  out[2] = 0x80 | ((code >> 6) & 0x3f);
+  out[3] = 0x80 | (code & 0x3f);
+  return 4;
+}
+
+// After the opening quote; unescaped text is never longer than escaped
+char *readJsonString(int *length)
+{
+  char *text = (char *)malloc(jsonSize - jsonPosition + 1);
+  int size = 0;
+  int code, low;
+  char c;
+
+  jsonPending = text;
+  for (;;)
+  {
+    if (jsonPosition >= jsonSize)
+      badJson();
+    c = jsonText[jsonPosition++];
+    if (c == '"')
+      break;
+    if (c != '\\')
+    {
+      text[size++] = c;
+      continue;
+    }
+    if (jsonPosition >= jsonSize)
+      badJson();
+    switch (c = jsonText[jsonPosition++])
+    {
+    case 'b': text[size++] = '\b'; break;
+    case 'f': text[size++] = '\f'; break;
+    case 'n': text[size++] = '\n'; break;
+    case 'r': text[size++] = '\r'; break;
+    case 't': text[size++] = '\t'; break;
+    case 'u':
+      code = readHex4();
+      // a surrogate pair is one character
+      if (code >= 0xd800 && code < 0xdc00 && jsonSize - jsonPosition >= 6 &&
+          jsonText[jsonPosition] == '\\' && jsonText[jsonPosition + 1] == 'u')
+      {
+        jsonPosition += 2;
+        low = readHex4();
+        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+      }
+      size += encodeUtf8(code, text + size);
+      break;
+    default:
+      text[size++] = c;
+      break;
+    }
+  }
+  text[size] = '\0';
+  *length = size;
+  jsonPending = NULL;
+  return text;
+}
+
+void readJsonValue(JsonValue *value, int depth);
+
+// The children of an array or object, up to close
+void readJsonChildren(JsonValue *value, char close, int depth)
+{
+  JsonValue **last = &value->children;
+  JsonValue *child;
+  int length;
+
+  if (takeJson(close))
+    return;
+  do
+  {
+    child = newJsonValue(JSON_NULL);
+    *last = child;
+    last = &child->next;
+    if (value->type == JSON_OBJECT)
+    {
+      expectJson('"');
+      child->key = readJsonString(&length);
+      expectJson(':');
+    }
+    readJsonValue(child, depth + 1);
+  } while (takeJson(','));
+  expectJson(close);
+}
+
+// Every value is in the tree before it is read, so that the tree can be
+// freed whole when it is malformed
+void readJsonValue(JsonValue *value, int depth)
+{
+  int start;
+
+  if (depth > JSON_MAX_DEPTH)
+    badJson();
+  skipBlanks();
+  if (jsonPosition >= jsonSize)
+    badJson();
+  switch (jsonText[jsonPosition])
+  {
+  case '{':
+  case '[':
+    value->type = (jsonText[jsonPosition] == '{') ? JSON_OBJECT : JSON_ARRAY;
+    jsonPosition++;
+    readJsonChildren(value, (value->type == JSON_OBJECT) ? '}' : ']', depth);
+    break;
+  case '"':
+    jsonPosition++;
+    value->text = readJsonString(&value->length);
+    value->type = JSON_STRING;
+    break;
+  case 't':
+    expectWord("true");
+    value->type = JSON_TRUE;
+    break;
+  case 'f':
+    expectWord("false");
+    value->type = JSON_FALSE;
+    break;
+  case 'n':
+    expectWord("null");
+    value->type = JSON_NULL;
+    break;
+  default:
+    start = jsonPosition;
+    while (jsonPosition < jsonSize && strchr("+-0123456789.eE", jsonText[jsonPosition]) != NULL)
+      jsonPosition++;
+    if (jsonPosition == start)
+      badJson();
+    value->length = jsonPosition - start;
+    value->text = (char *)malloc(value->length + 1);
+    memcpy(value->text, jsonText + start, value->length);
+    value->text[value->length] = '\0';
+    value->type = JSON_NUMBER;
+    break;
+  }
+}
+
+JsonValue *parseJson(char *text, int size)
+{
+  JsonValue *root = newJsonValue(JSON_NULL);
+
+  jsonText = text;
+  jsonSize = size;
+  jsonPosition = 0;
+  jsonPending = NULL;
+  if (setjmp(jsonError) != 0)
+  {
+    free(jsonPending);
+    freeJson(root);
+    return NULL;
+  }
+  readJsonValue(root, 0);
+  skipBlanks();
+  if (jsonPosition != jsonSize)
+    badJson();
+  return root;
+}
+
+JsonValue *getMember(JsonValue *value, char *key)
+{
+  JsonValue *member;
+
+  if (value == NULL || value->type != JSON_OBJECT)
+    return NULL;
+  for (member = value->children; member != NULL; member = member->next)
+    if (strcmp(member->key, key) == 0)
+      return member;
+  return NULL;
+}
+
+int getInteger(JsonValue *value, int otherwise)
+{
+  if (value == NULL || value->type != JSON_NUMBER)
+    return otherwise;
+  return atoi(value->text);
+}
@@ -0,0 +1,38 @@
+#ifndef __JSON_H__
+#define __JSON_H__
+
+// Just enough JSON for the requests of a language client (see lsp.h):
+// a message is read into a tree of values, whose strings are unescaped.
+
+// Arrays and objects nested deeper are refused
+#define JSON_MAX_DEPTH 64
+
+typedef enum {
+  JSON_NULL,
+  JSON_FALSE,
+  JSON_TRUE,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_ARRAY,
+  JSON_OBJECT
+} JsonType;
+
+typedef struct JsonValue_ {
+  JsonType type;
+  char *text;                   // a string unescaped, a number as written
+  int length;
+  char *key;                    // of a member of an object
+  struct JsonValue_ *children;  // of an array or object, in order
+  struct JsonValue_ *next;
+} JsonValue;
+
+// NULL when text is not one JSON value
+JsonValue *parseJson(char *text, int size);
+void freeJson(JsonValue *value);
+
+// The member key of an object; NULL when value is not an object or has none
+JsonValue *getMember(JsonValue *value, char *key);
+// A number's value, or otherwise when value is not a number
+int getInteger(JsonValue *value, int otherwise);
+
+#endif
@@ -0,0 +1,186 @@
+// Thin client of kplc --server.
+//
+//   kplclient socket input.kpl          compile, printing the diagnostic if any
+//   kplclient -n N socket input.kpl     compile N times and print the latency
+//   kplclient -shutdown socket          stop the server
+//
+// Exits with 1 when the program has an error, 2 when the server can't be used.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+int connectServer(char *socketPath)
+{
+  struct sockaddr_un address;
+  int fd;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+  {
+    fprintf(stderr, "kplclient: can't connect to %s\n", socketPath);
+    exit(2);
+  }
+  return fd;
+}
+
+void sendAll(int fd, char *buffer, long size)
+{
+  long done = 0, n;
+
+  while (done < size)
+  {
+    n = write(fd, buffer + done, size - done);
+    if (n <= 0)
+    {
+      fprintf(stderr, "kplclient: lost the server\n");
+      exit(2);
+    }
+    done += n;
+  }
+}
+
+void receiveReply(int fd, char *reply, int size)
+{
+  int length = 0;
+  char c;
+
+  while (read(fd, &c, 1) == 1)
+  {
+    if (c == '\n')
+    {
+      reply[length] = '\0';
+      return;
+    }
+    if (length + 1 < size)
+      reply[length++] = c;
+  }
+  fprintf(stderr, "kplclient: lost the server\n");
+  exit(2);
+}
+
+char *readSource(char *fileName, long *size)
+{
+  FILE *f = fopen(fileName, "rb");
+  char *source;
+
+  if (f == NULL)
+  {
+    fprintf(stderr, "kplclient: can't read %s\n", fileName);
+    exit(2);
+  }
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  source = (char *)malloc(*size + 1);
+  if (fread(source, 1, *size, f) != (size_t)*size)
+  {
+    fprintf(stderr, "kplclient: can't read %s\n", fileName);
+    exit(2);
+  }
+  fclose(f);
+  return source;
+}
+
+void compileSource(int fd, char *source, long size, char *reply)
+{
+  char header[SERVER_MAX_LINE];
+
+  snprintf(header, sizeof(header), "COMPILE %ld\n", size);
+  sendAll(fd, header, strlen(header));
+  sendAll(fd, source, size);
+  receiveReply(fd, reply, SERVER_MAX_REPLY);
+}
+
+long long microClock(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+int compareLatency(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+// Requests one after another on one connection, as an editor sends them
+void measureLatency(int fd, char *source, long size, int requests)
+{
+  char reply[SERVER_MAX_REPLY];
+  long long *latencies = (long long *)malloc(requests * sizeof(long long));
+  long long start, total = 0;
+  int i;
+
+  for (i = 0; i < requests; i++)
+  {
+    start = microClock();
+    compileSource(fd, source, size, reply);
+    latencies[i] = microClock() - start;
+    total += latencies[i];
+  }
+  qsort(latencies, requests, sizeof(long long), compareLatency);
+  printf("requests %d  mean %lld us  p50 %lld us  p99 %lld us  max %lld us  (%s)\n",
+         requests, total / requests, latencies[requests / 2],
+         latencies[(requests * 99 + 99) / 100 - 1], latencies[requests - 1], reply);
+  free(latencies);
+}
+
+int main(int argc, char *argv[])
+{
+  char reply[SERVER_MAX_REPLY];
+  char *source;
+  long size;
+  int requests = 0;
+  int fd;
+
+  if (argc == 3 && strcmp(argv[1], "-shutdown") == 0)
+  {
+    fd = connectServer(argv[2]);
+    sendAll(fd, "SHUTDOWN\n", 9);
+    receiveReply(fd, reply, sizeof(reply));
+    close(fd);
+    return 0;
+  }
+  if (argc == 5 && strcmp(argv[1], "-n") == 0)
+  {
+    requests = atoi(argv[2]);
+    argv += 2;
+    argc -= 2;
+  }
+  if (argc != 3 || requests < 0)
+  {
+    fprintf(stderr, "Usage: kplclient [-n requests] socket input | kplclient -shutdown socket\n");
+    return 2;
+  }
+
+  source = readSource(argv[2], &size);
+  fd = connectServer(argv[1]);
+  if (requests > 0)
+  {
+    measureLatency(fd, source, size, requests);
+    close(fd);
+    return 0;
+  }
+
+  compileSource(fd, source, size, reply);
+  close(fd);
+  free(source);
+  if (strncmp(reply, "ERROR ", 6) == 0)
+  {
+    printf("%s\n", reply + 6);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "alloc.h"
+#include "lines.h"
+
+__thread LineIndex *sourceLines = NULL;
+
+void addLine(LineIndex *index, int start)
+{
+  if (index->count == index->capacity)
+  {
+    index->capacity = 2 * index->capacity + 1024;
+    index->starts = REALLOCATE_ARRAY(index->starts, int, index->capacity, ALLOC_LINES);
+  }
+  index->starts[index->count++] = start;
+}
+
+LineIndex *indexLines(char *text, int size)
+{
+  LineIndex *index = ALLOCATE(LineIndex, ALLOC_LINES);
+  int offset = 0;
+#ifdef __SSE2__
+  __m128i newlines = _mm_set1_epi8('\n');
+  int found;
+#endif
+
+  index->starts = NULL;
+  index->count = index->capacity = 0;
+  addLine(index, 0);
+#ifdef __SSE2__
+  // a bit of found for each newline among the 16 bytes
+  for (; offset + 16 <= size; offset += 16)
+  {
+    found = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(text + offset)), newlines));
+    while (found != 0)
+    {
+      addLine(index, offset + __builtin_ctz(found) + 1);
+      found &= found - 1;
+    }
+  }
+#endif
+  for (; offset < size; offset++)
+    if (text[offset] == '\n')
+      addLine(index, offset + 1);
+  return index;
+}
+
+void freeLineIndex(LineIndex *index)
+{
+  RELEASE(index->starts);
+  RELEASE(index);
+}
+
+int findLine(LineIndex *index, int offset)
+{
+  int low = 0, high = index->count;
+  int middle;
+
+  // the last line starting at or before offset
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+    if (index->starts[middle] <= offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low - 1;
+}
+
+void findPosition(LineIndex *index, int offset, int *lineNo, int *colNo)
+{
+  // the reader is on the next line once it read a newline
+  int line = findLine(index, offset + 1);
+
+  *lineNo = line + 1;
+  *colNo = offset + 1 - index->starts[line];
+}
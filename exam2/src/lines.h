@@ -0,0 +1,34 @@
+#ifndef __LINES_H__
+#define __LINES_H__
+
+// Where the lines of a text start, found 16 bytes at a time with SSE2
+// where the compiler has it, or noted by the reader as it passes them:
+// the line of any place in the text is then a binary search away, without
+// reading up to it. Tokens and errors carry only their offset in the
+// source; the line and column are found this way when a diagnostic is
+// written.
+
+typedef struct {
+  int *starts;    // the offset of each line, the first at 0
+  int count;
+  int capacity;
+} LineIndex;
+
+// The index offsets of diagnostics are found in, per thread: the reader's
+// while it reads a source, a TokenBuffer's while its tokens are parsed;
+// error() places none without one
+extern __thread LineIndex *sourceLines;
+
+LineIndex *indexLines(char *text, int size);
+void freeLineIndex(LineIndex *index);
+// Notes a line starting at start, after those already noted
+void addLine(LineIndex *index, int start);
+
+// The line holding offset, the first being 0; a newline ends its line
+int findLine(LineIndex *index, int offset);
+// The lineNo-colNo of the character at offset as the reader counts them,
+// from 1-1: a newline is at column 0 of the line it starts, and the end
+// of the source where its last character is
+void findPosition(LineIndex *index, int offset, int *lineNo, int *colNo);
+
+#endif
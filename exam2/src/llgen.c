@@ -0,0 +1,489 @@
+// Build-time LL(1) table generator.
+//
+//   llgen [-d dialect] grammar output
+//
+// reads a grammar, computes FIRST and FOLLOW, checks that every
+// nonterminal can be predicted from one token of lookahead, and writes
+// output.h/output.c with the sets indexed by Nonterminal and TokenType.
+// Lines between "%if name ..." and "%endif" only count when one of the
+// names is the dialect; "Name += ..." adds alternatives to a rule.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_LINE_LEN 1024
+#define MAX_NAME_LEN 64
+#define MAX_SYMBOLS 256
+#define MAX_PRODUCTIONS 512
+#define MAX_RHS_LEN 16
+
+#define EMPTY_SYMBOL "EMPTY"
+#define END_SYMBOL "TK_EOF"
+#define NO_PRODUCTION -1
+
+struct Symbol_ {
+  char name[MAX_NAME_LEN];
+  int isTerminal;
+  int isDefined;
+  int isGreedy;
+  int isNullable;
+  char first[MAX_SYMBOLS];
+  char follow[MAX_SYMBOLS];
+};
+
+typedef struct Symbol_ Symbol;
+
+struct Production_ {
+  int lhs;
+  int rhs[MAX_RHS_LEN];
+  int length;
+  int line;
+};
+
+typedef struct Production_ Production;
+
+Symbol symbols[MAX_SYMBOLS];
+int symbolCount = 0;
+Production productions[MAX_PRODUCTIONS];
+int productionCount = 0;
+int startSymbol = -1;
+// Nonterminals in the order their rules appear
+int rules[MAX_SYMBOLS];
+int ruleCount = 0;
+char *grammarFile;
+char *dialect = NULL;
+int lineNo = 0;
+
+void fail(char *message, char *name)
+{
+  fprintf(stderr, "%s:%d: %s %s\n", grammarFile, lineNo, message, name != NULL ? name : "");
+  exit(1);
+}
+
+// Token names (TK_, KW_, SB_ ...) are terminals, anything else a nonterminal
+int isTerminalName(char *name)
+{
+  char *c;
+  for (c = name; *c != '\0'; c++)
+    if (islower((unsigned char)*c))
+      return 0;
+  return strchr(name, '_') != NULL;
+}
+
+int findSymbol(char *name)
+{
+  int i;
+
+  for (i = 0; i < symbolCount; i++)
+    if (strcmp(symbols[i].name, name) == 0)
+      return i;
+
+  if (symbolCount == MAX_SYMBOLS)
+    fail("too many symbols at", name);
+  if (strlen(name) >= MAX_NAME_LEN)
+    fail("symbol name too long:", name);
+  memset(symbols + symbolCount, 0, sizeof(Symbol));
+  strcpy(symbols[symbolCount].name, name);
+  symbols[symbolCount].isTerminal = isTerminalName(name);
+  return symbolCount++;
+}
+
+/******************************************************************/
+
+// Next whitespace separated word of a line, NULL at the end or at a comment
+char *nextWord(char **cursor)
+{
+  char *word;
+
+  while (isspace((unsigned char)**cursor))
+    (*cursor)++;
+  if (**cursor == '\0' || **cursor == '#')
+    return NULL;
+  word = *cursor;
+  while (**cursor != '\0' && !isspace((unsigned char)**cursor))
+    (*cursor)++;
+  if (**cursor != '\0')
+    *(*cursor)++ = '\0';
+  return word;
+}
+
+Production *newProduction(int lhs)
+{
+  if (productionCount == MAX_PRODUCTIONS)
+    fail("too many productions", NULL);
+  productions[productionCount].lhs = lhs;
+  productions[productionCount].length = 0;
+  productions[productionCount].line = lineNo;
+  return productions + productionCount++;
+}
+
+void readGrammar(FILE *in)
+{
+  char line[MAX_LINE_LEN];
+  char *cursor, *word;
+  int lhs = -1;
+  int symbol;
+  int inCondition = 0, skipping = 0;
+  Production *production = NULL;
+
+  while (fgets(line, MAX_LINE_LEN, in) != NULL)
+  {
+    lineNo++;
+    cursor = line;
+    word = nextWord(&cursor);
+    if (word == NULL)
+      continue;
+
+    if (strcmp(word, "%if") == 0)
+    {
+      if (inCondition)
+        fail("nested %if", NULL);
+      inCondition = skipping = 1;
+      while ((word = nextWord(&cursor)) != NULL)
+        if (dialect != NULL && strcmp(word, dialect) == 0)
+          skipping = 0;
+      continue;
+    }
+    if (strcmp(word, "%endif") == 0)
+    {
+      if (!inCondition)
+        fail("%endif without %if", NULL);
+      inCondition = skipping = 0;
+      continue;
+    }
+    if (skipping)
+      continue;
+
+    if (strcmp(word, "%start") == 0)
+    {
+      if ((word = nextWord(&cursor)) == NULL)
+        fail("missing start symbol", NULL);
+      startSymbol = findSymbol(word);
+      continue;
+    }
+    if (strcmp(word, "%greedy") == 0)
+    {
+      while ((word = nextWord(&cursor)) != NULL)
+        symbols[findSymbol(word)].isGreedy = 1;
+      continue;
+    }
+
+    // "Name ::= ..." starts a rule, "Name += ..." extends one and
+    // "| ..." continues the previous line
+    if (strcmp(word, "|") != 0)
+    {
+      lhs = findSymbol(word);
+      if (symbols[lhs].isTerminal)
+        fail("a token cannot be defined:", word);
+      word = nextWord(&cursor);
+      if (word != NULL && strcmp(word, "+=") == 0)
+      {
+        if (!symbols[lhs].isDefined)
+          fail("extending an undefined rule:", symbols[lhs].name);
+      }
+      else if (word != NULL && strcmp(word, "::=") == 0)
+      {
+        if (symbols[lhs].isDefined)
+          fail("rule defined twice:", symbols[lhs].name);
+        symbols[lhs].isDefined = 1;
+        rules[ruleCount++] = lhs;
+        if (startSymbol < 0)
+          startSymbol = lhs;
+      }
+      else
+        fail("'::=' expected after", symbols[lhs].name);
+    }
+    else if (lhs < 0)
+      fail("'|' outside a rule", NULL);
+
+    production = newProduction(lhs);
+    while ((word = nextWord(&cursor)) != NULL)
+    {
+      if (strcmp(word, "|") == 0)
+      {
+        production = newProduction(lhs);
+        continue;
+      }
+      if (strcmp(word, EMPTY_SYMBOL) == 0)
+        continue;
+      symbol = findSymbol(word);
+      if (production->length == MAX_RHS_LEN)
+        fail("alternative too long in", symbols[lhs].name);
+      production->rhs[production->length++] = symbol;
+    }
+  }
+
+  if (inCondition)
+    fail("%if without %endif", NULL);
+  for (symbol = 0; symbol < symbolCount; symbol++)
+    if (!symbols[symbol].isTerminal && !symbols[symbol].isDefined)
+      fail("undefined nonterminal", symbols[symbol].name);
+  if (startSymbol < 0)
+    fail("empty grammar", NULL);
+}
+
+/******************************************************************/
+
+// Add the terminals of from to into; report whether anything was new
+int merge(char *into, char *from)
+{
+  int i, changed = 0;
+
+  for (i = 0; i < symbolCount; i++)
+    if (from[i] && !into[i])
+    {
+      into[i] = 1;
+      changed = 1;
+    }
+  return changed;
+}
+
+// FIRST of rhs[from..], returning whether that part can derive nothing
+int firstOfSequence(Production *production, int from, char *first)
+{
+  int i;
+  Symbol *symbol;
+
+  for (i = from; i < production->length; i++)
+  {
+    symbol = symbols + production->rhs[i];
+    if (symbol->isTerminal)
+    {
+      first[production->rhs[i]] = 1;
+      return 0;
+    }
+    merge(first, symbol->first);
+    if (!symbol->isNullable)
+      return 0;
+  }
+  return 1;
+}
+
+void computeFirstSets(void)
+{
+  int changed = 1;
+  int i;
+  char first[MAX_SYMBOLS];
+  Symbol *lhs;
+
+  while (changed)
+  {
+    changed = 0;
+    for (i = 0; i < productionCount; i++)
+    {
+      lhs = symbols + productions[i].lhs;
+      memset(first, 0, sizeof(first));
+      if (firstOfSequence(productions + i, 0, first) && !lhs->isNullable)
+        lhs->isNullable = changed = 1;
+      changed |= merge(lhs->first, first);
+    }
+  }
+}
+
+void computeFollowSets(void)
+{
+  int changed = 1;
+  int i, k;
+  char first[MAX_SYMBOLS];
+  Production *production;
+  Symbol *symbol;
+
+  symbols[startSymbol].follow[findSymbol(END_SYMBOL)] = 1;
+
+  while (changed)
+  {
+    changed = 0;
+    for (i = 0; i < productionCount; i++)
+    {
+      production = productions + i;
+      for (k = 0; k < production->length; k++)
+      {
+        symbol = symbols + production->rhs[k];
+        if (symbol->isTerminal)
+          continue;
+        memset(first, 0, sizeof(first));
+        if (firstOfSequence(production, k + 1, first))
+          changed |= merge(symbol->follow, symbols[production->lhs].follow);
+        changed |= merge(symbol->follow, first);
+      }
+    }
+  }
+}
+
+/******************************************************************/
+
+void reportConflict(Production *a, Production *b, int token)
+{
+  fprintf(stderr, "%s:%d: LL(1) conflict in %s on %s with the alternative on line %d\n",
+          grammarFile, b->line, symbols[b->lhs].name, symbols[token].name, a->line);
+}
+
+void predict(int *table, int production, int token, int *conflicts)
+{
+  int lhs = productions[production].lhs;
+  int *entry = table + lhs * MAX_SYMBOLS + token;
+  Production *old;
+
+  if (*entry == NO_PRODUCTION || *entry == production)
+  {
+    *entry = production;
+    return;
+  }
+
+  old = productions + *entry;
+  if (symbols[lhs].isGreedy && (old->length == 0 || productions[production].length == 0))
+  {
+    if (old->length == 0)
+      *entry = production;
+    return;
+  }
+  reportConflict(old, productions + production, token);
+  (*conflicts)++;
+}
+
+// Fill the prediction table; every clash not declared %greedy is an error
+int checkLL1(void)
+{
+  int *table = (int *)malloc(MAX_SYMBOLS * MAX_SYMBOLS * sizeof(int));
+  char first[MAX_SYMBOLS];
+  int conflicts = 0;
+  int i, token, nullable;
+
+  for (i = 0; i < MAX_SYMBOLS * MAX_SYMBOLS; i++)
+    table[i] = NO_PRODUCTION;
+
+  for (i = 0; i < productionCount; i++)
+  {
+    memset(first, 0, sizeof(first));
+    nullable = firstOfSequence(productions + i, 0, first);
+    for (token = 0; token < symbolCount; token++)
+    {
+      if (first[token])
+        predict(table, i, token, &conflicts);
+      if (nullable && symbols[productions[i].lhs].follow[token])
+        predict(table, i, token, &conflicts);
+    }
+  }
+
+  free(table);
+  return conflicts;
+}
+
+/******************************************************************/
+
+// Expression2 -> NT_EXPRESSION2, LValueList -> NT_L_VALUE_LIST
+void enumName(char *name, char *out)
+{
+  int i, k = 0;
+
+  strcpy(out, "NT_");
+  k = 3;
+  for (i = 0; name[i] != '\0'; i++)
+  {
+    if (i > 0 && isupper((unsigned char)name[i]) &&
+        (islower((unsigned char)name[i - 1]) ||
+         (name[i + 1] != '\0' && islower((unsigned char)name[i + 1]))))
+      out[k++] = '_';
+    out[k++] = toupper((unsigned char)name[i]);
+  }
+  out[k] = '\0';
+}
+
+void writeSets(FILE *out, char *tableName, int isFollow)
+{
+  char name[2 * MAX_NAME_LEN];
+  char *set;
+  int i, token;
+
+  fprintf(out, "const char %s[NONTERMINAL_COUNT][TOKEN_TYPE_COUNT] = {\n", tableName);
+  for (i = 0; i < ruleCount; i++)
+  {
+    enumName(symbols[rules[i]].name, name);
+    fprintf(out, "  [%s] = {", name);
+    set = isFollow ? symbols[rules[i]].follow : symbols[rules[i]].first;
+    for (token = 0; token < symbolCount; token++)
+      if (set[token])
+        fprintf(out, " [%s] = 1,", symbols[token].name);
+    fprintf(out, " },\n");
+  }
+  fprintf(out, "};\n\n");
+}
+
+int writeTables(char *output)
+{
+  char fileName[MAX_LINE_LEN];
+  char name[2 * MAX_NAME_LEN];
+  char *baseName;
+  FILE *out;
+  int i;
+
+  snprintf(fileName, MAX_LINE_LEN, "%s.h", output);
+  if ((out = fopen(fileName, "w")) == NULL)
+    return 0;
+  fprintf(out, "/* Generated by llgen from %s. Do not edit. */\n\n", grammarFile);
+  fprintf(out, "#ifndef __PARSETAB_H__\n#define __PARSETAB_H__\n\n#include \"token.h\"\n\n");
+  fprintf(out, "typedef enum {\n");
+  for (i = 0; i < ruleCount; i++)
+  {
+    enumName(symbols[rules[i]].name, name);
+    fprintf(out, "  %s,\n", name);
+  }
+  fprintf(out, "} Nonterminal;\n\n#define NONTERMINAL_COUNT %d\n\n", ruleCount);
+  fprintf(out, "extern const char firstSets[NONTERMINAL_COUNT][TOKEN_TYPE_COUNT];\n");
+  fprintf(out, "extern const char followSets[NONTERMINAL_COUNT][TOKEN_TYPE_COUNT];\n\n");
+  fprintf(out, "#define inFirst(nonterminal, tokenType) (firstSets[nonterminal][tokenType])\n");
+  fprintf(out, "#define inFollow(nonterminal, tokenType) (followSets[nonterminal][tokenType])\n\n");
+  fprintf(out, "#endif\n");
+  fclose(out);
+
+  snprintf(fileName, MAX_LINE_LEN, "%s.c", output);
+  if ((out = fopen(fileName, "w")) == NULL)
+    return 0;
+  fprintf(out, "/* Generated by llgen from %s. Do not edit. */\n\n", grammarFile);
+  baseName = strrchr(output, '/');
+  fprintf(out, "#include \"%s.h\"\n\n", baseName != NULL ? baseName + 1 : output);
+  writeSets(out, "firstSets", 0);
+  writeSets(out, "followSets", 1);
+  fclose(out);
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  FILE *in;
+
+  if (argc == 5 && strcmp(argv[1], "-d") == 0)
+  {
+    dialect = argv[2];
+    argv += 2;
+    argc -= 2;
+  }
+  if (argc != 3)
+  {
+    fprintf(stderr, "Usage: llgen [-d dialect] grammar output\n");
+    return 1;
+  }
+
+  grammarFile = argv[1];
+  if ((in = fopen(grammarFile, "r")) == NULL)
+  {
+    fprintf(stderr, "llgen: can't read %s\n", grammarFile);
+    return 1;
+  }
+  readGrammar(in);
+  fclose(in);
+
+  computeFirstSets();
+  computeFollowSets();
+  if (checkLL1() > 0)
+    return 1;
+
+  if (!writeTables(argv[2]))
+  {
+    fprintf(stderr, "llgen: can't write %s\n", argv[2]);
+    return 1;
+  }
+  return 0;
+}
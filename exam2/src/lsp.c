@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include "reader.h"
+#include "symtab.h"
+#include "debug.h"
+#include "document.h"
+#include "json.h"
+#include "lsp.h"
+
+// JSON-RPC error codes
+#define PARSE_ERROR -32700
+#define INVALID_REQUEST -32600
+#define METHOD_NOT_FOUND -32601
+
+// Kinds of DocumentSymbol, the nearest the protocol has for each object
+#define SYMBOL_CLASS 5
+#define SYMBOL_FUNCTION 12
+#define SYMBOL_VARIABLE 13
+#define SYMBOL_CONSTANT 14
+
+typedef struct OpenDocument_ {
+  char *uri;
+  Document *document;
+  int changed;          // since its diagnostics were published
+  char *symbols;        // the last documentSymbol result
+  int symbolsSize;
+  int symbolsRevision;  // the revision of the document it was made at
+  struct OpenDocument_ *next;
+} OpenDocument;
+
+OpenDocument *openDocuments = NULL;
+int shutdownRequested = 0;
+
+// What has been read of stdin and not taken yet
+char input[LSP_INPUT_BUFFER];
+int inputStart = 0;
+int inputEnd = 0;
+
+// The message being written
+char *reply = NULL;
+int replySize = 0;
+int replyCapacity = 0;
+
+// Where visitDeclarations has got to in the reply
+Document *symbolDocument;
+int symbolDepth;
+int symbolCount;
+
+/******************* messages ******************************/
+
+void appendReply(char *format, ...)
+{
+  va_list arguments;
+  int n;
+
+  for (;;)
+  {
+    va_start(arguments, format);
+    n = vsnprintf(reply + replySize, replyCapacity - replySize, format, arguments);
+    va_end(arguments);
+    if (replySize + n < replyCapacity)
+      break;
+    replyCapacity = 2 * (replySize + n) + 256;
+    reply = (char *)realloc(reply, replyCapacity);
+  }
+  replySize += n;
+}
+
+void appendString(char *text, int length)
+{
+  unsigned char c;
+  int i;
+
+  appendReply("\"");
+  for (i = 0; i < length; i++)
+  {
+    c = (unsigned char)text[i];
+    if (c == '"' || c == '\\')
+      appendReply("\\%c", c);
+    else if (c == '\n')
+      appendReply("\\n");
+    else if (c < 0x20)
+      appendReply("\\u%04x", c);
+    else
+      appendReply("%c", c);
+  }
+  appendReply("\"");
+}
+
+// An id is sent back as it came, a number or a string
+void appendId(JsonValue *id)
+{
+  if (id == NULL)
+    appendReply("null");
+  else if (id->type == JSON_STRING)
+    appendString(id->text, id->length);
+  else
+    appendReply("%s", id->text);
+}
+
+void sendReply(void)
+{
+  printf("Content-Length: %d\r\n\r\n", replySize);
+  fwrite(reply, 1, replySize, stdout);
+  fflush(stdout);
+  replySize = 0;
+}
+
+void beginResult(JsonValue *id)
+{
+  appendReply("{\"jsonrpc\":\"2.0\",\"id\":");
+  appendId(id);
+  appendReply(",\"result\":");
+}
+
+void endResult(void)
+{
+  appendReply("}");
+  sendReply();
+}
+
+void sendError(JsonValue *id, int code, char *message)
+{
+  appendReply("{\"jsonrpc\":\"2.0\",\"id\":");
+  appendId(id);
+  appendReply(",\"error\":{\"code\":%d,\"message\":\"%s\"}}", code, message);
+  sendReply();
+}
+
+// 0 at the end of the input
+int fillInput(void)
+{
+  int n;
+
+  do
+    n = read(0, input, LSP_INPUT_BUFFER);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0)
+    return 0;
+  inputStart = 0;
+  inputEnd = n;
+  return 1;
+}
+
+// 1 when more of the input has come, read or not
+int inputWaiting(void)
+{
+  struct pollfd fd;
+
+  fd.fd = 0;
+  fd.events = POLLIN;
+  return inputStart < inputEnd || poll(&fd, 1, 0) > 0;
+}
+
+// Reads size bytes; 0 when the input ends before
+int readInput(char *buffer, int size)
+{
+  int n;
+
+  for (; size > 0; size -= n, buffer += n)
+  {
+    if (inputStart == inputEnd && !fillInput())
+      return 0;
+    n = (inputEnd - inputStart < size) ? inputEnd - inputStart : size;
+    memcpy(buffer, input + inputStart, n);
+    inputStart += n;
+  }
+  return 1;
+}
+
+// A line of the header, cut to its first size - 1 bytes; 0 at the end of the input
+int readHeaderLine(char *line, int size)
+{
+  int length = 0;
+  char c;
+
+  do
+  {
+    if (!readInput(&c, 1))
+      return 0;
+    if (length < size - 1)
+      line[length++] = c;
+  }
+  while (c != '\n');
+  line[length] = '\0';
+  return 1;
+}
+
+// The body of the next message; NULL at the end of the input
+char *readMessage(int *size)
+{
+  char header[LSP_MAX_HEADER];
+  char *body;
+  int length = -1;
+
+  for (;;)
+  {
+    if (!readHeaderLine(header, sizeof(header)))
+      return NULL;
+    if (strcmp(header, "\r\n") == 0 || strcmp(header, "\n") == 0)
+    {
+      if (length >= 0)
+        break;
+      continue;
+    }
+    sscanf(header, "Content-Length: %d", &length);
+  }
+  if (length > LSP_MAX_MESSAGE)
+    return NULL;
+  body = (char *)malloc(length + 1);
+  if (!readInput(body, length))
+  {
+    free(body);
+    return NULL;
+  }
+  body[length] = '\0';
+  *size = length;
+  return body;
+}
+
+/******************* places ******************************/
+
+OpenDocument *findOpenDocument(char *uri)
+{
+  OpenDocument *open;
+
+  for (open = openDocuments; open != NULL; open = open->next)
+    if (strcmp(open->uri, uri) == 0)
+      return open;
+  return NULL;
+}
+
+// The document params->textDocument names
+OpenDocument *requestedDocument(JsonValue *params)
+{
+  JsonValue *uri = getMember(getMember(params, "textDocument"), "uri");
+
+  if (uri == NULL || uri->type != JSON_STRING)
+    return NULL;
+  return findOpenDocument(uri->text);
+}
+
+// Characters a token takes on its line; symbols are taken as one
+int tokenLength(Token *token)
+{
+  if (token->tokenType == TK_IDENT || token->tokenType == TK_NUMBER)
+    return strlen(token->string);
+  if (token->tokenType == TK_CHAR)
+    return 3;
+  return 1;
+}
+
+void appendPosition(int lineNo, int colNo)
+{
+  appendReply("{\"line\":%d,\"character\":%d}", lineNo - 1, colNo - 1);
+}
+
+// The reader's lineNo-colNo of the first character of token
+void findTokenPosition(Document *document, int token, LexedToken *lexed, int *lineNo, int *colNo)
+{
+  getLexedToken(document->tokens, token, lexed);
+  findPosition(getLineIndex(document->tokens), lexed->token.offset, lineNo, colNo);
+}
+
+// From the first character of token first to the end of token last
+void appendRange(Document *document, int first, int last)
+{
+  LexedToken lexed;
+  int lineNo, colNo;
+
+  findTokenPosition(document, first, &lexed, &lineNo, &colNo);
+  appendReply("{\"start\":");
+  appendPosition(lineNo, colNo);
+  findTokenPosition(document, last, &lexed, &lineNo, &colNo);
+  appendReply(",\"end\":");
+  appendPosition(lineNo, colNo + tokenLength(&lexed.token));
+  appendReply("}");
+}
+
+// A position of the protocol as the reader's lineNo-colNo; 0 when malformed
+int readPosition(JsonValue *position, int *lineNo, int *colNo)
+{
+  *lineNo = getInteger(getMember(position, "line"), -1) + 1;
+  *colNo = getInteger(getMember(position, "character"), -1) + 1;
+  return *lineNo > 0 && *colNo > 0;
+}
+
+int holdsPlace(Document *document, int token, int lineNo, int colNo)
+{
+  LexedToken lexed;
+  int tokenLine, tokenCol;
+
+  findTokenPosition(document, token, &lexed, &tokenLine, &tokenCol);
+  return lexed.token.tokenType == TK_IDENT && tokenLine == lineNo &&
+         tokenCol <= colNo && colNo <= tokenCol + tokenLength(&lexed.token);
+}
+
+// The identifier at params->position, or just before it as when the
+// cursor follows a name; -1 when none
+int requestedName(Document *document, JsonValue *params)
+{
+  int lineNo, colNo, token;
+
+  if (!readPosition(getMember(params, "position"), &lineNo, &colNo))
+    return -1;
+  token = findToken(document->tokens, lineNo, colNo);
+  if (holdsPlace(document, token, lineNo, colNo))
+    return token;
+  if (token > 0 && holdsPlace(document, token - 1, lineNo, colNo))
+    return token - 1;
+  return -1;
+}
+
+/******************* notifications ******************************/
+
+void publishDiagnostics(OpenDocument *open)
+{
+  char message[MAX_ERROR_MESSAGE];
+  int i, count = (open->document != NULL) ? getDiagnosticCount(open->document) : 0;
+  int lineNo, colNo, length;
+
+  appendReply("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+  appendString(open->uri, strlen(open->uri));
+  appendReply(",\"diagnostics\":[");
+  for (i = 0; i < count; i++)
+  {
+    getDiagnostic(open->document, i, message);
+    lineNo = colNo = 1;
+    length = 0;
+    sscanf(message, "%d-%d:%n", &lineNo, &colNo, &length);
+    if (lineNo < 1)
+      lineNo = 1;
+    if (colNo < 1)
+      colNo = 1;
+    appendReply("%s{\"range\":{\"start\":", (i > 0) ? "," : "");
+    appendPosition(lineNo, colNo);
+    appendReply(",\"end\":");
+    appendPosition(lineNo, colNo + 1);
+    appendReply("},\"severity\":1,\"source\":\"kplc\",\"message\":");
+    appendString(message + length, strlen(message + length));
+    appendReply("}");
+  }
+  appendReply("]}}");
+  sendReply();
+  open->changed = 0;
+}
+
+// Checking the documents changed since, the edits in between together
+void publishChanged(void)
+{
+  OpenDocument *open;
+
+  for (open = openDocuments; open != NULL; open = open->next)
+    if (open->changed)
+      publishDiagnostics(open);
+}
+
+// The text is new, the revisions of its document with it
+void reopen(OpenDocument *open, JsonValue *text)
+{
+  open->document = openDocument(text->text, text->length);
+  open->symbolsRevision = 0;
+  open->changed = 1;
+}
+
+void didOpen(JsonValue *params)
+{
+  JsonValue *item = getMember(params, "textDocument");
+  JsonValue *uri = getMember(item, "uri");
+  JsonValue *text = getMember(item, "text");
+  OpenDocument *open;
+
+  if (uri == NULL || uri->type != JSON_STRING || text == NULL || text->type != JSON_STRING)
+    return;
+  if ((open = findOpenDocument(uri->text)) != NULL)
+    closeDocument(open->document);
+  else
+  {
+    open = (OpenDocument *)malloc(sizeof(OpenDocument));
+    open->uri = strdup(uri->text);
+    open->symbols = NULL;
+    open->symbolsSize = 0;
+    open->next = openDocuments;
+    openDocuments = open;
+  }
+  reopen(open, text);
+}
+
+void didChange(JsonValue *params)
+{
+  OpenDocument *open = requestedDocument(params);
+  JsonValue *change, *range, *text;
+  int startLine, startCol, endLine, endCol;
+  int start, end;
+
+  if (open == NULL)
+    return;
+  change = getMember(params, "contentChanges");
+  for (change = (change != NULL) ? change->children : NULL; change != NULL; change = change->next)
+  {
+    text = getMember(change, "text");
+    if (text == NULL || text->type != JSON_STRING)
+      continue;
+    range = getMember(change, "range");
+    if (range == NULL)
+    {
+      closeDocument(open->document);
+      reopen(open, text);
+      continue;
+    }
+    if (!readPosition(getMember(range, "start"), &startLine, &startCol) ||
+        !readPosition(getMember(range, "end"), &endLine, &endCol))
+      continue;
+    start = findOffset(open->document->tokens, startLine, startCol);
+    end = findOffset(open->document->tokens, endLine, endCol);
+    if (end >= start && editDocument(open->document, start, end - start, text->text, text->length))
+      open->changed = 1;
+  }
+}
+
+void didClose(JsonValue *params)
+{
+  OpenDocument *open = requestedDocument(params);
+  OpenDocument **link;
+
+  if (open == NULL)
+    return;
+  closeDocument(open->document);
+  open->document = NULL;
+  // an editor clears the errors of a file it closed when told so
+  publishDiagnostics(open);
+  for (link = &openDocuments; *link != open; link = &(*link)->next)
+    ;
+  *link = open->next;
+  free(open->uri);
+  free(open->symbols);
+  free(open);
+}
+
+/******************* requests ******************************/
+
+void initialize(JsonValue *id)
+{
+  beginResult(id);
+  appendReply("{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+              "\"definitionProvider\":true,\"hoverProvider\":true,\"documentSymbolProvider\":true},"
+              "\"serverInfo\":{\"name\":\"kplc\"}}");
+  endResult();
+}
+
+void definition(JsonValue *id, JsonValue *params)
+{
+  OpenDocument *open = requestedDocument(params);
+  int token = (open != NULL) ? requestedName(open->document, params) : -1;
+  int declaration = -1;
+  Object *obj;
+
+  if (token >= 0)
+    declaration = findDeclaration(open->document, token, &obj);
+  beginResult(id);
+  if (declaration < 0)
+    appendReply("null");
+  else
+  {
+    appendReply("{\"uri\":");
+    appendString(open->uri, strlen(open->uri));
+    appendReply(",\"range\":");
+    appendRange(open->document, declaration, declaration);
+    appendReply("}");
+  }
+  endResult();
+}
+
+void hover(JsonValue *id, JsonValue *params)
+{
+  OpenDocument *open = requestedDocument(params);
+  int token = (open != NULL) ? requestedName(open->document, params) : -1;
+  char text[MAX_DEBUG_TEXT];
+  Object *obj = NULL;
+
+  if (token >= 0)
+    findDeclaration(open->document, token, &obj);
+  beginResult(id);
+  if (obj == NULL)
+    appendReply("null");
+  else
+  {
+    formatObject(text, MAX_DEBUG_TEXT, obj);
+    appendReply("{\"contents\":{\"kind\":\"plaintext\",\"value\":");
+    appendString(text, strlen(text));
+    appendReply("},\"range\":");
+    appendRange(open->document, token, token);
+    appendReply("}");
+  }
+  endResult();
+}
+
+int symbolKind(Object *obj)
+{
+  switch (obj->kind)
+  {
+  case OBJ_CONSTANT:
+    return SYMBOL_CONSTANT;
+  case OBJ_TYPE:
+    return SYMBOL_CLASS;
+  case OBJ_FUNCTION:
+  case OBJ_PROCEDURE:
+    return SYMBOL_FUNCTION;
+  default:
+    return SYMBOL_VARIABLE;
+  }
+}
+
+// Each symbol is left open for the children that may follow it
+void appendSymbol(Object *obj, int name, int first, int last, int depth)
+{
+  char text[MAX_DEBUG_TEXT];
+
+  if (depth > symbolDepth)
+  {
+    appendReply(",\"children\":[");
+    symbolDepth = depth;
+  }
+  else if (symbolCount > 0)
+  {
+    for (; symbolDepth > depth; symbolDepth--)
+      appendReply("}]");
+    appendReply("},");
+  }
+  symbolCount++;
+
+  formatObject(text, MAX_DEBUG_TEXT, obj);
+  appendReply("{\"name\":");
+  appendString(obj->name, strlen(obj->name));
+  appendReply(",\"detail\":");
+  appendString(text, strlen(text));
+  appendReply(",\"kind\":%d,\"range\":", symbolKind(obj));
+  appendRange(symbolDocument, first, last);
+  appendReply(",\"selectionRange\":");
+  appendRange(symbolDocument, name, name);
+}
+
+// Kept until the document changes: an editor asks again for its outline
+// on every switch to it
+void documentSymbol(JsonValue *id, JsonValue *params)
+{
+  OpenDocument *open = requestedDocument(params);
+  int start;
+
+  beginResult(id);
+  if (open != NULL && open->symbolsRevision == open->document->revision)
+  {
+    appendReply("%.*s", open->symbolsSize, open->symbols);
+    endResult();
+    return;
+  }
+  start = replySize;
+  appendReply("[");
+  symbolDepth = symbolCount = 0;
+  if (open != NULL)
+  {
+    symbolDocument = open->document;
+    visitDeclarations(open->document, appendSymbol);
+  }
+  if (symbolCount > 0)
+  {
+    for (; symbolDepth > 0; symbolDepth--)
+      appendReply("}]");
+    appendReply("}");
+  }
+  appendReply("]");
+  if (open != NULL)
+  {
+    open->symbolsSize = replySize - start;
+    open->symbols = (char *)realloc(open->symbols, open->symbolsSize);
+    memcpy(open->symbols, reply + start, open->symbolsSize);
+    open->symbolsRevision = open->document->revision;
+  }
+  endResult();
+}
+
+/******************* server ******************************/
+
+// 1 when the client asked the server to exit
+int handleMessage(JsonValue *message)
+{
+  JsonValue *method = getMember(message, "method");
+  JsonValue *id = getMember(message, "id");
+  JsonValue *params = getMember(message, "params");
+
+  // responses to requests of the server: it makes none
+  if (method == NULL || method->type != JSON_STRING)
+    return 0;
+  if (strcmp(method->text, "exit") == 0)
+    return 1;
+
+  if (id == NULL)
+  {
+    if (strcmp(method->text, "textDocument/didOpen") == 0)
+      didOpen(params);
+    else if (strcmp(method->text, "textDocument/didChange") == 0)
+      didChange(params);
+    else if (strcmp(method->text, "textDocument/didClose") == 0)
+      didClose(params);
+    // others, initialized among them, need nothing
+    return 0;
+  }
+
+  // a reply tells the client the server has got this far
+  publishChanged();
+  if (shutdownRequested)
+    sendError(id, INVALID_REQUEST, "The server is shutting down");
+  else if (strcmp(method->text, "initialize") == 0)
+    initialize(id);
+  else if (strcmp(method->text, "shutdown") == 0)
+  {
+    shutdownRequested = 1;
+    beginResult(id);
+    appendReply("null");
+    endResult();
+  }
+  else if (strcmp(method->text, "textDocument/definition") == 0)
+    definition(id, params);
+  else if (strcmp(method->text, "textDocument/hover") == 0)
+    hover(id, params);
+  else if (strcmp(method->text, "textDocument/documentSymbol") == 0)
+    documentSymbol(id, params);
+  else
+    sendError(id, METHOD_NOT_FOUND, "Method not found");
+  return 0;
+}
+
+int runLanguageServer(void)
+{
+  OpenDocument *open;
+  JsonValue *message;
+  char *body;
+  int size, stop = 0;
+
+  // stdout carries the messages
+  echoInput = 0;
+
+  while (!stop)
+  {
+    // the client is waiting: check what the edits so far changed
+    if (!inputWaiting())
+      publishChanged();
+    if ((body = readMessage(&size)) == NULL)
+      break;
+    if ((message = parseJson(body, size)) == NULL)
+      sendError(NULL, PARSE_ERROR, "Parse error");
+    else
+    {
+      stop = handleMessage(message);
+      freeJson(message);
+    }
+    free(body);
+  }
+
+  while ((open = openDocuments) != NULL)
+  {
+    openDocuments = open->next;
+    closeDocument(open->document);
+    free(open->uri);
+    free(open->symbols);
+    free(open);
+  }
+  free(reply);
+  cleanBuiltins();
+  // exit without shutdown, or the end of the input, is an error
+  return shutdownRequested ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#ifndef __LSP_H__
+#define __LSP_H__
+
+// Language server for editors: the Language Server Protocol, JSON-RPC
+// messages each behind a Content-Length header, on stdin and stdout.
+//
+//   initialize, initialized, shutdown, exit
+//   textDocument/didOpen, didChange, didClose  -> textDocument/publishDiagnostics
+//   textDocument/definition                    -> the name's declaration
+//   textDocument/hover                         -> its kind and type, as -dump's symbols
+//   textDocument/documentSymbol                -> the declarations, nested
+//
+// An open file is a Document (see document.h), kept with its tokens and
+// symbol table between requests. Changes are only applied as they come:
+// the blocks they touched are checked, together, when the input has
+// nothing more or before the next reply, and the diagnostics published
+// then, once. The other requests only look things up.
+//
+// Lines and characters count from 0, a character being a byte: KPL
+// sources are ASCII.
+
+#define LSP_MAX_HEADER 256
+#define LSP_MAX_MESSAGE (256 << 20)
+#define LSP_INPUT_BUFFER 65536
+
+int runLanguageServer(void);
+
+#endif
@@ -1,4 +1,4 @@
-/* 
+/*
  * @copyright (c) 2008, Hedspi, Hanoi University of Technology
  * @author Huu-Duc Nguyen
  * @version 1.0
@@ -6,22 +6,263 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "reader.h"
 #include "parser.h"
+#include "codegen.h"
+#include "asmgen.h"
+#include "cgen.h"
+#include "vm.h"
+#include "server.h"
+#include "lsp.h"
+#include "cache.h"
+#include "unit.h"
+#include "check.h"
+#include "alloc.h"
+#include "stats.h"
+#include "trace.h"
+
+#define MAX_FILENAME_LEN 1024
 
 /******************************************************************/
 
+void printUsage(void) {
+#ifdef KPL_STATS
+  printf("Usage: kplc input [-o output] [-S] [--emit-c] [-run] [-jit] [-dump] [--cache dir] [--units dir] [--stats] [--counters] [--alloc-profile] [--trace file]\n");
+#else
+  printf("Usage: kplc input [-o output] [-S] [--emit-c] [-run] [-jit] [-dump] [--cache dir] [--units dir]\n");
+#endif
+  printf("       kplc input --check [-j threads]\n");
+  printf("       kplc --server socket\n");
+  printf("       kplc --lsp\n");
+  printf("   input:    input kpl program\n");
+  printf("   -o:       build a native x86-64 executable named output\n");
+  printf("   -S:       stop after writing x86-64 assembly (or C) to output\n");
+  printf("   --emit-c: go through C99 and the system C compiler instead of assembly,\n");
+  printf("             building a.out without -o or -S\n");
+  printf("   -run:     interpret the generated stack machine code\n");
+  printf("   -jit:     run tiered, compiling hot subroutines to x86-64 in memory\n");
+  printf("   -dump:    print the generated stack machine code\n");
+  printf("   --cache:  reuse the results of unchanged sources kept in dir (see cache.h)\n");
+  printf("   --cache-limit: keep the cache under this many megabytes (%d)\n", CACHE_DEFAULT_LIMIT_MB);
+  printf("   --units:  write and read the interfaces of units in dir (see unit.h)\n");
+  printf("   --check:  only report the first error, checking subroutines on threads (see check.h)\n");
+  printf("   -j:       the threads of --check, lexing and checking, one per processor by default\n");
+  printf("   --server: compile sources sent to the Unix domain socket (see server.h)\n");
+  printf("   --lsp:    serve an editor the Language Server Protocol on stdin and stdout (see lsp.h)\n");
+#ifdef KPL_STATS
+  printf("   --stats:  print phase times and counters as JSON on stderr\n");
+  printf("   --counters: add hardware counters and IPC per phase to --stats\n");
+  printf("   --alloc-profile: print allocations per kind and call site on exit\n");
+  printf("   --trace:  write compiler spans as Chrome trace events to file\n");
+#endif
+}
+
+#ifdef KPL_STATS
+void printAllocationProfileAtExit(void) {
+  printAllocationProfile(stderr);
+}
+
+void printStatisticsAtExit(void) {
+  printStatistics(stderr);
+}
+
+void closeInstrumentationAtExit(void) {
+  closeTrace();
+  closeCounters();
+}
+#endif
+
 int main(int argc, char *argv[]) {
-  if (argc <= 1) {
+  char *inputFile = NULL;
+  char *outputFile = NULL;
+  char *serverSocket = NULL;
+  int languageServer = 0;
+  char *cacheDirectory = NULL;
+  long long cacheLimit = (long long)CACHE_DEFAULT_LIMIT_MB << 20;
+  char asmFile[MAX_FILENAME_LEN];
+  int assemblyOnly = 0;
+  int emitC = 0;
+  int runProgram = 0;
+  int status = PS_NORMAL_EXIT;
+  int tiered = 0;
+  int dumpCode = 0;
+  int checkOnly = 0;
+  int checkThreads = 0;
+#ifdef KPL_STATS
+  int printStats = 0;
+  int useCounters = 0;
+  int profileAllocations = 0;
+  char *traceFileName = NULL;
+#endif
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      outputFile = argv[++i];
+    else if (strcmp(argv[i], "-S") == 0)
+      assemblyOnly = 1;
+    else if (strcmp(argv[i], "--emit-c") == 0)
+      emitC = 1;
+    else if (strcmp(argv[i], "-run") == 0)
+      runProgram = 1;
+    else if (strcmp(argv[i], "-jit") == 0) {
+      runProgram = 1;
+      tiered = 1;
+    } else if (strcmp(argv[i], "-dump") == 0)
+      dumpCode = 1;
+    else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+      cacheDirectory = argv[++i];
+    else if (strcmp(argv[i], "--units") == 0 && i + 1 < argc)
+      unitDirectory = argv[++i];
+    else if (strcmp(argv[i], "--cache-limit") == 0 && i + 1 < argc)
+      cacheLimit = atoll(argv[++i]) << 20;
+    else if (strcmp(argv[i], "--check") == 0)
+      checkOnly = 1;
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      checkThreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+      serverSocket = argv[++i];
+    else if (strcmp(argv[i], "--lsp") == 0)
+      languageServer = 1;
+#ifdef KPL_STATS
+    else if (strcmp(argv[i], "--stats") == 0)
+      printStats = 1;
+    else if (strcmp(argv[i], "--counters") == 0)
+      printStats = useCounters = 1;
+    else if (strcmp(argv[i], "--alloc-profile") == 0)
+      profileAllocations = 1;
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      traceFileName = argv[++i];
+#endif
+    else if (argv[i][0] == '-') {
+      printUsage();
+      return -1;
+    } else
+      inputFile = argv[i];
+  }
+
+  if (serverSocket != NULL)
+    return runServer(serverSocket);
+  if (languageServer)
+    return runLanguageServer();
+
+  if (inputFile == NULL) {
     printf("parser: no input file.\n");
     return -1;
   }
+  // as -S writes a.c or a.s without -o
+  if (emitC && !assemblyOnly && outputFile == NULL)
+    outputFile = "a.out";
+
+#ifdef KPL_STATS
+  // before the first allocation; at exit, so a compile error still reports
+  if (profileAllocations) {
+    setAllocator(&profilingAllocator);
+    atexit(printAllocationProfileAtExit);
+  }
+#endif
+
+  initCodeBuffer();
+
+#ifdef KPL_STATS
+  if (traceFileName != NULL && !openTrace(traceFileName)) {
+    printf("Can\'t write trace file!\n");
+    return -1;
+  }
+  if (useCounters && !(countersEnabled = openCounters()))
+    fprintf(stderr, "kplc: hardware performance counters are unavailable\n");
+  // at exit, so a failing compile still reports what it got through;
+  // the report runs first, before the counters close
+  atexit(closeInstrumentationAtExit);
+  if (printStats)
+    atexit(printStatisticsAtExit);
+#endif
+
+  if (checkOnly) {
+    if (checkThreads <= 0)
+      checkThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    TRACE_BEGIN("check", inputFile);
+    if (checkFile(inputFile, checkThreads) == IO_ERROR) {
+      printf("Can\'t read input file!\n");
+      return -1;
+    }
+    TRACE_END();
+    cleanCodeBuffer();
+    return 0;
+  }
 
-  if (compile(argv[1]) == IO_ERROR) {
+  TRACE_BEGIN("compile", inputFile);
+  if ((cacheDirectory != NULL ? compileCached(inputFile, cacheDirectory, cacheLimit)
+                              : compile(inputFile)) == IO_ERROR) {
     printf("Can\'t read input file!\n");
     return -1;
   }
-    
-  return 0;
+  TRACE_END();
+
+  if (dumpCode)
+    printCodeBuffer();
+
+  STATS_START(EMIT);
+  STATS_COUNTERS_START(EMIT);
+  if (emitC || assemblyOnly || outputFile != NULL)
+    TRACE_BEGIN("emit", NULL);
+  if (emitC) {
+    if (assemblyOnly) {
+      if (saveCSource(getCodeBuffer(), outputFile != NULL ? outputFile : "a.c") == CGEN_ERROR) {
+        printf("Can\'t write output file!\n");
+        return -1;
+      }
+    } else if (outputFile != NULL) {
+      snprintf(asmFile, MAX_FILENAME_LEN, "%s.c", outputFile);
+      if (saveCSource(getCodeBuffer(), asmFile) == CGEN_ERROR) {
+        printf("Can\'t write output file!\n");
+        return -1;
+      }
+      if (buildCExecutable(asmFile, outputFile) == CGEN_ERROR) {
+        printf("Can\'t compile output file!\n");
+        remove(asmFile);
+        return -1;
+      }
+      remove(asmFile);
+    }
+  } else if (assemblyOnly) {
+    if (saveAssembly(getCodeBuffer(), outputFile != NULL ? outputFile : "a.s") == ASM_ERROR) {
+      printf("Can\'t write output file!\n");
+      return -1;
+    }
+  } else if (outputFile != NULL) {
+    snprintf(asmFile, MAX_FILENAME_LEN, "%s.s", outputFile);
+    if (saveAssembly(getCodeBuffer(), asmFile) == ASM_ERROR) {
+      printf("Can\'t write output file!\n");
+      return -1;
+    }
+    if (buildExecutable(asmFile, outputFile) == ASM_ERROR) {
+      printf("Can\'t assemble output file!\n");
+      remove(asmFile);
+      return -1;
+    }
+    remove(asmFile);
+  }
+  if (emitC || assemblyOnly || outputFile != NULL) {
+    STATS_COUNTERS_STOP(EMIT);
+    STATS_STOP(EMIT);
+    TRACE_END();
+  }
+
+  if (runProgram) {
+    STATS_START(RUN);
+    STATS_COUNTERS_START(RUN);
+    TRACE_BEGIN("run", NULL);
+    status = runCode(getCodeBuffer(), tiered);
+    TRACE_END();
+    STATS_COUNTERS_STOP(RUN);
+    STATS_STOP(RUN);
+  }
+
+  cleanCodeBuffer();
+  // a runtime error fails like it does in the native and emitted C programs
+  return (status == PS_NORMAL_EXIT) ? 0 : EXIT_FAILURE;
 }
@@ -5,27 +5,39 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "reader.h"
 #include "scanner.h"
 #include "parser.h"
+#include "parsetab.h"
 #include "semantics.h"
+#include "codegen.h"
 #include "error.h"
+#include "alloc.h"
 #include "debug.h"
+#include "stats.h"
+#include "trace.h"
+#include "unit.h"
 
-Token *currentToken;
-Token *lookAhead;
+// The state of a parse is per thread, for bodies checked on several at
+// once (see check.h)
+__thread Token *currentToken;
+__thread Token *lookAhead;
+
+__thread ParserHooks *parserHooks = NULL;
+__thread Token *(*tokenSource)(void) = getValidToken;
 
 extern Type *intType;
 extern Type *charType;
-extern SymTab *symtab;
+extern __thread SymTab *symtab;
 
 void scan(void)
 {
   Token *tmp = currentToken;
   currentToken = lookAhead;
-  lookAhead = getValidToken();
-  free(tmp);
+  lookAhead = tokenSource();
+  RELEASE(tmp);
 }
 
 void eat(TokenType tokenType)
@@ -35,28 +47,145 @@ void eat(TokenType tokenType)
     scan();
   }
   else
-    missingToken(tokenType, lookAhead->lineNo, lookAhead->colNo);
+    missingToken(tokenType, lookAhead->offset);
+}
+
+void compileModule(void)
+{
+#if HAS_UNITS
+  if (lookAhead->tokenType == KW_UNIT)
+  {
+    compileUnit();
+    return;
+  }
+#endif
+  compileProgram();
 }
 
 void compileProgram(void)
 {
   Object *program;
+  CodeAddress usesJmp, blockJmp;
 
   eat(KW_PROGRAM);
   eat(TK_IDENT);
+  TRACE_BEGIN("compileProgram", currentToken->string);
 
   program = createProgramObject(currentToken->string);
   enterBlock(program->progAttrs->scope);
+  if (parserHooks != NULL)
+    parserHooks->beginRoutine(program);
 
   eat(SB_SEMICOLON);
+  usesJmp = compileUses();
 
+  if (parserHooks != NULL)
+    parserHooks->beginBlock();
+  blockJmp = getCurrentCodeAddress();
   compileBlock();
   eat(SB_PERIOD);
+  // Straight on to the body, which the back ends find a jump from the start
+  if (usesJmp >= 0)
+    updateJ(usesJmp, getCodeBuffer()->code[blockJmp].q);
+  if (parserHooks != NULL)
+    parserHooks->endRoutine();
+
+  genHL();
 
   exitBlock();
+  TRACE_END();
 }
 
+// The code of the units comes first, jumped over; the address of the
+// jump, -1 when there are none
+CodeAddress compileUses(void)
+{
+#if HAS_UNITS
+  CodeAddress jmp;
+
+  if (lookAhead->tokenType != KW_USES)
+    return -1;
+  eat(KW_USES);
+  jmp = getCurrentCodeAddress();
+  genJ(DC_VALUE);
+
+  compileUse();
+  while (lookAhead->tokenType == SB_COMMA)
+  {
+    eat(SB_COMMA);
+    compileUse();
+  }
+
+  eat(SB_SEMICOLON);
+  updateJ(jmp, getCurrentCodeAddress());
+  return jmp;
+#else
+  return -1;
+#endif
+}
+
+#if HAS_UNITS
+void compileUse(void)
+{
+  eat(TK_IDENT);
+  if (findUnit(symtab->units, currentToken->string) != NULL)
+    error(ERR_DUPLICATE_IDENT, currentToken->offset);
+  if (!importUnit(currentToken->string))
+    error(ERR_UNIT_NOT_FOUND, currentToken->offset);
+}
+
+// A unit is the declarations of a block without its body. Its scope
+// stands for the frame of the program using it.
+void compileUnit(void)
+{
+  Object *unit;
+  CodeAddress jmp;
+
+  eat(KW_UNIT);
+  eat(TK_IDENT);
+  TRACE_BEGIN("compileUnit", currentToken->string);
+
+  unit = createProgramObject(currentToken->string);
+  enterBlock(unit->progAttrs->scope);
+  beginUnit(unit->progAttrs->scope);
+
+  eat(SB_SEMICOLON);
+
+  jmp = getCurrentCodeAddress();
+  genJ(DC_VALUE);
+  compileConstDecls();
+  compileBlock2();
+  eat(KW_END);
+  eat(SB_PERIOD);
+  updateJ(jmp, getCurrentCodeAddress());
+
+  if (!writeUnitInterface(jmp + 1))
+    error(ERR_UNIT_NOT_WRITTEN, currentToken->offset);
+  genHL();
+
+  exitBlock();
+  TRACE_END();
+}
+#endif
+
 void compileBlock(void)
+{
+  CodeAddress jmp;
+
+  // Jump over the nested subroutines to the body of the block
+  jmp = getCurrentCodeAddress();
+  genJ(DC_VALUE);
+
+  compileConstDecls();
+  compileBlock2();
+
+  updateJ(jmp, getCurrentCodeAddress());
+  genINT(symtab->currentScope->frameSize);
+
+  compileBlock5();
+}
+
+void compileConstDecls(void)
 {
   Object *constObj;
   ConstantValue *constValue;
@@ -80,11 +209,7 @@ void compileBlock(void)
 
       eat(SB_SEMICOLON);
     } while (lookAhead->tokenType == TK_IDENT);
-
-    compileBlock2();
   }
-  else
-    compileBlock2();
 }
 
 void compileBlock2(void)
@@ -152,7 +277,6 @@ void compileBlock3(void)
 void compileBlock4(void)
 {
   compileSubDecls();
-  compileBlock5();
 }
 
 void compileBlock5(void)
@@ -166,6 +290,8 @@ void compileSubDecls(void)
 {
   while ((lookAhead->tokenType == KW_FUNCTION) || (lookAhead->tokenType == KW_PROCEDURE))
   {
+    if (parserHooks != NULL && parserHooks->reuseRoutine())
+      continue;
     if (lookAhead->tokenType == KW_FUNCTION)
       compileFuncDecl();
     else
@@ -180,12 +306,15 @@ void compileFuncDecl(void)
 
   eat(KW_FUNCTION);
   eat(TK_IDENT);
+  TRACE_BEGIN("compileFuncDecl", currentToken->string);
 
   checkFreshIdent(currentToken->string);
   funcObj = createFunctionObject(currentToken->string);
   declareObject(funcObj);
 
   enterBlock(funcObj->funcAttrs->scope);
+  if (parserHooks != NULL)
+    parserHooks->beginRoutine(funcObj);
 
   compileParams();
 
@@ -194,10 +323,20 @@ void compileFuncDecl(void)
   funcObj->funcAttrs->returnType = returnType;
 
   eat(SB_SEMICOLON);
-  compileBlock();
+
+  funcObj->funcAttrs->codeAddress = getCurrentCodeAddress();
+  if (parserHooks != NULL)
+    parserHooks->beginBlock();
+  if (parserHooks == NULL || !parserHooks->skipBlock())
+    compileBlock();
+  genEF();
+
   eat(SB_SEMICOLON);
+  if (parserHooks != NULL)
+    parserHooks->endRoutine();
 
   exitBlock();
+  TRACE_END();
 }
 
 void compileProcDecl(void)
@@ -206,20 +345,33 @@ void compileProcDecl(void)
 
   eat(KW_PROCEDURE);
   eat(TK_IDENT);
+  TRACE_BEGIN("compileProcDecl", currentToken->string);
 
   checkFreshIdent(currentToken->string);
   procObj = createProcedureObject(currentToken->string);
   declareObject(procObj);
 
   enterBlock(procObj->procAttrs->scope);
+  if (parserHooks != NULL)
+    parserHooks->beginRoutine(procObj);
 
   compileParams();
 
   eat(SB_SEMICOLON);
-  compileBlock();
+
+  procObj->procAttrs->codeAddress = getCurrentCodeAddress();
+  if (parserHooks != NULL)
+    parserHooks->beginBlock();
+  if (parserHooks == NULL || !parserHooks->skipBlock())
+    compileBlock();
+  genEP();
+
   eat(SB_SEMICOLON);
+  if (parserHooks != NULL)
+    parserHooks->endRoutine();
 
   exitBlock();
+  TRACE_END();
 }
 
 ConstantValue *compileUnsignedConstant(void)
@@ -245,35 +397,113 @@ ConstantValue *compileUnsignedConstant(void)
     constValue = makeCharConstant(currentToken->string[0]);
     break;
   default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_CONSTANT, lookAhead->offset);
     break;
   }
   return constValue;
 }
 
+// Combine two integer constants at compile time; right is consumed
+void foldConstant(ConstantValue *left, enum OpCode op, ConstantValue *right)
+{
+  WORD value;
+
+  if (!evaluateOperation(op, left->intValue, right->intValue, &value))
+    error(ERR_CONSTANT_DIVISION_BY_ZERO, currentToken->offset);
+  left->intValue = value;
+  RELEASE(right);
+}
+
 ConstantValue *compileConstant(void)
 {
   ConstantValue *constValue;
+  enum OpCode op;
 
   switch (lookAhead->tokenType)
   {
+#if HAS_SUM
+  case KW_SUM:
+    eat(KW_SUM);
+    return compileConstantSum();
+#endif
   case SB_PLUS:
     eat(SB_PLUS);
-    constValue = compileConstant2();
+    constValue = compileConstantTerm();
     break;
   case SB_MINUS:
     eat(SB_MINUS);
-    constValue = compileConstant2();
-    constValue->intValue = -constValue->intValue;
+    constValue = compileConstantTerm();
+    constValue->intValue = (WORD)(0 - (unsigned long long)constValue->intValue);
     break;
   case TK_CHAR:
     eat(TK_CHAR);
-    constValue = makeCharConstant(currentToken->string[0]);
-    break;
+    return makeCharConstant(currentToken->string[0]);
   default:
-    constValue = compileConstant2();
+    constValue = compileConstantTerm();
     break;
   }
+
+  // Integer constants may be expressions over numbers and other constants
+  while (lookAhead->tokenType == SB_PLUS || lookAhead->tokenType == SB_MINUS)
+  {
+    op = (lookAhead->tokenType == SB_PLUS) ? OP_AD : OP_SB;
+    eat(lookAhead->tokenType);
+    foldConstant(constValue, op, compileConstantTerm());
+  }
+  return constValue;
+}
+
+#if HAS_SUM
+// The terms of SUM as compileSum reads them, added up at compile time
+ConstantValue *compileConstantSum(void)
+{
+  ConstantValue *constValue = makeIntConstant(0);
+  ConstantValue *term;
+
+  // the terms are separated by commas, as ConstantSumTail has them
+  for (;;)
+  {
+    term = compileConstant();
+    if (term->type != TP_INT)
+      error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
+    foldConstant(constValue, OP_AD, term);
+
+    if (lookAhead->tokenType != SB_COMMA)
+      break;
+    eat(SB_COMMA);
+  }
+  return constValue;
+}
+#endif
+
+ConstantValue *compileConstantTerm(void)
+{
+  ConstantValue *constValue;
+  enum OpCode op;
+
+  constValue = compileConstantPower();
+  while (lookAhead->tokenType == SB_TIMES || lookAhead->tokenType == SB_SLASH)
+  {
+    op = (lookAhead->tokenType == SB_TIMES) ? OP_ML : OP_DV;
+    eat(lookAhead->tokenType);
+    foldConstant(constValue, op, compileConstantPower());
+  }
+  return constValue;
+}
+
+// a ** b ** c = a ** (b ** c)
+ConstantValue *compileConstantPower(void)
+{
+  ConstantValue *constValue;
+
+  constValue = compileConstant2();
+#if HAS_POWER
+  if (lookAhead->tokenType == SB_POWER)
+  {
+    eat(SB_POWER);
+    foldConstant(constValue, OP_PW, compileConstantPower());
+  }
+#endif
   return constValue;
 }
 
@@ -294,10 +524,10 @@ ConstantValue *compileConstant2(void)
     if (obj->constAttrs->value->type == TP_INT)
       constValue = duplicateConstantValue(obj->constAttrs->value);
     else
-      error(ERR_UNDECLARED_INT_CONSTANT, currentToken->lineNo, currentToken->colNo);
+      error(ERR_UNDECLARED_INT_CONSTANT, currentToken->offset);
     break;
   default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_CONSTANT, lookAhead->offset);
     break;
   }
   return constValue;
@@ -320,6 +550,13 @@ Type *compileType(void)
     eat(KW_CHAR);
     type = makeCharType();
     break;
+#if HAS_BYTES
+    // a byte count, stored and checked as an integer
+  case KW_BYTES:
+    eat(KW_BYTES);
+    type = makeIntType();
+    break;
+#endif
   case KW_ARRAY:
     eat(KW_ARRAY);
     eat(SB_LSEL);
@@ -338,7 +575,7 @@ Type *compileType(void)
     type = duplicateType(obj->typeAttrs->actualType);
     break;
   default:
-    error(ERR_INVALID_TYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_TYPE, lookAhead->offset);
     break;
   }
   return type;
@@ -358,8 +595,15 @@ Type *compileBasicType(void)
     eat(KW_CHAR);
     type = makeCharType();
     break;
+#if HAS_BYTES
+    // a byte count, stored and checked as an integer
+  case KW_BYTES:
+    eat(KW_BYTES);
+    type = makeIntType();
+    break;
+#endif
   default:
-    error(ERR_INVALID_BASICTYPE, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_BASICTYPE, lookAhead->offset);
     break;
   }
   return type;
@@ -396,7 +640,7 @@ void compileParam(void)
     paramKind = PARAM_REFERENCE;
     break;
   default:
-    error(ERR_INVALID_PARAMETER, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_PARAMETER, lookAhead->offset);
     break;
   }
 
@@ -441,14 +685,15 @@ void compileStatement(void)
   case KW_FOR:
     compileForSt();
     break;
-    // EmptySt needs to check FOLLOW tokens
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
+#if HAS_REPEAT
+  case KW_REPEAT:
+    compileRepeatSt();
     break;
-    // Error occurs
+#endif
+    // EmptySt needs to check FOLLOW tokens
   default:
-    error(ERR_INVALID_STATEMENT, lookAhead->lineNo, lookAhead->colNo);
+    if (!inFollow(NT_STATEMENT, lookAhead->tokenType))
+      error(ERR_INVALID_STATEMENT, lookAhead->offset);
     break;
   }
 }
@@ -463,60 +708,86 @@ Type *compileLValue(void)
   var = checkDeclaredLValueIdent(currentToken->string);
 
   if (var->kind == OBJ_CONSTANT)
-    error(ERR_CONSTANT_ASSIGN, currentToken->lineNo, currentToken->colNo);
+    error(ERR_CONSTANT_ASSIGN, currentToken->offset);
 
   if (var->kind == OBJ_VARIABLE) {
+    genVariableAddress(var);
     if (var->varAttrs->type->typeClass == TP_ARRAY)
       varType = compileIndexes(var->varAttrs->type);
     else
       varType = var->varAttrs->type;
   } else if (var->kind == OBJ_PARAMETER) {
+    genParameterAddress(var);
     varType = var->paramAttrs->type;
   } else if (var->kind == OBJ_FUNCTION) {
+    genReturnValueAddress(var);
     varType = var->funcAttrs->returnType;
   } else {
-    error(ERR_INVALID_LVALUE, currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_LVALUE, currentToken->offset);
   }
 
   return varType;
 }
 
 
-void compileLValueList(Type *lvalueTypes[], int *lvalueCount)
+// Assignments do not nest, so at most one list spills at a time and the
+// spill buffer is kept for the next wide assignment
+__thread Type **spilledTypes = NULL;
+__thread int spilledCapacity = 0;
+
+void initTypeList(TypeList *list)
 {
-  Type *type;
+  list->types = list->inlineTypes;
+  list->count = 0;
+  list->capacity = TYPE_LIST_INLINE;
+}
+
+void appendType(TypeList *list, Type *type)
+{
+  if (list->count == list->capacity)
+  {
+    if (spilledCapacity < 2 * list->capacity)
+    {
+      spilledCapacity = 2 * list->capacity;
+      spilledTypes = REALLOCATE_ARRAY(spilledTypes, Type *, spilledCapacity, ALLOC_PARSER);
+    }
+    if (list->types == list->inlineTypes)
+      memcpy(spilledTypes, list->inlineTypes, list->count * sizeof(Type *));
+    list->types = spilledTypes;
+    list->capacity = spilledCapacity;
+  }
+  list->types[list->count++] = type;
+}
 
-  type = compileLValue();
-  lvalueTypes[(*lvalueCount)++] = type;
+void compileLValueList(TypeList *lvalueTypes)
+{
+  appendType(lvalueTypes, compileLValue());
 
   while (lookAhead->tokenType == SB_COMMA) {
     eat(SB_COMMA);
-    type = compileLValue();
-    lvalueTypes[(*lvalueCount)++] = type;
+    appendType(lvalueTypes, compileLValue());
   }
 }
 
-#define MAX_VARIABLES 100
 void compileAssignSt(void)
 {
-  Type *lvalueTypes[MAX_VARIABLES];
-  Type *expressionTypes[MAX_VARIABLES];
-  int lvalueCount = 0, expressionCount = 0;
+  TypeList lvalueTypes;
 
-  compileLValueList(lvalueTypes, &lvalueCount);
+  initTypeList(&lvalueTypes);
+  compileLValueList(&lvalueTypes);
 
   eat(SB_ASSIGN);
 
-  compileExpressionList(expressionTypes, &expressionCount);
-
-
-  if(lvalueCount != expressionCount) {
-    error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
-  }
-
+  compileExpressionList(&lvalueTypes);
 
-  for (int i = 0; i < lvalueCount; i++) {
-    checkTypeEquality(lvalueTypes[i], expressionTypes[i]);
+  // Addresses lie below the values, so a parallel assignment stores
+  // each value into the address lvalueTypes.count slots deeper
+  if (lvalueTypes.count == 1)
+    genST();
+  else {
+    for (int i = 0; i < lvalueTypes.count; i++)
+      genSTN(lvalueTypes.count);
+    genDCT(lvalueTypes.count);
   }
 }
 
@@ -530,7 +801,16 @@ void compileCallSt(void)
 
   proc = checkDeclaredProcedure(currentToken->string);
 
-  compileArguments(proc->procAttrs->paramList);
+  if (isPredefinedProcedure(proc)) {
+    compileArguments(proc->procAttrs->paramList);
+    genPredefinedProcedureCall(proc);
+  } else {
+    // Reserve room for the return value, dynamic link, return address and static link
+    genINT(RESERVED_WORDS);
+    compileArguments(proc->procAttrs->paramList);
+    genDCT(RESERVED_WORDS + proc->procAttrs->paramCount);
+    genProcedureCall(proc);
+  }
 }
 
 void compileGroupSt(void)
@@ -542,12 +822,25 @@ void compileGroupSt(void)
 
 void compileIfSt(void)
 {
+  CodeAddress fjInstruction;
+  CodeAddress jInstruction;
+
   eat(KW_IF);
   compileCondition();
   eat(KW_THEN);
+
+  fjInstruction = getCurrentCodeAddress();
+  genFJ(DC_VALUE);
   compileStatement();
-  if (lookAhead->tokenType == KW_ELSE)
+  if (lookAhead->tokenType == KW_ELSE) {
+    jInstruction = getCurrentCodeAddress();
+    genJ(DC_VALUE);
+    updateFJ(fjInstruction, getCurrentCodeAddress());
     compileElseSt();
+    updateJ(jInstruction, getCurrentCodeAddress());
+  } else {
+    updateFJ(fjInstruction, getCurrentCodeAddress());
+  }
 }
 
 void compileElseSt(void)
@@ -558,17 +851,41 @@ void compileElseSt(void)
 
 void compileWhileSt(void)
 {
+  CodeAddress beginWhile;
+  CodeAddress fjInstruction;
+
+  beginWhile = getCurrentCodeAddress();
   eat(KW_WHILE);
   compileCondition();
+  fjInstruction = getCurrentCodeAddress();
+  genFJ(DC_VALUE);
   eat(KW_DO);
   compileStatement();
+  genJ(beginWhile);
+  updateFJ(fjInstruction, getCurrentCodeAddress());
+}
+
+#if HAS_REPEAT
+void compileRepeatSt(void)
+{
+  CodeAddress beginRepeat;
+
+  beginRepeat = getCurrentCodeAddress();
+  eat(KW_REPEAT);
+  compileStatements();
+  eat(KW_UNTIL);
+  compileCondition();
+  genFJ(beginRepeat);
 }
+#endif
 
 void compileForSt(void)
 {
   // TODO: Check type consistency of FOR's variable
   Object *var;
   Type *type1, *type2;
+  CodeAddress beginLoop;
+  CodeAddress fjInstruction;
 
   eat(KW_FOR);
   eat(TK_IDENT);
@@ -576,32 +893,58 @@ void compileForSt(void)
   // check if the identifier is a variable
   var = checkDeclaredVariable(currentToken->string);
 
+  // The address of the loop variable stays on the stack during the loop
+  genVariableAddress(var);
+  genCV();
+
   eat(SB_ASSIGN);
   type1 = compileExpression();
   checkTypeEquality(var->varAttrs->type, type1);
+  genST();
+
+  beginLoop = getCurrentCodeAddress();
+  genCV();
+  genLI();
 
   eat(KW_TO);
   type2 = compileExpression();
   checkTypeEquality(var->varAttrs->type, type2);
+  genLE();
+  fjInstruction = getCurrentCodeAddress();
+  genFJ(DC_VALUE);
 
   eat(KW_DO);
   compileStatement();
+
+  // Increase the loop variable by one
+  genCV();
+  genCV();
+  genLI();
+  genLC(1);
+  genAD();
+  genST();
+  genJ(beginLoop);
+
+  updateFJ(fjInstruction, getCurrentCodeAddress());
+  genDCT(1);
 }
 
 void compileArgument(Object *param)
 {
   // TODO: parse an argument, and check type consistency
   //       If the corresponding parameter is a reference, the argument must be a lvalue
-  // Type *type;
+  Type *type;
 
   if(param->paramAttrs->kind == PARAM_REFERENCE) {
+    // pass the address of the lvalue
     if(lookAhead->tokenType == TK_IDENT) {
-      checkDeclaredLValueIdent(lookAhead->string);
+      type = compileLValue();
     } else {
-      error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+      error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
     }
-  }
-  checkTypeEquality(compileExpression(), param->paramAttrs->type);
+  } else
+    type = compileExpression();
+  checkTypeEquality(type, param->paramAttrs->type);
 }
 
 void compileArguments(ObjectNode *paramList)
@@ -614,45 +957,31 @@ void compileArguments(ObjectNode *paramList)
   case SB_LPAR:
     eat(SB_LPAR);
     if (node == NULL)
-      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
     compileArgument(node->object);
     node = node->next;
     while (lookAhead->tokenType == SB_COMMA)
     {
       eat(SB_COMMA);
       if (node == NULL)
-        error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+        error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
       compileArgument(node->object);
       node = node->next;
     }
 
     if (node != NULL)
-      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
     eat(SB_RPAR);
     break;
-    // Check FOLLOW set
-  case SB_TIMES:
-  case SB_SLASH:
-  case SB_PLUS:
-  case SB_MINUS:
-  case KW_TO:
-  case KW_DO:
-  case SB_RPAR:
-  case SB_COMMA:
-  case SB_EQ:
-  case SB_NEQ:
-  case SB_LE:
-  case SB_LT:
-  case SB_GE:
-  case SB_GT:
-  case SB_RSEL:
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-  case KW_THEN:
-    break;
+    // Check FOLLOW set: arguments end a function factor or a call statement
   default:
-    error(ERR_INVALID_ARGUMENTS, lookAhead->lineNo, lookAhead->colNo);
+    if (!inFollow(NT_FACTOR, lookAhead->tokenType) &&
+        !inFollow(NT_CALL_ST, lookAhead->tokenType))
+      error(ERR_INVALID_ARGUMENTS, lookAhead->offset);
+    // parameters want their arguments: without them the call would pop
+    // what was never pushed
+    if (node != NULL)
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
   }
 }
 
@@ -660,11 +989,13 @@ void compileCondition(void)
 {
   // TODO: check the type consistency of LHS and RSH, check the basic type
   Type *type1, *type2;
+  TokenType op;
 
   type1 = compileExpression();
   checkBasicType(type1);
 
-  switch (lookAhead->tokenType)
+  op = lookAhead->tokenType;
+  switch (op)
   {
   case SB_EQ:
     eat(SB_EQ);
@@ -685,51 +1016,100 @@ void compileCondition(void)
     eat(SB_GT);
     break;
   default:
-    error(ERR_INVALID_COMPARATOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_COMPARATOR, lookAhead->offset);
   }
 
   type2 = compileExpression();
   checkTypeEquality(type1, type2);
+
+  switch (op)
+  {
+  case SB_EQ:
+    genEQ();
+    break;
+  case SB_NEQ:
+    genNE();
+    break;
+  case SB_LE:
+    genLE();
+    break;
+  case SB_LT:
+    genLT();
+    break;
+  case SB_GE:
+    genGE();
+    break;
+  case SB_GT:
+    genGT();
+    break;
+  default:
+    break;
+  }
 }
 
-#define MAX_EXPRESSION_COUNT 100
-Type *compileExpression(void)
+#if HAS_SUM
+// Constant terms are added up at compile time; the others stay on the
+// stack and are reduced MAX_SUM_WIDTH at a time, so any number of terms
+// needs a bounded operand stack
+void compileSum(void)
 {
   Type *type;
+  CodeAddress start;
+  WORD constantSum = 0;
+  WORD value;
+  int operandCount = 0;
 
-  switch (lookAhead->tokenType)
+  // the terms are separated by commas, as SumTail has them
+  for (;;)
   {
-  case KW_SUM:
-    eat(KW_SUM);
-    Type *sumTypes[MAX_EXPRESSION_COUNT];
-    int sumCount = 0;
+    start = getExpressionStart();
+    type = compileExpression();
+    checkIntType(type);
 
-    do {
-      type = compileExpression();
-      checkIntType(type);
-      sumTypes[sumCount++] = type;
+    if (takeFoldedConstant(start, &value))
+      evaluateOperation(OP_AD, constantSum, value, &constantSum);
+    else if (++operandCount == MAX_SUM_WIDTH)
+    {
+      genSUM(operandCount);
+      operandCount = 1;
+    }
 
-      if (lookAhead->tokenType == SB_COMMA) {
-        eat(SB_COMMA);
-      }
-    } while (lookAhead->tokenType != SB_SEMICOLON && sumCount < MAX_EXPRESSION_COUNT);
+    if (lookAhead->tokenType != SB_COMMA)
+      break;
+    eat(SB_COMMA);
+  }
 
-    for (int i = 0; i < sumCount; i++) {
-      if (sumTypes[i]->typeClass != TP_INT) {
-        error(ERR_INVALID_TYPE, currentToken->lineNo, currentToken->colNo);
-      }
-    }
+  if (operandCount == 0 || constantSum != 0)
+  {
+    genLC(constantSum);
+    operandCount++;
+  }
+  genSUM(operandCount);
+}
+#endif
+
+Type *compileExpression(void)
+{
+  Type *type;
 
+  switch (lookAhead->tokenType)
+  {
+#if HAS_SUM
+  case KW_SUM:
+    eat(KW_SUM);
+    compileSum();
     type = intType;
     break;
+#endif
   case SB_PLUS:
     eat(SB_PLUS);
     type = compileExpression2();
     checkIntType(type);
     break;
   case SB_MINUS:
+    // only the first term is negated: -a + b = (-a) + b
     eat(SB_MINUS);
-    type = compileExpression2();
+    type = compileOperators(1);
     checkIntType(type);
     break;
   default:
@@ -738,119 +1118,125 @@ Type *compileExpression(void)
   return type;
 }
 
-void compileExpressionList(Type *expressionTypes[], int *expressionCount)
+// Each expression is checked against its left-hand side as soon as it is
+// compiled, so the right-hand types are never collected
+void compileExpressionList(TypeList *lvalueTypes)
 {
-  Type *type;
+  int expressionCount = 0;
 
-  type = compileExpression();
-  expressionTypes[(*expressionCount)++] = type;
+  checkTypeEquality(lvalueTypes->types[expressionCount++], compileExpression());
 
   while (lookAhead->tokenType == SB_COMMA) {
     eat(SB_COMMA);
-    type = compileExpression();
-    expressionTypes[(*expressionCount)++] = type;
+    if (expressionCount == lvalueTypes->count)
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
+    checkTypeEquality(lvalueTypes->types[expressionCount++], compileExpression());
   }
+
+  if (expressionCount != lvalueTypes->count)
+    error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->offset);
 }
 
 Type *compileExpression2(void)
 {
-  Type *type;
+  return compileOperators(0);
+}
 
-  type = compileTerm();
-  compileExpression3();
+// Pending operators of the expressions being compiled. A nested expression
+// (an argument or an index) works on the part above its caller's operators.
+__thread enum OpCode *operatorStack = NULL;
+__thread int operatorCount = 0;
+__thread int operatorCapacity = 0;
 
-  return type;
+void pushOperator(enum OpCode op)
+{
+  if (operatorCount == operatorCapacity)
+  {
+    operatorCapacity = (operatorCapacity == 0) ? 64 : 2 * operatorCapacity;
+    operatorStack = REALLOCATE_ARRAY(operatorStack, enum OpCode, operatorCapacity, ALLOC_PARSER);
+  }
+  operatorStack[operatorCount++] = op;
 }
 
-void compileExpression3(void)
+// + - and the leading negation, then * /, then ** (right associative)
+int operatorPrecedence(enum OpCode op)
 {
-  Type *type;
-
-  switch (lookAhead->tokenType)
+  switch (op)
   {
-  case SB_PLUS:
-    eat(SB_PLUS);
-    type = compileTerm();
-    checkIntType(type);
-    compileExpression3();
-    break;
-  case SB_MINUS:
-    eat(SB_MINUS);
-    type = compileTerm();
-    checkIntType(type);
-    compileExpression3();
-    break;
-    // check the FOLLOW set
-  case KW_TO:
-  case KW_DO:
-  case SB_RPAR:
-  case SB_COMMA:
-  case SB_EQ:
-  case SB_NEQ:
-  case SB_LE:
-  case SB_LT:
-  case SB_GE:
-  case SB_GT:
-  case SB_RSEL:
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-  case KW_THEN:
-    break;
+  case OP_PW:
+    return 3;
+  case OP_ML:
+  case OP_DV:
+    return 2;
   default:
-    error(ERR_INVALID_EXPRESSION, lookAhead->lineNo, lookAhead->colNo);
+    return 1;
   }
 }
 
-Type *compileTerm(void)
+void genOperator(enum OpCode op)
 {
-  Type *type;
-
-  type = compileFactor();
-  compileTerm2();
-
-  return type;
+  switch (op)
+  {
+  case OP_AD: genAD(); break;
+  case OP_SB: genSB(); break;
+  case OP_ML: genML(); break;
+  case OP_DV: genDV(); break;
+  case OP_PW: genPW(); break;
+  case OP_NEG: genNEG(); break;
+  default: break;
+  }
 }
 
-void compileTerm2(void)
+// Precedence climbing with an explicit operator stack, so the C stack does
+// not grow with the length of an expression. Every factor after an operator
+// must be an integer; the expression has the type of its first factor.
+Type *compileOperators(int negateFirstTerm)
 {
+  int bottom = operatorCount;
   Type *type;
+  Type *factorType;
+  enum OpCode op;
+  int precedence;
 
-  switch (lookAhead->tokenType)
+  if (negateFirstTerm)
+    pushOperator(OP_NEG);
+
+  type = compileFactor();
+  factorType = type;
+
+  while (1)
   {
-  case SB_TIMES:
-    eat(SB_TIMES);
-    type = compileFactor();
-    checkIntType(type);
-    compileTerm2();
-    break;
-  case SB_SLASH:
-    eat(SB_SLASH);
-    type = compileFactor();
-    checkIntType(type);
-    compileTerm2();
-    break;
-    // check the FOLLOW set
-  case SB_PLUS:
-  case SB_MINUS:
-  case KW_TO:
-  case KW_DO:
-  case SB_RPAR:
-  case SB_COMMA:
-  case SB_EQ:
-  case SB_NEQ:
-  case SB_LE:
-  case SB_LT:
-  case SB_GE:
-  case SB_GT:
-  case SB_RSEL:
-  case SB_SEMICOLON:
-  case KW_END:
-  case KW_ELSE:
-  case KW_THEN:
-    break;
-  default:
-    error(ERR_INVALID_TERM, lookAhead->lineNo, lookAhead->colNo);
+    switch (lookAhead->tokenType)
+    {
+    case SB_PLUS: op = OP_AD; break;
+    case SB_MINUS: op = OP_SB; break;
+    case SB_TIMES: op = OP_ML; break;
+    case SB_SLASH: op = OP_DV; break;
+#if HAS_POWER
+    case SB_POWER:
+      op = OP_PW;
+      checkIntType(factorType);
+      break;
+#endif
+      // check the FOLLOW set
+    default:
+      if (!inFollow(NT_EXPRESSION, lookAhead->tokenType))
+        error(ERR_INVALID_TERM, lookAhead->offset);
+      while (operatorCount > bottom)
+        genOperator(operatorStack[--operatorCount]);
+      return type;
+    }
+
+    precedence = operatorPrecedence(op);
+    while (operatorCount > bottom &&
+           (operatorPrecedence(operatorStack[operatorCount - 1]) > precedence ||
+            (operatorPrecedence(operatorStack[operatorCount - 1]) == precedence && op != OP_PW)))
+      genOperator(operatorStack[--operatorCount]);
+    pushOperator(op);
+
+    eat(lookAhead->tokenType);
+    factorType = compileFactor();
+    checkIntType(factorType);
   }
 }
 
@@ -866,10 +1252,12 @@ Type *compileFactor(void)
   case TK_NUMBER:
     eat(TK_NUMBER);
     type = intType;
+    genLC(currentToken->value);
     break;
   case TK_CHAR:
     eat(TK_CHAR);
     type = charType;
+    genLC(currentToken->string[0]);
     break;
   case TK_IDENT:
     eat(TK_IDENT);
@@ -883,34 +1271,49 @@ Type *compileFactor(void)
       {
       case TP_INT:
         type = intType;
+        genLC(obj->constAttrs->value->intValue);
         break;
       case TP_CHAR:
         type = charType;
+        genLC(obj->constAttrs->value->charValue);
         break;
       default:
-        break;
+        error(ERR_INVALID_FACTOR, currentToken->offset);
       }
       break;
     case OBJ_VARIABLE:
-      if (obj->varAttrs->type->typeClass == TP_ARRAY)
+      if (obj->varAttrs->type->typeClass == TP_ARRAY) {
+        genVariableAddress(obj);
         type = compileIndexes(obj->varAttrs->type);
-      else
+        genLI();
+      } else {
         type = obj->varAttrs->type;
+        genVariableValue(obj);
+      }
       break;
     case OBJ_PARAMETER:
       type = obj->paramAttrs->type;
+      genParameterValue(obj);
       break;
     case OBJ_FUNCTION:
-      compileArguments(obj->funcAttrs->paramList);
+      if (isPredefinedFunction(obj)) {
+        compileArguments(obj->funcAttrs->paramList);
+        genPredefinedFunctionCall(obj);
+      } else {
+        genINT(RESERVED_WORDS);
+        compileArguments(obj->funcAttrs->paramList);
+        genDCT(RESERVED_WORDS + obj->funcAttrs->paramCount);
+        genFunctionCall(obj);
+      }
       type = obj->funcAttrs->returnType;
       break;
     default:
-      error(ERR_INVALID_FACTOR, currentToken->lineNo, currentToken->colNo);
+      error(ERR_INVALID_FACTOR, currentToken->offset);
       break;
     }
     break;
   default:
-    error(ERR_INVALID_FACTOR, lookAhead->lineNo, lookAhead->colNo);
+    error(ERR_INVALID_FACTOR, lookAhead->offset);
   }
 
   return type;
@@ -921,11 +1324,18 @@ Type *compileIndexes(Type *arrayType)
   // TODO: parse a sequence of indexes, check the consistency to the arrayType, and return the element type
   Type *type;
 
+  // The address of the array is on the stack; indexes start from 1
   while (lookAhead->tokenType == SB_LSEL)
   {
     eat(SB_LSEL);
     type = compileExpression();
     checkIntType(type);
+    checkArrayType(arrayType);
+    genLC(1);
+    genSB();
+    genLC(sizeOfType(arrayType->elementType));
+    genML();
+    genAX();
     arrayType = arrayType->elementType;
     eat(SB_RSEL);
   }
@@ -933,24 +1343,55 @@ Type *compileIndexes(Type *arrayType)
   return arrayType;
 }
 
-int compile(char *fileName)
+// Drops the tokens and pending operators of a parse that error() stopped,
+// before parsing again from the same stacks
+void resetParser(void)
 {
-  if (openInputStream(fileName) == IO_ERROR)
-    return IO_ERROR;
+  // scan() stopped in tokenSource leaves both on the same token
+  if (lookAhead != currentToken)
+    RELEASE(lookAhead);
+  RELEASE(currentToken);
+  currentToken = lookAhead = NULL;
+  operatorCount = 0;
+}
 
+// Compiles what the reader has open. The parser's stacks start out empty
+// rather than reused: after a compile server request they lie in an arena
+// that has been reset.
+void compileInput(void)
+{
+  STATS_START(COMPILE);
+  STATS_COUNTERS_START(COMPILE);
   currentToken = NULL;
+  operatorStack = NULL;
+  operatorCount = operatorCapacity = 0;
+  spilledTypes = NULL;
+  spilledCapacity = 0;
   lookAhead = getValidToken();
 
   initSymTab();
+  resetUnits();
 
-  compileProgram();
+  compileModule();
 
   // printObject(symtab->program, 0);
 
   cleanSymTab();
+  STATS_COUNTERS_STOP(COMPILE);
+  STATS_STOP(COMPILE);
+
+  RELEASE(currentToken);
+  RELEASE(lookAhead);
+  currentToken = lookAhead = NULL;
+}
+
+int compile(char *fileName)
+{
+  if (openInputStream(fileName) == IO_ERROR)
+    return IO_ERROR;
 
-  free(currentToken);
-  free(lookAhead);
+  compileInput();
+  cleanBuiltins();
   closeInputStream();
   return IO_SUCCESS;
 }
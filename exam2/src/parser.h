@@ -8,10 +8,45 @@
 #include "token.h"
 #include "symtab.h"
 
+// Types of an assignment's left-hand sides: a small vector whose first
+// TYPE_LIST_INLINE entries need no allocation
+#define TYPE_LIST_INLINE 16
+
+typedef struct {
+  Type *inlineTypes[TYPE_LIST_INLINE];
+  Type **types;
+  int count;
+  int capacity;
+} TypeList;
+
+// Lets a document being edited follow the parse of its tokens: where
+// each subroutine and its block begin and end, and what names resolve to
+// (see document.h), and --check leave blocks for later (see check.h).
+// None while kplc compiles a file.
+typedef struct {
+  int (*reuseRoutine)(void);         // at FUNCTION or PROCEDURE: 1 when it skipped the declaration
+  void (*beginRoutine)(Object *obj); // after the name, in the subroutine's (or program's) scope
+  void (*beginBlock)(void);          // after the header, before its block
+  int (*skipBlock)(void);            // then: 1 when it moved the parser past the block's END
+  void (*endRoutine)(void);          // after its closing ; (or .)
+  void (*resolved)(char *name, Object *obj, int levels);  // levels: scopes out from the current one
+  void (*declared)(void);            // at the name of a declaration, found fresh in its scope
+} ParserHooks;
+
+extern __thread ParserHooks *parserHooks;
+// Where scan() takes the next token from: getValidToken, or a document
+extern __thread Token *(*tokenSource)(void);
+
 void scan(void);
 void eat(TokenType tokenType);
 
+void compileModule(void);
 void compileProgram(void);
+CodeAddress compileUses(void);
+#if HAS_UNITS
+void compileUse(void);
+void compileUnit(void);
+#endif
 void compileBlock(void);
 void compileBlock2(void);
 void compileBlock3(void);
@@ -28,6 +63,11 @@ void compileFuncDecl(void);
 void compileProcDecl(void);
 ConstantValue* compileUnsignedConstant(void);
 ConstantValue* compileConstant(void);
+#if HAS_SUM
+ConstantValue* compileConstantSum(void);
+#endif
+ConstantValue* compileConstantTerm(void);
+ConstantValue* compileConstantPower(void);
 ConstantValue* compileConstant2(void);
 Type* compileType(void);
 Type* compileBasicType(void);
@@ -36,25 +76,34 @@ void compileParam(void);
 void compileStatements(void);
 void compileStatement(void);
 Type* compileLValue(void);
+void initTypeList(TypeList *list);
+void appendType(TypeList *list, Type *type);
+void compileLValueList(TypeList *lvalueTypes);
 void compileAssignSt(void);
 void compileCallSt(void);
 void compileGroupSt(void);
 void compileIfSt(void);
 void compileElseSt(void);
 void compileWhileSt(void);
+#if HAS_REPEAT
+void compileRepeatSt(void);
+#endif
 void compileForSt(void);
 void compileArgument(Object* param);
 void compileArguments(ObjectNode* paramList);
 void compileCondition(void);
+#if HAS_SUM
+void compileSum(void);
+#endif
 Type* compileExpression(void);
-void compileExpressionList(Type *expressionTypes[], int *expressionCount);
+void compileExpressionList(TypeList *lvalueTypes);
 Type* compileExpression2(void);
-void compileExpression3(void);
-Type* compileTerm(void);
-void compileTerm2(void);
+Type* compileOperators(int negateFirstTerm);
 Type* compileFactor(void);
 Type* compileIndexes(Type* arrayType);
 
+void resetParser(void);
+void compileInput(void);
 int compile(char *fileName);
 
 #endif
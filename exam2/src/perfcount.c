@@ -0,0 +1,141 @@
+#include <string.h>
+#include "perfcount.h"
+
+char *counterNames[COUNTER_COUNT] = {
+  "cycles", "instructions", "branchMisses", "cacheMisses"
+};
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// All counters form one group led by the cycle counter, so they are
+// scheduled together and one read returns them all
+int counterFds[COUNTER_COUNT] = { -1, -1, -1, -1 };
+int groupSlots[COUNTER_COUNT];  // position of each counter in a group read
+int groupSize = 0;
+
+unsigned long long counterConfigs[COUNTER_COUNT] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_BRANCH_MISSES,
+  PERF_COUNT_HW_CACHE_MISSES
+};
+
+int openCounter(Counter counter, int groupFd)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = counterConfigs[counter];
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.disabled = (groupFd == -1);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+int openCounters(void)
+{
+  int counter;
+
+  counterFds[COUNTER_CYCLES] = openCounter(COUNTER_CYCLES, -1);
+  if (counterFds[COUNTER_CYCLES] < 0)
+    return 0;
+  groupSlots[COUNTER_CYCLES] = groupSize++;
+
+  // a counter the processor lacks is left out rather than failing them all
+  for (counter = COUNTER_CYCLES + 1; counter < COUNTER_COUNT; counter++)
+  {
+    counterFds[counter] = openCounter(counter, counterFds[COUNTER_CYCLES]);
+    if (counterFds[counter] >= 0)
+      groupSlots[counter] = groupSize++;
+  }
+
+  ioctl(counterFds[COUNTER_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(counterFds[COUNTER_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return 1;
+}
+
+void closeCounters(void)
+{
+  int counter;
+
+  for (counter = 0; counter < COUNTER_COUNT; counter++)
+    if (counterFds[counter] >= 0)
+    {
+      close(counterFds[counter]);
+      counterFds[counter] = -1;
+    }
+  groupSize = 0;
+}
+
+int counterSupported(Counter counter)
+{
+  return counterFds[counter] >= 0;
+}
+
+// Values are scaled up when the kernel had to multiplex the group
+void readCounters(CounterSample *sample)
+{
+  unsigned long long buffer[3 + COUNTER_COUNT];
+  double scale = 1.0;
+  int counter;
+
+  memset(sample, 0, sizeof(*sample));
+  if (groupSize == 0 ||
+      read(counterFds[COUNTER_CYCLES], buffer, sizeof(buffer)) < (ssize_t)(3 + groupSize) * 8)
+    return;
+  if (buffer[2] > 0 && buffer[2] < buffer[1])
+    scale = (double)buffer[1] / buffer[2];
+  for (counter = 0; counter < COUNTER_COUNT; counter++)
+    if (counterFds[counter] >= 0)
+      sample->values[counter] = (long long)(buffer[3 + groupSlots[counter]] * scale);
+}
+
+#else
+
+int openCounters(void)
+{
+  return 0;
+}
+
+void closeCounters(void)
+{
+}
+
+int counterSupported(Counter counter)
+{
+  return 0;
+}
+
+void readCounters(CounterSample *sample)
+{
+  memset(sample, 0, sizeof(*sample));
+}
+
+#endif
+
+// Adds what was counted since start to total
+void addCounterDelta(CounterSample *total, CounterSample *start)
+{
+  CounterSample now;
+  int counter;
+
+  readCounters(&now);
+  for (counter = 0; counter < COUNTER_COUNT; counter++)
+    total->values[counter] += now.values[counter] - start->values[counter];
+}
+
+double instructionsPerCycle(CounterSample *sample)
+{
+  if (sample->values[COUNTER_CYCLES] == 0)
+    return 0;
+  return (double)sample->values[COUNTER_INSTRUCTIONS] / sample->values[COUNTER_CYCLES];
+}
@@ -0,0 +1,31 @@
+#ifndef __PERFCOUNT_H__
+#define __PERFCOUNT_H__
+
+// Hardware performance counters of this process, read with the Linux
+// perf_event_open system call. They count user space only, which works
+// with the default perf_event_paranoid setting. Elsewhere, or when the
+// kernel or a virtual machine does not expose them, openCounters fails
+// and the callers carry on without counters.
+
+typedef enum {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_CACHE_MISSES,
+  COUNTER_COUNT
+} Counter;
+
+typedef struct {
+  long long values[COUNTER_COUNT];
+} CounterSample;
+
+extern char *counterNames[COUNTER_COUNT];
+
+int openCounters(void);
+void closeCounters(void);
+int counterSupported(Counter counter);
+void readCounters(CounterSample *sample);
+void addCounterDelta(CounterSample *total, CounterSample *start);
+double instructionsPerCycle(CounterSample *sample);
+
+#endif
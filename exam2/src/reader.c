@@ -5,36 +5,80 @@
  */
 
 #include <stdio.h>
+#include "alloc.h"
+#include "lines.h"
 #include "reader.h"
+#include "stats.h"
+#include "trace.h"
 
-FILE *inputStream;
-int lineNo, colNo;
-int currentChar;
+// Per thread, for sources lexed in chunks on several at once (see tokenbuf.h)
+__thread FILE *inputStream;
+__thread int inputOffset;       // of currentChar; at the end, of the last one
+__thread LineIndex inputLines;  // the lines read so far
+__thread int currentChar;
+__thread int echoInput = 1;
 
 int readChar(void) {
   currentChar = getc(inputStream);
   if (currentChar == EOF) {
+    TRACE_LINE(inputLines.count, 1);
     return EOF;
   }
-  colNo ++;
+  inputOffset ++;
+  STATS_COUNT(characters);
   if (currentChar == '\n') {
-    lineNo ++;
-    colNo = 0;
+    STATS_COUNT(lines);
+    TRACE_LINE(inputLines.count, 0);
+    addLine(&inputLines, inputOffset + 1);
   }
-  printf("%c", currentChar);
+  if (echoInput)
+    printf("%c", currentChar);
   return currentChar;
 }
 
-int openInputStream(char *fileName) {
-  inputStream = fopen(fileName, "rt");
+// The first character of stream is read as if at offset
+int resumeInput(FILE *stream, int offset) {
+  inputStream = stream;
   if (inputStream == NULL)
     return IO_ERROR;
-  lineNo = 1;
-  colNo = 0;
+  inputOffset = offset - 1;
+  inputLines.starts = NULL;
+  inputLines.count = inputLines.capacity = 0;
+  addLine(&inputLines, 0);
   readChar();
   return IO_SUCCESS;
 }
 
+int openInput(FILE *stream) {
+  return resumeInput(stream, 0);
+}
+
+// A whole source, whose diagnostics are placed by the lines the reader saw
+int openSource(FILE *stream) {
+  if (openInput(stream) == IO_ERROR)
+    return IO_ERROR;
+  sourceLines = &inputLines;
+  return IO_SUCCESS;
+}
+
+int openInputStream(char *fileName) {
+  return openSource(fopen(fileName, "rt"));
+}
+
+// Reads size bytes of buffer, which must outlive the stream
+int openInputBuffer(char *buffer, int size) {
+  return openSource(fmemopen(buffer, size, "r"));
+}
+
+// Bytes read so far, each of them echoed
+long inputPosition(void) {
+  return ftell(inputStream);
+}
+
 void closeInputStream() {
   fclose(inputStream);
+  if (sourceLines == &inputLines)
+    sourceLines = NULL;
+  RELEASE(inputLines.starts);
+  inputLines.starts = NULL;
 }
@@ -7,11 +7,21 @@
 #ifndef __READER_H__
 #define __READER_H__
 
+#include <stdio.h>
+
 #define IO_ERROR 0
 #define IO_SUCCESS 1
 
+// The command line compiler shows the source as it reads it; per thread,
+// as the reader is
+extern __thread int echoInput;
+
 int readChar(void);
+int openInput(FILE *stream);
+int resumeInput(FILE *stream, int offset);
 int openInputStream(char *fileName);
+int openInputBuffer(char *buffer, int size);
+long inputPosition(void);
 void closeInputStream(void);
 
 #endif
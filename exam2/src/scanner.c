@@ -13,11 +13,13 @@
 #include "token.h"
 #include "error.h"
 #include "scanner.h"
+#include "alloc.h"
+#include "stats.h"
+#include "lines.h"
 
 
-extern int lineNo;
-extern int colNo;
-extern int currentChar;
+extern __thread int inputOffset;
+extern __thread int currentChar;
 
 extern CharCode charCodes[];
 
@@ -45,11 +47,11 @@ void skipComment() {
     readChar();
   }
   if (state != 2)
-    error(ERR_END_OF_COMMENT, lineNo, colNo);
+    error(ERR_END_OF_COMMENT, inputOffset);
 }
 
 Token* readIdentKeyword(void) {
-  Token *token = makeToken(TK_NONE, lineNo, colNo);
+  Token *token = makeToken(TK_NONE, inputOffset);
   int count = 1;
 
   token->string[0] = toupper((char)currentChar);
@@ -62,7 +64,7 @@ Token* readIdentKeyword(void) {
   }
 
   if (count > MAX_IDENT_LEN) {
-    error(ERR_IDENT_TOO_LONG, token->lineNo, token->colNo);
+    error(ERR_IDENT_TOO_LONG, token->offset);
     return token;
   }
 
@@ -76,7 +78,7 @@ Token* readIdentKeyword(void) {
 }
 
 Token* readNumber(void) {
-  Token *token = makeToken(TK_NUMBER, lineNo, colNo);
+  Token *token = makeToken(TK_NUMBER, inputOffset);
   int count = 0;
 
   while ((currentChar != EOF) && (charCodes[currentChar] == CHAR_DIGIT)) {
@@ -90,12 +92,12 @@ Token* readNumber(void) {
 }
 
 Token* readConstChar(void) {
-  Token *token = makeToken(TK_CHAR, lineNo, colNo);
+  Token *token = makeToken(TK_CHAR, inputOffset);
 
   readChar();
   if (currentChar == EOF) {
     token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
+    error(ERR_INVALID_CONSTANT_CHAR, token->offset);
     return token;
   }
 
@@ -105,7 +107,7 @@ Token* readConstChar(void) {
   readChar();
   if (currentChar == EOF) {
     token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
+    error(ERR_INVALID_CONSTANT_CHAR, token->offset);
     return token;
   }
 
@@ -114,141 +116,148 @@ Token* readConstChar(void) {
     return token;
   } else {
     token->tokenType = TK_NONE;
-    error(ERR_INVALID_CONSTANT_CHAR, token->lineNo, token->colNo);
+    error(ERR_INVALID_CONSTANT_CHAR, token->offset);
     return token;
   }
 }
 
 Token* getToken(void) {
   Token *token;
-  int ln, cn;
+  int offset;
 
   if (currentChar == EOF)
-    return makeToken(TK_EOF, lineNo, colNo);
+    return makeToken(TK_EOF, inputOffset);
 
   switch (charCodes[currentChar]) {
   case CHAR_SPACE: skipBlank(); return getToken();
   case CHAR_LETTER: return readIdentKeyword();
   case CHAR_DIGIT: return readNumber();
   case CHAR_PLUS:
-    token = makeToken(SB_PLUS, lineNo, colNo);
+    token = makeToken(SB_PLUS, inputOffset);
     readChar();
     return token;
   case CHAR_MINUS:
-    token = makeToken(SB_MINUS, lineNo, colNo);
+    token = makeToken(SB_MINUS, inputOffset);
     readChar();
     return token;
   case CHAR_TIMES:
-    token = makeToken(SB_TIMES, lineNo, colNo);
+    token = makeToken(SB_TIMES, inputOffset);
     readChar();
+#if HAS_POWER
+    if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_TIMES)) {
+      token->tokenType = SB_POWER;
+      readChar();
+    }
+#endif
     return token;
   case CHAR_SLASH:
-    token = makeToken(SB_SLASH, lineNo, colNo);
+    token = makeToken(SB_SLASH, inputOffset);
     readChar();
     return token;
   case CHAR_LT:
-    ln = lineNo;
-    cn = colNo;
+    offset = inputOffset;
     readChar();
     if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
       readChar();
-      return makeToken(SB_LE, ln, cn);
-    } else return makeToken(SB_LT, ln, cn);
+      return makeToken(SB_LE, offset);
+    } else return makeToken(SB_LT, offset);
   case CHAR_GT:
-    ln = lineNo;
-    cn = colNo;
+    offset = inputOffset;
     readChar();
     if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
       readChar();
-      return makeToken(SB_GE, ln, cn);
-    } else return makeToken(SB_GT, ln, cn);
+      return makeToken(SB_GE, offset);
+    } else return makeToken(SB_GT, offset);
   case CHAR_EQ:
-    token = makeToken(SB_EQ, lineNo, colNo);
+    token = makeToken(SB_EQ, inputOffset);
     readChar();
     return token;
   case CHAR_EXCLAIMATION:
-    ln = lineNo;
-    cn = colNo;
+    offset = inputOffset;
     readChar();
     if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
       readChar();
-      return makeToken(SB_NEQ, ln, cn);
+      return makeToken(SB_NEQ, offset);
     } else {
-      token = makeToken(TK_NONE, ln, cn);
-      error(ERR_INVALID_SYMBOL, ln, cn);
+      token = makeToken(TK_NONE, offset);
+      error(ERR_INVALID_SYMBOL, offset);
       return token;
     }
   case CHAR_COMMA:
-    token = makeToken(SB_COMMA, lineNo, colNo);
+    token = makeToken(SB_COMMA, inputOffset);
     readChar();
     return token;
   case CHAR_PERIOD:
-    ln = lineNo;
-    cn = colNo;
+    offset = inputOffset;
     readChar();
     if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_RPAR)) {
       readChar();
-      return makeToken(SB_RSEL, ln, cn);
-    } else return makeToken(SB_PERIOD, ln, cn);
+      return makeToken(SB_RSEL, offset);
+    } else return makeToken(SB_PERIOD, offset);
   case CHAR_SEMICOLON:
-    token = makeToken(SB_SEMICOLON, lineNo, colNo);
+    token = makeToken(SB_SEMICOLON, inputOffset);
     readChar();
     return token;
   case CHAR_COLON:
-    ln = lineNo;
-    cn = colNo;
+    offset = inputOffset;
     readChar();
     if ((currentChar != EOF) && (charCodes[currentChar] == CHAR_EQ)) {
       readChar();
-      return makeToken(SB_ASSIGN, ln, cn);
-    } else return makeToken(SB_COLON, ln, cn);
+      return makeToken(SB_ASSIGN, offset);
+    } else return makeToken(SB_COLON, offset);
   case CHAR_SINGLEQUOTE: return readConstChar();
   case CHAR_LPAR:
-    ln = lineNo;
-    cn = colNo;
+    offset = inputOffset;
     readChar();
 
     if (currentChar == EOF)
-      return makeToken(SB_LPAR, ln, cn);
+      return makeToken(SB_LPAR, offset);
 
     switch (charCodes[currentChar]) {
     case CHAR_PERIOD:
       readChar();
-      return makeToken(SB_LSEL, ln, cn);
+      return makeToken(SB_LSEL, offset);
     case CHAR_TIMES:
       readChar();
       skipComment();
       return getToken();
     default:
-      return makeToken(SB_LPAR, ln, cn);
+      return makeToken(SB_LPAR, offset);
     }
   case CHAR_RPAR:
-    token = makeToken(SB_RPAR, lineNo, colNo);
+    token = makeToken(SB_RPAR, inputOffset);
     readChar();
     return token;
   default:
-    token = makeToken(TK_NONE, lineNo, colNo);
-    error(ERR_INVALID_SYMBOL, lineNo, colNo);
+    token = makeToken(TK_NONE, inputOffset);
+    error(ERR_INVALID_SYMBOL, inputOffset);
     readChar();
     return token;
   }
 }
 
 Token* getValidToken(void) {
+  STATS_START(SCAN);
   Token *token = getToken();
   while (token->tokenType == TK_NONE) {
-    free(token);
+    RELEASE(token);
     token = getToken();
   }
+  STATS_STOP(SCAN);
+  STATS_TOKEN(token->tokenType);
   return token;
 }
 
 
 /******************************************************************/
 
+// At the token's lineNo-colNo in sourceLines, found for the output
 void printToken(Token *token) {
+  int lineNo = 0, colNo = 0;
 
-  printf("%d-%d:", token->lineNo, token->colNo);
+  if (sourceLines != NULL)
+    findPosition(sourceLines, token->offset, &lineNo, &colNo);
+  printf("%d-%d:", lineNo, colNo);
 
   switch (token->tokenType) {
   case TK_NONE: printf("TK_NONE\n"); break;
@@ -258,11 +267,18 @@ void printToken(Token *token) {
   case TK_EOF: printf("TK_EOF\n"); break;
 
   case KW_PROGRAM: printf("KW_PROGRAM\n"); break;
+#if HAS_UNITS
+  case KW_UNIT: printf("KW_UNIT\n"); break;
+  case KW_USES: printf("KW_USES\n"); break;
+#endif
   case KW_CONST: printf("KW_CONST\n"); break;
   case KW_TYPE: printf("KW_TYPE\n"); break;
   case KW_VAR: printf("KW_VAR\n"); break;
   case KW_INTEGER: printf("KW_INTEGER\n"); break;
   case KW_CHAR: printf("KW_CHAR\n"); break;
+#if HAS_BYTES
+  case KW_BYTES: printf("KW_BYTES\n"); break;
+#endif
   case KW_ARRAY: printf("KW_ARRAY\n"); break;
   case KW_OF: printf("KW_OF\n"); break;
   case KW_FUNCTION: printf("KW_FUNCTION\n"); break;
@@ -277,7 +293,13 @@ void printToken(Token *token) {
   case KW_DO: printf("KW_DO\n"); break;
   case KW_FOR: printf("KW_FOR\n"); break;
   case KW_TO: printf("KW_TO\n"); break;
+#if HAS_REPEAT
+  case KW_REPEAT: printf("KW_REPEAT\n"); break;
+  case KW_UNTIL: printf("KW_UNTIL\n"); break;
+#endif
+#if HAS_SUM
   case KW_SUM: printf("KW_SUM\n"); break;
+#endif
 
   case SB_SEMICOLON: printf("SB_SEMICOLON\n"); break;
   case SB_COLON: printf("SB_COLON\n"); break;
@@ -294,6 +316,9 @@ void printToken(Token *token) {
   case SB_MINUS: printf("SB_MINUS\n"); break;
   case SB_TIMES: printf("SB_TIMES\n"); break;
   case SB_SLASH: printf("SB_SLASH\n"); break;
+#if HAS_POWER
+  case SB_POWER: printf("SB_POWER\n"); break;
+#endif
   case SB_LPAR: printf("SB_LPAR\n"); break;
   case SB_RPAR: printf("SB_RPAR\n"); break;
   case SB_LSEL: printf("SB_LSEL\n"); break;
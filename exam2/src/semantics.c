@@ -7,35 +7,56 @@
 #include <stdlib.h>
 #include <string.h>
 #include "semantics.h"
+#include "parser.h"
 #include "error.h"
+#include "stats.h"
+#include "unit.h"
 
-extern SymTab *symtab;
-extern Token *currentToken;
+extern __thread SymTab *symtab;
+extern __thread Token *currentToken;
 
 // Find object with name in symtab table (the whole program)
 Object *lookupObject(char *name)
 {
   Scope *scope = symtab->currentScope;
-  Object *obj;
+  Object *obj = NULL;
+  int depth = 0;
+  int levels;
 
-  while (scope != NULL)
+  STATS_START(LOOKUP);
+  while (scope != NULL && obj == NULL)
   {
-    obj = findObject(scope->objList, name);
-    if (obj != NULL)
-      return obj;
+    obj = findObjectBefore(scope->objList, (scope == symtab->partialScope) ? symtab->partialEnd : NULL, name);
     scope = scope->outer;
+    depth++;
   }
-  obj = findObject(symtab->globalObjectList, name);
-  if (obj != NULL)
-    return obj;
-  return NULL;
+  levels = depth - 1;
+  // the units' names come after the program's own
+  if (obj == NULL && symtab->units != NULL)
+    obj = findUnitObject(symtab->units, name);
+  if (obj == NULL)
+  {
+    obj = findObject(symtab->globalObjectList, name);
+    levels = depth;
+  }
+  STATS_STOP(LOOKUP);
+
+  if (parserHooks != NULL && obj != NULL)
+    parserHooks->resolved(name, obj, levels);
+
+  STATS_COUNT(lookups);
+  STATS_ADD(scopesWalked, depth);
+  STATS_MAX(maxScopeDepth, depth);
+  return obj;
 }
 
 // Check if ident is fresh or not in current scope
 void checkFreshIdent(char *name)
 {
   if (findObject(symtab->currentScope->objList, name) != NULL)
-    error(ERR_DUPLICATE_IDENT, currentToken->lineNo, currentToken->colNo);
+    error(ERR_DUPLICATE_IDENT, currentToken->offset);
+  if (parserHooks != NULL)
+    parserHooks->declared();
 }
 
 // Check if ident if fresh or not in the whole program
@@ -44,7 +65,7 @@ Object *checkDeclaredIdent(char *name)
   Object *obj = lookupObject(name);
   if (obj == NULL)
   {
-    error(ERR_UNDECLARED_IDENT, currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_IDENT, currentToken->offset);
   }
   return obj;
 }
@@ -55,10 +76,10 @@ Object *checkDeclaredConstant(char *name)
   // Check fresh
   Object *obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_CONSTANT, currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_CONSTANT, currentToken->offset);
   // Check kind is as expected or not
   if (obj->kind != OBJ_CONSTANT)
-    error(ERR_INVALID_CONSTANT, currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_CONSTANT, currentToken->offset);
 
   return obj;
 }
@@ -69,10 +90,10 @@ Object *checkDeclaredType(char *name)
   // Check fresh
   Object *obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_TYPE, currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_TYPE, currentToken->offset);
   // Check kind
   if (obj->kind != OBJ_TYPE)
-    error(ERR_INVALID_TYPE, currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_TYPE, currentToken->offset);
 
   return obj;
 }
@@ -82,9 +103,9 @@ Object *checkDeclaredVariable(char *name)
 {
   Object *obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_VARIABLE, currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_VARIABLE, currentToken->offset);
   if (obj->kind != OBJ_VARIABLE)
-    error(ERR_INVALID_VARIABLE, currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_VARIABLE, currentToken->offset);
 
   return obj;
 }
@@ -94,9 +115,9 @@ Object *checkDeclaredFunction(char *name)
 {
   Object *obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_FUNCTION, currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_FUNCTION, currentToken->offset);
   if (obj->kind != OBJ_FUNCTION)
-    error(ERR_INVALID_FUNCTION, currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_FUNCTION, currentToken->offset);
 
   return obj;
 }
@@ -106,9 +127,9 @@ Object *checkDeclaredProcedure(char *name)
 {
   Object *obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_PROCEDURE, currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_PROCEDURE, currentToken->offset);
   if (obj->kind != OBJ_PROCEDURE)
-    error(ERR_INVALID_PROCEDURE, currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_PROCEDURE, currentToken->offset);
 
   return obj;
 }
@@ -117,7 +138,7 @@ Object *checkDeclaredLValueIdent(char *name)
 {
   Object *obj = lookupObject(name);
   if (obj == NULL)
-    error(ERR_UNDECLARED_IDENT, currentToken->lineNo, currentToken->colNo);
+    error(ERR_UNDECLARED_IDENT, currentToken->offset);
 
   switch (obj->kind)
   {
@@ -125,14 +146,14 @@ Object *checkDeclaredLValueIdent(char *name)
   case OBJ_PARAMETER:
     break;
   case OBJ_CONSTANT:
-    error(ERR_CONSTANT_ASSIGN, currentToken->lineNo, currentToken->colNo);
+    error(ERR_CONSTANT_ASSIGN, currentToken->offset);
     break;
   case OBJ_FUNCTION:
     if (obj != symtab->currentScope->owner)
-      error(ERR_INVALID_IDENT, currentToken->lineNo, currentToken->colNo);
+      error(ERR_INVALID_IDENT, currentToken->offset);
     break;
   default:
-    error(ERR_INVALID_IDENT, currentToken->lineNo, currentToken->colNo);
+    error(ERR_INVALID_IDENT, currentToken->offset);
   }
 
   return obj;
@@ -145,7 +166,7 @@ void checkIntType(Type *type)
   if (type != NULL && type->typeClass == TP_INT)
     return;
   else
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 void checkCharType(Type *type)
@@ -154,7 +175,7 @@ void checkCharType(Type *type)
   if (type != NULL && type->typeClass == TP_CHAR)
     return;
   else
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 void checkBasicType(Type *type)
@@ -163,7 +184,7 @@ void checkBasicType(Type *type)
   if ((type != NULL) && ((type->typeClass == TP_INT) || (type->typeClass == TP_CHAR)))
     return;
   else
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 void checkArrayType(Type *type)
@@ -172,13 +193,14 @@ void checkArrayType(Type *type)
   if ((type != NULL) && (type->typeClass == TP_ARRAY))
     return;
   else
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
 }
 
 // Compare 2 input type
 void checkTypeEquality(Type *type1, Type *type2)
 {
-  // TODO
+  STATS_START(TYPE_CHECK);
   if (compareType(type1, type2) == 0)
-    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    error(ERR_TYPE_INCONSISTENCY, currentToken->offset);
+  STATS_STOP(TYPE_CHECK);
 }
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "reader.h"
+#include "parser.h"
+#include "codegen.h"
+#include "error.h"
+#include "alloc.h"
+#include "server.h"
+
+// One line of a request without its newline; 0 at the end of the connection
+int readRequestLine(int fd, char *line, int size)
+{
+  int length = 0;
+  char c;
+
+  while (read(fd, &c, 1) == 1)
+  {
+    if (c == '\n')
+    {
+      line[length] = '\0';
+      return 1;
+    }
+    if (length + 1 < size)
+      line[length++] = c;
+  }
+  return 0;
+}
+
+int readFully(int fd, char *buffer, long size)
+{
+  long done = 0, n;
+
+  while (done < size)
+  {
+    n = read(fd, buffer + done, size - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    done += n;
+  }
+  return 1;
+}
+
+int writeFully(int fd, char *buffer, long size)
+{
+  long done = 0, n;
+
+  while (done < size)
+  {
+    n = write(fd, buffer + done, size - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    done += n;
+  }
+  return 1;
+}
+
+void compileRequest(char *source, long size, char *reply)
+{
+  jmp_buf handler;
+  volatile int opened = 0;
+
+  errorHandler = &handler;
+  if (setjmp(handler) == 0)
+  {
+    initCodeBuffer();
+    if (openInputBuffer(source, size) == IO_ERROR)
+      snprintf(reply, SERVER_MAX_REPLY, "ERROR 0-0:Can't read input\n");
+    else
+    {
+      opened = 1;
+      compileInput();
+      snprintf(reply, SERVER_MAX_REPLY, "OK %d\n", getCodeBuffer()->codeSize);
+    }
+  }
+  else
+    snprintf(reply, SERVER_MAX_REPLY, "ERROR %s\n", errorMessage);
+  errorHandler = NULL;
+
+  if (opened)
+    closeInputStream();
+  resetArena();
+}
+
+// Serves the requests of one client; 1 when it asked the server to stop
+int serveConnection(int fd)
+{
+  char line[SERVER_MAX_LINE];
+  char reply[SERVER_MAX_REPLY];
+  char *source = NULL;
+  long capacity = 0;
+  long size;
+  int stop = 0;
+
+  while (readRequestLine(fd, line, sizeof(line)))
+  {
+    if (strcmp(line, "SHUTDOWN") == 0)
+    {
+      writeFully(fd, "OK 0\n", 5);
+      stop = 1;
+      break;
+    }
+    if (sscanf(line, "COMPILE %ld", &size) != 1 || size < 0 || size > SERVER_MAX_SOURCE)
+    {
+      writeFully(fd, "ERROR 0-0:Bad request\n", 22);
+      break;
+    }
+    if (size + 1 > capacity)
+    {
+      capacity = size + 1;
+      source = (char *)realloc(source, capacity);
+    }
+    if (!readFully(fd, source, size))
+      break;
+    compileRequest(source, size, reply);
+    if (!writeFully(fd, reply, strlen(reply)))
+      break;
+  }
+  free(source);
+  return stop;
+}
+
+int runServer(char *socketPath)
+{
+  struct sockaddr_un address;
+  struct stat status;
+  int listener, client;
+  int stop = 0;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "kplc: socket path too long: %s\n", socketPath);
+    return -1;
+  }
+  strcpy(address.sun_path, socketPath);
+
+  // the socket of an earlier server is replaced, anything else is kept
+  if (lstat(socketPath, &status) == 0)
+  {
+    if (!S_ISSOCK(status.st_mode))
+    {
+      fprintf(stderr, "kplc: %s exists and is not a socket\n", socketPath);
+      return -1;
+    }
+    unlink(socketPath);
+  }
+
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(listener, 16) < 0)
+  {
+    fprintf(stderr, "kplc: can't listen on %s: %s\n", socketPath, strerror(errno));
+    return -1;
+  }
+
+  // a client that goes away mid reply must not end the server
+  signal(SIGPIPE, SIG_IGN);
+  echoInput = 0;
+  initBuiltins();
+  setAllocator(&arenaAllocator);
+
+  while (!stop)
+  {
+    client = accept(listener, NULL, NULL);
+    if (client < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    stop = serveConnection(client);
+    close(client);
+  }
+
+  close(listener);
+  unlink(socketPath);
+  resetArena();
+  setAllocator(&mallocAllocator);
+  cleanBuiltins();
+  return 0;
+}
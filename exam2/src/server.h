@@ -0,0 +1,23 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "error.h"
+
+// Compile server for editors that compile on every change. It listens on a
+// Unix domain socket and answers requests one connection at a time; a
+// connection may carry any number of requests, each answered by one line:
+//
+//   COMPILE <bytes>\n<bytes of source>  ->  OK <instructions>\n
+//                                       or  ERROR <lineNo>-<colNo>:<message>\n
+//   SHUTDOWN\n                          ->  OK 0\n and the server exits
+//
+// The predefined subroutines are built once. Everything a request
+// allocates comes from an arena that is reset after it, errors included.
+
+#define SERVER_MAX_LINE 64
+#define SERVER_MAX_REPLY (MAX_ERROR_MESSAGE + 16)
+#define SERVER_MAX_SOURCE (256 << 20)
+
+int runServer(char *socketPath);
+
+#endif
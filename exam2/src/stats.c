@@ -0,0 +1,114 @@
+#ifdef KPL_STATS
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+__thread Statistics statistics;
+int countersEnabled = 0;
+
+char *phaseNames[PHASE_COUNT] = {
+  "compile", "scan", "lookup", "typeCheck",
+  "addObject", "findObject", "emit", "run", "cache"
+};
+
+long long statsClock(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void addStatistics(Statistics *other)
+{
+  int i, counter;
+
+  for (i = 0; i < PHASE_COUNT; i++)
+  {
+    statistics.phases[i].nanoseconds += other->phases[i].nanoseconds;
+    statistics.phases[i].calls += other->phases[i].calls;
+    for (counter = 0; counter < COUNTER_COUNT; counter++)
+      statistics.counters[i].values[counter] += other->counters[i].values[counter];
+  }
+  statistics.characters += other->characters;
+  statistics.lines += other->lines;
+  statistics.chunks += other->chunks;
+  statistics.chunksRelexed += other->chunksRelexed;
+  for (i = 0; i < TOKEN_TYPE_COUNT; i++)
+    statistics.tokens[i] += other->tokens[i];
+  statistics.lookups += other->lookups;
+  statistics.scopesWalked += other->scopesWalked;
+  if (other->maxScopeDepth > statistics.maxScopeDepth)
+    statistics.maxScopeDepth = other->maxScopeDepth;
+  statistics.objectsCompared += other->objectsCompared;
+  statistics.allocations += other->allocations;
+  statistics.allocatedBytes += other->allocatedBytes;
+  statistics.cacheHits += other->cacheHits;
+  statistics.cacheMisses += other->cacheMisses;
+  statistics.cacheEvictions += other->cacheEvictions;
+}
+
+// Token names such as "keyword BEGIN" or "';'" never need JSON escapes
+void printStatistics(FILE *out)
+{
+  int i, counter;
+  char *separator = "";
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  fprintf(out, "{\n  \"phases\": {\n");
+  for (i = 0; i < PHASE_COUNT; i++)
+    fprintf(out, "    \"%s\": { \"ns\": %lld, \"calls\": %lld }%s\n", phaseNames[i],
+            statistics.phases[i].nanoseconds, statistics.phases[i].calls,
+            (i + 1 < PHASE_COUNT) ? "," : "");
+  fprintf(out, "  },\n");
+
+  fprintf(out, "  \"reader\": { \"characters\": %lld, \"lines\": %lld, \"chunks\": %lld, "
+          "\"chunksRelexed\": %lld },\n",
+          statistics.characters, statistics.lines, statistics.chunks, statistics.chunksRelexed);
+
+  fprintf(out, "  \"tokens\": {");
+  for (i = 0; i < TOKEN_TYPE_COUNT; i++)
+    if (statistics.tokens[i] > 0)
+    {
+      fprintf(out, "%s\n    \"%s\": %lld", separator, tokenToString(i), statistics.tokens[i]);
+      separator = ",";
+    }
+  fprintf(out, "\n  },\n");
+
+  fprintf(out, "  \"symtab\": { \"lookups\": %lld, \"scopesWalked\": %lld, "
+          "\"maxScopeDepth\": %lld, \"objectsCompared\": %lld },\n",
+          statistics.lookups, statistics.scopesWalked,
+          statistics.maxScopeDepth, statistics.objectsCompared);
+  fprintf(out, "  \"cache\": { \"hits\": %lld, \"misses\": %lld, \"evictions\": %lld },\n",
+          statistics.cacheHits, statistics.cacheMisses, statistics.cacheEvictions);
+  fprintf(out, "  \"check\": { \"threads\": %lld, \"blocks\": %lld, \"onePass\": %lld },\n",
+          statistics.checkThreads, statistics.checkBlocks, statistics.checkOnePass);
+  fprintf(out, "  \"memory\": { \"allocations\": %lld, \"bytes\": %lld, \"maxRssKb\": %ld }",
+          statistics.allocations, statistics.allocatedBytes, usage.ru_maxrss);
+
+  if (countersEnabled)
+  {
+    separator = "";
+    fprintf(out, ",\n  \"counters\": {");
+    for (i = 0; i < PHASE_COUNT; i++)
+      if (statistics.counters[i].values[COUNTER_CYCLES] > 0)
+      {
+        fprintf(out, "%s\n    \"%s\": {", separator, phaseNames[i]);
+        for (counter = 0; counter < COUNTER_COUNT; counter++)
+          if (counterSupported(counter))
+            fprintf(out, " \"%s\": %lld,", counterNames[counter],
+                    statistics.counters[i].values[counter]);
+        fprintf(out, " \"ipc\": %.3f }", instructionsPerCycle(&statistics.counters[i]));
+        separator = ",";
+      }
+    fprintf(out, "\n  }");
+  }
+  fprintf(out, "\n}\n");
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdio.h>
+#include "token.h"
+#include "perfcount.h"
+
+// Compiler statistics for --stats. Built only with -DKPL_STATS; otherwise
+// every STATS_ macro below expands to nothing. Phase times are inclusive:
+// lookup contains the findObject calls it makes, compile contains scan.
+// Hardware counters (--counters) are read only around the coarse phases
+// compile, emit and run: a system call per scan or lookup would cost more
+// than the work it measures. bench/micro counts those primitives instead.
+
+typedef enum {
+  PHASE_COMPILE,     // parsing, semantics and code generation
+  PHASE_SCAN,        // getValidToken, reading included
+  PHASE_LOOKUP,      // lookupObject
+  PHASE_TYPE_CHECK,  // checkTypeEquality
+  PHASE_ADD_OBJECT,  // addObject
+  PHASE_FIND_OBJECT, // findObject
+  PHASE_EMIT,        // writing and building assembly or C
+  PHASE_RUN,         // interpreting or running tiered
+  PHASE_CACHE,       // hashing the source, reading and writing --cache records
+  PHASE_COUNT
+} Phase;
+
+typedef struct {
+  long long nanoseconds;
+  long long calls;
+} PhaseTimer;
+
+typedef struct {
+  PhaseTimer phases[PHASE_COUNT];
+  long long characters;
+  long long lines;
+  long long chunks;         // of sources lexed on several threads
+  long long chunksRelexed;  // those lexed again from where the one before ended
+  long long tokens[TOKEN_TYPE_COUNT];
+  long long lookups;
+  long long scopesWalked;  // scopes searched by all lookups
+  long long maxScopeDepth; // most scopes searched by one lookup
+  long long objectsCompared;
+  long long allocations;
+  long long allocatedBytes;
+  long long cacheHits;
+  long long cacheMisses;
+  long long cacheEvictions; // records removed to keep the cache in its limit
+  long long checkThreads;   // --check: the threads that checked blocks
+  long long checkBlocks;    // the blocks they were left
+  long long checkOnePass;   // 1 when the program was checked again in one pass
+  CounterSample counters[PHASE_COUNT];
+} Statistics;
+
+#ifdef KPL_STATS
+
+// Each thread counts its own: one checking bodies for --check adds them
+// to the main thread's when it ends
+extern __thread Statistics statistics;
+extern int countersEnabled;
+
+long long statsClock(void);
+void printStatistics(FILE *out);
+void addStatistics(Statistics *other);
+
+#define STATS_START(phase) long long statsStart_##phase = statsClock()
+#define STATS_STOP(phase)                                                        \
+  (statistics.phases[PHASE_##phase].nanoseconds += statsClock() - statsStart_##phase, \
+   statistics.phases[PHASE_##phase].calls++)
+#define STATS_COUNT(counter) (statistics.counter++)
+#define STATS_ADD(counter, n) (statistics.counter += (n))
+#define STATS_MAX(counter, n) \
+  (statistics.counter = ((n) > statistics.counter) ? (n) : statistics.counter)
+#define STATS_TOKEN(tokenType) (statistics.tokens[tokenType]++)
+#define STATS_ALLOCATION(size) (statistics.allocations++, statistics.allocatedBytes += (size))
+#define STATS_COUNTERS_START(phase)                 \
+  CounterSample countersStart_##phase = { { 0 } }; \
+  (countersEnabled ? readCounters(&countersStart_##phase) : (void)0)
+#define STATS_COUNTERS_STOP(phase)                                             \
+  (countersEnabled                                                             \
+   ? addCounterDelta(&statistics.counters[PHASE_##phase], &countersStart_##phase) \
+   : (void)0)
+
+#else
+
+#define STATS_START(phase)
+#define STATS_STOP(phase) ((void)0)
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_MAX(counter, n) ((void)0)
+#define STATS_TOKEN(tokenType) ((void)0)
+#define STATS_ALLOCATION(size) ((void)0)
+#define STATS_COUNTERS_START(phase)
+#define STATS_COUNTERS_STOP(phase) ((void)0)
+
+#endif
+
+#endif
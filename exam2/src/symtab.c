@@ -9,16 +9,26 @@
 #include <string.h>
 #include "symtab.h"
 #include "error.h"
+#include "alloc.h"
+#include "stats.h"
 
 void freeObject(Object *obj);
 void freeScope(Scope *scope);
 void freeObjectList(ObjectNode *objList);
 void freeReferenceList(ObjectNode *objList);
+void freeUnits(struct Unit_ *units);
 
-SymTab *symtab;
+// Per thread, as the parser's state is
+__thread SymTab *symtab;
 Type *intType;
 Type *charType;
 
+Object *readiFunction;
+Object *readcFunction;
+Object *writeiProcedure;
+Object *writecProcedure;
+Object *writelnProcedure;
+
 /******************* Type utilities ******************************/
 // Make type functions
 // Type have 3 part
@@ -30,7 +40,7 @@ Type *charType;
 // Make int type
 Type *makeIntType(void)
 {
-  Type *type = (Type *)malloc(sizeof(Type));
+  Type *type = ALLOCATE(Type, ALLOC_TYPE);
   type->typeClass = TP_INT;
   return type;
 }
@@ -38,7 +48,7 @@ Type *makeIntType(void)
 // Make char type
 Type *makeCharType(void)
 {
-  Type *type = (Type *)malloc(sizeof(Type));
+  Type *type = ALLOCATE(Type, ALLOC_TYPE);
   type->typeClass = TP_CHAR;
   return type;
 }
@@ -46,7 +56,7 @@ Type *makeCharType(void)
 // Make array type
 Type *makeArrayType(int arraySize, Type *elementType)
 {
-  Type *type = (Type *)malloc(sizeof(Type));
+  Type *type = ALLOCATE(Type, ALLOC_TYPE);
   type->typeClass = TP_ARRAY;
   type->arraySize = arraySize;
   type->elementType = elementType;
@@ -56,7 +66,7 @@ Type *makeArrayType(int arraySize, Type *elementType)
 // Output duplicate type with input type
 Type *duplicateType(Type *type)
 {
-  Type *resultType = (Type *)malloc(sizeof(Type));
+  Type *resultType = ALLOCATE(Type, ALLOC_TYPE);
   resultType->typeClass = type->typeClass;
   if (type->typeClass == TP_ARRAY)
   {
@@ -92,15 +102,29 @@ void freeType(Type *type)
   {
   case TP_INT:
   case TP_CHAR:
-    free(type);
+    RELEASE(type);
     break;
   case TP_ARRAY:
     freeType(type->elementType);
-    freeType(type);
+    RELEASE(type);
     break;
   }
 }
 
+// Size of a value of input type, in stack words
+int sizeOfType(Type *type)
+{
+  switch (type->typeClass)
+  {
+  case TP_INT:
+  case TP_CHAR:
+    return 1;
+  case TP_ARRAY:
+    return type->arraySize * sizeOfType(type->elementType);
+  }
+  return 0;
+}
+
 /******************* Constant utility ******************************/
 // Make constant value functions
 // constantValue have two part
@@ -108,9 +132,9 @@ void freeType(Type *type)
 // 2. value -> value of that type
 
 // Make constant int value
-ConstantValue *makeIntConstant(int i)
+ConstantValue *makeIntConstant(WORD i)
 {
-  ConstantValue *value = (ConstantValue *)malloc(sizeof(ConstantValue));
+  ConstantValue *value = ALLOCATE(ConstantValue, ALLOC_CONSTANT);
   value->type = TP_INT;
   value->intValue = i;
   return value;
@@ -119,7 +143,7 @@ ConstantValue *makeIntConstant(int i)
 // Make constant char value
 ConstantValue *makeCharConstant(char ch)
 {
-  ConstantValue *value = (ConstantValue *)malloc(sizeof(ConstantValue));
+  ConstantValue *value = ALLOCATE(ConstantValue, ALLOC_CONSTANT);
   value->type = TP_CHAR;
   value->charValue = ch;
   return value;
@@ -127,7 +151,7 @@ ConstantValue *makeCharConstant(char ch)
 
 ConstantValue *duplicateConstantValue(ConstantValue *v)
 {
-  ConstantValue *value = (ConstantValue *)malloc(sizeof(ConstantValue));
+  ConstantValue *value = ALLOCATE(ConstantValue, ALLOC_CONSTANT);
   value->type = v->type;
   if (v->type == TP_INT)
     value->intValue = v->intValue;
@@ -146,26 +170,28 @@ ConstantValue *duplicateConstantValue(ConstantValue *v)
 // Watch slide for detail
 
 // Create scope function
-// Scope have 3 part
+// Scope have 4 part
 // 1. objList -> list of children objects inside block
 // 2. owner -> object of this scope
 // 3. outer -> outside scope
+// 4. frameSize -> words needed by the block's stack frame
 Scope *createScope(Object *owner, Scope *outer)
 {
-  Scope *scope = (Scope *)malloc(sizeof(Scope));
+  Scope *scope = ALLOCATE(Scope, ALLOC_SCOPE);
   scope->objList = NULL;
   scope->owner = owner;
   scope->outer = outer;
+  scope->frameSize = RESERVED_WORDS;
   return scope;
 }
 
 // Make program object 
 Object *createProgramObject(char *programName)
 {
-  Object *program = (Object *)malloc(sizeof(Object));
+  Object *program = ALLOCATE(Object, ALLOC_OBJECT);
   strcpy(program->name, programName);
   program->kind = OBJ_PROGRAM;
-  program->progAttrs = (ProgramAttributes *)malloc(sizeof(ProgramAttributes));
+  program->progAttrs = ALLOCATE(ProgramAttributes, ALLOC_ATTRIBUTES);
   program->progAttrs->scope = createScope(program, NULL);
   symtab->program = program;
 
@@ -175,30 +201,30 @@ Object *createProgramObject(char *programName)
 // Make constant object
 Object *createConstantObject(char *name)
 {
-  Object *obj = (Object *)malloc(sizeof(Object));
+  Object *obj = ALLOCATE(Object, ALLOC_OBJECT);
   strcpy(obj->name, name);
   obj->kind = OBJ_CONSTANT;
-  obj->constAttrs = (ConstantAttributes *)malloc(sizeof(ConstantAttributes));
+  obj->constAttrs = ALLOCATE(ConstantAttributes, ALLOC_ATTRIBUTES);
   return obj;
 }
 
 // Make type object
 Object *createTypeObject(char *name)
 {
-  Object *obj = (Object *)malloc(sizeof(Object));
+  Object *obj = ALLOCATE(Object, ALLOC_OBJECT);
   strcpy(obj->name, name);
   obj->kind = OBJ_TYPE;
-  obj->typeAttrs = (TypeAttributes *)malloc(sizeof(TypeAttributes));
+  obj->typeAttrs = ALLOCATE(TypeAttributes, ALLOC_ATTRIBUTES);
   return obj;
 }
 
 // Make variable object
 Object *createVariableObject(char *name)
 {
-  Object *obj = (Object *)malloc(sizeof(Object));
+  Object *obj = ALLOCATE(Object, ALLOC_OBJECT);
   strcpy(obj->name, name);
   obj->kind = OBJ_VARIABLE;
-  obj->varAttrs = (VariableAttributes *)malloc(sizeof(VariableAttributes));
+  obj->varAttrs = ALLOCATE(VariableAttributes, ALLOC_ATTRIBUTES);
   obj->varAttrs->scope = symtab->currentScope;
   return obj;
 }
@@ -206,11 +232,14 @@ Object *createVariableObject(char *name)
 // Make function object
 Object *createFunctionObject(char *name)
 {
-  Object *obj = (Object *)malloc(sizeof(Object));
+  Object *obj = ALLOCATE(Object, ALLOC_OBJECT);
   strcpy(obj->name, name);
   obj->kind = OBJ_FUNCTION;
-  obj->funcAttrs = (FunctionAttributes *)malloc(sizeof(FunctionAttributes));
+  obj->funcAttrs = ALLOCATE(FunctionAttributes, ALLOC_ATTRIBUTES);
   obj->funcAttrs->paramList = NULL;
+  obj->funcAttrs->returnType = NULL;
+  obj->funcAttrs->paramCount = 0;
+  obj->funcAttrs->codeAddress = -1;
   obj->funcAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
@@ -218,11 +247,13 @@ Object *createFunctionObject(char *name)
 // Make procedure object
 Object *createProcedureObject(char *name)
 {
-  Object *obj = (Object *)malloc(sizeof(Object));
+  Object *obj = ALLOCATE(Object, ALLOC_OBJECT);
   strcpy(obj->name, name);
   obj->kind = OBJ_PROCEDURE;
-  obj->procAttrs = (ProcedureAttributes *)malloc(sizeof(ProcedureAttributes));
+  obj->procAttrs = ALLOCATE(ProcedureAttributes, ALLOC_ATTRIBUTES);
   obj->procAttrs->paramList = NULL;
+  obj->procAttrs->paramCount = 0;
+  obj->procAttrs->codeAddress = -1;
   obj->procAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
@@ -230,10 +261,10 @@ Object *createProcedureObject(char *name)
 // Make parameter object
 Object *createParameterObject(char *name, enum ParamKind kind, Object *owner)
 {
-  Object *obj = (Object *)malloc(sizeof(Object));
+  Object *obj = ALLOCATE(Object, ALLOC_OBJECT);
   strcpy(obj->name, name);
   obj->kind = OBJ_PARAMETER;
-  obj->paramAttrs = (ParameterAttributes *)malloc(sizeof(ParameterAttributes));
+  obj->paramAttrs = ALLOCATE(ParameterAttributes, ALLOC_ATTRIBUTES);
   obj->paramAttrs->kind = kind;
   obj->paramAttrs->function = owner;
   return obj;
@@ -245,43 +276,45 @@ void freeObject(Object *obj)
   switch (obj->kind)
   {
   case OBJ_CONSTANT:
-    free(obj->constAttrs->value);
-    free(obj->constAttrs);
+    RELEASE(obj->constAttrs->value);
+    RELEASE(obj->constAttrs);
     break;
   case OBJ_TYPE:
-    free(obj->typeAttrs->actualType);
-    free(obj->typeAttrs);
+    RELEASE(obj->typeAttrs->actualType);
+    RELEASE(obj->typeAttrs);
     break;
   case OBJ_VARIABLE:
-    free(obj->varAttrs->type);
-    free(obj->varAttrs);
+    RELEASE(obj->varAttrs->type);
+    RELEASE(obj->varAttrs);
     break;
   case OBJ_FUNCTION:
     freeReferenceList(obj->funcAttrs->paramList);
-    freeType(obj->funcAttrs->returnType);
+    // none when an error stopped the header before it
+    if (obj->funcAttrs->returnType != NULL)
+      freeType(obj->funcAttrs->returnType);
     freeScope(obj->funcAttrs->scope);
-    free(obj->funcAttrs);
+    RELEASE(obj->funcAttrs);
     break;
   case OBJ_PROCEDURE:
     freeReferenceList(obj->procAttrs->paramList);
     freeScope(obj->procAttrs->scope);
-    free(obj->procAttrs);
+    RELEASE(obj->procAttrs);
     break;
   case OBJ_PROGRAM:
     freeScope(obj->progAttrs->scope);
-    free(obj->progAttrs);
+    RELEASE(obj->progAttrs);
     break;
   case OBJ_PARAMETER:
     freeType(obj->paramAttrs->type);
-    free(obj->paramAttrs);
+    RELEASE(obj->paramAttrs);
   }
-  free(obj);
+  RELEASE(obj);
 }
 
 void freeScope(Scope *scope)
 {
   freeObjectList(scope->objList);
-  free(scope);
+  RELEASE(scope);
 }
 
 void freeObjectList(ObjectNode *objList)
@@ -293,7 +326,7 @@ void freeObjectList(ObjectNode *objList)
     ObjectNode *node = list;
     list = list->next;
     freeObject(node->object);
-    free(node);
+    RELEASE(node);
   }
 }
 
@@ -305,14 +338,15 @@ void freeReferenceList(ObjectNode *objList)
   {
     ObjectNode *node = list;
     list = list->next;
-    free(node);
+    RELEASE(node);
   }
 }
 
 // Add object to objList
 void addObject(ObjectNode **objList, Object *obj)
 {
-  ObjectNode *node = (ObjectNode *)malloc(sizeof(ObjectNode));
+  STATS_START(ADD_OBJECT);
+  ObjectNode *node = ALLOCATE(ObjectNode, ALLOC_OBJECT_NODE);
   node->object = obj;
   node->next = NULL;
   if ((*objList) == NULL)
@@ -324,66 +358,111 @@ void addObject(ObjectNode **objList, Object *obj)
       n = n->next;
     n->next = node;
   }
+  STATS_STOP(ADD_OBJECT);
 }
 
 // Find obj with name == name inside objList
 Object *findObject(ObjectNode *objList, char *name)
 {
-  while (objList != NULL)
+  return findObjectBefore(objList, NULL, name);
+}
+
+// The same among the nodes of objList before end
+Object *findObjectBefore(ObjectNode *objList, ObjectNode *end, char *name)
+{
+  STATS_START(FIND_OBJECT);
+  while (objList != end)
   {
+    STATS_COUNT(objectsCompared);
     if (strcmp(objList->object->name, name) == 0)
-      return objList->object;
+      break;
     else
       objList = objList->next;
   }
-  return NULL;
+  STATS_STOP(FIND_OBJECT);
+  return (objList != end) ? objList->object : NULL;
 }
 
 /******************* others ******************************/
-void initSymTab(void)
+
+// The predefined subroutines and basic types outlive a compilation, so a
+// compile server builds them once for all of its requests
+ObjectNode *builtinObjects = NULL;
+
+void initBuiltins(void)
 {
   Object *obj;
   Object *param;
 
-  symtab = (SymTab *)malloc(sizeof(SymTab));
+  symtab = ALLOCATE(SymTab, ALLOC_SYMTAB);
+  symtab->currentScope = NULL;
   symtab->globalObjectList = NULL;
 
   obj = createFunctionObject("READC");
   obj->funcAttrs->returnType = makeCharType();
   addObject(&(symtab->globalObjectList), obj);
+  readcFunction = obj;
 
   obj = createFunctionObject("READI");
   obj->funcAttrs->returnType = makeIntType();
   addObject(&(symtab->globalObjectList), obj);
+  readiFunction = obj;
 
   obj = createProcedureObject("WRITEI");
   param = createParameterObject("i", PARAM_VALUE, obj);
   param->paramAttrs->type = makeIntType();
   addObject(&(obj->procAttrs->paramList), param);
+  obj->procAttrs->paramCount = 1;
   addObject(&(symtab->globalObjectList), obj);
+  writeiProcedure = obj;
 
   obj = createProcedureObject("WRITEC");
   param = createParameterObject("ch", PARAM_VALUE, obj);
   param->paramAttrs->type = makeCharType();
   addObject(&(obj->procAttrs->paramList), param);
+  obj->procAttrs->paramCount = 1;
   addObject(&(symtab->globalObjectList), obj);
+  writecProcedure = obj;
 
   obj = createProcedureObject("WRITELN");
   addObject(&(symtab->globalObjectList), obj);
+  writelnProcedure = obj;
 
   intType = makeIntType();
   charType = makeCharType();
+
+  builtinObjects = symtab->globalObjectList;
+  RELEASE(symtab);
 }
 
-void cleanSymTab(void)
+void cleanBuiltins(void)
 {
-  freeObject(symtab->program);
-  freeObjectList(symtab->globalObjectList);
-  free(symtab);
+  freeObjectList(builtinObjects);
+  builtinObjects = NULL;
   freeType(intType);
   freeType(charType);
 }
 
+void initSymTab(void)
+{
+  if (builtinObjects == NULL)
+    initBuiltins();
+  symtab = ALLOCATE(SymTab, ALLOC_SYMTAB);
+  symtab->program = NULL;
+  symtab->currentScope = NULL;
+  symtab->globalObjectList = builtinObjects;
+  symtab->units = NULL;
+  symtab->partialScope = NULL;
+  symtab->partialEnd = NULL;
+}
+
+void cleanSymTab(void)
+{
+  freeUnits(symtab->units);
+  freeObject(symtab->program);
+  RELEASE(symtab);
+}
+
 // Enter block's scope
 void enterBlock(Scope *scope)
 {
@@ -397,6 +476,7 @@ void exitBlock(void)
 }
 
 // Declare object int symtab table
+// Variables and parameters also get their slot in the current frame
 void declareObject(Object *obj)
 {
   if (obj->kind == OBJ_PARAMETER)
@@ -406,13 +486,22 @@ void declareObject(Object *obj)
     {
     case OBJ_FUNCTION:
       addObject(&(owner->funcAttrs->paramList), obj);
+      owner->funcAttrs->paramCount++;
       break;
     case OBJ_PROCEDURE:
       addObject(&(owner->procAttrs->paramList), obj);
+      owner->procAttrs->paramCount++;
       break;
     default:
       break;
     }
+    obj->paramAttrs->localOffset = symtab->currentScope->frameSize;
+    symtab->currentScope->frameSize++;
+  }
+  else if (obj->kind == OBJ_VARIABLE)
+  {
+    obj->varAttrs->localOffset = symtab->currentScope->frameSize;
+    symtab->currentScope->frameSize += sizeOfType(obj->varAttrs->type);
   }
 
   addObject(&(symtab->currentScope->objList), obj);
@@ -8,6 +8,11 @@
 #define __SYMTAB_H__
 
 #include "token.h"
+#include "instructions.h"
+
+#define RESERVED_WORDS 4
+
+typedef int CodeAddress;
 
 enum TypeClass {
   TP_INT,
@@ -43,7 +48,7 @@ typedef struct Type_ BasicType;
 struct ConstantValue_ {
   enum TypeClass type;
   union {
-    int intValue;
+    WORD intValue;
     char charValue;
   };
 };
@@ -61,6 +66,7 @@ struct ConstantAttributes_ {
 struct VariableAttributes_ {
   Type *type;
   struct Scope_ *scope;
+  int localOffset;
 };
 
 struct TypeAttributes_ {
@@ -70,12 +76,16 @@ struct TypeAttributes_ {
 struct ProcedureAttributes_ {
   struct ObjectNode_ *paramList;
   struct Scope_* scope;
+  int paramCount;
+  CodeAddress codeAddress;
 };
 
 struct FunctionAttributes_ {
   struct ObjectNode_ *paramList;
   Type* returnType;
   struct Scope_ *scope;
+  int paramCount;
+  CodeAddress codeAddress;
 };
 
 struct ProgramAttributes_ {
@@ -86,6 +96,7 @@ struct ParameterAttributes_ {
   enum ParamKind kind;
   Type* type;
   struct Object_ *function;
+  int localOffset;
 };
 
 typedef struct ConstantAttributes_ ConstantAttributes;
@@ -123,6 +134,7 @@ struct Scope_ {
   ObjectNode *objList;
   Object *owner;
   struct Scope_ *outer;
+  int frameSize;
 };
 
 typedef struct Scope_ Scope;
@@ -131,6 +143,11 @@ struct SymTab_ {
   Object* program;
   Scope* currentScope;
   ObjectNode *globalObjectList;
+  struct Unit_ *units;  // those the program uses (see unit.h)
+  // A body checked apart (see check.h) sees the objects of partialScope
+  // before partialEnd only, those declared when the parser reached it
+  Scope *partialScope;
+  ObjectNode *partialEnd;
 };
 
 typedef struct SymTab_ SymTab;
@@ -141,8 +158,9 @@ Type* makeArrayType(int arraySize, Type* elementType);
 Type* duplicateType(Type* type);
 int compareType(Type* type1, Type* type2);
 void freeType(Type* type);
+int sizeOfType(Type* type);
 
-ConstantValue* makeIntConstant(int i);
+ConstantValue* makeIntConstant(WORD i);
 ConstantValue* makeCharConstant(char ch);
 ConstantValue* duplicateConstantValue(ConstantValue* v);
 
@@ -157,7 +175,10 @@ Object* createProcedureObject(char *name);
 Object* createParameterObject(char *name, enum ParamKind kind, Object* owner);
 
 Object* findObject(ObjectNode *objList, char *name);
+Object* findObjectBefore(ObjectNode *objList, ObjectNode *end, char *name);
 
+void initBuiltins(void);
+void cleanBuiltins(void);
 void initSymTab(void);
 void cleanSymTab(void);
 void enterBlock(Scope* scope);
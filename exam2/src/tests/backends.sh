@@ -0,0 +1,118 @@
+#!/bin/sh
+# The native and emitted C executables print what the interpreter does,
+# whatever the name they are built under, wrap around as it does, and stop
+# on its runtime errors with its message and status.
+# Usage: tests/backends.sh   (run from exam2/src after make kplc)
+
+WORK=${TMPDIR:-/tmp}/kplc-backends-test.$$
+FAILED=0
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+report() {
+  if [ "$3" = "ok" ]; then
+    printf "%-9s %-12s ok\n" "$1" "$2"
+  else
+    printf "%-9s %-12s FAILED: %s\n" "$1" "$2" "$3"
+    FAILED=1
+  fi
+}
+
+# a name a shell would run a command from
+EXE="$WORK/it's'; touch injected; echo 'x"
+cp tests/native.kpl "$WORK/it's.kpl"
+for backend in native emitted-c; do
+  [ $backend = native ] && flag= || flag=--emit-c
+  rm -f "$EXE" "$WORK/injected"
+  (cd "$WORK" && "$OLDPWD/kplc" "it's.kpl" $flag -o "$EXE" > /dev/null)
+  if [ -f "$WORK/injected" ]; then
+    report $backend quoted "the file name ran a command"
+  elif [ "$("$EXE" < /dev/null)" != "$(cat tests/expected/native.out)" ]; then
+    report $backend quoted "printed something else"
+  else
+    report $backend quoted ok
+  fi
+done
+
+# --emit-c alone builds a.out
+(cd "$WORK" && "$OLDPWD/kplc" "it's.kpl" --emit-c > /dev/null)
+if [ ! -x "$WORK/a.out" ]; then
+  report emitted-c a.out "no executable"
+elif [ "$("$WORK/a.out" < /dev/null)" != "$(cat tests/expected/native.out)" ]; then
+  report emitted-c a.out "printed something else"
+else
+  report emitted-c a.out ok
+fi
+
+# arithmetic that overflows, LLONG_MIN / -1 too, wraps the same everywhere
+size=$(wc -c < tests/wrap.kpl)
+for backend in interp jit native emitted-c; do
+  case $backend in
+    interp) ./kplc tests/wrap.kpl -run < /dev/null | tail -c +$((size + 1)) > "$WORK/wrap.out" ;;
+    jit) ./kplc tests/wrap.kpl -jit < /dev/null | tail -c +$((size + 1)) > "$WORK/wrap.out" ;;
+    *)
+      [ $backend = native ] && flag= || flag=--emit-c
+      ./kplc tests/wrap.kpl $flag -o "$WORK/wrap.exe" > /dev/null
+      "$WORK/wrap.exe" < /dev/null > "$WORK/wrap.out" ;;
+  esac
+  if cmp -s "$WORK/wrap.out" tests/expected/wrap.out; then
+    report $backend wrap ok
+  else
+    report $backend wrap "printed '$(cat "$WORK/wrap.out")'"
+  fi
+done
+
+# a runtime error: the interpreter's message on stderr and its failing status
+cat > "$WORK/divide.kpl" <<'END'
+PROGRAM DIVIDE;
+VAR X : INTEGER;
+BEGIN
+  X := 0;
+  CALL WRITEI(7); CALL WRITELN;
+  CALL WRITEI(7 / X)
+END.
+END
+cat > "$WORK/deep.kpl" <<'END'
+PROGRAM DEEP;
+PROCEDURE R(K : INTEGER);
+BEGIN
+  IF K / 10000 * 10000 = K THEN BEGIN CALL WRITEI(K); CALL WRITELN END;
+  CALL R(K + 1)
+END;
+BEGIN
+  CALL R(1)
+END.
+END
+cat > "$WORK/input.kpl" <<'END'
+PROGRAM INPUT;
+VAR X : INTEGER;
+BEGIN
+  X := READI;
+  CALL WRITEI(X)
+END.
+END
+for t in divide deep input; do
+  ./kplc "$WORK/$t.kpl" -run < /dev/null > /dev/null 2> "$WORK/run.err"
+  status=$?
+  if [ $status -eq 0 ] || ! grep -q 'Runtime error' "$WORK/run.err"; then
+    report interp $t "status $status, stderr '$(cat "$WORK/run.err")'"
+    continue
+  fi
+  report interp $t ok
+  for backend in native emitted-c; do
+    [ $backend = native ] && flag= || flag=--emit-c
+    ./kplc "$WORK/$t.kpl" $flag -o "$WORK/$t.exe" > /dev/null
+    "$WORK/$t.exe" < /dev/null > /dev/null 2> "$WORK/exe.err"
+    got=$?
+    if [ $got -ne $status ]; then
+      report $backend $t "status $got, expected $status"
+    elif ! cmp -s "$WORK/exe.err" "$WORK/run.err"; then
+      report $backend $t "stderr '$(cat "$WORK/exe.err")'"
+    else
+      report $backend $t ok
+    fi
+  done
+done
+
+exit $FAILED
@@ -0,0 +1,56 @@
+#!/bin/sh
+# kplc --cache prints what kplc prints, on a miss and on a hit, damaged
+# records are recompiled, and a full cache sheds records.
+# Usage: tests/cache.sh   (run from exam2/src after make kplc)
+
+WORK=${TMPDIR:-/tmp}/kplc-cache-test.$$
+CACHE=$WORK/cache
+FAILED=0
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+report() {
+  if [ "$2" = "ok" ]; then
+    printf "%-6s %-12s ok\n" cache "$1"
+  else
+    printf "%-6s %-12s FAILED: %s\n" cache "$1" "$2"
+    FAILED=1
+  fi
+}
+
+# the echoed source, the dump, and the program's output or the error
+for t in swap swapError1 fold sumError sum; do
+  ./kplc "tests/$t.kpl" -dump -run < /dev/null > "$WORK/expected"
+  ./kplc "tests/$t.kpl" -dump -run --cache "$CACHE" < /dev/null > "$WORK/miss"
+  ./kplc "tests/$t.kpl" -dump -run --cache "$CACHE" --stats < /dev/null > "$WORK/hit" 2> "$WORK/stats"
+  if ! cmp -s "$WORK/expected" "$WORK/miss"; then
+    report "$t" "differs on a miss"
+  elif ! cmp -s "$WORK/expected" "$WORK/hit"; then
+    report "$t" "differs on a hit"
+  elif [ "$t" != swapError1 ] && [ "$t" != sumError ] && ! grep -q '"hits": 1' "$WORK/stats"; then
+    report "$t" "was not a hit"
+  else
+    report "$t" ok
+  fi
+done
+
+# a truncated record is a miss, and is written again
+for record in "$CACHE"/*; do
+  head -c 40 "$record" > "$WORK/part" && mv "$WORK/part" "$record"
+done
+./kplc tests/swap.kpl -dump --cache "$CACHE" > "$WORK/damaged"
+./kplc tests/swap.kpl -dump > "$WORK/expected"
+if cmp -s "$WORK/expected" "$WORK/damaged"; then report damaged ok; else report damaged "differs"; fi
+
+# with no room at all, the records written go again when eviction runs
+i=0
+while [ $i -lt 100 ]; do
+  { cat tests/swap.kpl; echo "(* $i *)"; } > "$WORK/variant.kpl"
+  ./kplc "$WORK/variant.kpl" --cache "$WORK/small" --cache-limit 0 > /dev/null
+  i=$((i + 1))
+done
+left=$(ls "$WORK/small" | wc -l)
+if [ "$left" -lt 100 ]; then report eviction ok; else report eviction "kept all $left records"; fi
+
+exit $FAILED
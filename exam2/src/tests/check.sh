@@ -0,0 +1,102 @@
+#!/bin/sh
+# kplc --check reports the error kplc stops at, or none, with one thread
+# and with several: on the tests, on generated programs with an error put
+# in a body, a header or the main program, on a body that ends before the
+# END counting found, and on names declared after a body that uses them.
+# Usage: tests/check.sh   (run from exam2/src after make kplc bench/kplgen)
+
+WORK=${TMPDIR:-/tmp}/kplc-check-test.$$
+FAILED=0
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+report() {
+  if [ "$2" = "ok" ]; then
+    printf "%-6s %-18s ok\n" check "$1"
+  else
+    printf "%-6s %-18s FAILED: %s\n" check "$1" "$2"
+    FAILED=1
+  fi
+}
+
+# the error kplc stops at, after the echoed source; none without one
+expected() {
+  ./kplc "$1" < /dev/null | tail -n 1 | grep -o '[0-9]*-[0-9]*:.*$' || echo none
+}
+
+compare() {
+  want=$(expected "$2")
+  for threads in 1 4; do
+    got=$(./kplc "$2" --check -j $threads < /dev/null | tail -n 1)
+    if [ "${got:-none}" != "$want" ]; then
+      report "$1" "-j $threads: expected $want, got ${got:-none}"
+      return
+    fi
+  done
+  report "$1" ok
+}
+
+for source in tests/*.kpl; do
+  name=${source#tests/}
+  compare "${name%.kpl}" "$source"
+done
+
+# many subroutines at the top, each with two nested ones
+bench/kplgen -lines 3000 -depth 1 > "$WORK/gen.kpl"
+compare generated "$WORK/gen.kpl"
+./kplc "$WORK/gen.kpl" --check -j 4 --stats 2> "$WORK/stats" > /dev/null
+if grep -q '"check": { "threads": 4, "blocks": 32, "onePass": 0 }' "$WORK/stats"; then
+  report "generated blocks" ok
+else
+  report "generated blocks" "$(grep '"check"' "$WORK/stats")"
+fi
+
+# an undeclared name in statements here and there, the main program's too
+for line in $(grep -n ':=' "$WORK/gen.kpl" | awk -F: 'NR % 211 == 0 { print $1 }'); do
+  sed "${line}s/:=/:= ZZ +/" "$WORK/gen.kpl" > "$WORK/undeclared.kpl"
+  compare "undeclared $line" "$WORK/undeclared.kpl"
+done
+sed '$s/^END\./  ZZ := 1\nEND./' "$WORK/gen.kpl" > "$WORK/main.kpl"
+compare "main program" "$WORK/main.kpl"
+
+# a compile stopped by the error still reports its statistics
+./kplc "$WORK/main.kpl" --stats < /dev/null 2> "$WORK/stats" > /dev/null
+if grep -q '"scan": { "ns": [0-9]*, "calls": [1-9]' "$WORK/stats"; then
+  report "stats on error" ok
+else
+  report "stats on error" "no statistics"
+fi
+
+# a header, after bodies with errors of their own
+sed -e '/^PROCEDURE P24(/s/VAR R : INTEGER/VAR R : INTEGR/' -e '/^FUNCTION F5(/,$s/L0 := X + 0/L0 := Y/' \
+  "$WORK/gen.kpl" > "$WORK/header.kpl"
+compare header "$WORK/header.kpl"
+sed '/^PROCEDURE P24(/s/VAR R : INTEGER/VAR R : INTEGR/' "$WORK/gen.kpl" > "$WORK/header.kpl"
+compare "header alone" "$WORK/header.kpl"
+
+# an END too many ends a body early: checked again in one pass
+awk '/^PROCEDURE P12\(/ { top = 1 } top && /^  L0 := X \+ 0;/ { print; print "END;"; top = 0; next } { print }' \
+  "$WORK/gen.kpl" > "$WORK/moved.kpl"
+compare "moved end" "$WORK/moved.kpl"
+
+# a body sees only what was declared before it
+cat > "$WORK/later.kpl" <<'EOF'
+PROGRAM LATER;
+PROCEDURE A;
+BEGIN
+  CALL WRITELN
+END;
+FUNCTION WRITELN : INTEGER;
+BEGIN
+  WRITELN := 1
+END;
+BEGIN
+  CALL A
+END.
+EOF
+compare "later shadow" "$WORK/later.kpl"
+sed 's/CALL WRITELN/CALL B/; s/FUNCTION WRITELN : INTEGER/PROCEDURE B/; s/WRITELN := 1//' "$WORK/later.kpl" > "$WORK/later2.kpl"
+compare "later callee" "$WORK/later2.kpl"
+
+exit $FAILED
@@ -0,0 +1,95 @@
+#!/bin/sh
+# kplc --lsp answers a session of an editor on tests/nested.kpl: names
+# resolve through nested scopes, and edits bring diagnostics and take
+# them away again, those in a row published once.
+# Usage: tests/lsp.sh   (run from exam2/src after make kplc)
+
+WORK=${TMPDIR:-/tmp}/kplc-lsp-test.$$
+URI=file:///nested.kpl
+FAILED=0
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+send() {
+  printf 'Content-Length: %d\r\n\r\n%s' "$(printf '%s' "$1" | wc -c)" "$1"
+}
+
+# a request about the place line-character of the document
+at() {
+  send "{\"jsonrpc\":\"2.0\",\"id\":$1,\"method\":\"textDocument/$2\",\"params\":{\"textDocument\":{\"uri\":\"$URI\"},\"position\":{\"line\":$3,\"character\":$4}}}"
+}
+
+# replaces line-from..to of the document by text
+change() {
+  send "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"$URI\"},\"contentChanges\":[{\"range\":{\"start\":{\"line\":$1,\"character\":$2},\"end\":{\"line\":$1,\"character\":$3}},\"text\":\"$4\"}]}}"
+}
+
+TEXT=$(awk 'BEGIN { ORS = "" } { gsub(/\\/, "\\\\"); gsub(/"/, "\\\""); print $0 "\\n" }' tests/nested.kpl)
+
+{
+  send '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{}}'
+  send '{"jsonrpc":"2.0","method":"initialized","params":{}}'
+  send "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"$URI\",\"languageId\":\"kpl\",\"version\":1,\"text\":\"$TEXT\"}}}"
+  at 2 definition 29 39
+  at 3 definition 54 2
+  at 4 definition 32 8
+  at 5 definition 32 19
+  at 6 definition 45 46
+  at 7 hover 17 12
+  at 8 hover 29 18
+  send "{\"jsonrpc\":\"2.0\",\"id\":9,\"method\":\"textDocument/documentSymbol\",\"params\":{\"textDocument\":{\"uri\":\"$URI\"}}}"
+  change 10 12 13 Q
+  at 13 hover 10 12
+  change 10 12 13 K
+  # a global declared in a new line moves every subroutine after it
+  change 7 0 0 '    Z : INTEGER;\n'
+  at 12 definition 30 39
+  send "{\"jsonrpc\":\"2.0\",\"id\":14,\"method\":\"textDocument/documentSymbol\",\"params\":{\"textDocument\":{\"uri\":\"$URI\"}}}"
+  send '{"jsonrpc":"2.0","id":10,"method":"textDocument/rename","params":{}}'
+  send '{"jsonrpc":"2.0","id":11,"method":"shutdown"}'
+  send '{"jsonrpc":"2.0","method":"exit"}'
+} > "$WORK/session"
+
+./kplc --lsp < "$WORK/session" > "$WORK/replies"
+status=$?
+sed 's/Content-Length: [0-9]*/\n/g' "$WORK/replies" > "$WORK/messages"
+grep -F publishDiagnostics "$WORK/messages" | tail -n 1 > "$WORK/last"
+# opened, the edit, and the two after it checked together
+grep -c -F publishDiagnostics "$WORK/messages" | sed 's/^/published /' > "$WORK/count"
+grep -F '"id":14,' "$WORK/messages" > "$WORK/symbols"
+
+# expect name text [file]: the replies, or file, have text
+expect() {
+  if grep -F -q "$2" "$WORK/${3:-messages}"; then
+    printf "%-6s %-12s ok\n" lsp "$1"
+  else
+    printf "%-6s %-12s FAILED: no '%s'\n" lsp "$1" "$2"
+    FAILED=1
+  fi
+}
+
+R='"range":{"start":{"line":'
+expect initialize '"id":1,"result":{"capabilities":'
+expect opened '"diagnostics":[]}}'
+expect local '"id":2,"result":{"uri":"file:///nested.kpl",'"$R"'24,"character":4}'
+expect global '"id":3,"result":{"uri":"file:///nested.kpl",'"$R"'6,"character":4}'
+expect outer '"id":4,"result":{"uri":"file:///nested.kpl",'"$R"'26,"character":6}'
+expect param '"id":5,"result":{"uri":"file:///nested.kpl",'"$R"'25,"character":17}'
+expect recursion '"id":6,"result":{"uri":"file:///nested.kpl",'"$R"'42,"character":9}'
+expect hover '"id":7,"result":{"contents":{"kind":"plaintext","value":"Function SQUARE : Int"}'
+expect hoverArray '"id":8,"result":{"contents":{"kind":"plaintext","value":"Var A : Arr(5,Int)"}'
+expect symbols '"children":[{"name":"J","detail":"Param J : Int","kind":13'
+expect edit '"diagnostics":[{'"$R"'10,"character":12},"end":{"line":10,"character":13}},"severity":1,"source":"kplc","message":"Undeclared identifier."}]'
+expect clean '"diagnostics":[]}}' last
+expect moved '"id":12,"result":{"uri":"file:///nested.kpl",'"$R"'25,"character":4}'
+expect coalesced 'published 3' count
+expect symbolsMoved '"name":"SHOW","detail":"Procedure SHOW","kind":12,'"$R"'24,' symbols
+expect unknown '"id":10,"error":{"code":-32601'
+expect shutdown '"id":11,"result":null}'
+if [ $status -ne 0 ]; then
+  printf "%-6s %-12s FAILED: exit status %d\n" lsp exit $status
+  FAILED=1
+fi
+
+exit $FAILED
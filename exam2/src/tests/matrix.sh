@@ -0,0 +1,68 @@
+#!/bin/sh
+# Run every dialect's compiler over the tests written for it and compare the
+# program output (or the error message) with tests/expected/<test>.out.
+# Tests using features outside a dialect must be rejected by it. Tests
+# without a .kpl file here are written by tests/<test>.sh first.
+# Usage: tests/matrix.sh   (run from exam2/src after make dialects)
+
+BASE="swap swapError1 argsError jit nested wideassign wrap unitNames"
+SUM="fold native sum sumError sumErrorComma sumErrorTrailing sumErrorTerms sum10k"
+
+week2_accepts="$BASE"
+week2_rejects="precedence repeat fold sum"
+exam1_accepts="$BASE precedence repeat"
+exam1_rejects="fold native sum"
+exam2_accepts="$BASE precedence $SUM"
+exam2_rejects="repeat"
+
+WORK=${TMPDIR:-/tmp}/kplc-matrix.$$
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+
+sh tests/wideassign.sh > "$WORK/wideassign.kpl"
+
+# The compiler echoes its input; keep what follows it, or the error, which
+# a missing token's report puts at the end of the echoed line
+compile() {
+  source="tests/$2.kpl"
+  [ -f "$source" ] || source="$WORK/$2.kpl"
+  "./kplc-$1" "$source" -run < /dev/null > "$WORK/output"
+  size=$(wc -c < "$source")
+  if head -c "$size" "$WORK/output" | cmp -s - "$source"; then
+    tail -c +$((size + 1)) "$WORK/output"
+  else
+    grep -oE '[0-9]+-[0-9]+:.*$' "$WORK/output" | tail -n 1
+  fi > "$WORK/actual"
+}
+
+report() {
+  printf "%-6s %-12s %s\n" "$1" "$2" "$3"
+  [ "$3" = "ok" ] || failures=$((failures + 1))
+}
+
+for dialect in week2 exam1 exam2; do
+  eval accepts=\$${dialect}_accepts
+  eval rejects=\$${dialect}_rejects
+
+  for test in $accepts; do
+    compile $dialect $test
+    if cmp -s "$WORK/actual" "tests/expected/$test.out"; then
+      report $dialect $test ok
+    else
+      report $dialect $test FAILED
+    fi
+  done
+
+  for test in $rejects; do
+    compile $dialect $test
+    if grep -qE '^[0-9]+-[0-9]+:' "$WORK/actual"; then
+      report $dialect $test ok
+    else
+      report $dialect $test "FAILED (accepted)"
+    fi
+  done
+done
+
+[ $failures -eq 0 ] || { echo "$failures failed"; exit 1; }
@@ -0,0 +1,187 @@
+// Edits each source at random with pieces of declarations and statements,
+// undoing some of them, and every HISTORY edits kept all of them one by
+// one back to the good program. After most edits, the others checked
+// together with the next, it compares the first diagnostic of the
+// document with that of one checked afresh from its text and, when
+// neither has any, the declaration of every name.
+//
+//   recheck [-edits N] [-seed S] input.kpl...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "document.h"
+
+void cleanBuiltins(void);
+
+char *pieces[] = {
+  " ", "\n", "X", "N", "I", "1", "'A'", ";", ":= 1", "+", "(", ")", "(*", "*)",
+  "BEGIN", "END", "END;", "VAR X : INTEGER;", "VAR N : CHAR;", "CONST N = 2;",
+  "TYPE T = INTEGER;", "PROCEDURE P; BEGIN END;", "FUNCTION F : INTEGER; BEGIN F := 1 END;",
+  "CALL WRITELN", "X := N"
+};
+
+#define HISTORY 8
+
+// An edit, with what it deleted for undoing it
+typedef struct {
+  int offset;
+  int deleted;
+  char removed[8];
+  char *piece;
+} Edit;
+
+unsigned long long randomState = 88172645463325252ULL;
+
+int randomBelow(int n)
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 7;
+  randomState ^= randomState << 17;
+  return (int)(randomState % (unsigned long long)n);
+}
+
+void firstDiagnostic(Document *document, char message[MAX_ERROR_MESSAGE])
+{
+  if (getDiagnosticCount(document) == 0)
+    strcpy(message, "none");
+  else
+    getDiagnostic(document, 0, message);
+}
+
+// The first token whose declaration differs in the two; -1 when none
+int compareDeclarations(Document *document, Document *fresh)
+{
+  Object *obj;
+  int token;
+
+  for (token = 0; token < getTokenCount(fresh->tokens); token++)
+    if (findDeclaration(document, token, &obj) != findDeclaration(fresh, token, &obj))
+      return token;
+  return -1;
+}
+
+// 1 when the document has the diagnostic of the same text checked afresh
+int compareWithFresh(Document *document, char *expected, char *actual)
+{
+  int size = getTextSize(document->tokens);
+  char *text = (char *)malloc(size + 1);
+  Document *fresh;
+  int token;
+
+  copyText(document->tokens, 0, size, text);
+  fresh = openDocument(text, size);
+  firstDiagnostic(fresh, expected);
+  firstDiagnostic(document, actual);
+  if (strcmp(expected, "none") == 0 && strcmp(actual, "none") == 0 &&
+      (token = compareDeclarations(document, fresh)) >= 0)
+    sprintf(actual, "another declaration for token %d", token);
+  closeDocument(fresh);
+  free(text);
+  return strcmp(expected, actual) == 0;
+}
+
+char *readFile(char *fileName, int *size)
+{
+  FILE *f = fopen(fileName, "rb");
+  char *source;
+
+  if (f == NULL)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  source = (char *)malloc(*size + 1);
+  if (fread(source, 1, *size, f) != (size_t)*size)
+    *size = 0;
+  fclose(f);
+  return source;
+}
+
+int main(int argc, char *argv[])
+{
+  int pieceCount = sizeof(pieces) / sizeof(pieces[0]);
+  int edits = 300, failed = 0;
+  int i, edit, size, same, undo, historyCount, rewinding;
+  long long tokensChecked, tokenCount;
+  char expected[MAX_ERROR_MESSAGE], actual[MAX_ERROR_MESSAGE];
+  Edit history[HISTORY];
+  Edit *last;
+  Document *document;
+  char *source, *name;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i += 2)
+  {
+    if (i + 1 >= argc)
+      break;
+    if (strcmp(argv[i], "-edits") == 0)
+      edits = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-seed") == 0)
+      randomState = strtoull(argv[i + 1], NULL, 10) | 1;
+  }
+  if (i >= argc)
+  {
+    fprintf(stderr, "Usage: recheck [-edits N] [-seed S] input.kpl...\n");
+    return 2;
+  }
+
+  for (; i < argc; i++)
+  {
+    if ((source = readFile(argv[i], &size)) == NULL)
+    {
+      fprintf(stderr, "recheck: can't read %s\n", argv[i]);
+      return 2;
+    }
+    document = openDocument(source, size);
+    same = compareWithFresh(document, expected, actual);
+    tokensChecked = tokenCount = 0;
+    historyCount = rewinding = 0;
+    for (edit = 0; edit < edits && same; edit++)
+    {
+      rewinding = (historyCount == HISTORY) || (rewinding && historyCount > 0);
+      undo = rewinding || (historyCount > 0 && randomBelow(3) == 0);
+      if (undo)
+      {
+        last = &history[--historyCount];
+        editDocument(document, last->offset, strlen(last->piece), last->removed, last->deleted);
+      }
+      else
+      {
+        last = &history[historyCount++];
+        size = getTextSize(document->tokens);
+        last->offset = randomBelow(size + 1);
+        last->deleted = randomBelow(6);
+        if (last->offset + last->deleted > size)
+          last->deleted = size - last->offset;
+        copyText(document->tokens, last->offset, last->deleted, last->removed);
+        last->removed[last->deleted] = '\0';
+        // mostly typing, sometimes cutting without pasting
+        last->piece = (randomBelow(4) == 0) ? "" : pieces[randomBelow(pieceCount)];
+        editDocument(document, last->offset, last->deleted, last->piece, strlen(last->piece));
+      }
+      if (edit + 1 < edits && randomBelow(4) == 0)
+        continue;
+      checkDocument(document);
+      tokensChecked += document->tokensChecked;
+      tokenCount += getTokenCount(document->tokens);
+      same = compareWithFresh(document, expected, actual);
+    }
+    name = (strrchr(argv[i], '/') != NULL) ? strrchr(argv[i], '/') + 1 : argv[i];
+    if (same)
+      printf("%-7s %-12s ok, an edit read %lld%% of the tokens, %d of %d checked all\n",
+             "recheck", name, tokenCount > 0 ? tokensChecked * 100 / tokenCount : 0,
+             document->fullChecks, edit + 1);
+    else
+    {
+      printf("%-7s %-12s FAILED after %d edits, %s at %d (-%d +\"%s\"): expected %s, got %s\n",
+             "recheck", name, edit, undo ? "undoing the last" : "the last", last->offset,
+             undo ? (int)strlen(last->piece) : last->deleted, undo ? last->removed : last->piece,
+             expected, actual);
+      failed = 1;
+    }
+    closeDocument(document);
+    free(source);
+  }
+  cleanBuiltins();
+  return failed;
+}
@@ -0,0 +1,153 @@
+// Edits each source at random with the pieces that make and break tokens
+// and comments, and after every edit compares the token buffer with one
+// lexed afresh from its text, and that one with the text lexed in chunks
+// of a few lines on several threads.
+//
+//   relex [-edits N] [-seed S] input.kpl...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tokenbuf.h"
+
+char *pieces[] = {
+  " ", "\n", "X", "7", "(*", "*)", "(", "*", ")", "'", "'A'", ":=", ":", "=",
+  "<", ">", "!", "@", ".", "(.", ".)", "END", "BEGIN", "(* a\n comment *)", "\n\n  "
+};
+
+unsigned long long randomState = 88172645463325252ULL;
+
+int randomBelow(int n)
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 7;
+  randomState ^= randomState << 17;
+  return (int)(randomState % (unsigned long long)n);
+}
+
+int sameToken(LexedToken *a, LexedToken *b)
+{
+  return a->token.tokenType == b->token.tokenType && a->token.offset == b->token.offset &&
+         a->token.value == b->token.value && strcmp(a->token.string, b->token.string) == 0 &&
+         a->start == b->start;
+}
+
+// The index of the first token that differs, or -1
+int firstDifference(TokenBuffer *buffer, TokenBuffer *other)
+{
+  LexedToken a, b;
+  int i;
+
+  for (i = 0; i < getTokenCount(buffer) || i < getTokenCount(other); i++)
+  {
+    if (i >= getTokenCount(buffer) || i >= getTokenCount(other))
+      return i;
+    getLexedToken(buffer, i, &a);
+    getLexedToken(other, i, &b);
+    if (!sameToken(&a, &b))
+      return i;
+  }
+  return -1;
+}
+
+// The first token that differs, or -1; chunked set when it is the
+// chunked lexing that differs
+int compareWithFresh(TokenBuffer *buffer, int *chunked)
+{
+  int size = getTextSize(buffer);
+  char *text = (char *)malloc(size + 1);
+  TokenBuffer *fresh, *chunks;
+  int differs;
+
+  copyText(buffer, 0, size, text);
+  fresh = createTokenBuffer(text, size);
+  differs = firstDifference(buffer, fresh);
+  *chunked = 0;
+  if (differs < 0)
+  {
+    chunks = createChunkedTokenBuffer(text, size, 8, 24);
+    differs = firstDifference(chunks, fresh);
+    *chunked = (differs >= 0);
+    freeTokenBuffer(chunks);
+  }
+  freeTokenBuffer(fresh);
+  free(text);
+  return differs;
+}
+
+char *readFile(char *fileName, int *size)
+{
+  FILE *f = fopen(fileName, "rb");
+  char *source;
+
+  if (f == NULL)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  source = (char *)malloc(*size + 1);
+  if (fread(source, 1, *size, f) != (size_t)*size)
+    *size = 0;
+  fclose(f);
+  return source;
+}
+
+int main(int argc, char *argv[])
+{
+  int pieceCount = sizeof(pieces) / sizeof(pieces[0]);
+  int edits = 300, failed = 0;
+  int i, edit, size, offset, deleted, differs, chunked;
+  TokenBuffer *buffer;
+  TokenChange change;
+  char *source, *piece, *name;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i += 2)
+  {
+    if (i + 1 >= argc)
+      break;
+    if (strcmp(argv[i], "-edits") == 0)
+      edits = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-seed") == 0)
+      randomState = strtoull(argv[i + 1], NULL, 10) | 1;
+  }
+  if (i >= argc)
+  {
+    fprintf(stderr, "Usage: relex [-edits N] [-seed S] input.kpl...\n");
+    return 2;
+  }
+
+  for (; i < argc; i++)
+  {
+    if ((source = readFile(argv[i], &size)) == NULL)
+    {
+      fprintf(stderr, "relex: can't read %s\n", argv[i]);
+      return 2;
+    }
+    buffer = createTokenBuffer(source, size);
+    differs = -1;
+    for (edit = 0; edit < edits && differs < 0; edit++)
+    {
+      size = getTextSize(buffer);
+      offset = randomBelow(size + 1);
+      deleted = randomBelow(4);
+      if (offset + deleted > size)
+        deleted = size - offset;
+      // mostly typing, sometimes cutting without pasting
+      piece = (randomBelow(4) == 0) ? "" : pieces[randomBelow(pieceCount)];
+      editTokenBuffer(buffer, offset, deleted, piece, strlen(piece), &change);
+      differs = compareWithFresh(buffer, &chunked);
+    }
+    name = (strrchr(argv[i], '/') != NULL) ? strrchr(argv[i], '/') + 1 : argv[i];
+    if (differs < 0)
+      printf("%-6s %-12s ok\n", "relex", name);
+    else
+    {
+      printf("%-6s %-12s FAILED: token %d%s differs after edit %d at %d (-%d +\"%s\")\n", "relex",
+             name, differs, chunked ? " lexed in chunks" : "", edit, offset, deleted, piece);
+      failed = 1;
+    }
+    freeTokenBuffer(buffer);
+    free(source);
+  }
+  return failed;
+}
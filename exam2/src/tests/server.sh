@@ -0,0 +1,41 @@
+#!/bin/sh
+# The compile server gives the diagnostics of kplc and outlives errors.
+# Usage: tests/server.sh   (run from exam2/src after make kplc kplclient)
+
+WORK=${TMPDIR:-/tmp}/kplc-server-test.$$
+SOCKET=$WORK/kplc.sock
+FAILED=0
+
+mkdir -p "$WORK"
+trap './kplclient -shutdown "$SOCKET" 2> /dev/null; rm -rf "$WORK"' EXIT
+
+./kplc --server "$SOCKET" &
+tries=0
+until [ -S "$SOCKET" ] || [ $tries -ge 50 ]; do
+  sleep 0.1
+  tries=$((tries + 1))
+done
+
+# errors alternate with good programs, so each compile starts from a reset state
+for t in swap swapError1 precedence sumError fold swapError1 sum; do
+  expected=$(./kplc "tests/$t.kpl" | grep -E '^[0-9]+-[0-9]+:')
+  actual=$(./kplclient "$SOCKET" "tests/$t.kpl")
+  if [ "$expected" = "$actual" ]; then
+    printf "%-6s %-12s ok\n" server "$t"
+  else
+    printf "%-6s %-12s FAILED: expected '%s', got '%s'\n" server "$t" "$expected" "$actual"
+    FAILED=1
+  fi
+done
+
+./kplclient -shutdown "$SOCKET" > /dev/null || FAILED=1
+
+# a path that is not a socket is left alone
+echo keep > "$WORK/kept.kpl"
+if ! ./kplc --server "$WORK/kept.kpl" 2> /dev/null && [ "$(cat "$WORK/kept.kpl")" = keep ]; then
+  printf "%-6s %-12s ok\n" server "not socket"
+else
+  printf "%-6s %-12s FAILED: the file was replaced\n" server "not socket"
+  FAILED=1
+fi
+exit $FAILED
@@ -0,0 +1,89 @@
+#!/bin/sh
+# Programs using units run as they would with the declarations inline, an
+# interface is written again only when it changes, missing and damaged
+# ones are errors, and --cache compiles a program again when a unit it
+# uses changed.
+# Usage: tests/unit.sh   (run from exam2/src after make kplc)
+
+WORK=${TMPDIR:-/tmp}/kplc-unit-test.$$
+UNITS=$WORK/units
+FAILED=0
+
+mkdir -p "$UNITS"
+trap 'rm -rf "$WORK"' EXIT
+
+report() {
+  if [ "$2" = "ok" ]; then
+    printf "%-6s %-12s ok\n" unit "$1"
+  else
+    printf "%-6s %-12s FAILED: %s\n" unit "$1" "$2"
+    FAILED=1
+  fi
+}
+
+# the last two lines kplc prints, the output of show.kpl
+last() {
+  ./kplc "$@" < /dev/null | tail -n 2
+}
+
+cp tests/units/maths.kpl tests/units/text.kpl "$WORK"
+for u in maths text; do
+  if ./kplc "$WORK/$u.kpl" --units "$UNITS" > /dev/null; then report "$u" ok; else report "$u" "didn't compile"; fi
+done
+
+# what show.kpl prints with the units' declarations inline
+expected="11,14,19,26,35
+105,5,25"
+for mode in -run -jit; do
+  actual=$(last tests/units/show.kpl --units "$UNITS" $mode)
+  if [ "$actual" = "$expected" ]; then report "show $mode" ok; else report "show $mode" "printed $actual"; fi
+done
+
+# compiling a unit again keeps its file when nothing changed
+cp -p "$UNITS/MATHS.kpi" "$WORK/before"
+sleep 1
+./kplc "$WORK/maths.kpl" --units "$UNITS" > /dev/null
+if [ "$UNITS/MATHS.kpi" -nt "$WORK/before" ]; then report unchanged "the interface was written again"; else report unchanged ok; fi
+
+# --cache: a hit, then a miss once MATHS has changed
+./kplc tests/units/show.kpl --units "$UNITS" --cache "$WORK/cache" > /dev/null
+actual=$(./kplc tests/units/show.kpl --units "$UNITS" --cache "$WORK/cache" -run --stats 2> "$WORK/stats" < /dev/null | tail -n 1)
+if [ "$actual" = "105,5,25" ] && grep -q '"hits": 1' "$WORK/stats"; then report "cache hit" ok; else report "cache hit" "printed $actual"; fi
+sed 's/SQUARE := K \* K/SQUARE := K * K + 1/' tests/units/maths.kpl > "$WORK/maths.kpl"
+./kplc "$WORK/maths.kpl" --units "$UNITS" > /dev/null
+actual=$(./kplc tests/units/show.kpl --units "$UNITS" --cache "$WORK/cache" -run < /dev/null | tail -n 1)
+if [ "$actual" = "105,5,26" ]; then report "cache miss" ok; else report "cache miss" "printed $actual"; fi
+
+# a unit not there, and one whose interface was cut short
+mkdir -p "$WORK/damaged"
+head -c 100 "$UNITS/TEXT.kpi" > "$WORK/damaged/TEXT.kpi"
+cp "$UNITS/MATHS.kpi" "$WORK/damaged"
+# and one whose entries, the offset at byte 60, are a byte off their alignment
+mkdir -p "$WORK/misaligned"
+cp "$UNITS/MATHS.kpi" "$UNITS/TEXT.kpi" "$WORK/misaligned"
+entries=$(od -An -tu4 -j60 -N4 "$UNITS/MATHS.kpi")
+printf "\\$(printf %03o $((entries + 1)))" | dd of="$WORK/misaligned/MATHS.kpi" bs=1 seek=60 conv=notrunc 2> /dev/null
+# and ones whose first LA or LV reaches past every frame, or up more
+# static links than the subroutines nest
+code=$(od -An -tu4 -j92 -N4 "$UNITS/MATHS.kpi")
+count=$(od -An -tu4 -j88 -N4 "$UNITS/MATHS.kpi")
+i=0
+while [ $i -lt $count ]; do
+  op=$(od -An -tu4 -j$((code + 24 * i)) -N4 "$UNITS/MATHS.kpi")
+  [ $op -le 1 ] && break
+  i=$((i + 1))
+done
+for field in "farframe 16" "farlink 8"; do
+  set -- $field
+  mkdir -p "$WORK/$1"
+  cp "$UNITS/MATHS.kpi" "$UNITS/TEXT.kpi" "$WORK/$1"
+  printf '\377\377\377\177' | dd of="$WORK/$1/MATHS.kpi" bs=1 seek=$((code + 24 * i + $2)) conv=notrunc 2> /dev/null
+done
+for case in "missing $WORK/none 2-6" "damaged $WORK/damaged 2-13" "misaligned $WORK/misaligned 2-6" \
+            "farframe $WORK/farframe 2-6" "farlink $WORK/farlink 2-6"; do
+  set -- $case
+  actual=$(./kplc tests/units/show.kpl --units "$2" < /dev/null | tail -n 1)
+  if [ "$actual" = "$3:No interface of the unit, or a damaged one." ]; then report "$1" ok; else report "$1" "printed $actual"; fi
+done
+
+exit $FAILED
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Print a KPL program made of parallel assignments WIDTH targets wide
+# (100000 by default): one fills an array, the next rotates it by one.
+# Usage: tests/wideassign.sh [WIDTH] > wideassign.kpl
+
+WIDTH=${1:-100000}
+
+awk -v n="$WIDTH" 'BEGIN {
+  printf "PROGRAM WideAssign;\n"
+  printf "(* %d-wide parallel assignments *)\n", n
+  printf "CONST N = %d;\n", n
+  printf "VAR A : ARRAY(. %d .) OF INTEGER;\n", n
+  printf "    I : INTEGER;\n    S : INTEGER;\n    T : INTEGER;\n    V : INTEGER;\n\nBEGIN\n"
+
+  for (i = 1; i <= n; i++) printf "%sA(.%d.)", (i > 1 ? (i % 10 == 1 ? ",\n" : ", ") : "  "), i
+  printf "\n  :=\n"
+  for (i = 1; i <= n; i++) printf "%s%d", (i > 1 ? (i % 10 == 1 ? ",\n" : ", ") : "  "), (i * 7) % 1000
+  printf ";\n\n  S := 0;\n"
+  printf "  FOR I := 1 TO N DO S := S + A(.I.);\n"
+  printf "  CALL WRITEI(S); CALL WRITELN;\n\n"
+
+  for (i = 1; i <= n; i++) printf "%sA(.%d.)", (i > 1 ? (i % 10 == 1 ? ",\n" : ", ") : "  "), i
+  printf "\n  :=\n"
+  for (i = 1; i <= n; i++) printf "%sA(.%d.)", (i > 1 ? (i % 10 == 1 ? ",\n" : ", ") : "  "), (i % n) + 1
+  printf ";\n\n  T := 0;\n"
+  printf "  FOR I := 1 TO N - 1 DO\n  BEGIN\n"
+  printf "    V := I * 7 + 7;\n    V := V - V / 1000 * 1000;\n"
+  printf "    IF A(.I.) = V THEN T := T + 1\n  END;\n"
+  printf "  CALL WRITEI(T); CALL WRITELN;\n"
+  printf "  CALL WRITEI(A(.N.)); CALL WRITELN\n"
+  printf "END.\n"
+}'
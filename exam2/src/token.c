@@ -7,17 +7,25 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include "token.h"
+#include "alloc.h"
 
 struct {
   char string[MAX_IDENT_LEN + 1];
   TokenType tokenType;
 } keywords[KEYWORDS_COUNT] = {
   {"PROGRAM", KW_PROGRAM},
+#if HAS_UNITS
+  {"UNIT", KW_UNIT},
+  {"USES", KW_USES},
+#endif
   {"CONST", KW_CONST},
   {"TYPE", KW_TYPE},
   {"VAR", KW_VAR},
   {"INTEGER", KW_INTEGER},
   {"CHAR", KW_CHAR},
+#if HAS_BYTES
+  {"BYTES", KW_BYTES},
+#endif
   {"ARRAY", KW_ARRAY},
   {"OF", KW_OF},
   {"FUNCTION", KW_FUNCTION},
@@ -32,7 +40,13 @@ struct {
   {"DO", KW_DO},
   {"FOR", KW_FOR},
   {"TO", KW_TO},
-  {"SUM", KW_SUM}
+#if HAS_REPEAT
+  {"REPEAT", KW_REPEAT},
+  {"UNTIL", KW_UNTIL},
+#endif
+#if HAS_SUM
+  {"SUM", KW_SUM},
+#endif
 };
 
 int keywordEq(char *kw, char *string) {
@@ -51,11 +65,10 @@ TokenType checkKeyword(char *string) {
   return TK_NONE;
 }
 
-Token* makeToken(TokenType tokenType, int lineNo, int colNo) {
-  Token *token = (Token*)malloc(sizeof(Token));
+Token* makeToken(TokenType tokenType, int offset) {
+  Token *token = ALLOCATE(Token, ALLOC_TOKEN);
   token->tokenType = tokenType;
-  token->lineNo = lineNo;
-  token->colNo = colNo;
+  token->offset = offset;
   return token;
 }
 
@@ -68,11 +81,18 @@ char *tokenToString(TokenType tokenType) {
   case TK_EOF: return "end of file";
 
   case KW_PROGRAM: return "keyword PROGRAM";
+#if HAS_UNITS
+  case KW_UNIT: return "keyword UNIT";
+  case KW_USES: return "keyword USES";
+#endif
   case KW_CONST: return "keyword CONST";
   case KW_TYPE: return "keyword TYPE";
   case KW_VAR: return "keyword VAR";
   case KW_INTEGER: return "keyword INTEGER";
   case KW_CHAR: return "keyword CHAR";
+#if HAS_BYTES
+  case KW_BYTES: return "keyword BYTES";
+#endif
   case KW_ARRAY: return "keyword ARRAY";
   case KW_OF: return "keyword OF";
   case KW_FUNCTION: return "keyword FUNCTION";
@@ -87,7 +107,13 @@ char *tokenToString(TokenType tokenType) {
   case KW_DO: return "keyword DO";
   case KW_FOR: return "keyword FOR";
   case KW_TO: return "keyword TO";
+#if HAS_REPEAT
+  case KW_REPEAT: return "keyword REPEAT";
+  case KW_UNTIL: return "keyword UNTIL";
+#endif
+#if HAS_SUM
   case KW_SUM: return "keyword SUM";
+#endif
 
   case SB_SEMICOLON: return "\';\'";
   case SB_COLON: return "\':\'";
@@ -104,6 +130,9 @@ char *tokenToString(TokenType tokenType) {
   case SB_MINUS: return "\'-\'";
   case SB_TIMES: return "\'*\'";
   case SB_SLASH: return "\'/\'";
+#if HAS_POWER
+  case SB_POWER: return "\'**\'";
+#endif
   case SB_LPAR: return "\'(\'";
   case SB_RPAR: return "\')\'";
   case SB_LSEL: return "\'(.\'";
@@ -7,34 +7,56 @@
 #ifndef __TOKEN_H__
 #define __TOKEN_H__
 
+#include "dialect.h"
+
 #define MAX_IDENT_LEN 15
-#define KEYWORDS_COUNT 21
+#define KEYWORDS_COUNT (20 + 2 * HAS_UNITS + HAS_BYTES + 2 * HAS_REPEAT + HAS_SUM)
 
 typedef enum {
   TK_NONE, TK_IDENT, TK_NUMBER, TK_CHAR, TK_EOF,
 
-  KW_PROGRAM, KW_CONST, KW_TYPE, KW_VAR,
+  KW_PROGRAM,
+#if HAS_UNITS
+  KW_UNIT, KW_USES,
+#endif
+  KW_CONST, KW_TYPE, KW_VAR,
   KW_INTEGER, KW_CHAR, KW_ARRAY, KW_OF,
+#if HAS_BYTES
+  KW_BYTES,
+#endif
   KW_FUNCTION, KW_PROCEDURE,
   KW_BEGIN, KW_END, KW_CALL,
   KW_IF, KW_THEN, KW_ELSE,
-  KW_WHILE, KW_DO, KW_FOR, KW_TO, KW_SUM,
+  KW_WHILE, KW_DO, KW_FOR, KW_TO,
+#if HAS_REPEAT
+  KW_REPEAT, KW_UNTIL,
+#endif
+#if HAS_SUM
+  KW_SUM,
+#endif
 
   SB_SEMICOLON, SB_COLON, SB_PERIOD, SB_COMMA,
   SB_ASSIGN, SB_EQ, SB_NEQ, SB_LT, SB_LE, SB_GT, SB_GE,
   SB_PLUS, SB_MINUS, SB_TIMES, SB_SLASH,
+#if HAS_POWER
+  SB_POWER,
+#endif
   SB_LPAR, SB_RPAR, SB_LSEL, SB_RSEL
 } TokenType;
 
+#define TOKEN_TYPE_COUNT (SB_RSEL + 1)
+
+// A token knows only its offset in the source: its line and column are
+// found in a LineIndex when a diagnostic needs them (see lines.h)
 typedef struct {
   char string[MAX_IDENT_LEN + 1];
-  int lineNo, colNo;
+  int offset;
   TokenType tokenType;
   int value;
 } Token;
 
 TokenType checkKeyword(char *string);
-Token* makeToken(TokenType tokenType, int lineNo, int colNo);
+Token* makeToken(TokenType tokenType, int offset);
 char *tokenToString(TokenType tokenType);
 
 
@@ -0,0 +1,623 @@
+#define _GNU_SOURCE  // fopencookie
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include "reader.h"
+#include "charcode.h"
+#include "scanner.h"
+#include "error.h"
+#include "alloc.h"
+#include "stats.h"
+#include "trace.h"
+#include "lines.h"
+#include "tokenbuf.h"
+
+#define TEXT_GAP 4096
+#define TOKEN_GAP 1024
+// Of the stream the scanner reads: past the end of a small edit it reads
+// only as far as it needs to find the old tokens again
+#define STREAM_BUFFER 512
+
+extern __thread int inputOffset;
+extern __thread int currentChar;
+
+extern CharCode charCodes[];
+
+typedef struct {
+  TokenBuffer *buffer;
+  long position;
+} TextReader;
+
+// The tokens of a chunk of a source lexed on a thread of its own
+typedef struct {
+  char *source;
+  int size;             // of the whole source
+  int begin, end;       // the chunk; tokens start before end
+  LexedToken *tokens;
+  int count, capacity;
+  int stop;             // where the token after the last starts
+  int index;            // 0 for the calling thread
+  pthread_t thread;
+#ifdef KPL_STATS
+  Statistics statistics;
+#endif
+} Chunk;
+
+/******************* text ******************************/
+
+int getTextSize(TokenBuffer *buffer)
+{
+  return buffer->textCapacity - (buffer->textGapEnd - buffer->textGapStart);
+}
+
+void copyText(TokenBuffer *buffer, int offset, int size, char *out)
+{
+  int before = 0;
+
+  if (offset < buffer->textGapStart)
+  {
+    before = buffer->textGapStart - offset;
+    if (before > size)
+      before = size;
+    memcpy(out, buffer->text + offset, before);
+  }
+  memcpy(out + before, buffer->text + (offset + before) + (buffer->textGapEnd - buffer->textGapStart),
+         size - before);
+}
+
+void moveTextGap(TokenBuffer *buffer, int offset)
+{
+  int gap = buffer->textGapEnd - buffer->textGapStart;
+
+  if (offset < buffer->textGapStart)
+    memmove(buffer->text + offset + gap, buffer->text + offset, buffer->textGapStart - offset);
+  else
+    memmove(buffer->text + buffer->textGapStart, buffer->text + buffer->textGapEnd,
+            offset - buffer->textGapStart);
+  buffer->textGapStart = offset;
+  buffer->textGapEnd = offset + gap;
+}
+
+void growTextGap(TokenBuffer *buffer, int size)
+{
+  int after = buffer->textCapacity - buffer->textGapEnd;
+  int capacity = buffer->textCapacity;
+
+  if (buffer->textGapEnd - buffer->textGapStart >= size)
+    return;
+  while (capacity - after - buffer->textGapStart < size)
+    capacity = 2 * capacity + TEXT_GAP;
+  buffer->text = REALLOCATE_ARRAY(buffer->text, char, capacity, ALLOC_EDIT_BUFFER);
+  memmove(buffer->text + capacity - after, buffer->text + buffer->textGapEnd, after);
+  buffer->textCapacity = capacity;
+  buffer->textGapEnd = capacity - after;
+}
+
+void replaceText(TokenBuffer *buffer, int offset, int deleted, char *inserted, int insertedSize)
+{
+  moveTextGap(buffer, offset);
+  buffer->textGapEnd += deleted;
+  growTextGap(buffer, insertedSize);
+  memcpy(buffer->text + buffer->textGapStart, inserted, insertedSize);
+  buffer->textGapStart += insertedSize;
+}
+
+// The scanner reads the text through stdio, across the gap
+ssize_t readText(void *cookie, char *out, size_t size)
+{
+  TextReader *reader = (TextReader *)cookie;
+  long left = getTextSize(reader->buffer) - reader->position;
+
+  if ((long)size > left)
+    size = left;
+  copyText(reader->buffer, reader->position, size, out);
+  reader->position += size;
+  return size;
+}
+
+// For ftell, which inputPosition uses
+int seekText(void *cookie, off64_t *offset, int whence)
+{
+  TextReader *reader = (TextReader *)cookie;
+
+  if (whence == SEEK_CUR)
+    *offset += reader->position;
+  else if (whence == SEEK_END)
+    *offset += getTextSize(reader->buffer);
+  reader->position = *offset;
+  return 0;
+}
+
+/******************* tokens ******************************/
+
+int getTokenCount(TokenBuffer *buffer)
+{
+  return buffer->tokenCapacity - (buffer->tokenGapEnd - buffer->tokenGapStart);
+}
+
+void toRelative(TokenBuffer *buffer, LexedToken *token)
+{
+  token->start -= getTextSize(buffer);
+  token->token.offset -= getTextSize(buffer);
+}
+
+void toAbsolute(TokenBuffer *buffer, LexedToken *token)
+{
+  token->start += getTextSize(buffer);
+  token->token.offset += getTextSize(buffer);
+}
+
+void getLexedToken(TokenBuffer *buffer, int index, LexedToken *token)
+{
+  if (index < buffer->tokenGapStart)
+    *token = buffer->tokens[index];
+  else
+  {
+    *token = buffer->tokens[index + buffer->tokenGapEnd - buffer->tokenGapStart];
+    toAbsolute(buffer, token);
+  }
+}
+
+int tokenStart(TokenBuffer *buffer, int index)
+{
+  if (index < buffer->tokenGapStart)
+    return buffer->tokens[index].start;
+  return buffer->tokens[index + buffer->tokenGapEnd - buffer->tokenGapStart].start +
+         getTextSize(buffer);
+}
+
+void moveTokenGap(TokenBuffer *buffer, int index)
+{
+  while (buffer->tokenGapStart > index)
+  {
+    buffer->tokens[--buffer->tokenGapEnd] = buffer->tokens[--buffer->tokenGapStart];
+    toRelative(buffer, &buffer->tokens[buffer->tokenGapEnd]);
+  }
+  while (buffer->tokenGapStart < index)
+  {
+    buffer->tokens[buffer->tokenGapStart] = buffer->tokens[buffer->tokenGapEnd++];
+    toAbsolute(buffer, &buffer->tokens[buffer->tokenGapStart++]);
+  }
+}
+
+void addToken(TokenBuffer *buffer, LexedToken *token)
+{
+  int after = buffer->tokenCapacity - buffer->tokenGapEnd;
+  int capacity;
+
+  if (buffer->tokenGapStart == buffer->tokenGapEnd)
+  {
+    capacity = 2 * buffer->tokenCapacity + TOKEN_GAP;
+    buffer->tokens = REALLOCATE_ARRAY(buffer->tokens, LexedToken, capacity, ALLOC_EDIT_BUFFER);
+    memmove(buffer->tokens + capacity - after, buffer->tokens + buffer->tokenGapEnd,
+            after * sizeof(LexedToken));
+    buffer->tokenCapacity = capacity;
+    buffer->tokenGapEnd = capacity - after;
+  }
+  buffer->tokens[buffer->tokenGapStart++] = *token;
+}
+
+// The first token that read the byte at offset: the one before the first
+// starting at or after it, as the scanner looked at offset to end it
+int firstTokenReading(TokenBuffer *buffer, int offset)
+{
+  int low = 0, high = getTokenCount(buffer);
+  int middle;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+    if (tokenStart(buffer, middle) < offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return (low > 0) ? low - 1 : 0;
+}
+
+LineIndex *getLineIndex(TokenBuffer *buffer)
+{
+  if (buffer->lines == NULL)
+  {
+    // the text in one piece
+    moveTextGap(buffer, getTextSize(buffer));
+    buffer->lines = indexLines(buffer->text, getTextSize(buffer));
+  }
+  return buffer->lines;
+}
+
+int findToken(TokenBuffer *buffer, int lineNo, int colNo)
+{
+  int offset = findOffset(buffer, lineNo, colNo);
+  int low = 0, high = getTokenCount(buffer);
+  int middle;
+  LexedToken token;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+    getLexedToken(buffer, middle, &token);
+    if (token.token.offset <= offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return (low > 0) ? low - 1 : 0;
+}
+
+int findOffset(TokenBuffer *buffer, int lineNo, int colNo)
+{
+  LineIndex *lines = getLineIndex(buffer);
+  int size = getTextSize(buffer);
+  int end;
+
+  if (lineNo < 1)
+    return 0;
+  if (lineNo > lines->count)
+    return size;
+  // the newline ending the line, or the end of the source
+  end = (lineNo < lines->count) ? lines->starts[lineNo] - 1 : size;
+  if (colNo < 1)
+    colNo = 1;
+  return (colNo - 1 < end - lines->starts[lineNo - 1]) ? lines->starts[lineNo - 1] + colNo - 1 : end;
+}
+
+/******************* lexing ******************************/
+
+int currentOffset(int size)
+{
+  return (currentChar == EOF) ? size : inputOffset;
+}
+
+void lexToken(LexedToken *entry)
+{
+  jmp_buf handler;
+  Token *token;
+
+  errorHandler = &handler;
+  if (setjmp(handler) == 0)
+  {
+    token = getToken();
+    // only what the scanner set: symbols have no spelling, only numbers a value
+    memset(&entry->token, 0, sizeof(Token));
+    entry->token.tokenType = token->tokenType;
+    entry->token.offset = token->offset;
+    if (token->tokenType != TK_EOF && token->tokenType < SB_SEMICOLON)
+      strcpy(entry->token.string, token->string);
+    if (token->tokenType == TK_NUMBER)
+      entry->token.value = token->value;
+    RELEASE(token);
+  }
+  else
+  {
+    // The scanner is past the token in error, unless at a character it
+    // doesn't know. The token it was making, if any, is lost.
+    memset(&entry->token, 0, sizeof(Token));
+    entry->token.tokenType = TK_NONE;
+    entry->token.value = lastError;
+    entry->token.offset = errorOffset;
+    if (currentChar != EOF && charCodes[currentChar] == CHAR_UNKNOWN)
+      readChar();
+  }
+  errorHandler = NULL;
+}
+
+// Lexes from the token from, or from the start of the source when NULL,
+// into the token gap. Old tokens behind the gap that start before where
+// the scanner is are dropped; one starting just there, behind editEnd,
+// ends it.
+void relex(TokenBuffer *buffer, LexedToken *from, int editEnd, TokenChange *change)
+{
+  cookie_io_functions_t functions = { readText, NULL, seekText, NULL };
+  TextReader reader = { buffer, (from != NULL) ? from->start : 0 };
+  char streamBuffer[STREAM_BUFFER];
+  jmp_buf *outerHandler = errorHandler;
+  int outerEcho = echoInput;
+  LineIndex *outerLines = sourceLines;
+  FILE *stream = fopencookie(&reader, "r", functions);
+  LexedToken entry, *old;
+  int position;
+
+  setvbuf(stream, streamBuffer, _IOFBF, sizeof(streamBuffer));
+  echoInput = 0;
+  // errors keep their offsets, not lines the index before the edit gives
+  sourceLines = NULL;
+  resumeInput(stream, reader.position);
+
+  change->first = buffer->tokenGapStart;
+  change->removed = change->inserted = 0;
+  for (;;)
+  {
+    position = currentOffset(getTextSize(buffer));
+    while (buffer->tokenGapEnd < buffer->tokenCapacity &&
+           buffer->tokens[buffer->tokenGapEnd].start + getTextSize(buffer) < position)
+    {
+      buffer->tokenGapEnd++;
+      change->removed++;
+    }
+    old = &buffer->tokens[buffer->tokenGapEnd];
+    if (buffer->tokenGapEnd < buffer->tokenCapacity && position >= editEnd &&
+        old->start + getTextSize(buffer) == position)
+      break;
+
+    entry.start = position;
+    lexToken(&entry);
+    addToken(buffer, &entry);
+    change->inserted++;
+    if (entry.token.tokenType == TK_EOF)
+    {
+      change->removed += buffer->tokenCapacity - buffer->tokenGapEnd;
+      buffer->tokenGapEnd = buffer->tokenCapacity;
+      break;
+    }
+  }
+
+  closeInputStream();
+  sourceLines = outerLines;
+  echoInput = outerEcho;
+  errorHandler = outerHandler;
+}
+
+// A buffer holding source, without tokens
+TokenBuffer *newTokenBuffer(char *source, int size)
+{
+  TokenBuffer *buffer = ALLOCATE(TokenBuffer, ALLOC_EDIT_BUFFER);
+
+  buffer->textCapacity = size + TEXT_GAP;
+  buffer->text = ALLOCATE_ARRAY(char, buffer->textCapacity, ALLOC_EDIT_BUFFER);
+  memcpy(buffer->text, source, size);
+  buffer->textGapStart = size;
+  buffer->textGapEnd = buffer->textCapacity;
+  buffer->lines = NULL;
+  return buffer;
+}
+
+TokenBuffer *createTokenBuffer(char *source, int size)
+{
+  TokenBuffer *buffer = newTokenBuffer(source, size);
+  TokenChange change;
+
+  buffer->tokenCapacity = TOKEN_GAP;
+  buffer->tokens = ALLOCATE_ARRAY(LexedToken, buffer->tokenCapacity, ALLOC_EDIT_BUFFER);
+  buffer->tokenGapStart = 0;
+  buffer->tokenGapEnd = buffer->tokenCapacity;
+
+  relex(buffer, NULL, 0, &change);
+  return buffer;
+}
+
+/******************* lexing in chunks ******************************/
+
+void addChunkToken(Chunk *chunk, LexedToken *token)
+{
+  if (chunk->count == chunk->capacity)
+  {
+    chunk->capacity = 2 * chunk->capacity + TOKEN_GAP;
+    chunk->tokens = REALLOCATE_ARRAY(chunk->tokens, LexedToken, chunk->capacity, ALLOC_EDIT_BUFFER);
+  }
+  chunk->tokens[chunk->count++] = *token;
+}
+
+// The first token of chunk starting at or after offset
+int firstChunkToken(Chunk *chunk, int offset)
+{
+  int low = 0, high = chunk->count;
+  int middle;
+
+  while (low < high)
+  {
+    middle = (low + high) / 2;
+    if (chunk->tokens[middle].start < offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+// Lexes the source from offset from into chunk until a token would start
+// at or after until. With resync, it stops as well where one of its
+// tokens starts, and returns its index; -1 otherwise.
+int lexChunk(Chunk *chunk, int from, int until, Chunk *resync)
+{
+  FILE *stream = fmemopen(chunk->source + from, chunk->size - from, "r");
+  jmp_buf *outerHandler = errorHandler;
+  int outerEcho = echoInput;
+  LineIndex *outerLines = sourceLines;
+  int next = (resync != NULL) ? firstChunkToken(resync, from) : 0;
+  int found = -1;
+  LexedToken entry;
+  int position;
+
+  echoInput = 0;
+  sourceLines = NULL;
+  resumeInput(stream, from);
+
+  for (;;)
+  {
+    position = currentOffset(chunk->size);
+    if (resync != NULL)
+    {
+      while (next < resync->count && resync->tokens[next].start < position)
+        next++;
+      if (next < resync->count && resync->tokens[next].start == position)
+      {
+        found = next;
+        break;
+      }
+    }
+    if (position >= until)
+      break;
+
+    entry.start = position;
+    lexToken(&entry);
+    addChunkToken(chunk, &entry);
+    if (entry.token.tokenType == TK_EOF)
+      break;
+  }
+  chunk->stop = position;
+
+  closeInputStream();
+  sourceLines = outerLines;
+  echoInput = outerEcho;
+  errorHandler = outerHandler;
+  return found;
+}
+
+void *lexChunkThread(void *argument)
+{
+  Chunk *chunk = (Chunk *)argument;
+
+#ifdef KPL_STATS
+  if (chunk->index > 0)
+    setTraceThread(chunk->index);
+#endif
+  lexChunk(chunk, chunk->begin, chunk->end, NULL);
+#ifdef KPL_STATS
+  if (chunk->index > 0)
+    chunk->statistics = statistics;
+#endif
+  return NULL;
+}
+
+// Appends the chunks to the first, each from where the tokens before it
+// end
+void joinChunks(Chunk *chunks, int chunkCount)
+{
+  Chunk *joined = &chunks[0], *chunk;
+  int i, k, first;
+
+  for (k = 1; k < chunkCount; k++)
+  {
+    chunk = &chunks[k];
+    if (joined->tokens[joined->count - 1].token.tokenType == TK_EOF)
+      break;
+    // a comment or an error ran over the whole chunk
+    if (joined->stop >= chunk->end)
+      continue;
+
+    first = firstChunkToken(chunk, joined->stop);
+    if (first == chunk->count || chunk->tokens[first].start != joined->stop)
+    {
+      STATS_COUNT(chunksRelexed);
+      first = lexChunk(joined, joined->stop, chunk->end, chunk);
+      if (first < 0)
+        continue;
+    }
+    for (i = first; i < chunk->count; i++)
+      addChunkToken(joined, &chunk->tokens[i]);
+    joined->stop = chunk->stop;
+  }
+}
+
+TokenBuffer *createChunkedTokenBuffer(char *source, int size, int threadCount, int chunkSize)
+{
+  Chunk chunks[LEX_MAX_CHUNKS];
+  int chunkCount = (chunkSize > 0) ? size / chunkSize : 1;
+  int line, previous, k, count;
+  LineIndex *lines;
+  TokenBuffer *buffer;
+
+  if (chunkCount > threadCount)
+    chunkCount = threadCount;
+  if (chunkCount > LEX_MAX_CHUNKS)
+    chunkCount = LEX_MAX_CHUNKS;
+  // the profiling and arena allocators are for one thread
+  if (chunkCount < 2 || allocator != &mallocAllocator)
+    return createTokenBuffer(source, size);
+
+  // each chunk but the first starts a line, the first past its share;
+  // the index is the buffer's then, for the diagnostics
+  lines = indexLines(source, size);
+  count = 0;
+  previous = 0;
+  for (k = 0; k < chunkCount; k++)
+  {
+    line = 0;
+    if (k > 0)
+    {
+      line = findLine(lines, (int)((long long)size * k / chunkCount)) + 1;
+      // the line after the one before, if the share ended on it
+      if (line <= previous)
+        line = previous + 1;
+      if (line >= lines->count || lines->starts[line] >= size)
+        break;
+      chunks[count - 1].end = lines->starts[line];
+    }
+    chunks[count].source = source;
+    chunks[count].size = size;
+    chunks[count].begin = lines->starts[line];
+    // the last one lexes TK_EOF, at size
+    chunks[count].end = size + 1;
+    chunks[count].tokens = NULL;
+    chunks[count].count = chunks[count].capacity = 0;
+    chunks[count].index = count;
+    count++;
+    previous = line;
+  }
+
+  for (k = 1; k < count; k++)
+    if (pthread_create(&chunks[k].thread, NULL, lexChunkThread, &chunks[k]) != 0)
+    {
+      // lexed on the calling thread, after the first
+      chunks[k].index = -1;
+    }
+  lexChunkThread(&chunks[0]);
+  for (k = 1; k < count; k++)
+    if (chunks[k].index < 0)
+      lexChunkThread(&chunks[k]);
+    else
+    {
+      pthread_join(chunks[k].thread, NULL);
+#ifdef KPL_STATS
+      addStatistics(&chunks[k].statistics);
+#endif
+    }
+  STATS_ADD(chunks, count);
+  joinChunks(chunks, count);
+
+  buffer = newTokenBuffer(source, size);
+  buffer->tokenCapacity = chunks[0].count + TOKEN_GAP;
+  buffer->tokens = REALLOCATE_ARRAY(chunks[0].tokens, LexedToken, buffer->tokenCapacity,
+                                    ALLOC_EDIT_BUFFER);
+  buffer->tokenGapStart = chunks[0].count;
+  buffer->tokenGapEnd = buffer->tokenCapacity;
+  buffer->lines = lines;
+  for (k = 1; k < count; k++)
+    RELEASE(chunks[k].tokens);
+  return buffer;
+}
+
+void freeTokenBuffer(TokenBuffer *buffer)
+{
+  if (buffer->lines != NULL)
+    freeLineIndex(buffer->lines);
+  RELEASE(buffer->text);
+  RELEASE(buffer->tokens);
+  RELEASE(buffer);
+}
+
+int editTokenBuffer(TokenBuffer *buffer, int offset, int deleted,
+                    char *inserted, int insertedSize, TokenChange *change)
+{
+  LexedToken from;
+  int first;
+
+  if (offset < 0 || deleted < 0 || insertedSize < 0 || offset + deleted > getTextSize(buffer))
+    return 0;
+
+  // taken before the text changes, which shifts the tokens behind the gap
+  first = firstTokenReading(buffer, offset);
+  getLexedToken(buffer, first, &from);
+  moveTokenGap(buffer, first);
+  replaceText(buffer, offset, deleted, inserted, insertedSize);
+  if (buffer->lines != NULL)
+  {
+    freeLineIndex(buffer->lines);
+    buffer->lines = NULL;
+  }
+  relex(buffer, &from, offset + insertedSize, change);
+  return 1;
+}
@@ -0,0 +1,85 @@
+#ifndef __TOKENBUF_H__
+#define __TOKENBUF_H__
+
+#include "token.h"
+#include "lines.h"
+
+#define LEX_CHUNK_SIZE (1 << 20)
+#define LEX_MAX_CHUNKS 64
+
+// The tokens of a source being edited, for editors. Every token owns the
+// blanks and comments in front of it, so the tokens cover the source from
+// its first byte to the end; the last is TK_EOF. A token read the bytes
+// from its start up to the start of the next one, which the scanner
+// looked at to end it. An edit is lexed again from the first token that
+// read a changed byte, until a new token starts where an old one did
+// behind the edit: from there on the old tokens are the same but for
+// their offset. A comment opened or closed by an edit is followed to its
+// end that way.
+//
+// Errors of the scanner become TK_NONE tokens at the place error() gave,
+// with its ErrorCode as value.
+//
+// The text and the tokens are each kept in a gap buffer at the last edit,
+// so edits close to each other move little. Offsets of the tokens behind
+// the gap are kept from the end of the source, so they need no change
+// when an edit before them adds bytes. Lines are found from a LineIndex
+// of the text, made when a diagnostic or a place asks for one and
+// dropped by the next edit.
+
+typedef struct {
+  Token token;
+  int start;      // offset of the blanks and comments before the token
+} LexedToken;
+
+typedef struct {
+  int first;     // the first token lexed again
+  int removed;   // old tokens it replaced from there
+  int inserted;  // new tokens in their place
+} TokenChange;
+
+typedef struct {
+  char *text;
+  int textCapacity;
+  int textGapStart, textGapEnd;
+  LexedToken *tokens;
+  int tokenCapacity;
+  int tokenGapStart, tokenGapEnd;
+  LineIndex *lines;  // of the text, NULL until asked for
+} TokenBuffer;
+
+TokenBuffer *createTokenBuffer(char *source, int size);
+void freeTokenBuffer(TokenBuffer *buffer);
+
+// Replaces deleted bytes at offset by insertedSize bytes of inserted;
+// 0 when the bytes to delete are not all in the source
+int editTokenBuffer(TokenBuffer *buffer, int offset, int deleted,
+                    char *inserted, int insertedSize, TokenChange *change);
+
+int getTokenCount(TokenBuffer *buffer);
+void getLexedToken(TokenBuffer *buffer, int index, LexedToken *token);
+int getTextSize(TokenBuffer *buffer);
+void copyText(TokenBuffer *buffer, int offset, int size, char *out);
+
+// As createTokenBuffer, for large sources: the source is cut after
+// newlines into chunks of at least chunkSize bytes, at most threadCount
+// of them, lexed at once on as many threads as if no comment were open at
+// their start, each from the line a LineIndex finds it at, which the
+// buffer keeps. The chunks are then joined in order, each from where the
+// tokens before it end: when that isn't where the chunk starts, as after
+// a comment over its first line, the text is lexed again from there until
+// a token starts where one of the chunk did. One thread with an allocator
+// other than malloc's.
+TokenBuffer *createChunkedTokenBuffer(char *source, int size, int threadCount, int chunkSize);
+
+// The line index of the text, made the first time it is asked for after
+// an edit; the text gap is moved to the end for it
+LineIndex *getLineIndex(TokenBuffer *buffer);
+// The last token starting at or before lineNo-colNo, the first if none
+int findToken(TokenBuffer *buffer, int lineNo, int colNo);
+// The offset of the character at lineNo-colNo, the first one being at
+// 1-1; the offset of the newline for a column past the end of its line,
+// and of the end for a place past the end of the source
+int findOffset(TokenBuffer *buffer, int lineNo, int colNo);
+
+#endif
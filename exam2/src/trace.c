@@ -0,0 +1,106 @@
+#ifdef KPL_STATS
+
+#include <stdio.h>
+#include "trace.h"
+#include "stats.h"
+
+#define TRACE_PID 1
+
+FILE *traceFile = NULL;
+long long traceStart;
+__thread long long lineStart;  // per thread, as the reader is
+
+// Threads of a batch or pipelined compilation number themselves from 0
+__thread int traceThread = 0;
+
+char *trackNames[TRACK_COUNT] = { "parser", "scanner" };
+
+int traceTid(TraceTrack track)
+{
+  return traceThread * TRACK_COUNT + track + 1;
+}
+
+// Microseconds since the trace was opened
+double traceTime(long long now)
+{
+  return (now - traceStart) / 1000.0;
+}
+
+void setTraceThread(int index)
+{
+  int track;
+
+  traceThread = index;
+  if (traceFile == NULL)
+    return;
+  lineStart = statsClock();
+  for (track = 0; track < TRACK_COUNT; track++)
+    fprintf(traceFile,
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s %d\"}},\n",
+            TRACE_PID, traceTid(track), trackNames[track], index);
+}
+
+int openTrace(char *fileName)
+{
+  traceFile = fopen(fileName, "w");
+  if (traceFile == NULL)
+    return 0;
+  traceStart = statsClock();
+  fprintf(traceFile, "[\n");
+  setTraceThread(0);
+  return 1;
+}
+
+// Every event ends in a comma, so the array is closed by a last metadata
+// event. Runs at exit, so a compilation stopped by error() closes it too,
+// with the spans it was in left open.
+void closeTrace(void)
+{
+  if (traceFile == NULL)
+    return;
+  fprintf(traceFile,
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"kplc\"}}\n]\n",
+          TRACE_PID);
+  fclose(traceFile);
+  traceFile = NULL;
+}
+
+void traceBegin(char *name, char *detail)
+{
+  double ts = traceTime(statsClock());
+
+  if (detail != NULL)
+    fprintf(traceFile,
+            "{\"name\":\"%s\",\"cat\":\"parser\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}},\n",
+            name, ts, TRACE_PID, traceTid(TRACK_PARSER), detail);
+  else
+    fprintf(traceFile,
+            "{\"name\":\"%s\",\"cat\":\"parser\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+            name, ts, TRACE_PID, traceTid(TRACK_PARSER));
+}
+
+void traceEnd(void)
+{
+  fprintf(traceFile, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+          traceTime(statsClock()), TRACE_PID, traceTid(TRACK_PARSER));
+}
+
+// The span of a line runs from the end of the previous one to its newline
+void traceLine(int lineNo, int isLast)
+{
+  long long now;
+
+  if (lineStart < 0)
+    return;
+  now = statsClock();
+  fprintf(traceFile,
+          "{\"name\":\"line\",\"cat\":\"scanner\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+          "\"pid\":%d,\"tid\":%d,\"args\":{\"line\":%d}},\n",
+          traceTime(lineStart), (now - lineStart) / 1000.0, TRACE_PID,
+          traceTid(TRACK_SCANNER), lineNo);
+  lineStart = isLast ? -1 : now;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+
+// Chrome trace events for --trace, part of the KPL_STATS instrumentation.
+// Each thread gets one track per kind of work: parser spans nest as
+// begin/end pairs, while the lines read by the scanner overlap them and
+// are written as complete events on a track of their own.
+
+typedef enum {
+  TRACK_PARSER,
+  TRACK_SCANNER,
+  TRACK_COUNT
+} TraceTrack;
+
+#ifdef KPL_STATS
+
+extern FILE *traceFile;
+
+int openTrace(char *fileName);
+void closeTrace(void);
+void setTraceThread(int index);
+
+void traceBegin(char *name, char *detail);
+void traceEnd(void);
+void traceLine(int lineNo, int isLast);
+
+#define TRACE_BEGIN(name, detail) ((traceFile != NULL) ? traceBegin(name, detail) : (void)0)
+#define TRACE_END() ((traceFile != NULL) ? traceEnd() : (void)0)
+#define TRACE_LINE(lineNo, isLast) ((traceFile != NULL) ? traceLine(lineNo, isLast) : (void)0)
+
+#else
+
+#define TRACE_BEGIN(name, detail) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_LINE(lineNo, isLast) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,762 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "codegen.h"
+#include "alloc.h"
+#include "unit.h"
+
+#define UNIT_MAGIC "KPLUNIT"
+#define UNIT_FORMAT 2
+
+extern __thread SymTab *symtab;
+
+void addObject(ObjectNode **objList, Object *obj);
+void freeObjectList(ObjectNode *objList);
+
+// An interface starts with its header. Offsets are from the start of the
+// file, and the key is the hash of all that follows the header.
+typedef struct {
+  char magic[8];
+  int format;
+  int instructionSize;  // sizeof(Instruction) of the kplc that wrote it
+  CacheKey key;
+  char name[MAX_IDENT_LEN + 1];
+  int frameSize;        // of the unit's scope, RESERVED_WORDS included
+  int codeStart;        // the unit's address of the first instruction
+  int entryCount;       // UnitEntry, sorted by name
+  int entries;
+  int typeCount;        // UnitType
+  int types;
+  int paramCount;       // UnitParam
+  int params;
+  int relocationCount;  // addresses of the LA and LV of the unit's frame
+  int relocations;
+  int codeSize;         // Instruction
+  int code;
+} UnitHeader;
+
+// An object declared at the top of the unit
+typedef struct {
+  char name[MAX_IDENT_LEN + 1];
+  int kind;
+  int type;        // of a constant's value or a variable, the type of a
+                   // type, the return type of a function; -1 for none
+  WORD value;      // of a constant, the offset of a variable, or the code
+                   // address of a subroutine
+  int firstParam;
+  int paramCount;
+} UnitEntry;
+
+// The element type of an array comes before it in the table
+typedef struct {
+  int typeClass;
+  int arraySize;
+  int elementType;
+} UnitType;
+
+typedef struct {
+  char name[MAX_IDENT_LEN + 1];
+  int kind;
+  int type;
+} UnitParam;
+
+// A mapped interface, shared by the compiles of a process until its file
+// is written again
+typedef struct Interface_ {
+  char path[UNIT_MAX_PATH];
+  struct stat status;   // of the file when it was mapped
+  char *bytes;
+  long long size;
+  int references;       // units using it
+  int stale;            // the file has changed: unmapped with the last unit
+  struct Interface_ *next;
+} Interface;
+
+struct Unit_ {
+  Interface *interface;
+  UnitHeader *header;
+  Scope *scope;         // of the program, holding the unit's variables
+  int codeShift;        // added to the unit's code addresses
+  int frameShift;       // added to the offsets of its variables
+  ObjectNode *objects;  // those built so far
+  Unit *next;
+};
+
+typedef struct {
+  char name[MAX_IDENT_LEN + 1];
+  CacheKey key;
+} Import;
+
+char *unitDirectory = ".";
+Interface *interfaces = NULL;
+
+// The unit being compiled
+Scope *unitScope = NULL;
+int unitCompiled = 0;
+CodeAddress *relocations = NULL;
+int relocationCount = 0;
+int relocationCapacity = 0;
+
+Import *imports = NULL;
+int importCount = 0;
+int importCapacity = 0;
+
+// Bodies checked on several threads build the objects of units as they
+// meet them (see check.h)
+pthread_mutex_t unitLock = PTHREAD_MUTEX_INITIALIZER;
+
+void interfacePath(char *path, char *name)
+{
+  snprintf(path, UNIT_MAX_PATH, "%s/%s%s", unitDirectory, name, UNIT_EXTENSION);
+}
+
+void resetUnits(void)
+{
+  unitScope = NULL;
+  unitCompiled = 0;
+  // an arena may have taken the last compile's
+  relocations = NULL;
+  relocationCount = relocationCapacity = 0;
+  importCount = 0;
+}
+
+/******************* writing ******************************/
+
+// The tables of the interface as they are built
+UnitEntry *entryTable;
+UnitType *typeTable;
+UnitParam *paramTable;
+int typeCount, typeCapacity;
+
+void beginUnit(Scope *scope)
+{
+  unitScope = scope;
+  unitCompiled = 1;
+}
+
+int compiledUnit(void)
+{
+  return unitCompiled;
+}
+
+void noteUnitVariable(Object *var)
+{
+  if (unitScope == NULL || var->varAttrs->scope != unitScope)
+    return;
+  if (relocationCount == relocationCapacity)
+  {
+    relocationCapacity = (relocationCapacity == 0) ? 64 : 2 * relocationCapacity;
+    relocations = REALLOCATE_ARRAY(relocations, CodeAddress, relocationCapacity, ALLOC_UNIT);
+  }
+  relocations[relocationCount++] = getCodeBuffer()->codeSize;
+}
+
+int addType(Type *type)
+{
+  int element = (type->typeClass == TP_ARRAY) ? addType(type->elementType) : -1;
+
+  if (typeCount == typeCapacity)
+  {
+    typeCapacity = (typeCapacity == 0) ? 64 : 2 * typeCapacity;
+    typeTable = (UnitType *)realloc(typeTable, typeCapacity * sizeof(UnitType));
+  }
+  memset(&typeTable[typeCount], 0, sizeof(UnitType));
+  typeTable[typeCount].typeClass = type->typeClass;
+  typeTable[typeCount].arraySize = (type->typeClass == TP_ARRAY) ? type->arraySize : 0;
+  typeTable[typeCount].elementType = element;
+  return typeCount++;
+}
+
+// Adds the parameters of a subroutine from paramCount on; their count
+int addParams(ObjectNode *paramList, int paramCount)
+{
+  UnitParam *param;
+  int count = 0;
+
+  for (; paramList != NULL; paramList = paramList->next, count++)
+  {
+    param = &paramTable[paramCount + count];
+    strcpy(param->name, paramList->object->name);
+    param->kind = paramList->object->paramAttrs->kind;
+    param->type = addType(paramList->object->paramAttrs->type);
+  }
+  return count;
+}
+
+int compareEntries(const void *a, const void *b)
+{
+  return strcmp(((const UnitEntry *)a)->name, ((const UnitEntry *)b)->name);
+}
+
+// Builds the entries of the objects of the unit's scope; their count
+int addEntries(ObjectNode *objList)
+{
+  ConstantValue *value;
+  UnitEntry *entry;
+  Type valueType;
+  int count = 0, paramCount = 0;
+
+  for (; objList != NULL; objList = objList->next, count++)
+  {
+    entry = &entryTable[count];
+    strcpy(entry->name, objList->object->name);
+    entry->kind = objList->object->kind;
+    entry->type = -1;
+    switch (objList->object->kind)
+    {
+    case OBJ_CONSTANT:
+      value = objList->object->constAttrs->value;
+      valueType.typeClass = value->type;
+      entry->type = addType(&valueType);
+      entry->value = (value->type == TP_INT) ? value->intValue : value->charValue;
+      break;
+    case OBJ_TYPE:
+      entry->type = addType(objList->object->typeAttrs->actualType);
+      break;
+    case OBJ_VARIABLE:
+      entry->type = addType(objList->object->varAttrs->type);
+      entry->value = objList->object->varAttrs->localOffset;
+      break;
+    case OBJ_FUNCTION:
+      entry->type = addType(objList->object->funcAttrs->returnType);
+      entry->value = objList->object->funcAttrs->codeAddress;
+      entry->firstParam = paramCount;
+      entry->paramCount = addParams(objList->object->funcAttrs->paramList, paramCount);
+      break;
+    case OBJ_PROCEDURE:
+      entry->value = objList->object->procAttrs->codeAddress;
+      entry->firstParam = paramCount;
+      entry->paramCount = addParams(objList->object->procAttrs->paramList, paramCount);
+      break;
+    default:
+      break;
+    }
+    paramCount += entry->paramCount;
+  }
+  qsort(entryTable, count, sizeof(UnitEntry), compareEntries);
+  return count;
+}
+
+// Whether the file at path holds an interface with this key
+int sameInterface(char *path, CacheKey *key)
+{
+  UnitHeader header;
+  FILE *f = fopen(path, "rb");
+  int same;
+
+  if (f == NULL)
+    return 0;
+  same = fread(&header, sizeof(UnitHeader), 1, f) == 1 &&
+         memcmp(header.magic, UNIT_MAGIC, 8) == 0 && header.format == UNIT_FORMAT &&
+         header.key.high == key->high && header.key.low == key->low;
+  fclose(f);
+  return same;
+}
+
+// To a temporary file renamed into place, as the cache does its records
+int writeInterfaceFile(char *path, char *bytes, long long size)
+{
+  char temporary[UNIT_MAX_PATH];
+  long long done = 0;
+  long n;
+  int fd;
+
+  snprintf(temporary, UNIT_MAX_PATH, "%s.tmp-%ld", path, (long)getpid());
+  fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return 0;
+  while (done < size && (n = write(fd, bytes + done, size - done)) > 0)
+    done += n;
+  if (close(fd) == 0 && done == size && rename(temporary, path) == 0)
+    return 1;
+  unlink(temporary);
+  return 0;
+}
+
+int writeUnitInterface(CodeAddress codeStart)
+{
+  Object *unit = symtab->program;
+  CodeBlock *buffer = getCodeBuffer();
+  char path[UNIT_MAX_PATH];
+  UnitHeader *header;
+  Instruction *code;
+  ObjectNode *node;
+  long long size;
+  char *bytes;
+  int entryCount = 0, paramCount = 0, written;
+  int i;
+
+  for (node = unit->progAttrs->scope->objList; node != NULL; node = node->next, entryCount++)
+    if (node->object->kind == OBJ_FUNCTION)
+      paramCount += node->object->funcAttrs->paramCount;
+    else if (node->object->kind == OBJ_PROCEDURE)
+      paramCount += node->object->procAttrs->paramCount;
+  // zeroed, so that the bytes between the fields hash the same every time
+  entryTable = (UnitEntry *)calloc(entryCount + 1, sizeof(UnitEntry));
+  paramTable = (UnitParam *)calloc(paramCount + 1, sizeof(UnitParam));
+  typeTable = NULL;
+  typeCount = typeCapacity = 0;
+  addEntries(unit->progAttrs->scope->objList);
+
+  size = sizeof(UnitHeader) + entryCount * sizeof(UnitEntry) + typeCount * sizeof(UnitType) +
+         paramCount * sizeof(UnitParam) + relocationCount * sizeof(int);
+  size = (size + sizeof(Instruction) - 1) / sizeof(Instruction) * sizeof(Instruction);
+  bytes = (char *)calloc(size + (buffer->codeSize - codeStart) * sizeof(Instruction), 1);
+  header = (UnitHeader *)bytes;
+  memcpy(header->magic, UNIT_MAGIC, 8);
+  header->format = UNIT_FORMAT;
+  header->instructionSize = sizeof(Instruction);
+  strcpy(header->name, unit->name);
+  header->frameSize = unit->progAttrs->scope->frameSize;
+  header->codeStart = codeStart;
+  header->entryCount = entryCount;
+  header->entries = sizeof(UnitHeader);
+  header->typeCount = typeCount;
+  header->types = header->entries + entryCount * sizeof(UnitEntry);
+  header->paramCount = paramCount;
+  header->params = header->types + typeCount * sizeof(UnitType);
+  header->relocationCount = relocationCount;
+  header->relocations = header->params + paramCount * sizeof(UnitParam);
+  header->codeSize = buffer->codeSize - codeStart;
+  header->code = size;
+  memcpy(bytes + header->entries, entryTable, entryCount * sizeof(UnitEntry));
+  memcpy(bytes + header->types, typeTable, typeCount * sizeof(UnitType));
+  memcpy(bytes + header->params, paramTable, paramCount * sizeof(UnitParam));
+  for (i = 0; i < relocationCount; i++)
+    ((int *)(bytes + header->relocations))[i] = relocations[i];
+  code = (Instruction *)(bytes + header->code);
+  for (i = 0; i < header->codeSize; i++)
+  {
+    code[i].op = buffer->code[codeStart + i].op;
+    code[i].p = buffer->code[codeStart + i].p;
+    code[i].q = buffer->code[codeStart + i].q;
+  }
+  size += header->codeSize * sizeof(Instruction);
+  hashBytes(bytes + sizeof(UnitHeader), size - sizeof(UnitHeader), &header->key);
+
+  // an unchanged interface keeps its file, and what depends on its date
+  interfacePath(path, unit->name);
+  written = sameInterface(path, &header->key) || writeInterfaceFile(path, bytes, size);
+  free(bytes);
+  free(entryTable);
+  free(typeTable);
+  free(paramTable);
+  return written;
+}
+
+/******************* reading ******************************/
+
+int holdsTable(long long size, int offset, int count, int recordSize)
+{
+  return offset >= 0 && count >= 0 && offset <= size && count <= (size - offset) / recordSize;
+}
+
+int validHeader(UnitHeader *header, long long size)
+{
+  return size >= (long long)sizeof(UnitHeader) &&
+         memcmp(header->magic, UNIT_MAGIC, 8) == 0 && header->format == UNIT_FORMAT &&
+         header->instructionSize == (int)sizeof(Instruction) &&
+         memchr(header->name, '\0', MAX_IDENT_LEN + 1) != NULL &&
+         header->frameSize >= RESERVED_WORDS && header->codeStart >= 0 &&
+         holdsTable(size, header->entries, header->entryCount, sizeof(UnitEntry)) &&
+         header->entries % __alignof__(UnitEntry) == 0 &&
+         holdsTable(size, header->types, header->typeCount, sizeof(UnitType)) &&
+         header->types % __alignof__(UnitType) == 0 &&
+         holdsTable(size, header->params, header->paramCount, sizeof(UnitParam)) &&
+         header->params % __alignof__(UnitParam) == 0 &&
+         holdsTable(size, header->relocations, header->relocationCount, sizeof(int)) &&
+         header->relocations % sizeof(int) == 0 &&
+         holdsTable(size, header->code, header->codeSize, sizeof(Instruction)) &&
+         header->code % sizeof(Instruction) == 0;
+}
+
+void unmapInterface(Interface *interface)
+{
+  munmap(interface->bytes, interface->size);
+  free(interface);
+}
+
+// The interface of unit name, mapped again when its file has changed;
+// NULL when it can't be read
+Interface *mapInterface(char *name)
+{
+  char path[UNIT_MAX_PATH];
+  Interface *interface, **link;
+  struct stat status;
+  void *bytes;
+  int fd;
+
+  interfacePath(path, name);
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+  if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) ||
+      status.st_size < (off_t)sizeof(UnitHeader))
+  {
+    close(fd);
+    return NULL;
+  }
+  for (link = &interfaces; (interface = *link) != NULL; link = &interface->next)
+    if (strcmp(interface->path, path) == 0)
+    {
+      if (interface->status.st_dev == status.st_dev && interface->status.st_ino == status.st_ino &&
+          interface->status.st_size == status.st_size &&
+          interface->status.st_mtim.tv_sec == status.st_mtim.tv_sec &&
+          interface->status.st_mtim.tv_nsec == status.st_mtim.tv_nsec)
+      {
+        close(fd);
+        return interface;
+      }
+      // the units of documents still open keep the old one
+      *link = interface->next;
+      interface->stale = 1;
+      if (interface->references == 0)
+        unmapInterface(interface);
+      break;
+    }
+
+  bytes = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (bytes == MAP_FAILED)
+    return NULL;
+  if (!validHeader((UnitHeader *)bytes, status.st_size))
+  {
+    munmap(bytes, status.st_size);
+    return NULL;
+  }
+  interface = (Interface *)malloc(sizeof(Interface));
+  strcpy(interface->path, path);
+  interface->status = status;
+  interface->bytes = (char *)bytes;
+  interface->size = status.st_size;
+  interface->references = 0;
+  interface->stale = 0;
+  interface->next = interfaces;
+  interfaces = interface;
+  return interface;
+}
+
+int readInterfaceKey(char *name, CacheKey *key)
+{
+  Interface *interface = mapInterface(name);
+
+  if (interface == NULL)
+    return 0;
+  *key = ((UnitHeader *)interface->bytes)->key;
+  return 1;
+}
+
+int isCodeAddress(enum OpCode op)
+{
+  return op == OP_J || op == OP_FJ || op == OP_CALL;
+}
+
+int usesStaticLink(enum OpCode op)
+{
+  return op == OP_LA || op == OP_LV || op == OP_CALL;
+}
+
+// Whether the code stays within itself, and within its frames: a static
+// link goes no further up than the subroutines nest, an offset no further
+// than the largest frame, and a relocated one stays in the unit's
+int validCode(UnitHeader *header, Instruction *code, int *relocated)
+{
+  int end = header->codeStart + header->codeSize;
+  // every subroutine makes its frame with an INT, as do calls, so the
+  // INTs bound both how deep the subroutines nest and their frames
+  WORD depth = 0, frameSize = header->frameSize;
+  Instruction *inst;
+  int i;
+
+  for (i = 0; i < header->codeSize; i++)
+    if (code[i].op == OP_INT)
+    {
+      depth++;
+      if (code[i].q > frameSize)
+        frameSize = code[i].q;
+    }
+  for (i = 0; i < header->codeSize; i++)
+    if (code[i].op < OP_LA || code[i].op > OP_BP ||
+        (isCodeAddress(code[i].op) && (code[i].q < header->codeStart || code[i].q > end)) ||
+        (usesStaticLink(code[i].op) && (code[i].p < 0 || code[i].p > depth)) ||
+        ((code[i].op == OP_LA || code[i].op == OP_LV) && (code[i].q < 0 || code[i].q >= frameSize)))
+      return 0;
+  for (i = 0; i < header->relocationCount; i++)
+  {
+    if (relocated[i] < header->codeStart || relocated[i] >= end)
+      return 0;
+    inst = &code[relocated[i] - header->codeStart];
+    if ((inst->op != OP_LA && inst->op != OP_LV) ||
+        inst->q < RESERVED_WORDS || inst->q >= header->frameSize)
+      return 0;
+  }
+  return 1;
+}
+
+void addImport(char *name, CacheKey *key)
+{
+  if (importCount == importCapacity)
+  {
+    importCapacity = (importCapacity == 0) ? 16 : 2 * importCapacity;
+    imports = (Import *)realloc(imports, importCapacity * sizeof(Import));
+  }
+  strcpy(imports[importCount].name, name);
+  imports[importCount].key = *key;
+  importCount++;
+}
+
+int importUnit(char *name)
+{
+  Interface *interface = mapInterface(name);
+  Scope *scope = symtab->program->progAttrs->scope;
+  CodeBlock *buffer = getCodeBuffer();
+  UnitHeader *header;
+  Instruction *code;
+  Unit *unit, **link;
+  int *relocated;
+  WORD q;
+  int i;
+
+  if (interface == NULL)
+    return 0;
+  header = (UnitHeader *)interface->bytes;
+  code = (Instruction *)(interface->bytes + header->code);
+  relocated = (int *)(interface->bytes + header->relocations);
+  if (strcmp(header->name, name) != 0 || !validCode(header, code, relocated))
+    return 0;
+
+  unit = ALLOCATE(Unit, ALLOC_UNIT);
+  unit->interface = interface;
+  interface->references++;
+  unit->header = header;
+  unit->scope = scope;
+  unit->codeShift = getCurrentCodeAddress() - header->codeStart;
+  unit->frameShift = scope->frameSize - RESERVED_WORDS;
+  unit->objects = NULL;
+  unit->next = NULL;
+  scope->frameSize += header->frameSize - RESERVED_WORDS;
+
+  for (i = 0; i < header->codeSize; i++)
+  {
+    q = isCodeAddress(code[i].op) ? code[i].q + unit->codeShift : code[i].q;
+    emitCode(buffer, code[i].op, code[i].p, q);
+  }
+  for (i = 0; i < header->relocationCount; i++)
+    buffer->code[relocated[i] + unit->codeShift].q += unit->frameShift;
+
+  for (link = &symtab->units; *link != NULL; link = &(*link)->next)
+    ;
+  *link = unit;
+  addImport(name, &header->key);
+  return 1;
+}
+
+Unit *findUnit(Unit *units, char *name)
+{
+  for (; units != NULL; units = units->next)
+    if (strcmp(units->header->name, name) == 0)
+      return units;
+  return NULL;
+}
+
+UnitEntry *findEntry(UnitHeader *header, char *name)
+{
+  UnitEntry *entries = (UnitEntry *)((char *)header + header->entries);
+  int low = 0, high = header->entryCount - 1;
+  int middle, order;
+
+  while (low <= high)
+  {
+    middle = (low + high) / 2;
+    order = strncmp(entries[middle].name, name, MAX_IDENT_LEN + 1);
+    if (order == 0)
+      return &entries[middle];
+    if (order < 0)
+      low = middle + 1;
+    else
+      high = middle - 1;
+  }
+  return NULL;
+}
+
+// NULL when the table has no such type
+Type *buildType(UnitHeader *header, int index)
+{
+  UnitType *types = (UnitType *)((char *)header + header->types);
+  Type *elementType;
+
+  if (index < 0 || index >= header->typeCount)
+    return NULL;
+  switch (types[index].typeClass)
+  {
+  case TP_INT:
+    return makeIntType();
+  case TP_CHAR:
+    return makeCharType();
+  case TP_ARRAY:
+    if (types[index].arraySize < 0 || types[index].elementType >= index ||
+        (elementType = buildType(header, types[index].elementType)) == NULL)
+      return NULL;
+    return makeArrayType(types[index].arraySize, elementType);
+  }
+  return NULL;
+}
+
+int isBasicType(UnitHeader *header, int index)
+{
+  UnitType *types = (UnitType *)((char *)header + header->types);
+
+  return index >= 0 && index < header->typeCount &&
+         (types[index].typeClass == TP_INT || types[index].typeClass == TP_CHAR);
+}
+
+int validSubroutine(UnitHeader *header, UnitEntry *entry)
+{
+  UnitParam *params = (UnitParam *)((char *)header + header->params);
+  int i;
+
+  if (entry->firstParam < 0 || entry->paramCount < 0 ||
+      entry->paramCount > header->paramCount - entry->firstParam ||
+      entry->value < header->codeStart || entry->value >= header->codeStart + header->codeSize ||
+      (entry->kind == OBJ_FUNCTION && !isBasicType(header, entry->type)))
+    return 0;
+  for (i = entry->firstParam; i < entry->firstParam + entry->paramCount; i++)
+    if (memchr(params[i].name, '\0', MAX_IDENT_LEN + 1) == NULL ||
+        (params[i].kind != PARAM_VALUE && params[i].kind != PARAM_REFERENCE) ||
+        !isBasicType(header, params[i].type))
+      return 0;
+  return 1;
+}
+
+// A function or procedure declared in the program's scope
+Object *buildSubroutine(Unit *unit, UnitEntry *entry)
+{
+  UnitParam *params = (UnitParam *)((char *)unit->header + unit->header->params);
+  Object *obj, *param;
+  ObjectNode **paramList;
+  Scope *scope;
+  int *paramCount;
+  int i;
+
+  if (entry->kind == OBJ_FUNCTION)
+  {
+    obj = createFunctionObject(entry->name);
+    obj->funcAttrs->returnType = buildType(unit->header, entry->type);
+    obj->funcAttrs->codeAddress = entry->value + unit->codeShift;
+    paramList = &obj->funcAttrs->paramList;
+    paramCount = &obj->funcAttrs->paramCount;
+    scope = obj->funcAttrs->scope;
+  }
+  else
+  {
+    obj = createProcedureObject(entry->name);
+    obj->procAttrs->codeAddress = entry->value + unit->codeShift;
+    paramList = &obj->procAttrs->paramList;
+    paramCount = &obj->procAttrs->paramCount;
+    scope = obj->procAttrs->scope;
+  }
+  scope->outer = unit->scope;
+
+  for (i = entry->firstParam; i < entry->firstParam + entry->paramCount; i++)
+  {
+    param = createParameterObject(params[i].name, params[i].kind, obj);
+    param->paramAttrs->type = buildType(unit->header, params[i].type);
+    param->paramAttrs->localOffset = scope->frameSize++;
+    addObject(paramList, param);
+    addObject(&scope->objList, param);
+    (*paramCount)++;
+  }
+  return obj;
+}
+
+// NULL when the entry is damaged
+Object *buildObject(Unit *unit, UnitEntry *entry)
+{
+  Object *obj;
+  Type *type;
+
+  switch (entry->kind)
+  {
+  case OBJ_CONSTANT:
+    if (!isBasicType(unit->header, entry->type))
+      return NULL;
+    type = buildType(unit->header, entry->type);
+    obj = createConstantObject(entry->name);
+    obj->constAttrs->value = (type->typeClass == TP_INT) ? makeIntConstant(entry->value)
+                                                         : makeCharConstant((char)entry->value);
+    freeType(type);
+    break;
+  case OBJ_TYPE:
+    if ((type = buildType(unit->header, entry->type)) == NULL)
+      return NULL;
+    obj = createTypeObject(entry->name);
+    obj->typeAttrs->actualType = type;
+    break;
+  case OBJ_VARIABLE:
+    if ((type = buildType(unit->header, entry->type)) == NULL)
+      return NULL;
+    if (entry->value < RESERVED_WORDS || entry->value > unit->header->frameSize - sizeOfType(type))
+    {
+      freeType(type);
+      return NULL;
+    }
+    obj = createVariableObject(entry->name);
+    obj->varAttrs->type = type;
+    obj->varAttrs->scope = unit->scope;
+    obj->varAttrs->localOffset = entry->value + unit->frameShift;
+    break;
+  case OBJ_FUNCTION:
+  case OBJ_PROCEDURE:
+    if (!validSubroutine(unit->header, entry))
+      return NULL;
+    obj = buildSubroutine(unit, entry);
+    break;
+  default:
+    return NULL;
+  }
+  addObject(&unit->objects, obj);
+  return obj;
+}
+
+Object *findUnitObject(Unit *units, char *name)
+{
+  UnitEntry *entry;
+  Object *obj = NULL;
+
+  pthread_mutex_lock(&unitLock);
+  for (; units != NULL && obj == NULL; units = units->next)
+    if ((obj = findObject(units->objects, name)) == NULL &&
+        (entry = findEntry(units->header, name)) != NULL)
+      obj = buildObject(units, entry);
+  pthread_mutex_unlock(&unitLock);
+  return obj;
+}
+
+void freeUnits(Unit *units)
+{
+  Unit *unit;
+
+  while ((unit = units) != NULL)
+  {
+    units = unit->next;
+    freeObjectList(unit->objects);
+    if (--unit->interface->references == 0 && unit->interface->stale)
+      unmapInterface(unit->interface);
+    RELEASE(unit);
+  }
+}
+
+int getImportCount(void)
+{
+  return importCount;
+}
+
+void getImport(int index, char name[MAX_IDENT_LEN + 1], CacheKey *key)
+{
+  strcpy(name, imports[index].name);
+  *key = imports[index].key;
+}
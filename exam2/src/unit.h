@@ -0,0 +1,69 @@
+#ifndef __UNIT_H__
+#define __UNIT_H__
+
+#include "symtab.h"
+#include "cache.h"
+
+// Units, compiled on their own for programs to use:
+//
+//   UNIT MATHS;                       PROGRAM SHOW;
+//   CONST ... TYPE ... VAR ...        USES MATHS, TEXT;
+//   FUNCTION ... PROCEDURE ...        VAR ...
+//   END.                              BEGIN ... END.
+//
+// Compiling a unit writes its interface, NAME.kpi in the unit directory:
+// the objects declared at the top of the unit, their types and the
+// parameters of its subroutines, in tables of fixed-size records that
+// refer to each other by index, followed by the code of the subroutines.
+// USES maps the file, appends the code to the program's, jumped over,
+// with its addresses moved, and gives the unit's variables a place in the
+// program's frame. The objects are only built from their records when a
+// name is not found in the program's scopes, then kept with the symbol
+// table until it goes.
+//
+// The names of the units come after the program's own, in the order of
+// USES, and before the predefined ones. A unit uses no other unit: each
+// would bring its own copy of the code and variables of one they shared.
+//
+// An interface is written only when its contents change, so the
+// programs cached through --cache with the hash of the one they read are
+// compiled again only when it did.
+
+#define UNIT_EXTENSION ".kpi"
+#define UNIT_MAX_PATH 4096
+
+typedef struct Unit_ Unit;
+
+// Where interfaces are written and read, "." unless --units says
+extern char *unitDirectory;
+
+// Forgets the unit and the imports of the last compile, before the next
+void resetUnits(void);
+
+// Compiling a unit: its scope, the frame a program using it lends its
+// variables; each use of one of them is noted where it is emitted
+void beginUnit(Scope *scope);
+void noteUnitVariable(Object *var);
+// Writes the interface of the unit the symbol table holds, whose
+// subroutines have the code from codeStart up to the current address;
+// 0 when it can't be written
+int writeUnitInterface(CodeAddress codeStart);
+// 1 when the last compile was of a unit
+int compiledUnit(void);
+
+// Adds the unit name to those of the program being compiled: 0 when its
+// interface can't be read
+int importUnit(char *name);
+Unit *findUnit(Unit *units, char *name);
+// The object a unit of the list declares as name, built when first asked
+// for; NULL when none does
+Object *findUnitObject(Unit *units, char *name);
+void freeUnits(Unit *units);
+
+// The interfaces the last compile imported, with the hash of each
+int getImportCount(void);
+void getImport(int index, char name[MAX_IDENT_LEN + 1], CacheKey *key);
+// The hash of the interface of unit name now; 0 when it can't be read
+int readInterfaceKey(char *name, CacheKey *key);
+
+#endif
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "vm.h"
+#include "jit.h"
+
+WORD *stack;
+int t;
+int b;
+int pc;
+int ps = PS_INACTIVE;
+
+// Count calls and back-edges, moving hot subroutines to native code
+int tiered = 0;
+
+// Frame base `p` static links away from the current frame
+int base(int p)
+{
+  int currentBase = b;
+  while (p > 0)
+  {
+    currentBase = stack[currentBase + 3];
+    p--;
+  }
+  return currentBase;
+}
+
+int checkStack(void)
+{
+  return ((t >= -1) && (t < STACK_SIZE - STACK_MARGIN));
+}
+
+int run(CodeBlock *codeBlock)
+{
+  Instruction *code = codeBlock->code;
+  Instruction *inst;
+  void *native;
+  WORD number;
+  int ch;
+  int i;
+
+  ps = PS_ACTIVE;
+  while (ps == PS_ACTIVE && pc != JIT_RETURN)
+  {
+    inst = code + pc;
+    pc++;
+    switch (inst->op)
+    {
+    case OP_LA:
+      t++;
+      stack[t] = base(inst->p) + inst->q;
+      break;
+    case OP_LV:
+      t++;
+      stack[t] = stack[base(inst->p) + inst->q];
+      break;
+    case OP_LC:
+      t++;
+      stack[t] = inst->q;
+      break;
+    case OP_LI:
+      stack[t] = stack[stack[t]];
+      break;
+    case OP_INT:
+      t += inst->q;
+      if (!checkStack())
+        ps = PS_STACK_OVERFLOW;
+      break;
+    case OP_DCT:
+      t -= inst->q;
+      break;
+    case OP_J:
+      pc = inst->q;
+      if (tiered && pc <= inst - code && (native = jitHotLoop(pc)) != NULL)
+        jitRun(native);
+      break;
+    case OP_FJ:
+      if (stack[t] == 0)
+        pc = inst->q;
+      t--;
+      break;
+    case OP_HL:
+      ps = PS_NORMAL_EXIT;
+      break;
+    case OP_ST:
+      stack[stack[t - 1]] = stack[t];
+      t -= 2;
+      break;
+    case OP_STN:
+      stack[stack[t - inst->q]] = stack[t];
+      t--;
+      break;
+    case OP_CALL:
+      stack[t + 2] = b;
+      stack[t + 3] = pc;
+      stack[t + 4] = base(inst->p);
+      b = t + 1;
+      pc = inst->q;
+      if (tiered && (native = jitHotCall(pc)) != NULL)
+        jitRun(native);
+      break;
+    case OP_EP:
+      t = b - 1;
+      pc = stack[b + 2];
+      b = stack[b + 1];
+      break;
+    case OP_EF:
+      t = b;
+      pc = stack[b + 2];
+      b = stack[b + 1];
+      break;
+    case OP_RC:
+      ch = getchar();
+      t++;
+      stack[t] = ch;
+      break;
+    case OP_RI:
+      number = 0;
+      if (scanf("%lld", &number) == EOF)
+        ps = PS_IO_ERROR;
+      t++;
+      stack[t] = number;
+      break;
+    case OP_WRC:
+      putchar((unsigned char)stack[t]);
+      t--;
+      break;
+    case OP_WRI:
+      printf("%lld", stack[t]);
+      t--;
+      break;
+    case OP_WLN:
+      putchar('\n');
+      break;
+    // arithmetic wraps around, as evaluateOperation folds it
+    case OP_AD:
+      t--;
+      stack[t] = (WORD)((unsigned long long)stack[t] + (unsigned long long)stack[t + 1]);
+      break;
+    case OP_SB:
+      t--;
+      stack[t] = (WORD)((unsigned long long)stack[t] - (unsigned long long)stack[t + 1]);
+      break;
+    case OP_ML:
+      t--;
+      stack[t] = (WORD)((unsigned long long)stack[t] * (unsigned long long)stack[t + 1]);
+      break;
+    case OP_DV:
+      t--;
+      if (stack[t + 1] == 0)
+        ps = PS_DIVIDE_BY_ZERO;
+      else if (stack[t + 1] == -1)
+        stack[t] = (WORD)(0 - (unsigned long long)stack[t]);
+      else
+        stack[t] /= stack[t + 1];
+      break;
+    case OP_PW:
+      t--;
+      stack[t] = powerOf(stack[t], stack[t + 1]);
+      break;
+    case OP_SUM:
+      t -= inst->q - 1;
+      for (i = 1; i < inst->q; i++)
+        stack[t] = (WORD)((unsigned long long)stack[t] + (unsigned long long)stack[t + i]);
+      break;
+    case OP_NEG:
+      stack[t] = (WORD)(0 - (unsigned long long)stack[t]);
+      break;
+    case OP_CV:
+      stack[t + 1] = stack[t];
+      t++;
+      break;
+    case OP_AX:
+      t--;
+      stack[t] += stack[t + 1];
+      break;
+    case OP_EQ:
+      t--;
+      stack[t] = (stack[t] == stack[t + 1]);
+      break;
+    case OP_NE:
+      t--;
+      stack[t] = (stack[t] != stack[t + 1]);
+      break;
+    case OP_GT:
+      t--;
+      stack[t] = (stack[t] > stack[t + 1]);
+      break;
+    case OP_LT:
+      t--;
+      stack[t] = (stack[t] < stack[t + 1]);
+      break;
+    case OP_GE:
+      t--;
+      stack[t] = (stack[t] >= stack[t + 1]);
+      break;
+    case OP_LE:
+      t--;
+      stack[t] = (stack[t] <= stack[t + 1]);
+      break;
+    case OP_BP:
+    default:
+      break;
+    }
+  }
+  return ps;
+}
+
+// Interpret the stack machine code, returning the final program status.
+// In tiered mode hot subroutines are compiled to x86-64 on the fly.
+int runCode(CodeBlock *codeBlock, int tieredMode)
+{
+  stack = (WORD *)malloc(STACK_SIZE * sizeof(WORD));
+  t = -1;
+  b = 0;
+  pc = 0;
+
+  tiered = tieredMode && initJit(codeBlock);
+  run(codeBlock);
+  fflush(stdout);
+  if (tiered)
+    cleanJit();
+
+  switch (ps)
+  {
+  case PS_DIVIDE_BY_ZERO:
+    fprintf(stderr, "\nRuntime error: divide by zero.\n");
+    break;
+  case PS_STACK_OVERFLOW:
+    fprintf(stderr, "\nRuntime error: stack overflow.\n");
+    break;
+  case PS_IO_ERROR:
+    fprintf(stderr, "\nRuntime error: unexpected end of input.\n");
+    break;
+  default:
+    break;
+  }
+
+  free(stack);
+  return ps;
+}
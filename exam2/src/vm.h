@@ -0,0 +1,23 @@
+#ifndef __VM_H__
+#define __VM_H__
+
+#include "instructions.h"
+
+#define STACK_SIZE 1048576
+// Room left above the last frame for the operand stack
+#define STACK_MARGIN 1024
+
+#define PS_INACTIVE -1
+#define PS_ACTIVE 0
+#define PS_NORMAL_EXIT 1
+#define PS_IO_ERROR 2
+#define PS_DIVIDE_BY_ZERO 3
+#define PS_STACK_OVERFLOW 4
+
+// Return address of frames called from native code
+#define JIT_RETURN -1
+
+int run(CodeBlock* codeBlock);
+int runCode(CodeBlock* codeBlock, int tiered);
+
+#endif